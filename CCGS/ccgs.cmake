@@ -11,7 +11,10 @@ INCLUDE_DIRECTORIES(CCGS/sources)
 
 ADD_LIBRARY(ccgs
   CCGS/sources/CCGSImplementation.cpp
-  CCGS/sources/CCGSGenerator.cpp)
+  CCGS/sources/CCGSGenerator.cpp
+  CCGS/sources/CCGSJacobian.cpp
+  CCGS/sources/CCGSLookupTables.cpp
+  CCGS/sources/CCGSConstantHoisting.cpp)
 TARGET_LINK_LIBRARIES(ccgs PUBLIC cuses cevas malaes annotools cellml ${CMAKE_DL_LIBS})
 SET_TARGET_PROPERTIES(ccgs PROPERTIES VERSION ${GLOBAL_VERSION} SOVERSION ${CCGS_SOVERSION})
 target_link_libraries(libcellml INTERFACE ccgs)
@@ -0,0 +1,388 @@
+#define MODULE_CONTAINS_CCGS
+#include "CCGSImplementation.hpp"
+#include <map>
+#include <list>
+#include <set>
+#include <cmath>
+#include <cstdlib>
+#include "CodeGenerationState.hxx"
+#include "CodeGenerationError.hxx"
+#include "IfaceMathML_content_APISPEC.hxx"
+
+/*
+ * Hoisting of the subexpressions of the rates and algebraic variables which
+ * depend only on constants, so they are computed once, when the constants are
+ * set up, rather than every time the rates are evaluated.
+ *
+ * The largest such subexpressions are computed into extra constants at the
+ * end of initConstsString, one per distinct expression, and are replaced in
+ * the maths with a passthrough csymbol naming the constant. Operations on
+ * numbers alone are evaluated here instead. As with lookup tables, the
+ * replaced subexpressions are kept for differentiation.
+ */
+
+// Reads a plain decimal cn, as MaLaES would, returning false for anything
+// else (such as e-notation or other bases).
+static bool
+ReadNumber(iface::mathml_dom::MathMLCnElement* aCn, double& aValue)
+{
+  RETURN_INTO_WSTRING(type, aCn->type());
+  if (type != L"" && type != L"real" && type != L"integer")
+    return false;
+  RETURN_INTO_WSTRING(base, aCn->base());
+  if (base != L"" && base != L"10")
+    return false;
+
+  RETURN_INTO_OBJREF(n, iface::dom::Node, aCn->firstChild());
+  DECLARE_QUERY_INTERFACE_OBJREF(t, n, dom::Text);
+  if (t == NULL)
+    return false;
+  RETURN_INTO_OBJREF(next, iface::dom::Node, t->nextSibling());
+  if (next != NULL)
+    return false;
+
+  RETURN_INTO_WSTRING(txt, t->data());
+
+  // Scoped locale change.
+  CNumericLocale locobj;
+
+  const wchar_t* start = txt.c_str();
+  wchar_t* end;
+  aValue = wcstod(start, &end);
+  if (end == start)
+    return false;
+  for (; *end != 0; end++)
+    if (*end != L' ' && *end != L'\t' && *end != L'\r' && *end != L'\n')
+      return false;
+
+  return true;
+}
+
+// Evaluates an operator on numbers, returning false if it can't be done here.
+static bool
+EvaluateOperator(const std::wstring& aOp, const std::vector<double>& aArgs,
+                 double& aValue)
+{
+  if (aArgs.empty())
+    return false;
+
+  if (aOp == L"plus" || aOp == L"times" || aOp == L"min" || aOp == L"max")
+  {
+    aValue = aArgs[0];
+    for (uint32_t i = 1; i < aArgs.size(); i++)
+    {
+      if (aOp == L"plus")
+        aValue += aArgs[i];
+      else if (aOp == L"times")
+        aValue *= aArgs[i];
+      else if (aOp == L"min")
+        aValue = (aArgs[i] < aValue) ? aArgs[i] : aValue;
+      else
+        aValue = (aArgs[i] > aValue) ? aArgs[i] : aValue;
+    }
+  }
+  else if (aOp == L"minus" && aArgs.size() == 1)
+    aValue = -aArgs[0];
+  else if (aArgs.size() == 2)
+  {
+    if (aOp == L"minus")
+      aValue = aArgs[0] - aArgs[1];
+    else if (aOp == L"divide")
+      aValue = aArgs[0] / aArgs[1];
+    else if (aOp == L"power")
+      aValue = pow(aArgs[0], aArgs[1]);
+    else
+      return false;
+  }
+  else if (aArgs.size() == 1)
+  {
+    // log and root are left out, as their qualifiers aren't arguments.
+    if (aOp == L"exp")
+      aValue = exp(aArgs[0]);
+    else if (aOp == L"ln")
+      aValue = log(aArgs[0]);
+    else if (aOp == L"abs")
+      aValue = fabs(aArgs[0]);
+    else if (aOp == L"sin")
+      aValue = sin(aArgs[0]);
+    else if (aOp == L"cos")
+      aValue = cos(aArgs[0]);
+    else if (aOp == L"tan")
+      aValue = tan(aArgs[0]);
+    else if (aOp == L"sinh")
+      aValue = sinh(aArgs[0]);
+    else if (aOp == L"cosh")
+      aValue = cosh(aArgs[0]);
+    else if (aOp == L"tanh")
+      aValue = tanh(aArgs[0]);
+    else if (aOp == L"arcsin")
+      aValue = asin(aArgs[0]);
+    else if (aOp == L"arccos")
+      aValue = acos(aArgs[0]);
+    else if (aOp == L"arctan")
+      aValue = atan(aArgs[0]);
+    else
+      return false;
+  }
+  else
+    return false;
+
+  // Anything which isn't finite is left for the model to report as it runs.
+  return aValue == aValue && aValue - aValue == 0.0;
+}
+
+// A constant part of an expression which isn't constant as a whole.
+struct HoistCandidate
+{
+  ObjRef<iface::mathml_dom::MathMLElement> mExpr;
+  bool mFolded;
+  double mValue;
+};
+
+void
+CodeGenerationState::HoistConstantSubexpressions(std::list<System*>& aSystems)
+{
+  // The constant each distinct expression has been hoisted into.
+  std::map<std::wstring, std::wstring> hoisted;
+  for (std::list<System*>::iterator i = aSystems.begin(); i != aSystems.end();
+       i++)
+    for (std::set<ptr_tag<MathStatement> >::iterator j =
+           (*i)->mMathStatements.begin();
+         j != (*i)->mMathStatements.end(); j++)
+      HoistInStatement(*j, hoisted);
+}
+
+void
+CodeGenerationState::HoistInStatement
+(
+ MathStatement* aStatement,
+ std::map<std::wstring, std::wstring>& aHoisted
+)
+{
+  if (aStatement->mType == MathStatement::PIECEWISE)
+  {
+    Piecewise* pw = static_cast<Piecewise*>(aStatement);
+    for (std::list<std::pair<ptr_tag<Equation>,
+                   ptr_tag<MathMLMathStatement> > >::iterator i =
+           pw->mPieces.begin();
+         i != pw->mPieces.end(); i++)
+      HoistInStatement((*i).first, aHoisted);
+    return;
+  }
+
+  if (aStatement->mType != MathStatement::EQUATION)
+    return;
+
+  Equation* eq = static_cast<Equation*>(aStatement);
+  CopyMathsForRewriting(eq);
+  ObjRef<iface::mathml_dom::MathMLElement>* sides[] = { &eq->mLHS, &eq->mRHS };
+  for (uint32_t i = 0; i < 2; i++)
+  {
+    ObjRef<iface::mathml_dom::MathMLElement> side = *sides[i];
+    if (side == NULL)
+      continue;
+
+    bool folded;
+    double value;
+    if (HoistSubexpressions(side, eq->mContext, aHoisted, folded, value))
+    {
+      RETURN_INTO_OBJREF(replacement, iface::mathml_dom::MathMLElement,
+                         ReplaceConstantSubexpression(side, eq->mContext,
+                                                      aHoisted, folded,
+                                                      value));
+      if (replacement != NULL)
+        side = replacement;
+    }
+
+    *sides[i] = side;
+  }
+}
+
+bool
+CodeGenerationState::HoistSubexpressions
+(
+ iface::mathml_dom::MathMLElement* aExpr,
+ iface::cellml_api::CellMLComponent* aContext,
+ std::map<std::wstring, std::wstring>& aHoisted,
+ bool& aFolded,
+ double& aValue
+)
+{
+  aFolded = false;
+  aValue = 0.0;
+
+  DECLARE_QUERY_INTERFACE_OBJREF(ci, aExpr, mathml_dom::MathMLCiElement);
+  if (ci != NULL)
+  {
+    CDA_ComputationTarget* targ;
+    try
+    {
+      targ = FindReferencedTarget(aExpr, aContext);
+    }
+    catch (NotDifferentiableError&)
+    {
+      return false;
+    }
+
+    // Rates which are constant are only aliased as constants for now, so
+    // only true constants can be hoisted.
+    return targ->mEvaluationType == iface::cellml_services::CONSTANT &&
+      targ->mDegree == 0;
+  }
+
+  DECLARE_QUERY_INTERFACE_OBJREF(cn, aExpr, mathml_dom::MathMLCnElement);
+  if (cn != NULL)
+  {
+    aFolded = ReadNumber(cn, aValue);
+    return true;
+  }
+
+  // Predefined constants such as pi...
+  DECLARE_QUERY_INTERFACE_OBJREF(csym, aExpr, mathml_dom::MathMLCsymbolElement);
+  DECLARE_QUERY_INTERFACE_OBJREF(pds, aExpr, mathml_dom::MathMLPredefinedSymbol);
+  if (csym == NULL && pds != NULL)
+    return true;
+
+  std::list<ObjRef<iface::mathml_dom::MathMLElement> > children;
+  bool constant = false;
+  std::wstring opName;
+
+  DECLARE_QUERY_INTERFACE_OBJREF(apply, aExpr, mathml_dom::MathMLApplyElement);
+  DECLARE_QUERY_INTERFACE_OBJREF(pw, aExpr, mathml_dom::MathMLPiecewiseElement);
+  if (apply != NULL)
+  {
+    RETURN_INTO_OBJREF(op, iface::mathml_dom::MathMLElement,
+                       apply->_cxx_operator());
+    DECLARE_QUERY_INTERFACE_OBJREF(opsym, op, mathml_dom::MathMLCsymbolElement);
+    if (opsym == NULL && apply->nBoundVariables() == 0)
+    {
+      RETURN_INTO_WSTRING(name, op->localName());
+      opName = name;
+      constant = isContinuousOperator(opName);
+    }
+
+    for (uint32_t i = 2, l = apply->nArguments(); i <= l; i++)
+      children.push_back(already_AddRefd<iface::mathml_dom::MathMLElement>
+                         (apply->getArgument(i)));
+  }
+  else if (pw != NULL)
+  {
+    // The conditions are left alone, as they are tracked separately.
+    RETURN_INTO_OBJREF(pnl, iface::mathml_dom::MathMLNodeList, pw->pieces());
+    for (uint32_t i = 1, l = pnl->length(); i <= l; i++)
+      children.push_back(already_AddRefd<iface::mathml_dom::MathMLElement>
+                         (pw->getCaseValue(i)));
+    try
+    {
+      children.push_back(already_AddRefd<iface::mathml_dom::MathMLElement>
+                         (pw->otherwise()));
+    }
+    catch (...)
+    {
+    }
+  }
+  else
+    return false;
+
+  std::list<HoistCandidate> candidates;
+  std::vector<double> values;
+  bool allFolded = true;
+  for (std::list<ObjRef<iface::mathml_dom::MathMLElement> >::iterator i =
+         children.begin();
+       i != children.end(); i++)
+  {
+    if (*i == NULL)
+      continue;
+
+    HoistCandidate c;
+    c.mExpr = *i;
+    if (!HoistSubexpressions(*i, aContext, aHoisted, c.mFolded, c.mValue))
+    {
+      constant = false;
+      continue;
+    }
+
+    candidates.push_back(c);
+    values.push_back(c.mValue);
+    allFolded = allFolded && c.mFolded;
+  }
+
+  // If this whole expression is constant, our caller decides what to do with
+  // it. Otherwise, the constant parts of it are replaced now.
+  if (constant)
+  {
+    aFolded = allFolded && EvaluateOperator(opName, values, aValue);
+    return true;
+  }
+
+  for (std::list<HoistCandidate>::iterator i = candidates.begin();
+       i != candidates.end(); i++)
+  {
+    RETURN_INTO_OBJREF(replacement, iface::mathml_dom::MathMLElement,
+                       ReplaceConstantSubexpression((*i).mExpr, aContext,
+                                                    aHoisted, (*i).mFolded,
+                                                    (*i).mValue));
+    if (replacement == NULL)
+      continue;
+
+    RETURN_INTO_OBJREF(parent, iface::dom::Node, (*i).mExpr->parentNode());
+    parent->replaceChild(replacement, (*i).mExpr)->release_ref();
+  }
+
+  return false;
+}
+
+already_AddRefd<iface::mathml_dom::MathMLElement>
+CodeGenerationState::ReplaceConstantSubexpression
+(
+ iface::mathml_dom::MathMLElement* aExpr,
+ iface::cellml_api::CellMLComponent* aContext,
+ std::map<std::wstring, std::wstring>& aHoisted,
+ bool aFolded,
+ double aValue
+)
+{
+  DECLARE_QUERY_INTERFACE_OBJREF(apply, aExpr, mathml_dom::MathMLApplyElement);
+  DECLARE_QUERY_INTERFACE_OBJREF(ci, aExpr, mathml_dom::MathMLCiElement);
+  // Numbers and the like are already as cheap as they get.
+  if (apply == NULL && ci == NULL)
+    return NULL;
+
+  if (apply != NULL && aFolded)
+    return MakePassthroughFor(aExpr, formatExactNumber(aValue));
+
+  RETURN_INTO_OBJREF(mr, iface::cellml_services::MaLaESResult,
+                     mTransform->transform(mCeVAS, mCUSES, mAnnoSet, aExpr,
+                                           aContext, NULL, NULL, 0));
+  RETURN_INTO_WSTRING(compileErrors, mr->compileErrors());
+  if (compileErrors != L"" || mr->supplementariesLength() != 0)
+    return NULL;
+  RETURN_INTO_WSTRING(expr, mr->expression());
+
+  // A lone variable is only worth hoisting if it has to be converted to
+  // other units.
+  if (ci != NULL)
+  {
+    RETURN_INTO_WSTRING(name,
+                        FindReferencedTarget(aExpr, aContext)->name());
+    if (expr == mTransform->wrapNumber(name))
+      return NULL;
+  }
+
+  std::wstring constantName;
+  std::map<std::wstring, std::wstring>::iterator hi = aHoisted.find(expr);
+  if (hi != aHoisted.end())
+    constantName = (*hi).second;
+  else
+  {
+    uint32_t index = mArrayOffset + mCodeInfo->mConstantIndexCount++;
+    mNextConstantIndex = index + 1;
+    GenerateVariableName(constantName, mConstantPattern, index);
+    AppendAssign(mCodeInfo->mInitConstsStr, constantName, expr,
+                 L"hoisted constant subexpression");
+    mCodeInfo->mHoistedConstantIndices.push_back(index);
+    aHoisted.insert(std::pair<std::wstring, std::wstring>(expr, constantName));
+  }
+
+  return MakePassthroughFor(aExpr, constantName);
+}
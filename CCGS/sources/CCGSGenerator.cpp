@@ -16,8 +16,6 @@
 #include "RDFBootstrap.hpp"
 #endif
 
-// Asymptotic complexity is bound around O(n^(((t^2)+t)/2)) for t=SEARCH_DEPTH. This is a pretty poor upper bound.
-#define SEARCH_DEPTH 3
 #define MATHML_NS L"http://www.w3.org/1998/Math/MathML"
 
 CodeGenerationState::~CodeGenerationState()
@@ -691,11 +689,17 @@ CodeGenerationState::IDAStyleCodeGeneration()
   MarkRemainingVariablesAsPseudoState();
   InitialisePseudoStates(mCodeInfo->mInitConstsStr);
 
-  std::list<System*> essentialSystems;
+  std::list<System*> essentialSystems, essentialOrder;
   FindSystemsForResiduals(algebraicSystems, essentialSystems);
-  GenerateCodeForSet(mCodeInfo->mEssentialVarsStr, mKnown, essentialSystems, sysByTargReq);
+  GenerateCodeForSet(mCodeInfo->mEssentialVarsStr, mKnown, essentialSystems, sysByTargReq,
+                     &essentialOrder);
   GenerateCodeForSet(mCodeInfo->mVarsStr, mKnown, algebraicSystems, sysByTargReq);
 
+  // Differentiate the residuals before GenerateResiduals consumes the saved
+  // rate names...
+  GenerateResidualJacobian(essentialOrder);
+  ComputeResidualDependencies(essentialOrder);
+
   // Now, generate residuals for all state and pseudostate variables...
   std::set<ptr_tag<CDA_ComputationTarget> > aNeeded;
   GenerateResiduals(mCodeInfo->mRatesStr);
@@ -855,6 +859,9 @@ CodeGenerationState::MarkRemainingVariablesAsPseudoState()
 void
 CodeGenerationState::ODESolverStyleCodeGeneration()
 {
+  if (mTrackPiecewiseConditions)
+    TransformPiecewiseConditions();
+
   // Put all targets into lists based on their classification...
   BuildFloatingAndKnownLists();
   
@@ -865,6 +872,7 @@ CodeGenerationState::ODESolverStyleCodeGeneration()
   bool wasError = DecomposeIntoSystems(mKnown, mFloating, mUnwanted, systems);
   CheckInappropriateStateAssignments(systems);
   MakeSystemsForResetRulesAndClearKnown(mResets, systems, mKnown, mFloating);
+  mCodeInfo->mHasResetRules = !mResets.empty();
   std::map<ptr_tag<CDA_ComputationTarget>, System*> sysByTargReq;
   BuildSystemsByTargetsRequired(systems, sysByTargReq);
   
@@ -893,12 +901,17 @@ CodeGenerationState::ODESolverStyleCodeGeneration()
     else
       throw UnderconstrainedError();
   }
+
+  GenerateLookupTables(systems);
+  if (mHoistConstantSubexpressions)
+    HoistConstantSubexpressions(systems);
   
   // Restore the saved rates...
   RestoreSavedRates(mCodeInfo->mRatesStr);
   
   // Write evaluations for all rates & algebraic variables in reachabletargets
-  GenerateCodeForSetByType(mKnown, systems, sysByTargReq);
+  std::list<System*> rateOrder;
+  GenerateCodeForSetByType(mKnown, systems, sysByTargReq, rateOrder);
   
   // Also cascade state variables to rate variables where they are the same
   // (e.g. if d^2y/dx^2 = constant then dy/dx is a state variable due to the
@@ -906,6 +919,11 @@ CodeGenerationState::ODESolverStyleCodeGeneration()
   GenerateStateToRateCascades();
   
   GenerateInfDelayUpdates();
+
+  GenerateRatesJacobian(rateOrder);
+  GenerateLinearCoefficients(rateOrder);
+  ComputeRateDependencies(rateOrder);
+  GenerateRootInformation();
 }
 
 bool
@@ -1095,7 +1113,7 @@ CodeGenerationState::GenerateResiduals
     throw UnderconstrainedError();
 }
 
-static std::wstring describeMaths(MathStatement* ms)
+std::wstring describeMaths(MathStatement* ms)
 {
   if (ms == NULL)
     return L"null math statement";
@@ -2916,19 +2934,9 @@ CodeGenerationState::DecomposeIntoSystems
       if ((*i).second.first.empty())
         continue;
 
-      if (FindSmallSystem((*i).second.first, (*i).second.second, start,
-                          aCandidates, aSystems))
-      {
+      if (FindMinimalSystems((*i).second.first, (*i).second.second, start,
+                             aCandidates, aSystems))
         progress = true;
-        continue;
-      }
-
-      // We failed to find a small system. Instead, start off with everything
-      // in one system and start taking stuff out...
-      bool error = FindBigSystem((*i).second.first, (*i).second.second, start, aCandidates,
-                                 aSystems);
-
-      progress |= (!error);
     }
 
     if (!progress)
@@ -2940,8 +2948,24 @@ CodeGenerationState::DecomposeIntoSystems
   }
 }
 
+/*
+ * Finds the minimal simultaneous systems in a cluster of equations.
+ *
+ * Each equation contributes one row per degree of freedom, and a maximum
+ * bipartite matching is found between these rows and the unknowns. Any row left
+ * unmatched means that some subset of the equations has fewer unknowns than
+ * equations, so the cluster is overconstrained. Unknowns left unmatched (and
+ * everything reachable from them along alternating paths) cannot be determined
+ * yet, so they are left for later. The remaining equations are then ordered by
+ * Tarjan's strongly connected components algorithm, applied to the graph where
+ * an equation depends on the equations which compute its unknowns; each
+ * component is the smallest system that has to be solved simultaneously, and
+ * components come out after everything they depend on.
+ *
+ * Returns true if at least one system was found.
+ */
 bool
-CodeGenerationState::FindSmallSystem
+CodeGenerationState::FindMinimalSystems
 (
  std::set<ptr_tag<MathStatement> >& aUseMathStatements,
  std::set<ptr_tag<CDA_ComputationTarget> >& aUseVars,
@@ -2950,317 +2974,292 @@ CodeGenerationState::FindSmallSystem
  std::list<System*>& aSystems
 )
 {
-
-  for (uint32_t systemCardinality = 1;
-       systemCardinality <= SEARCH_DEPTH;
-       systemCardinality++)
+  // Number all the unknowns...
+  std::vector<ptr_tag<CDA_ComputationTarget> > vars;
+  std::map<ptr_tag<CDA_ComputationTarget>, uint32_t> varIndex;
+  for (std::set<ptr_tag<CDA_ComputationTarget> >::iterator i = aUseVars.begin();
+       i != aUseVars.end(); i++)
   {
-    std::set<ptr_tag<MathStatement> > s;
-    std::set<ptr_tag<MathStatement> >::iterator i(aUseMathStatements.begin());
-
-    // printf("Trying to find small system of size %u from network of %u candidates, %u equations\n",
-    //        systemCardinality, aCandidates.size(), aUseMathStatements.size());
-    if (RecursivelyTestSmallSystem(s, i, systemCardinality,
-                                   aUseMathStatements, aUseVars, aStart, aCandidates,
-                                   aSystems
-                                  ))
+    if (aStart.count(*i))
+      continue;
+    varIndex.insert(std::pair<ptr_tag<CDA_ComputationTarget>, uint32_t>(*i, vars.size()));
+    vars.push_back(*i);
+  }
+  const uint32_t nVars = vars.size();
+
+  // Number the equations and their rows, and work out which unknowns each
+  // equation depends on and which it can be used to compute...
+  // Keep the original tags; a new ptr_tag of the same pointer compares as a
+  // different statement.
+  std::vector<ptr_tag<MathStatement> > eqs;
+  std::vector<std::vector<uint32_t> > eqDeps, eqMatchable;
+  std::vector<uint32_t> rowEq;
+  for (std::set<ptr_tag<MathStatement> >::iterator i = aUseMathStatements.begin();
+       i != aUseMathStatements.end(); i++)
+  {
+    MathStatement* ms = *i;
+    SampleFromDistribution* sfd = NULL;
+    if (ms->mType == MathStatement::SAMPLE_FROM_DIST)
     {
-      // printf("Success\n");
-      return true;
+      sfd = static_cast<SampleFromDistribution*>(ms);
+      // Sampling can only compute all its outputs at once, so if any are
+      // already known it can't be used here.
+      bool anyKnown = false;
+      for (std::set<ptr_tag<CDA_ComputationTarget> >::iterator j = sfd->mOutSet.begin();
+           j != sfd->mOutSet.end(); j++)
+        if (varIndex.count(*j) == 0)
+        {
+          anyKnown = true;
+          break;
+        }
+      if (anyKnown)
+        continue;
     }
-    // printf("No luck, upping cardinality.\n");
-  }
-
-  return false;
-}
 
-uint32_t
-ComputeSystemSize(std::set<ptr_tag<MathStatement> >& aSystem)
-{
-  uint32_t totalDegF = 0;
-  for (std::set<ptr_tag<MathStatement> >::iterator i = aSystem.begin();
-       i != aSystem.end(); i++)
-    totalDegF += (*i)->degFreedom();
-  return totalDegF;
-}
-
-bool
-CodeGenerationState::RecursivelyTestSmallSystem
-(
- std::set<ptr_tag<MathStatement> >& aSystem,
- std::set<ptr_tag<MathStatement> >::iterator& aEqIt,
- uint32_t aNeedToAdd,
- std::set<ptr_tag<MathStatement> >& aUseMathStatements,
- std::set<ptr_tag<CDA_ComputationTarget> >& aUseVars,
- std::set<ptr_tag<CDA_ComputationTarget> >& aStart,
- std::set<ptr_tag<CDA_ComputationTarget> >& aCandidates,
- std::list<System*>& aSystems
-)
-{
-  // Pre: aNeedToAdd is >= 1...
-  aNeedToAdd--;
+    std::vector<uint32_t> deps, matchable;
+    for (std::list<ptr_tag<CDA_ComputationTarget> >::iterator j = ms->mTargets.begin();
+         j != ms->mTargets.end(); j++)
+    {
+      std::map<ptr_tag<CDA_ComputationTarget>, uint32_t>::iterator vi = varIndex.find(*j);
+      if (vi == varIndex.end())
+        continue;
+      if (std::find(deps.begin(), deps.end(), (*vi).second) != deps.end())
+        continue;
+      deps.push_back((*vi).second);
+      if (sfd == NULL || sfd->mOutSet.count(*j))
+        matchable.push_back((*vi).second);
+    }
 
-  for (std::set<ptr_tag<MathStatement> >::iterator i(aEqIt); i != aUseMathStatements.end();)
+    for (uint32_t k = ms->degFreedom(); k > 0; k--)
+      rowEq.push_back(eqs.size());
+    eqs.push_back(*i);
+    eqDeps.push_back(deps);
+    eqMatchable.push_back(matchable);
+  }
+  const uint32_t nEqs = eqs.size(), nRows = rowEq.size();
+  if (nEqs == 0)
+    return false;
+
+  // Maximum bipartite matching between rows and unknowns, by augmenting
+  // paths found with a breadth first search from each unmatched row.
+  std::vector<int32_t> rowVar(nRows, -1), varRow(nVars, -1);
+  std::vector<int32_t> varVisitedBy(nVars, -1), varParentRow(nVars, -1);
+  std::vector<uint32_t> queue;
+  queue.reserve(nRows);
+  for (uint32_t r = 0; r < nRows; r++)
   {
-    if ((*i)->mType == MathStatement::SAMPLE_FROM_DIST)
+    // Try the cheap case first...
+    std::vector<uint32_t>& m = eqMatchable[rowEq[r]];
+    for (std::vector<uint32_t>::iterator j = m.begin(); j != m.end(); j++)
+      if (varRow[*j] == -1)
+      {
+        varRow[*j] = r;
+        rowVar[r] = *j;
+        break;
+      }
+    if (rowVar[r] != -1)
+      continue;
+
+    queue.clear();
+    queue.push_back(r);
+    int32_t freeVar = -1;
+    for (uint32_t qi = 0; qi < queue.size() && freeVar == -1; qi++)
     {
-      // Sampling cannot be part of a set of simultaneous equation, but can appear by itself.
-      if (aNeedToAdd > 0 || aSystem.size() > 0)
+      uint32_t qr = queue[qi];
+      std::vector<uint32_t>& qm = eqMatchable[rowEq[qr]];
+      for (std::vector<uint32_t>::iterator j = qm.begin(); j != qm.end(); j++)
       {
-        i++;
-        continue;
+        if (varVisitedBy[*j] == static_cast<int32_t>(r))
+          continue;
+        varVisitedBy[*j] = r;
+        varParentRow[*j] = qr;
+        if (varRow[*j] == -1)
+        {
+          freeVar = *j;
+          break;
+        }
+        queue.push_back(varRow[*j]);
       }
     }
 
-    // We do this insert and erase thing rather than copy the set to save stack
-    // space.
-    std::set<ptr_tag<MathStatement> >::iterator sysEq(aSystem.insert(*i).first);
-    i++;
+    // Flip the matching along the augmenting path...
+    while (freeVar != -1)
+    {
+      int32_t pr = varParentRow[freeVar];
+      int32_t next = rowVar[pr];
+      rowVar[pr] = freeVar;
+      varRow[freeVar] = pr;
+      freeVar = (static_cast<uint32_t>(pr) == r) ? -1 : next;
+    }
+  }
 
+  for (uint32_t r = 0; r < nRows; r++)
+    if (rowVar[r] == -1)
+    {
+      MathStatement* ms = eqs[rowEq[r]];
+      if (ms->mType == MathStatement::INITIAL_ASSIGNMENT)
+        throw OverconstrainedError(NULL);
+      else
+        throw OverconstrainedError(static_cast<MathMLMathStatement*>(ms)->mMaths);
+    }
 
-    if (aNeedToAdd > 0)
+  // Every row is matched. Anything depending on an unmatched unknown, directly
+  // or through the unknowns computed by the equations involved, is
+  // underdetermined for now.
+  std::vector<std::vector<uint32_t> > varEqs(nVars);
+  for (uint32_t e = 0; e < nEqs; e++)
+    for (std::vector<uint32_t>::iterator j = eqDeps[e].begin(); j != eqDeps[e].end(); j++)
+      varEqs[*j].push_back(e);
+
+  std::vector<bool> eqUsable(nEqs, true), varSeen(nVars, false);
+  std::vector<uint32_t> varStack;
+  for (uint32_t v = 0; v < nVars; v++)
+    if (varRow[v] == -1)
     {
-      if (RecursivelyTestSmallSystem(aSystem, i, aNeedToAdd, aUseMathStatements,
-                                     aUseVars, aStart, aCandidates, aSystems))
-        return true;
+      varSeen[v] = true;
+      varStack.push_back(v);
     }
-    else
+  std::vector<std::vector<uint32_t> > eqRows(nEqs);
+  for (uint32_t r = 0; r < nRows; r++)
+    eqRows[rowEq[r]].push_back(r);
+  while (!varStack.empty())
+  {
+    uint32_t v = varStack.back();
+    varStack.pop_back();
+    for (std::vector<uint32_t>::iterator j = varEqs[v].begin(); j != varEqs[v].end(); j++)
     {
-      // Well, we now have a set of equations which we are going to consider as
-      // a possible system in aSystem. Work out the variables involved...
-      std::set<ptr_tag<CDA_ComputationTarget> > targets;
-      std::set<ptr_tag<CDA_ComputationTarget> > known;
+      if (!eqUsable[*j])
+        continue;
+      eqUsable[*j] = false;
+      for (std::vector<uint32_t>::iterator k = eqRows[*j].begin(); k != eqRows[*j].end(); k++)
+      {
+        uint32_t mv = rowVar[*k];
+        if (varSeen[mv])
+          continue;
+        varSeen[mv] = true;
+        varStack.push_back(mv);
+      }
+    }
+  }
 
-      for (std::set<ptr_tag<MathStatement> >::iterator j(aSystem.begin());
-           j != aSystem.end(); j++)
-        for (std::list<ptr_tag<CDA_ComputationTarget> >::iterator k
-               ((*j)->mTargets.begin());
-             k != ((*j)->mTargets.end()); k++)
-        {
-          if (aStart.count(*k))
-          {
-            assert(aCandidates.count(*k) == 0);
-            known.insert(*k);
-          }
-          else
-          {
-            assert(aCandidates.count(*k));
-            assert(aUseVars.count(*k));
-            targets.insert(*k);
-          }
-        }
-      
-      uint32_t nEqns = ComputeSystemSize(aSystem), nUnknowns = targets.size();
+  // Tarjan's algorithm over the usable equations, iteratively so deep
+  // dependency chains don't exhaust the stack.
+  std::vector<int32_t> index(nEqs, -1), lowlink(nEqs, 0);
+  std::vector<bool> onStack(nEqs, false), blocked(nEqs, false);
+  std::vector<uint32_t> sccStack;
+  std::vector<std::pair<uint32_t, uint32_t> > callStack;
+  int32_t nextIndex = 0;
+  bool progress = false;
+
+  for (uint32_t root = 0; root < nEqs; root++)
+  {
+    if (!eqUsable[root] || index[root] != -1)
+      continue;
+
+    callStack.push_back(std::pair<uint32_t, uint32_t>(root, 0));
+    index[root] = lowlink[root] = nextIndex++;
+    sccStack.push_back(root);
+    onStack[root] = true;
 
-#if 0
-      if ((*targets.begin())->mVariable->name() == L"GK1_scal_rv")
+    while (!callStack.empty())
+    {
+      uint32_t e = callStack.back().first;
+      uint32_t& edge = callStack.back().second;
+      if (edge < eqDeps[e].size())
       {
-        for (std::set<ptr_tag<CDA_ComputationTarget> >::iterator i = targets.begin();
-             i != targets.end(); i++)
+        uint32_t dep = varRow[eqDeps[e][edge++]];
+        uint32_t d = rowEq[dep];
+        if (index[d] == -1)
         {
-          assert((*i)->mEvaluationType != iface::cellml_services::LOCALLY_BOUND);
+          index[d] = lowlink[d] = nextIndex++;
+          sccStack.push_back(d);
+          onStack[d] = true;
+          callStack.push_back(std::pair<uint32_t, uint32_t>(d, 0));
         }
-        asm("int $3");
+        else if (onStack[d] && index[d] < lowlink[e])
+          lowlink[e] = index[d];
+        continue;
       }
-#endif
 
-      if ((*aSystem.begin())->mType == MathStatement::SAMPLE_FROM_DIST &&
-          static_cast<SampleFromDistribution*>(static_cast<MathStatement*>(*aSystem.begin()))->mOutSet != targets)
+      callStack.pop_back();
+      if (!callStack.empty())
       {
-        aSystem.erase(sysEq);
-        continue;
+        uint32_t parent = callStack.back().first;
+        if (lowlink[e] < lowlink[parent])
+          lowlink[parent] = lowlink[e];
       }
 
-      // printf("In this case, nEqns = %u, nUnknowns = %u\n", nEqns, nUnknowns);
+      if (lowlink[e] != index[e])
+        continue;
 
-      if (nEqns > nUnknowns)
+      // e is the root of a strongly connected component. Everything it
+      // depends on outside of it has already been dealt with.
+      std::set<ptr_tag<MathStatement> > system;
+      std::vector<uint32_t> members;
+      uint32_t member;
+      do
       {
-        MathStatement * me = *(aUseMathStatements.begin());
-        if (me->mType != MathStatement::INITIAL_ASSIGNMENT)
-          throw OverconstrainedError(static_cast<MathMLMathStatement*>(me)->mMaths);
-        else
-          throw OverconstrainedError(NULL);
+        member = sccStack.back();
+        sccStack.pop_back();
+        onStack[member] = false;
+        members.push_back(member);
+        system.insert(eqs[member]);
       }
+      while (member != e);
 
-      if (nEqns < nUnknowns)
+      // Sampling cannot be part of a set of simultaneous equations, and nothing
+      // which needs something we couldn't compute can be computed either.
+      bool isBlocked = false;
+      for (std::vector<uint32_t>::iterator j = members.begin(); j != members.end(); j++)
+      {
+        if (members.size() > 1 && eqs[*j]->mType == MathStatement::SAMPLE_FROM_DIST)
+          isBlocked = true;
+        for (std::vector<uint32_t>::iterator k = eqDeps[*j].begin();
+             k != eqDeps[*j].end(); k++)
+          if (blocked[rowEq[varRow[*k]]])
+            isBlocked = true;
+      }
+      if (isBlocked)
       {
-        aSystem.erase(sysEq);
+        for (std::vector<uint32_t>::iterator j = members.begin(); j != members.end(); j++)
+          blocked[*j] = true;
         continue;
       }
 
-      // If we get here, we found a small system to remove.
-      System* syst = new System(aSystem, known, targets);
+      std::set<ptr_tag<CDA_ComputationTarget> > targets, known;
+      for (std::set<ptr_tag<MathStatement> >::iterator j = system.begin();
+           j != system.end(); j++)
+        for (std::list<ptr_tag<CDA_ComputationTarget> >::iterator k
+               ((*j)->mTargets.begin());
+             k != ((*j)->mTargets.end()); k++)
+        {
+          if (aStart.count(*k))
+            known.insert(*k);
+          else
+          {
+            assert(aCandidates.count(*k));
+            targets.insert(*k);
+          }
+        }
+
+      System* syst = new System(system, known, targets);
       mSystems.push_back(syst);
       aSystems.push_back(syst);
 
       aStart.insert(targets.begin(), targets.end());
-
       for (std::set<ptr_tag<CDA_ComputationTarget> >::iterator k(targets.begin());
-           k != targets.end();
-           k++)
+           k != targets.end(); k++)
         aCandidates.erase(*k);
 
-      for (std::set<ptr_tag<MathStatement> >::iterator k(aSystem.begin());
-           k != aSystem.end(); k++)
+      for (std::set<ptr_tag<MathStatement> >::iterator k(system.begin());
+           k != system.end(); k++)
         mUnusedMathStatements.erase(*k);
 
-      return true;
-    }
-
-    aSystem.erase(sysEq);
-  }
-
-  return false;
-}
-
-bool
-CodeGenerationState::FindBigSystem
-(
- std::set<ptr_tag<MathStatement> >& aUseMathStatements,
- std::set<ptr_tag<CDA_ComputationTarget> >& aUseVars,
- std::set<ptr_tag<CDA_ComputationTarget> >& aStart,
- std::set<ptr_tag<CDA_ComputationTarget> >& aCandidates,
- std::list<System*>& aSystems
-)
-{
-  // There is absolutely no point in doing this if the system is improperly
-  // constrained...
-  if (ComputeSystemSize(aUseMathStatements) != aUseVars.size())
-    return true;
-
-  bool didWork;
-  
-  do
-  {
-    didWork = false;
-
-    for (uint32_t nonSystemCardinality = 1;
-         nonSystemCardinality <= SEARCH_DEPTH;
-         nonSystemCardinality++)
-    {
-      // Empty systems are entirely meaningless...
-      if (nonSystemCardinality >= aUseMathStatements.size())
-        break;
-
-      std::set<ptr_tag<MathStatement> > s;
-      std::set<ptr_tag<MathStatement> >::iterator i(aUseMathStatements.begin());
-      if (RecursivelyTestBigSystem(s, i, nonSystemCardinality,
-                                   aUseMathStatements, aUseVars, aStart, aCandidates
-                                  ))
-      {
-        didWork = true;
-        break;
-      }
-    }
-  }
-  while (didWork);
-
-  // If we get here, we have removed as many equations as we can from aUseVars
-  // and aUseMathStatements, so that is now our system...
-
-  std::set<ptr_tag<CDA_ComputationTarget> > known;
-
-  for (std::set<ptr_tag<MathStatement> >::iterator i(aUseMathStatements.begin());
-       i != aUseMathStatements.end();
-       i++)
-    for (std::list<ptr_tag<CDA_ComputationTarget> >::iterator j((*i)->mTargets.begin());
-         j != (*i)->mTargets.end();
-         j++)
-    {
-      if (aStart.count(*j))
-        known.insert(*j);
-    }
-
-  System* st = new System(aUseMathStatements, known, aUseVars);
-  mSystems.push_back(st);
-  aSystems.push_back(st);
-
-  aStart.insert(aUseVars.begin(), aUseVars.end());
-  for (std::set<ptr_tag<CDA_ComputationTarget> >::iterator k(aUseVars.begin());
-       k != aUseVars.end();
-       k++)
-    aCandidates.erase(*k);
-  
-  for (std::set<ptr_tag<MathStatement> >::iterator k(aUseMathStatements.begin());
-       k != aUseMathStatements.end(); k++)
-    mUnusedMathStatements.erase(*k);
-
-  return false;
-}
-
-bool
-CodeGenerationState::RecursivelyTestBigSystem
-(
- std::set<ptr_tag<MathStatement> >& aNonSystem,
- std::set<ptr_tag<MathStatement> >::iterator& aEqIt,
- uint32_t aNeedToRemove,
- std::set<ptr_tag<MathStatement> >& aUseMathStatements,
- std::set<ptr_tag<CDA_ComputationTarget> >& aUseVars,
- std::set<ptr_tag<CDA_ComputationTarget> >& aStart,
- std::set<ptr_tag<CDA_ComputationTarget> >& aCandidates
-)
-{
-  // Pre: aNeedToRemove is >= 1...
-  aNeedToRemove--;
-
-  for (std::set<ptr_tag<MathStatement> >::iterator i(aEqIt); i != aUseMathStatements.end();)
-  {
-    if ((*i)->mType == MathStatement::INITIAL_ASSIGNMENT || (*i)->mType == MathStatement::SAMPLE_FROM_DIST)
-    {
-      i++;
-      continue;
-    }
-
-    // We do this insert and erase thing rather than copy the set to save stack
-    // space.
-    std::set<ptr_tag<MathStatement> >::iterator sysEq(aNonSystem.insert(*i).first);
-    i++;
-
-    if (aNeedToRemove > 0)
-    {
-      if (RecursivelyTestBigSystem(aNonSystem, i, aNeedToRemove, aUseMathStatements,
-                                   aUseVars, aStart, aCandidates))
-        return true;
-    }
-    else
-    {
-      // Build aUseMathStatements \ aNonSystem...
-      std::set<ptr_tag<MathStatement> > syst;
-      std::set_difference(aUseMathStatements.begin(),
-                          aUseMathStatements.end(),
-                          aNonSystem.begin(),
-                          aNonSystem.end(),
-                          std::inserter(syst, syst.end()));
-
-      // Which variables does this involve?
-      std::set<ptr_tag<CDA_ComputationTarget> > targs;
-      for (std::set<ptr_tag<MathStatement> >::iterator j(syst.begin());
-           j != syst.end(); j++)
-        for (std::list<ptr_tag<CDA_ComputationTarget> >::iterator k
-               ((*j)->mTargets.begin());
-             k != (*j)->mTargets.end(); k++)
-          if (aCandidates.count(*k))
-            targs.insert(*k);
-
-      if (targs.size() != syst.size())
-      {
-        aNonSystem.erase(sysEq);
-        continue;
-      }
-
-      // Well, we managed to shrink the system, so keep these changes and we
-      // will see if we get any further later...
-
-      aUseMathStatements = syst;
-      aUseVars = targs;
-
-      return true;
+      progress = true;
     }
-
-    aNonSystem.erase(sysEq);
   }
 
-  return false;
+  return progress;
 }
 
 void
@@ -3290,7 +3289,8 @@ CodeGenerationState::GenerateCodeForSet
  std::set<ptr_tag<CDA_ComputationTarget> >& aKnown,
  std::list<System*>& aSystems,
  std::map<ptr_tag<CDA_ComputationTarget>, System*>&
-   aSysByTargReq
+   aSysByTargReq,
+ std::list<System*>* aOrder
 )
 {
   std::list<System*> sysCopy(aSystems);
@@ -3350,8 +3350,52 @@ CodeGenerationState::GenerateCodeForSet
           ComputeInfDelayedName(*dcti, ignore);
         }
 
-    GenerateCodeForSet(aCodeTo, aKnown, subtargets, aSysByTargReq);
-    GenerateCodeForSystem(aCodeTo, sys);
+    GenerateCodeForSet(aCodeTo, aKnown, subtargets, aSysByTargReq, aOrder);
+    if (aOrder != NULL)
+      aOrder->push_back(sys);
+    if (&aCodeTo == &mCodeInfo->mVarsStr)
+      GenerateVariablesFragment(sys);
+    else
+      GenerateCodeForSystem(aCodeTo, sys);
+  }
+}
+
+/*
+ * Generates the code for a system into variablesString, also keeping it as a
+ * separate fragment so that the code can be cut down to just what is needed
+ * for some of the algebraic variables.
+ */
+void
+CodeGenerationState::GenerateVariablesFragment(System* aSys)
+{
+  std::wstring code;
+  GenerateCodeForSystem(code, aSys);
+  mCodeInfo->mVarsStr += code;
+
+  uint32_t fragment = mCodeInfo->mVariablesFragments.size();
+  mCodeInfo->mVariablesFragments.push_back(code);
+
+  std::set<uint32_t> deps;
+  for (std::set<ptr_tag<CDA_ComputationTarget> >::iterator i =
+         aSys->mKnowns.begin();
+       i != aSys->mKnowns.end();
+       i++)
+  {
+    std::map<CDA_ComputationTarget*, uint32_t>::iterator f =
+      mVariablesFragmentByTarget.find(*i);
+    if (f != mVariablesFragmentByTarget.end())
+      deps.insert((*f).second);
+  }
+  mCodeInfo->mVariablesFragmentDependencies.push_back(deps);
+
+  for (std::set<ptr_tag<CDA_ComputationTarget> >::iterator i =
+         aSys->mUnknowns.begin();
+       i != aSys->mUnknowns.end();
+       i++)
+  {
+    mVariablesFragmentByTarget[*i] = fragment;
+    if ((*i)->mEvaluationType == iface::cellml_services::ALGEBRAIC)
+      mCodeInfo->mAlgebraicFragment[(*i)->mAssignedIndex] = fragment;
   }
 }
 
@@ -3365,7 +3409,8 @@ CodeGenerationState::GenerateCodeForSetByType
  std::set<ptr_tag<CDA_ComputationTarget> >& aKnown,
  std::list<System*>& aSystems,
  std::map<ptr_tag<CDA_ComputationTarget>, System*>&
-   aSysByTargReq
+   aSysByTargReq,
+ std::list<System*>& aRateOrder
 )
 {
   // Make a list of all systems which allow us to compute rates...
@@ -3401,7 +3446,8 @@ CodeGenerationState::GenerateCodeForSetByType
       rateSys.push_back(sys);
   }
 
-  GenerateCodeForSet(mCodeInfo->mRatesStr, aKnown, rateSys, aSysByTargReq);
+  GenerateCodeForSet(mCodeInfo->mRatesStr, aKnown, rateSys, aSysByTargReq,
+                     &aRateOrder);
 
   // And now everything else goes in mVarsStr
   GenerateCodeForSet(mCodeInfo->mVarsStr, aKnown, aSystems, aSysByTargReq);
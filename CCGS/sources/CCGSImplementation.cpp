@@ -206,6 +206,90 @@ CDA_CodeInformation::functionsString() throw()
   return mFuncsStr;
 }
 
+std::wstring
+CDA_CodeInformation::jacobianString() throw()
+{
+  return mJacobianStr;
+}
+
+std::wstring
+CDA_CodeInformation::linearCoefficientsString() throw()
+{
+  return mLinearCoefficientsStr;
+}
+
+std::vector<uint32_t>
+CDA_CodeInformation::lookupTableErrorIndices() throw()
+{
+  return mLookupTableErrorIndices;
+}
+
+std::vector<uint32_t>
+CDA_CodeInformation::hoistedConstantIndices() throw()
+{
+  return mHoistedConstantIndices;
+}
+
+bool
+CDA_CodeInformation::hasResetRules() throw()
+{
+  return mHasResetRules;
+}
+
+std::vector<uint32_t>
+CDA_CodeInformation::rateDependencies(uint32_t rateIndex) throw()
+{
+  std::map<uint32_t, std::set<uint32_t> >::iterator i =
+    mRateDependencies.find(rateIndex);
+  if (i == mRateDependencies.end())
+    return std::vector<uint32_t>();
+  return std::vector<uint32_t>((*i).second.begin(), (*i).second.end());
+}
+
+uint32_t
+CDA_CodeInformation::variablesFragmentCount() throw()
+{
+  return mVariablesFragments.size();
+}
+
+std::wstring
+CDA_CodeInformation::variablesFragmentString(uint32_t fragment) throw()
+{
+  if (fragment >= mVariablesFragments.size())
+    return L"";
+  return mVariablesFragments[fragment];
+}
+
+std::vector<uint32_t>
+CDA_CodeInformation::variablesFragmentsFor
+(
+ const std::vector<uint32_t>& algebraicIndices
+)
+  throw()
+{
+  std::set<uint32_t> needed;
+  std::list<uint32_t> work;
+  for (std::vector<uint32_t>::const_iterator i = algebraicIndices.begin();
+       i != algebraicIndices.end(); i++)
+  {
+    std::map<uint32_t, uint32_t>::iterator f = mAlgebraicFragment.find(*i);
+    if (f != mAlgebraicFragment.end())
+      work.push_back((*f).second);
+  }
+
+  while (!work.empty())
+  {
+    uint32_t fragment = work.front();
+    work.pop_front();
+    if (!needed.insert(fragment).second)
+      continue;
+    work.insert(work.end(), mVariablesFragmentDependencies[fragment].begin(),
+                mVariablesFragmentDependencies[fragment].end());
+  }
+
+  return std::vector<uint32_t>(needed.begin(), needed.end());
+}
+
 std::wstring
 CDA_CodeInformation::essentialVariablesString() throw()
 {
@@ -432,8 +516,49 @@ CDA_CodeGenerator::CDA_CodeGenerator(bool aIDAStyle)
    (
     L"CONDVAR[%]"
    ),
-   mTrackPiecewiseConditions(true),
+   mJacobianEntryPattern(L"JACOBIAN[<ROW>][<COLUMN>]"),
+   mLinearCoefficientPattern(L"LINEAR_COEFFICIENTS[%]"),
+   mJacobianRateCoefficientName(L"CJ"),
+   mLookupTablePattern
+   (
+    L"(<VALUE> >= <MINIMUM> && <VALUE> <= <MAXIMUM> ? "
+    L"lookup_table(CONSTANTS + <FIRST>, <COUNT>, <MINIMUM>, 1.0 / <STEP>, "
+    L"<VALUE>) : <EXPRESSION>)"
+   ),
+   mLookupTableBuildPattern
+   (
+    L"{\r\n"
+    L"  double LOOKUP_SAVED = <VALUE>, LOOKUP_ERROR = 0.0, LOOKUP_DIFF;\r\n"
+    L"  int LOOKUP_I;\r\n"
+    L"  for (LOOKUP_I = 0; LOOKUP_I < <COUNT>; LOOKUP_I++)\r\n"
+    L"  {\r\n"
+    L"    <VALUE> = <MINIMUM> + LOOKUP_I * <STEP>;\r\n"
+    L"    CONSTANTS[<FIRST> + LOOKUP_I] = <EXPRESSION>;\r\n"
+    L"    /* Step off removable singularities. */\r\n"
+    L"    if (CONSTANTS[<FIRST> + LOOKUP_I] != CONSTANTS[<FIRST> + LOOKUP_I])\r\n"
+    L"    {\r\n"
+    L"      <VALUE> += 1E-6 * <STEP>;\r\n"
+    L"      CONSTANTS[<FIRST> + LOOKUP_I] = <EXPRESSION>;\r\n"
+    L"    }\r\n"
+    L"  }\r\n"
+    L"  for (LOOKUP_I = 0; LOOKUP_I + 1 < <COUNT>; LOOKUP_I++)\r\n"
+    L"  {\r\n"
+    L"    <VALUE> = <MINIMUM> + (LOOKUP_I + 0.5) * <STEP>;\r\n"
+    L"    LOOKUP_DIFF = fabs((<EXPRESSION>) - 0.5 * (CONSTANTS[<FIRST> + LOOKUP_I] + "
+    L"CONSTANTS[<FIRST> + LOOKUP_I + 1]));\r\n"
+    L"    if (LOOKUP_DIFF > LOOKUP_ERROR)\r\n"
+    L"      LOOKUP_ERROR = LOOKUP_DIFF;\r\n"
+    L"  }\r\n"
+    L"  <VALUE> = LOOKUP_SAVED;\r\n"
+    L"  <ERROR> = LOOKUP_ERROR;\r\n"
+    L"}\r\n"
+   ),
+   mLookupTableMinimum(0.0),
+   mLookupTableMaximum(0.0),
+   mLookupTableStep(0.0),
+   mTrackPiecewiseConditions(aIDAStyle),
    mAllowPassthrough(false),
+   mHoistConstantSubexpressions(false),
    mArrayOffset(0),
    mIDAStyle(aIDAStyle)
 {
@@ -637,6 +762,78 @@ CDA_CodeGenerator::conditionalAssignmentPattern(const std::wstring& aPattern)
   mConditionalAssignmentPattern = aPattern;
 }
 
+std::wstring
+CDA_CodeGenerator::jacobianEntryPattern()
+  throw()
+{
+  return mJacobianEntryPattern;
+}
+
+void
+CDA_CodeGenerator::jacobianEntryPattern(const std::wstring& aPattern)
+  throw()
+{
+  mJacobianEntryPattern = aPattern;
+}
+
+std::wstring
+CDA_CodeGenerator::linearCoefficientPattern()
+  throw()
+{
+  return mLinearCoefficientPattern;
+}
+
+void
+CDA_CodeGenerator::linearCoefficientPattern(const std::wstring& aPattern)
+  throw()
+{
+  mLinearCoefficientPattern = aPattern;
+}
+
+void
+CDA_CodeGenerator::setLookupTable
+(
+ iface::cellml_api::CellMLVariable* aVariable,
+ double aMinimum,
+ double aMaximum,
+ double aStep
+)
+  throw()
+{
+  mLookupTableVariable = aVariable;
+  mLookupTableMinimum = aMinimum;
+  mLookupTableMaximum = aMaximum;
+  mLookupTableStep = aStep;
+}
+
+std::wstring
+CDA_CodeGenerator::lookupTablePattern()
+  throw()
+{
+  return mLookupTablePattern;
+}
+
+void
+CDA_CodeGenerator::lookupTablePattern(const std::wstring& aPattern)
+  throw()
+{
+  mLookupTablePattern = aPattern;
+}
+
+std::wstring
+CDA_CodeGenerator::lookupTableBuildPattern()
+  throw()
+{
+  return mLookupTableBuildPattern;
+}
+
+void
+CDA_CodeGenerator::lookupTableBuildPattern(const std::wstring& aPattern)
+  throw()
+{
+  mLookupTableBuildPattern = aPattern;
+}
+
 std::wstring
 CDA_CodeGenerator::residualPattern()
   throw()
@@ -719,6 +916,18 @@ CDA_CodeGenerator::conditionVariablePattern(const std::wstring& aPattern) throw(
   mConditionVariablePattern = aPattern;
 }
 
+std::wstring
+CDA_CodeGenerator::jacobianRateCoefficientName() throw()
+{
+  return mJacobianRateCoefficientName;
+}
+
+void
+CDA_CodeGenerator::jacobianRateCoefficientName(const std::wstring& aName) throw()
+{
+  mJacobianRateCoefficientName = aName;
+}
+
 bool
 CDA_CodeGenerator::trackPiecewiseConditions() throw()
 {
@@ -731,6 +940,18 @@ CDA_CodeGenerator::trackPiecewiseConditions(bool aTrack) throw()
   mTrackPiecewiseConditions = aTrack;
 }
 
+bool
+CDA_CodeGenerator::hoistConstantSubexpressions() throw()
+{
+  return mHoistConstantSubexpressions;
+}
+
+void
+CDA_CodeGenerator::hoistConstantSubexpressions(bool aHoist) throw()
+{
+  mHoistConstantSubexpressions = aHoist;
+}
+
 already_AddRefd<iface::cellml_services::MaLaESTransform>
 CDA_CodeGenerator::transform() throw()
 {
@@ -848,12 +1069,21 @@ CDA_CodeGenerator::makeCodeGenerationState(int aCompat, iface::cellml_api::Model
       mResidualPattern, mConstrainedRateStateInfoPattern,
       mUnconstrainedRateStateInfoPattern,
       mInfDelayedRatePattern, mInfDelayedStatePattern,
-      mConditionVariablePattern, mTrackPiecewiseConditions,
+      mConditionVariablePattern, mJacobianEntryPattern,
+      mLinearCoefficientPattern, mJacobianRateCoefficientName, mTrackPiecewiseConditions,
       mArrayOffset, mTransform,
       mCeVAS, mCUSES, mAnnoSet, mIDAStyle
       )
     );
 
+  cgs->mLookupTableVariable = mLookupTableVariable;
+  cgs->mLookupTableMinimum = mLookupTableMinimum;
+  cgs->mLookupTableMaximum = mLookupTableMaximum;
+  cgs->mLookupTableStep = mLookupTableStep;
+  cgs->mLookupTablePattern = mLookupTablePattern;
+  cgs->mLookupTableBuildPattern = mLookupTableBuildPattern;
+  cgs->mHoistConstantSubexpressions = mHoistConstantSubexpressions;
+
   if (cgs->mAnnoSet == NULL)
   {
     RETURN_INTO_OBJREF(ats, iface::cellml_services::AnnotationToolService,
@@ -1058,7 +1288,8 @@ CDA_CustomGenerator::generateCode()
   CodeGenerationState cgs(1, mModel, emp, mStateVariableNamePattern, emp, emp, emp,
                           emp, emp, emp, mAssignPattern, mAssignConstantPattern,
                           mSolvePattern, mSolveNLSystemPattern,
-                          emp, emp, emp, emp, emp, emp, emp, emp, emp, false,
+                          emp, emp, emp, emp, emp, emp, emp, emp, emp, emp, emp,
+                          emp, false,
                           mArrayOffset, mTransform, mCeVAS, mCUSES, mAnnoSet, false);
   return
     cgs.GenerateCustomCode(mTargetSet, mRequestComputation, mKnown, mUnwanted);
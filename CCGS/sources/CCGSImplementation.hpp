@@ -14,6 +14,7 @@
 #include <list>
 #include <memory>
 #include <set>
+#include <map>
 
 // Disabled for now because modules aren't used by anyone and breaks MingW builds.
 // We can either fix the build system or remove it altogether later.
@@ -144,7 +145,7 @@ public:
   CDA_IMPL_REFCOUNT;
   CDA_IMPL_QI2(cellml_services::CodeInformation, cellml_services::IDACodeInformation);
 
-  CDA_CodeInformation() : mMissingInitial(NULL) {};
+  CDA_CodeInformation() : mHasResetRules(false), mMissingInitial(NULL) {};
   ~CDA_CodeInformation();
 
   std::wstring errorMessage() throw();
@@ -156,6 +157,16 @@ public:
   std::wstring ratesString() throw();
   std::wstring variablesString() throw();
   std::wstring functionsString() throw();
+  std::wstring jacobianString() throw();
+  std::vector<uint32_t> rateDependencies(uint32_t rateIndex) throw();
+  std::wstring linearCoefficientsString() throw();
+  std::vector<uint32_t> lookupTableErrorIndices() throw();
+  std::vector<uint32_t> hoistedConstantIndices() throw();
+  bool hasResetRules() throw();
+  uint32_t variablesFragmentCount() throw();
+  std::wstring variablesFragmentString(uint32_t fragment) throw();
+  std::vector<uint32_t> variablesFragmentsFor
+    (const std::vector<uint32_t>& algebraicIndices) throw();
   std::wstring essentialVariablesString() throw();
   std::wstring stateInformationString() throw();
   uint32_t conditionVariableCount() throw();
@@ -171,7 +182,15 @@ public:
   iface::cellml_services::ModelConstraintLevel mConstraintLevel;
   uint32_t mAlgebraicIndexCount, mRateIndexCount, mConstantIndexCount, mConditionVariableCount;
   std::wstring mInitConstsStr, mRatesStr, mVarsStr, mFuncsStr, mEssentialVarsStr, mStateInformationStr,
-               mRootInformationStr;
+               mRootInformationStr, mJacobianStr, mLinearCoefficientsStr;
+  std::map<uint32_t, std::set<uint32_t> > mRateDependencies;
+  std::vector<uint32_t> mLookupTableErrorIndices, mHoistedConstantIndices;
+  bool mHasResetRules;
+  // The systems making up mVarsStr, the fragments each one uses the results
+  // of, and the fragment computing each algebraic variable.
+  std::vector<std::wstring> mVariablesFragments;
+  std::vector<std::set<uint32_t> > mVariablesFragmentDependencies;
+  std::map<uint32_t, uint32_t> mAlgebraicFragment;
   std::vector<iface::dom::Element*> mFlaggedEquations;
   CDA_ComputationTarget* mMissingInitial;
 };
@@ -286,6 +305,18 @@ public:
   void declareTemporaryPattern(const std::wstring& aPattern) throw();
   std::wstring conditionalAssignmentPattern() throw();
   void conditionalAssignmentPattern(const std::wstring& aPattern) throw();
+  std::wstring jacobianEntryPattern() throw();
+  void jacobianEntryPattern(const std::wstring& aPattern) throw();
+  std::wstring linearCoefficientPattern() throw();
+  void linearCoefficientPattern(const std::wstring& aPattern) throw();
+  void setLookupTable(iface::cellml_api::CellMLVariable* aVariable,
+                      double aMinimum, double aMaximum, double aStep) throw();
+  std::wstring lookupTablePattern() throw();
+  void lookupTablePattern(const std::wstring& aPattern) throw();
+  std::wstring lookupTableBuildPattern() throw();
+  void lookupTableBuildPattern(const std::wstring& aPattern) throw();
+  bool hoistConstantSubexpressions() throw();
+  void hoistConstantSubexpressions(bool aHoist) throw();
   std::wstring residualPattern() throw();
   void residualPattern(const std::wstring& aPattern) throw();
   std::wstring constrainedRateStateInfoPattern() throw();
@@ -298,6 +329,8 @@ public:
   void infDelayedStatePattern(const std::wstring& aPattern) throw();
   std::wstring conditionVariablePattern() throw();
   void conditionVariablePattern(const std::wstring& aPattern) throw();
+  std::wstring jacobianRateCoefficientName() throw();
+  void jacobianRateCoefficientName(const std::wstring& aName) throw();
   bool trackPiecewiseConditions() throw();
   void trackPiecewiseConditions(bool aTrack) throw();
 
@@ -336,8 +369,12 @@ private:
     mTemporaryVariablePattern, mDeclareTemporaryPattern,
     mConditionalAssignmentPattern, mResidualPattern, mConstrainedRateStateInfoPattern,
     mUnconstrainedRateStateInfoPattern, mInfDelayedRatePattern, mInfDelayedStatePattern,
-    mConditionVariablePattern;
-  bool mTrackPiecewiseConditions, mAllowPassthrough;
+    mConditionVariablePattern, mJacobianEntryPattern, mLinearCoefficientPattern,
+    mJacobianRateCoefficientName, mLookupTablePattern, mLookupTableBuildPattern;
+  ObjRef<iface::cellml_api::CellMLVariable> mLookupTableVariable;
+  double mLookupTableMinimum, mLookupTableMaximum, mLookupTableStep;
+  bool mTrackPiecewiseConditions, mAllowPassthrough,
+    mHoistConstantSubexpressions;
   uint32_t mArrayOffset;
   bool mIDAStyle;
   ObjRef<iface::cellml_services::MaLaESTransform> mTransform;
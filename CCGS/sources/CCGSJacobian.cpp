@@ -0,0 +1,1552 @@
+#define MODULE_CONTAINS_CCGS
+#include "CCGSImplementation.hpp"
+#include <map>
+#include <set>
+#include <list>
+#include <vector>
+#include <cmath>
+#include "CodeGenerationState.hxx"
+#include "CodeGenerationError.hxx"
+#include "IfaceMathML_content_APISPEC.hxx"
+
+#define MATHML_NS L"http://www.w3.org/1998/Math/MathML"
+#define PASSTHROUGH_URL L"http://www.cellml.org/tools/api#passthrough"
+
+/*
+ * Symbolic differentiation of the model, used to generate code for the
+ * Jacobian of the rates (or residuals) with respect to the state variables.
+ *
+ * Derivatives are built up as MathML in the document of the expression being
+ * differentiated, and are rendered through the MaLaES transform, so they get
+ * the same units conversions and language templates as the rest of the
+ * generated code. The partial derivatives of each computed variable are
+ * propagated forwards, in evaluation order, through temporary variables.
+ * Anything which can't be differentiated throws NotDifferentiableError, and
+ * no Jacobian is generated at all.
+ */
+
+typedef ObjRef<iface::mathml_dom::MathMLElement> MathRef;
+
+static MathRef
+NewElement(iface::dom::Document* aDoc, const wchar_t* aName)
+{
+  RETURN_INTO_OBJREF(el, iface::dom::Element,
+                     aDoc->createElementNS(MATHML_NS, aName));
+  DECLARE_QUERY_INTERFACE_OBJREF(mel, el, mathml_dom::MathMLElement);
+  return mel;
+}
+
+// Returns the element itself if it is not yet part of any expression, or a
+// deep copy if it is, so the same subexpression can be used in several places.
+static MathRef
+Adopt(iface::mathml_dom::MathMLElement* aEl)
+{
+  RETURN_INTO_OBJREF(p, iface::dom::Node, aEl->parentNode());
+  if (p == NULL)
+    return aEl;
+
+  RETURN_INTO_OBJREF(n, iface::dom::Node, aEl->cloneNode(true));
+  DECLARE_QUERY_INTERFACE_OBJREF(mel, n, mathml_dom::MathMLElement);
+  return mel;
+}
+
+static void
+AppendArgument(iface::mathml_dom::MathMLElement* aTo,
+               iface::mathml_dom::MathMLElement* aArg)
+{
+  MathRef arg(Adopt(aArg));
+  aTo->appendChild(arg)->release_ref();
+}
+
+static MathRef
+MakeNumber(iface::dom::Document* aDoc, double aValue)
+{
+  // Scoped locale change.
+  CNumericLocale locobj;
+
+  wchar_t buf[40];
+  any_swprintf(buf, 40, L"%.17g", aValue);
+
+  MathRef cn(NewElement(aDoc, L"cn"));
+  RETURN_INTO_OBJREF(tn, iface::dom::Text, aDoc->createTextNode(buf));
+  cn->appendChild(tn)->release_ref();
+  return cn;
+}
+
+static MathRef
+MakePassthrough(iface::dom::Document* aDoc, const std::wstring& aText)
+{
+  MathRef pt(NewElement(aDoc, L"csymbol"));
+  pt->setAttributeNS(L"", L"definitionURL", PASSTHROUGH_URL);
+  RETURN_INTO_OBJREF(tn, iface::dom::Text, aDoc->createTextNode(aText));
+  pt->appendChild(tn)->release_ref();
+  return pt;
+}
+
+/*
+ * Determines whether aEl is a plain real constant, and if so, stores its value
+ * in aValue.
+ */
+static bool
+GetNumber(iface::mathml_dom::MathMLElement* aEl, double& aValue)
+{
+  DECLARE_QUERY_INTERFACE_OBJREF(cn, aEl, mathml_dom::MathMLCnElement);
+  if (cn == NULL)
+    return false;
+
+  RETURN_INTO_WSTRING(type, cn->type());
+  RETURN_INTO_WSTRING(base, cn->base());
+  if ((type != L"" && type != L"real" && type != L"integer") ||
+      (base != L"" && base != L"10"))
+    return false;
+
+  RETURN_INTO_OBJREF(n, iface::dom::Node, cn->firstChild());
+  DECLARE_QUERY_INTERFACE_OBJREF(tn, n, dom::Text);
+  if (tn == NULL)
+    return false;
+
+  RETURN_INTO_WSTRING(txt, tn->data());
+
+  // Scoped locale change.
+  CNumericLocale locobj;
+
+  wchar_t* end;
+  aValue = wcstod(txt.c_str(), &end);
+  if (end == txt.c_str())
+    return false;
+  while (*end == L' ' || *end == L'\t' || *end == L'\r' || *end == L'\n')
+    end++;
+
+  return (*end == 0);
+}
+
+static bool
+IsNumber(iface::mathml_dom::MathMLElement* aEl, double aValue)
+{
+  double v;
+  return GetNumber(aEl, v) && v == aValue;
+}
+
+static MathRef
+MakeApply(iface::dom::Document* aDoc, const wchar_t* aOperator,
+          iface::mathml_dom::MathMLElement* aArg1,
+          iface::mathml_dom::MathMLElement* aArg2 = NULL)
+{
+  MathRef apply(NewElement(aDoc, L"apply"));
+  MathRef op(NewElement(aDoc, aOperator));
+  apply->appendChild(op)->release_ref();
+  AppendArgument(apply, aArg1);
+  if (aArg2 != NULL)
+    AppendArgument(apply, aArg2);
+  return apply;
+}
+
+static MathRef
+MakeTimes(iface::dom::Document* aDoc, iface::mathml_dom::MathMLElement* aArg1,
+          iface::mathml_dom::MathMLElement* aArg2)
+{
+  if (IsNumber(aArg1, 1.0))
+    return Adopt(aArg2);
+  if (IsNumber(aArg2, 1.0))
+    return Adopt(aArg1);
+  return MakeApply(aDoc, L"times", aArg1, aArg2);
+}
+
+static MathRef
+MakeReciprocal(iface::dom::Document* aDoc,
+               iface::mathml_dom::MathMLElement* aArg)
+{
+  MathRef one(MakeNumber(aDoc, 1.0));
+  return MakeApply(aDoc, L"divide", one, aArg);
+}
+
+static MathRef
+MakeSquare(iface::dom::Document* aDoc, iface::mathml_dom::MathMLElement* aArg)
+{
+  MathRef two(MakeNumber(aDoc, 2.0));
+  return MakeApply(aDoc, L"power", aArg, two);
+}
+
+static MathRef
+MakePiecewise(iface::dom::Document* aDoc,
+              std::list<std::pair<MathRef, MathRef> >& aPieces,
+              iface::mathml_dom::MathMLElement* aOtherwise)
+{
+  MathRef pw(NewElement(aDoc, L"piecewise"));
+  for (std::list<std::pair<MathRef, MathRef> >::iterator i = aPieces.begin();
+       i != aPieces.end(); i++)
+  {
+    MathRef piece(NewElement(aDoc, L"piece"));
+    AppendArgument(piece, (*i).first);
+    AppendArgument(piece, (*i).second);
+    pw->appendChild(piece)->release_ref();
+  }
+
+  if (aOtherwise != NULL)
+  {
+    MathRef otherwise(NewElement(aDoc, L"otherwise"));
+    AppendArgument(otherwise, aOtherwise);
+    pw->appendChild(otherwise)->release_ref();
+  }
+
+  return pw;
+}
+
+/*
+ * Adds aFactor * aFrom (or -aFactor * aFrom if aNegate is set) to aTo. A NULL
+ * factor is treated as 1.
+ */
+static void
+AddScaled(iface::dom::Document* aDoc, SparseDerivative& aTo,
+          SparseDerivative& aFrom, iface::mathml_dom::MathMLElement* aFactor,
+          bool aNegate = false)
+{
+  for (SparseDerivative::iterator i = aFrom.begin(); i != aFrom.end(); i++)
+  {
+    MathRef term((*i).second);
+    if (aFactor != NULL)
+      term = MakeTimes(aDoc, aFactor, term);
+
+    SparseDerivative::iterator j = aTo.find((*i).first);
+    if (j == aTo.end())
+    {
+      if (aNegate)
+        term = MakeApply(aDoc, L"minus", term);
+      aTo.insert(std::pair<uint32_t, MathRef>((*i).first, term));
+    }
+    else
+      (*j).second = MakeApply(aDoc, aNegate ? L"minus" : L"plus",
+                              (*j).second, term);
+  }
+}
+
+static void
+ScaleDerivative(iface::dom::Document* aDoc, SparseDerivative& aDeriv,
+                double aFactor)
+{
+  if (aFactor == 1.0)
+    return;
+
+  MathRef factor(MakeNumber(aDoc, aFactor));
+  for (SparseDerivative::iterator i = aDeriv.begin(); i != aDeriv.end(); i++)
+    (*i).second = MakeTimes(aDoc, factor, (*i).second);
+}
+
+/*
+ * Builds the derivative of a piecewise function from the derivatives of each
+ * piece. Columns missing from a piece are zero in that piece.
+ */
+static void
+MakePiecewiseDerivative(iface::dom::Document* aDoc,
+                        std::list<std::pair<SparseDerivative, MathRef> >& aCases,
+                        SparseDerivative* aOtherwise,
+                        SparseDerivative& aResult)
+{
+  std::set<uint32_t> columns;
+  std::list<std::pair<SparseDerivative, MathRef> >::iterator i;
+  for (i = aCases.begin(); i != aCases.end(); i++)
+    for (SparseDerivative::iterator j = (*i).first.begin();
+         j != (*i).first.end(); j++)
+      columns.insert((*j).first);
+  if (aOtherwise != NULL)
+    for (SparseDerivative::iterator j = aOtherwise->begin();
+         j != aOtherwise->end(); j++)
+      columns.insert((*j).first);
+
+  MathRef zero(MakeNumber(aDoc, 0.0));
+  for (std::set<uint32_t>::iterator c = columns.begin(); c != columns.end(); c++)
+  {
+    std::list<std::pair<MathRef, MathRef> > pieces;
+    for (i = aCases.begin(); i != aCases.end(); i++)
+    {
+      SparseDerivative::iterator j = (*i).first.find(*c);
+      pieces.push_back(std::pair<MathRef, MathRef>
+                       (j == (*i).first.end() ? zero : (*j).second,
+                        (*i).second));
+    }
+
+    MathRef otherwise;
+    if (aOtherwise != NULL)
+    {
+      SparseDerivative::iterator j = aOtherwise->find(*c);
+      otherwise = (j == aOtherwise->end()) ? zero : (*j).second;
+    }
+
+    aResult[*c] = MakePiecewise(aDoc, pieces, otherwise);
+  }
+}
+
+/*
+ * Finds the argument of a qualifier (such as degree or logbase) on an apply,
+ * or returns NULL if there is no such qualifier.
+ */
+static MathRef
+FindQualifier(iface::mathml_dom::MathMLApplyElement* aApply,
+              const wchar_t* aName)
+{
+  RETURN_INTO_OBJREF(nl, iface::dom::NodeList, aApply->childNodes());
+  for (uint32_t i = 0, l = nl->length(); i < l; i++)
+  {
+    RETURN_INTO_OBJREF(n, iface::dom::Node, nl->item(i));
+    DECLARE_QUERY_INTERFACE_OBJREF(mc, n, mathml_dom::MathMLContainer);
+    DECLARE_QUERY_INTERFACE_OBJREF(el, n, dom::Element);
+    if (mc == NULL || el == NULL)
+      continue;
+    RETURN_INTO_WSTRING(ln, el->localName());
+    if (ln == aName && mc->nArguments() >= 1)
+      return already_AddRefd<iface::mathml_dom::MathMLElement>
+        (mc->getArgument(1));
+  }
+
+  return NULL;
+}
+
+static already_AddRefd<iface::cellml_api::CellMLVariable>
+FindCiVariable(iface::mathml_dom::MathMLElement* aCi,
+               iface::cellml_api::CellMLComponent* aContext)
+{
+  DECLARE_QUERY_INTERFACE_OBJREF(ci, aCi, mathml_dom::MathMLCiElement);
+  if (ci == NULL)
+    throw NotDifferentiableError();
+
+  RETURN_INTO_OBJREF(n, iface::dom::Node, ci->firstChild());
+  DECLARE_QUERY_INTERFACE_OBJREF(tn, n, dom::Text);
+  if (tn == NULL)
+    throw NotDifferentiableError();
+
+  RETURN_INTO_WSTRING(txt, tn->data());
+  size_t first = txt.find_first_not_of(L" \t\r\n"),
+    last = txt.find_last_not_of(L" \t\r\n");
+  if (first == std::wstring::npos)
+    throw NotDifferentiableError();
+
+  RETURN_INTO_OBJREF(vs, iface::cellml_api::CellMLVariableSet,
+                     aContext->variables());
+  return vs->getVariable(txt.substr(first, last - first + 1));
+}
+
+double
+CodeGenerationState::UnitsConversionFactor
+(
+ iface::cellml_api::CellMLVariable* aFrom,
+ iface::cellml_api::CellMLVariable* aTo
+)
+{
+  if (aFrom == NULL || aTo == NULL)
+    return 1.0;
+
+  RETURN_INTO_WSTRING(unFrom, aFrom->unitsName());
+  RETURN_INTO_OBJREF(compFrom, iface::cellml_api::CellMLElement,
+                     aFrom->parentElement());
+  RETURN_INTO_OBJREF(curFrom, iface::cellml_services::CanonicalUnitRepresentation,
+                     mCUSES->getUnitsByName(compFrom, unFrom.c_str()));
+  RETURN_INTO_WSTRING(unTo, aTo->unitsName());
+  RETURN_INTO_OBJREF(compTo, iface::cellml_api::CellMLElement,
+                     aTo->parentElement());
+  RETURN_INTO_OBJREF(curTo, iface::cellml_services::CanonicalUnitRepresentation,
+                     mCUSES->getUnitsByName(compTo, unTo.c_str()));
+
+  // MaLaES will already have reported any problems with the units...
+  if (curFrom == NULL || curTo == NULL || !curFrom->compatibleWith(curTo))
+    return 1.0;
+
+  double offset;
+  return curFrom->convertUnits(curTo, &offset);
+}
+
+std::wstring
+CodeGenerationState::JacobianExpression
+(
+ iface::mathml_dom::MathMLElement* aExpr,
+ iface::cellml_api::CellMLComponent* aContext
+)
+{
+  RETURN_INTO_OBJREF(mr, iface::cellml_services::MaLaESResult,
+                     mTransform->transform(mCeVAS, mCUSES, mAnnoSet, aExpr,
+                                           aContext, NULL, NULL, 0));
+  RETURN_INTO_WSTRING(compErr, mr->compileErrors());
+  if (compErr != L"" || mr->supplementariesLength() != 0)
+    throw NotDifferentiableError();
+
+  RETURN_INTO_WSTRING(expr, mr->expression());
+  return expr;
+}
+
+std::wstring
+CodeGenerationState::NewJacobianTemporary()
+{
+  std::wstring name;
+  GenerateVariableName(name, mTemporaryVariablePattern,
+                       mNextJacobianTemporary++);
+
+  std::wstring decl(mDeclareTemporaryPattern);
+  size_t cursor = decl.find(L'%');
+  if (cursor != std::wstring::npos)
+    decl.replace(cursor, 1, name);
+  mJacobianDeclarations += decl;
+
+  return name;
+}
+
+void
+CodeGenerationState::AppendJacobianEntry
+(
+ std::wstring& aCodeTo,
+ uint32_t aRow,
+ uint32_t aColumn,
+ const std::wstring& aValue,
+ const std::wstring& aXMLId
+)
+{
+  // Scoped locale change.
+  CNumericLocale locobj;
+
+  std::wstring lhs;
+  wchar_t buf[30];
+  for (size_t i = 0; i < mJacobianEntryPattern.size();)
+  {
+    if (mJacobianEntryPattern.compare(i, 5, L"<ROW>") == 0)
+    {
+      any_swprintf(buf, 30, L"%lu", aRow);
+      lhs += buf;
+      i += 5;
+    }
+    else if (mJacobianEntryPattern.compare(i, 8, L"<COLUMN>") == 0)
+    {
+      any_swprintf(buf, 30, L"%lu", aColumn);
+      lhs += buf;
+      i += 8;
+    }
+    else
+      lhs += mJacobianEntryPattern[i++];
+  }
+
+  AppendAssign(aCodeTo, lhs, aValue, aXMLId);
+}
+
+void
+CodeGenerationState::AssignJacobianTemporaries
+(
+ std::wstring& aCodeTo,
+ std::map<uint32_t, std::wstring>& aTemps,
+ SparseDerivative& aDeriv,
+ iface::cellml_api::CellMLComponent* aContext,
+ const std::wstring& aXMLId
+)
+{
+  for (SparseDerivative::iterator i = aDeriv.begin(); i != aDeriv.end(); i++)
+  {
+    std::wstring name(NewJacobianTemporary());
+    AppendAssign(aCodeTo, name, JacobianExpression((*i).second, aContext),
+                 aXMLId);
+    aTemps[(*i).first] = name;
+  }
+}
+
+void
+CodeGenerationState::DifferentiateVariable
+(
+ iface::mathml_dom::MathMLElement* aExpr,
+ iface::cellml_api::CellMLComponent* aContext,
+ SparseDerivative& aResult
+)
+{
+  RETURN_INTO_OBJREF(mr, iface::cellml_services::MaLaESResult,
+                     mTransform->transform(mCeVAS, mCUSES, mAnnoSet, aExpr,
+                                           aContext, NULL, NULL, 0));
+  RETURN_INTO_OBJREF(dvi, iface::cellml_services::DegreeVariableIterator,
+                     mr->iterateInvolvedVariablesByDegree());
+  RETURN_INTO_OBJREF(dv, iface::cellml_services::DegreeVariable,
+                     dvi->nextDegreeVariable());
+  if (dv == NULL || dv->appearedInfinitesimallyDelayed())
+    throw NotDifferentiableError();
+
+  RETURN_INTO_OBJREF(sv, iface::cellml_api::CellMLVariable, dv->variable());
+  uint32_t degree = dv->degree();
+
+  std::map<iface::cellml_api::CellMLVariable*, ptr_tag<CDA_ComputationTarget> >
+    ::iterator mi = mTargetsBySource.find(sv);
+  if (mi == mTargetsBySource.end() || mLocallyBoundTargs.count((*mi).second))
+    throw NotDifferentiableError();
+
+  ptr_tag<CDA_ComputationTarget> targ(GetTargetOfDegree((*mi).second, degree));
+
+  // Work out the units conversion MaLaES applies to this reference...
+  double factor;
+  if (degree == 0)
+  {
+    RETURN_INTO_OBJREF(lv, iface::cellml_api::CellMLVariable,
+                       FindCiVariable(aExpr, aContext));
+    factor = UnitsConversionFactor(sv, lv);
+  }
+  else
+  {
+    DECLARE_QUERY_INTERFACE_OBJREF(apply, aExpr, mathml_dom::MathMLApplyElement);
+    if (apply == NULL || apply->nArguments() < 2 ||
+        apply->nBoundVariables() < 1)
+      throw NotDifferentiableError();
+
+    RETURN_INTO_OBJREF(ci, iface::mathml_dom::MathMLElement,
+                       apply->getArgument(2));
+    RETURN_INTO_OBJREF(lv, iface::cellml_api::CellMLVariable,
+                       FindCiVariable(ci, aContext));
+    factor = UnitsConversionFactor(sv, lv);
+
+    RETURN_INTO_OBJREF(bvar, iface::mathml_dom::MathMLBvarElement,
+                       apply->getBoundVariable(1));
+    RETURN_INTO_OBJREF(bci, iface::mathml_dom::MathMLElement,
+                       bvar->getArgument(1));
+    RETURN_INTO_OBJREF(lbv, iface::cellml_api::CellMLVariable,
+                       FindCiVariable(bci, aContext));
+    if (lbv == NULL)
+      throw NotDifferentiableError();
+    RETURN_INTO_OBJREF(bcvs, iface::cellml_services::ConnectedVariableSet,
+                       mCeVAS->findVariableSet(lbv));
+    RETURN_INTO_OBJREF(sbv, iface::cellml_api::CellMLVariable,
+                       bcvs->sourceVariable());
+    factor /= pow(UnitsConversionFactor(sbv, lbv), (double)degree);
+  }
+
+  RETURN_INTO_OBJREF(doc, iface::dom::Document, aExpr->ownerDocument());
+  MathRef factorEl(MakeNumber(doc, factor));
+
+  std::map<ptr_tag<CDA_ComputationTarget>, std::map<uint32_t, std::wstring> >
+    ::iterator ti = mJacobianTemporaries.find(targ);
+  if (ti != mJacobianTemporaries.end())
+  {
+    // A variable we have already differentiated; chain through its partial
+    // derivatives...
+    for (std::map<uint32_t, std::wstring>::iterator i = (*ti).second.begin();
+         i != (*ti).second.end(); i++)
+    {
+      MathRef pt(MakePassthrough(doc, mTransform->wrapNumber((*i).second)));
+      aResult[(*i).first] = MakeTimes(doc, factorEl, pt);
+    }
+  }
+  else if (mIDAStyle && targ->mDegree != 0 && targ->mUpDegree == NULL)
+  {
+    // A rate in a residual; dRATES/dSTATES is the rate coefficient...
+    MathRef pt(MakePassthrough(doc,
+                               mTransform->wrapNumber(mJacobianRateCoefficientName)));
+    aResult[targ->mAssignedIndex] = MakeTimes(doc, factorEl, pt);
+  }
+  else if (targ->mEvaluationType == iface::cellml_services::STATE_VARIABLE ||
+           targ->mEvaluationType == iface::cellml_services::PSEUDOSTATE_VARIABLE)
+  {
+    if (mJacobianColumns == NULL ||
+        mJacobianColumns->count(targ->mAssignedIndex) != 0)
+      aResult[targ->mAssignedIndex] = factorEl;
+  }
+  else if (targ->mEvaluationType != iface::cellml_services::CONSTANT &&
+           targ->mEvaluationType != iface::cellml_services::VARIABLE_OF_INTEGRATION)
+    throw NotDifferentiableError();
+}
+
+void
+CodeGenerationState::Differentiate
+(
+ iface::mathml_dom::MathMLElement* aExpr,
+ iface::cellml_api::CellMLComponent* aContext,
+ SparseDerivative& aResult
+)
+{
+  // Lookups are differentiated exactly, through what they replaced.
+  std::map<iface::mathml_dom::MathMLElement*, MathRef>::iterator li =
+    mReplacedSubexpressions.find(aExpr);
+  if (li != mReplacedSubexpressions.end())
+  {
+    Differentiate((*li).second, aContext, aResult);
+    return;
+  }
+
+  DECLARE_QUERY_INTERFACE_OBJREF(ci, aExpr, mathml_dom::MathMLCiElement);
+  if (ci != NULL)
+  {
+    DifferentiateVariable(aExpr, aContext, aResult);
+    return;
+  }
+
+  DECLARE_QUERY_INTERFACE_OBJREF(cn, aExpr, mathml_dom::MathMLCnElement);
+  if (cn != NULL)
+    return;
+
+  DECLARE_QUERY_INTERFACE_OBJREF(apply, aExpr, mathml_dom::MathMLApplyElement);
+  if (apply != NULL)
+  {
+    DifferentiateApply(apply, aContext, aResult);
+    return;
+  }
+
+  DECLARE_QUERY_INTERFACE_OBJREF(pw, aExpr, mathml_dom::MathMLPiecewiseElement);
+  if (pw != NULL)
+  {
+    RETURN_INTO_OBJREF(doc, iface::dom::Document, aExpr->ownerDocument());
+    std::list<std::pair<SparseDerivative, MathRef> > cases;
+
+    RETURN_INTO_OBJREF(pnl, iface::mathml_dom::MathMLNodeList, pw->pieces());
+    for (uint32_t i = 1, l = pnl->length(); i <= l; i++)
+    {
+      RETURN_INTO_OBJREF(val, iface::mathml_dom::MathMLContentElement,
+                         pw->getCaseValue(i));
+      RETURN_INTO_OBJREF(cond, iface::mathml_dom::MathMLContentElement,
+                         pw->getCaseCondition(i));
+      cases.push_back(std::pair<SparseDerivative, MathRef>
+                      (SparseDerivative(), MathRef(cond)));
+      Differentiate(val, aContext, cases.back().first);
+    }
+
+    ObjRef<iface::mathml_dom::MathMLContentElement> otherwise;
+    try
+    {
+      otherwise = already_AddRefd<iface::mathml_dom::MathMLContentElement>
+        (pw->otherwise());
+    }
+    catch (...)
+    {
+    }
+
+    SparseDerivative dotherwise;
+    if (otherwise != NULL)
+      Differentiate(otherwise, aContext, dotherwise);
+
+    MakePiecewiseDerivative(doc, cases,
+                            otherwise == NULL ? NULL : &dotherwise, aResult);
+    return;
+  }
+
+  // Predefined constants such as pi have a zero derivative...
+  DECLARE_QUERY_INTERFACE_OBJREF(csym, aExpr, mathml_dom::MathMLCsymbolElement);
+  DECLARE_QUERY_INTERFACE_OBJREF(pds, aExpr, mathml_dom::MathMLPredefinedSymbol);
+  if (csym == NULL && pds != NULL)
+    return;
+
+  throw NotDifferentiableError();
+}
+
+void
+CodeGenerationState::DifferentiateApply
+(
+ iface::mathml_dom::MathMLApplyElement* aApply,
+ iface::cellml_api::CellMLComponent* aContext,
+ SparseDerivative& aResult
+)
+{
+  RETURN_INTO_OBJREF(op, iface::mathml_dom::MathMLElement,
+                     aApply->_cxx_operator());
+  DECLARE_QUERY_INTERFACE_OBJREF(csym, op, mathml_dom::MathMLCsymbolElement);
+  if (csym != NULL)
+    throw NotDifferentiableError();
+
+  RETURN_INTO_WSTRING(opName, op->localName());
+  if (opName == L"diff")
+  {
+    DifferentiateVariable(aApply, aContext, aResult);
+    return;
+  }
+
+  // Operators which are piecewise constant, or which produce booleans...
+  if (opName == L"floor" || opName == L"ceiling" || opName == L"rem" ||
+      opName == L"quotient" || opName == L"factorial" || opName == L"gcd" ||
+      opName == L"lcm" || opName == L"eq" || opName == L"neq" ||
+      opName == L"gt" || opName == L"lt" || opName == L"geq" ||
+      opName == L"leq" || opName == L"and" || opName == L"or" ||
+      opName == L"xor" || opName == L"not" || opName == L"implies")
+    return;
+
+  // Anything binding variables (int, sum, product, ...) is not supported.
+  if (aApply->nBoundVariables() != 0)
+    throw NotDifferentiableError();
+
+  RETURN_INTO_OBJREF(doc, iface::dom::Document, aApply->ownerDocument());
+
+  std::vector<MathRef> args;
+  for (uint32_t i = 2, l = aApply->nArguments(); i <= l; i++)
+    args.push_back(already_AddRefd<iface::mathml_dom::MathMLElement>
+                   (aApply->getArgument(i)));
+  if (args.empty())
+    throw NotDifferentiableError();
+
+  if (opName == L"plus")
+  {
+    for (std::vector<MathRef>::iterator i = args.begin(); i != args.end(); i++)
+    {
+      SparseDerivative d;
+      Differentiate(*i, aContext, d);
+      AddScaled(doc, aResult, d, NULL);
+    }
+    return;
+  }
+
+  if (opName == L"times")
+  {
+    for (uint32_t i = 0; i < args.size(); i++)
+    {
+      SparseDerivative d;
+      Differentiate(args[i], aContext, d);
+      if (d.empty())
+        continue;
+
+      MathRef others;
+      for (uint32_t j = 0; j < args.size(); j++)
+        if (j != i)
+          others = (others == NULL) ? args[j] : MakeTimes(doc, others, args[j]);
+      AddScaled(doc, aResult, d, others);
+    }
+    return;
+  }
+
+  if (opName == L"min" || opName == L"max")
+  {
+    // The derivative of whichever argument is selected...
+    const wchar_t* rel = (opName == L"max") ? L"geq" : L"leq";
+    std::list<std::pair<SparseDerivative, MathRef> > cases;
+    for (uint32_t i = 0; i + 1 < args.size(); i++)
+    {
+      MathRef cond;
+      for (uint32_t j = 0; j < args.size(); j++)
+      {
+        if (j == i)
+          continue;
+        MathRef c(MakeApply(doc, rel, args[i], args[j]));
+        cond = (cond == NULL) ? c : MakeApply(doc, L"and", cond, c);
+      }
+      cases.push_back(std::pair<SparseDerivative, MathRef>
+                      (SparseDerivative(), cond));
+      Differentiate(args[i], aContext, cases.back().first);
+    }
+
+    SparseDerivative last;
+    Differentiate(args.back(), aContext, last);
+    if (cases.empty())
+      aResult = last;
+    else
+      MakePiecewiseDerivative(doc, cases, &last, aResult);
+    return;
+  }
+
+  SparseDerivative da;
+  Differentiate(args[0], aContext, da);
+  MathRef a(args[0]);
+
+  if (opName == L"minus")
+  {
+    if (args.size() == 1)
+    {
+      AddScaled(doc, aResult, da, NULL, true);
+      return;
+    }
+    if (args.size() != 2)
+      throw NotDifferentiableError();
+
+    SparseDerivative db;
+    Differentiate(args[1], aContext, db);
+    AddScaled(doc, aResult, da, NULL);
+    AddScaled(doc, aResult, db, NULL, true);
+    return;
+  }
+
+  if (opName == L"divide" || opName == L"power")
+  {
+    if (args.size() != 2)
+      throw NotDifferentiableError();
+
+    MathRef b(args[1]);
+    SparseDerivative db;
+    Differentiate(b, aContext, db);
+
+    if (opName == L"divide")
+    {
+      // d(a/b) = da / b - a db / b^2
+      if (!da.empty())
+      {
+        MathRef factor(MakeReciprocal(doc, b));
+        AddScaled(doc, aResult, da, factor);
+      }
+      if (!db.empty())
+      {
+        MathRef factor(MakeApply(doc, L"divide", a, MakeSquare(doc, b)));
+        AddScaled(doc, aResult, db, factor, true);
+      }
+      return;
+    }
+
+    // d(a^b) = b a^(b - 1) da + a^b ln(a) db
+    if (!da.empty())
+    {
+      double bv;
+      MathRef exponent;
+      if (GetNumber(b, bv))
+        exponent = MakeNumber(doc, bv - 1.0);
+      else
+      {
+        MathRef one(MakeNumber(doc, 1.0));
+        exponent = MakeApply(doc, L"minus", b, one);
+      }
+
+      MathRef power(IsNumber(exponent, 1.0) ? a :
+                    MakeApply(doc, L"power", a, exponent));
+      MathRef factor(MakeTimes(doc, b, power));
+      AddScaled(doc, aResult, da, factor);
+    }
+    if (!db.empty())
+    {
+      MathRef factor(MakeTimes(doc, aApply, MakeApply(doc, L"ln", a)));
+      AddScaled(doc, aResult, db, factor);
+    }
+    return;
+  }
+
+  // Everything else is a function of one argument, so the result is
+  // f'(a) da...
+  if (args.size() != 1)
+    throw NotDifferentiableError();
+  if (da.empty())
+    return;
+
+  MathRef factor;
+  if (opName == L"root")
+  {
+    // d(a^(1/n)) = a^(1/n) / (n a) da
+    MathRef degree(FindQualifier(aApply, L"degree"));
+    if (degree == NULL)
+      degree = MakeNumber(doc, 2.0);
+    factor = MakeApply(doc, L"divide", aApply, MakeTimes(doc, degree, a));
+  }
+  else if (opName == L"exp")
+    factor = aApply;
+  else if (opName == L"ln")
+    factor = MakeReciprocal(doc, a);
+  else if (opName == L"log")
+  {
+    MathRef base(FindQualifier(aApply, L"logbase"));
+    if (base == NULL)
+      base = MakeNumber(doc, 10.0);
+    factor = MakeReciprocal(doc, MakeTimes(doc, a, MakeApply(doc, L"ln", base)));
+  }
+  else if (opName == L"abs")
+  {
+    std::list<std::pair<MathRef, MathRef> > pieces;
+    MathRef zero(MakeNumber(doc, 0.0));
+    pieces.push_back(std::pair<MathRef, MathRef>
+                     (MakeNumber(doc, -1.0), MakeApply(doc, L"lt", a, zero)));
+    MathRef one(MakeNumber(doc, 1.0));
+    factor = MakePiecewise(doc, pieces, one);
+  }
+  else if (opName == L"sin")
+    factor = MakeApply(doc, L"cos", a);
+  else if (opName == L"cos")
+    factor = MakeApply(doc, L"minus", MakeApply(doc, L"sin", a));
+  else if (opName == L"tan")
+    factor = MakeReciprocal(doc, MakeSquare(doc, MakeApply(doc, L"cos", a)));
+  else if (opName == L"sec")
+    factor = MakeTimes(doc, aApply, MakeApply(doc, L"tan", a));
+  else if (opName == L"csc")
+    factor = MakeApply(doc, L"minus",
+                       MakeTimes(doc, aApply, MakeApply(doc, L"cot", a)));
+  else if (opName == L"cot")
+    factor = MakeApply(doc, L"minus",
+                       MakeReciprocal(doc, MakeSquare(doc, MakeApply(doc, L"sin", a))));
+  else if (opName == L"sinh")
+    factor = MakeApply(doc, L"cosh", a);
+  else if (opName == L"cosh")
+    factor = MakeApply(doc, L"sinh", a);
+  else if (opName == L"tanh")
+    factor = MakeReciprocal(doc, MakeSquare(doc, MakeApply(doc, L"cosh", a)));
+  else if (opName == L"sech")
+    factor = MakeApply(doc, L"minus",
+                       MakeTimes(doc, aApply, MakeApply(doc, L"tanh", a)));
+  else if (opName == L"csch")
+    factor = MakeApply(doc, L"minus",
+                       MakeTimes(doc, aApply, MakeApply(doc, L"coth", a)));
+  else if (opName == L"coth")
+    factor = MakeApply(doc, L"minus",
+                       MakeReciprocal(doc, MakeSquare(doc, MakeApply(doc, L"sinh", a))));
+  else if (opName == L"arcsin" || opName == L"arccos")
+  {
+    MathRef one(MakeNumber(doc, 1.0));
+    factor = MakeReciprocal(doc, MakeApply(doc, L"root",
+                                           MakeApply(doc, L"minus", one,
+                                                     MakeSquare(doc, a))));
+    if (opName == L"arccos")
+      factor = MakeApply(doc, L"minus", factor);
+  }
+  else if (opName == L"arctan")
+  {
+    MathRef one(MakeNumber(doc, 1.0));
+    factor = MakeReciprocal(doc, MakeApply(doc, L"plus", one, MakeSquare(doc, a)));
+  }
+  else if (opName == L"arcsinh")
+  {
+    MathRef one(MakeNumber(doc, 1.0));
+    factor = MakeReciprocal(doc, MakeApply(doc, L"root",
+                                           MakeApply(doc, L"plus",
+                                                     MakeSquare(doc, a), one)));
+  }
+  else if (opName == L"arccosh")
+  {
+    MathRef one(MakeNumber(doc, 1.0));
+    factor = MakeReciprocal(doc, MakeApply(doc, L"root",
+                                           MakeApply(doc, L"minus",
+                                                     MakeSquare(doc, a), one)));
+  }
+  else if (opName == L"arctanh")
+  {
+    MathRef one(MakeNumber(doc, 1.0));
+    factor = MakeReciprocal(doc, MakeApply(doc, L"minus", one, MakeSquare(doc, a)));
+  }
+  else
+    throw NotDifferentiableError();
+
+  AddScaled(doc, aResult, da, factor);
+}
+
+void
+CodeGenerationState::DifferentiateAssignment
+(
+ Equation* aEq,
+ ptr_tag<CDA_ComputationTarget> aTarget,
+ SparseDerivative& aResult
+)
+{
+  if (aEq->mLHS == NULL)
+    throw NotDifferentiableError();
+
+  Differentiate(aEq->mRHS, aEq->mContext, aResult);
+
+  // Apply the same units conversion as GenerateCodeForEquation does when
+  // assigning to the target...
+  RETURN_INTO_OBJREF(localVar, iface::cellml_api::CellMLVariable,
+                     GetVariableInComponent(aEq->mContext, aTarget->mVariable));
+  double factor = UnitsConversionFactor(localVar, aTarget->mVariable);
+
+  if (aTarget->mDegree != 0 && mBoundTargs.begin() != mBoundTargs.end())
+  {
+    iface::cellml_api::CellMLVariable* bound = (*mBoundTargs.begin())->mVariable;
+    RETURN_INTO_OBJREF(localBound, iface::cellml_api::CellMLVariable,
+                       GetVariableInComponent(aEq->mContext, bound));
+    factor /= pow(UnitsConversionFactor(localBound, bound),
+                  (double)aTarget->mDegree);
+  }
+
+  RETURN_INTO_OBJREF(doc, iface::dom::Document, aEq->mRHS->ownerDocument());
+  ScaleDerivative(doc, aResult, factor);
+}
+
+void
+CodeGenerationState::GenerateJacobianForSystem
+(
+ std::wstring& aCodeTo,
+ System* aSys
+)
+{
+  // Systems which have to be solved numerically are not differentiated.
+  if (aSys->mMathStatements.size() != 1)
+    throw NotDifferentiableError();
+
+  MathStatement* ms = *(aSys->mMathStatements.begin());
+  ptr_tag<CDA_ComputationTarget> target = *(aSys->mUnknowns.begin());
+  if (ms->mInvolvesDelays || target->mIsReset)
+    throw NotDifferentiableError();
+
+  std::map<uint32_t, std::wstring>& temps = mJacobianTemporaries[target];
+
+  if (ms->mType == MathStatement::EQUATION)
+  {
+    Equation* eq = static_cast<Equation*>(ms);
+    SparseDerivative d;
+    DifferentiateAssignment(eq, target, d);
+    AssignJacobianTemporaries(aCodeTo, temps, d, eq->mContext,
+                              describeMaths(eq));
+  }
+  else if (ms->mType == MathStatement::PIECEWISE)
+  {
+    Piecewise* pw = static_cast<Piecewise*>(ms);
+    std::list<std::pair<ptr_tag<Equation>, ptr_tag<MathMLMathStatement> > >::iterator i;
+    std::list<SparseDerivative> derivs;
+    for (i = pw->mPieces.begin(); i != pw->mPieces.end(); i++)
+    {
+      derivs.push_back(SparseDerivative());
+      DifferentiateAssignment((*i).first, target, derivs.back());
+      for (SparseDerivative::iterator j = derivs.back().begin();
+           j != derivs.back().end(); j++)
+        if (temps.count((*j).first) == 0)
+        {
+          temps[(*j).first] = NewJacobianTemporary();
+          AppendAssign(aCodeTo, temps[(*j).first],
+                       mTransform->wrapNumber(L"0.0"), describeMaths(pw));
+        }
+    }
+
+    if (temps.empty())
+      return;
+
+    std::list<std::pair<std::wstring, std::wstring> > cases;
+    std::list<SparseDerivative>::iterator d = derivs.begin();
+    for (i = pw->mPieces.begin(); i != pw->mPieces.end(); i++, d++)
+    {
+      std::wstring statement;
+      for (SparseDerivative::iterator j = (*d).begin(); j != (*d).end(); j++)
+        AppendAssign(statement, temps[(*j).first],
+                     JacobianExpression((*j).second, pw->mContext),
+                     describeMaths((*i).first));
+
+      cases.push_back(std::pair<std::wstring, std::wstring>
+                      (statement,
+                       JacobianExpression((*i).second->mMaths, pw->mContext)));
+    }
+    GenerateCasesIntoTemplate(aCodeTo, cases);
+  }
+  else
+    throw NotDifferentiableError();
+}
+
+void
+CodeGenerationState::GenerateRatesJacobian(std::list<System*>& aRateOrder)
+{
+  // The rates depend on past values of infinitesimally delayed variables...
+  if (!mDelayedTargs.empty())
+    return;
+
+  std::wstring code;
+  try
+  {
+    for (std::list<System*>::iterator i = aRateOrder.begin();
+         i != aRateOrder.end(); i++)
+    {
+      GenerateJacobianForSystem(code, *i);
+
+      ptr_tag<CDA_ComputationTarget> ct = *((*i)->mUnknowns.begin());
+      if (ct->mDegree == 0)
+        continue;
+
+      std::map<uint32_t, std::wstring>& temps = mJacobianTemporaries[ct];
+      for (std::map<uint32_t, std::wstring>::iterator j = temps.begin();
+           j != temps.end(); j++)
+        AppendJacobianEntry(code, ct->mAssignedIndex, (*j).first,
+                            mTransform->wrapNumber((*j).second),
+                            ct->mVariable->name());
+    }
+
+    // Rates which are copied from state variables (see
+    // GenerateStateToRateCascades)...
+    for (std::list<ptr_tag<CDA_ComputationTarget> >::iterator i =
+           mBaseTargets.begin(); i != mBaseTargets.end(); i++)
+    {
+      ptr_tag<CDA_ComputationTarget> ct = (*i)->mUpDegree;
+      if (ct == NULL)
+        continue;
+
+      for (; ct->mUpDegree != NULL; ct = ct->mUpDegree)
+        AppendJacobianEntry(code, ct->mAssignedIndex - 1, ct->mAssignedIndex,
+                            mTransform->wrapNumber(L"1.0"),
+                            ct->mVariable->name());
+    }
+
+    if (code != L"")
+      mCodeInfo->mJacobianStr = mJacobianDeclarations + code;
+  }
+  catch (NotDifferentiableError&)
+  {
+    // Leave the Jacobian string empty, so it is approximated numerically.
+  }
+
+  mJacobianTemporaries.clear();
+  mJacobianDeclarations = L"";
+}
+
+ptr_tag<CDA_ComputationTarget>
+CodeGenerationState::FindReferencedTarget
+(
+ iface::mathml_dom::MathMLElement* aExpr,
+ iface::cellml_api::CellMLComponent* aContext
+)
+{
+  RETURN_INTO_OBJREF(mr, iface::cellml_services::MaLaESResult,
+                     mTransform->transform(mCeVAS, mCUSES, mAnnoSet, aExpr,
+                                           aContext, NULL, NULL, 0));
+  RETURN_INTO_OBJREF(dvi, iface::cellml_services::DegreeVariableIterator,
+                     mr->iterateInvolvedVariablesByDegree());
+  RETURN_INTO_OBJREF(dv, iface::cellml_services::DegreeVariable,
+                     dvi->nextDegreeVariable());
+  if (dv == NULL || dv->appearedInfinitesimallyDelayed())
+    throw NotDifferentiableError();
+
+  RETURN_INTO_OBJREF(sv, iface::cellml_api::CellMLVariable, dv->variable());
+  std::map<iface::cellml_api::CellMLVariable*, ptr_tag<CDA_ComputationTarget> >
+    ::iterator mi = mTargetsBySource.find(sv);
+  if (mi == mTargetsBySource.end() || mLocallyBoundTargs.count((*mi).second))
+    throw NotDifferentiableError();
+
+  return GetTargetOfDegree((*mi).second, dv->degree());
+}
+
+static void
+MergeLinearity(StateLinearity& aInto, const StateLinearity& aFrom)
+{
+  aInto.mDependencies.insert(aFrom.mDependencies.begin(),
+                             aFrom.mDependencies.end());
+  aInto.mNonlinear.insert(aFrom.mNonlinear.begin(), aFrom.mNonlinear.end());
+}
+
+void
+CodeGenerationState::FindLinearity
+(
+ iface::mathml_dom::MathMLElement* aExpr,
+ iface::cellml_api::CellMLComponent* aContext,
+ std::map<CDA_ComputationTarget*, StateLinearity>& aTargets,
+ StateLinearity& aResult
+)
+{
+  std::map<iface::mathml_dom::MathMLElement*, MathRef>::iterator li =
+    mReplacedSubexpressions.find(aExpr);
+  if (li != mReplacedSubexpressions.end())
+  {
+    FindLinearity((*li).second, aContext, aTargets, aResult);
+    return;
+  }
+
+  DECLARE_QUERY_INTERFACE_OBJREF(ci, aExpr, mathml_dom::MathMLCiElement);
+  DECLARE_QUERY_INTERFACE_OBJREF(apply, aExpr, mathml_dom::MathMLApplyElement);
+  std::wstring opName;
+  if (apply != NULL)
+  {
+    RETURN_INTO_OBJREF(op, iface::mathml_dom::MathMLElement,
+                       apply->_cxx_operator());
+    DECLARE_QUERY_INTERFACE_OBJREF(csym, op, mathml_dom::MathMLCsymbolElement);
+    if (csym != NULL)
+      throw NotDifferentiableError();
+    opName = op->localName();
+  }
+
+  if (ci != NULL || opName == L"diff")
+  {
+    ptr_tag<CDA_ComputationTarget> targ(FindReferencedTarget(aExpr, aContext));
+    std::map<CDA_ComputationTarget*, StateLinearity>::iterator i =
+      aTargets.find(targ);
+    if (i != aTargets.end())
+      aResult = (*i).second;
+    else if (targ->mEvaluationType == iface::cellml_services::STATE_VARIABLE ||
+             targ->mEvaluationType ==
+               iface::cellml_services::PSEUDOSTATE_VARIABLE)
+      aResult.mDependencies.insert(targ->mAssignedIndex);
+    else if (targ->mEvaluationType != iface::cellml_services::CONSTANT &&
+             targ->mEvaluationType !=
+               iface::cellml_services::VARIABLE_OF_INTEGRATION)
+      throw NotDifferentiableError();
+    return;
+  }
+
+  DECLARE_QUERY_INTERFACE_OBJREF(cn, aExpr, mathml_dom::MathMLCnElement);
+  if (cn != NULL)
+    return;
+
+  DECLARE_QUERY_INTERFACE_OBJREF(pw, aExpr, mathml_dom::MathMLPiecewiseElement);
+  if (pw != NULL)
+  {
+    // The conditions are fixed between the solver switching them, so only
+    // the values matter...
+    RETURN_INTO_OBJREF(pnl, iface::mathml_dom::MathMLNodeList, pw->pieces());
+    for (uint32_t i = 1, l = pnl->length(); i <= l; i++)
+    {
+      RETURN_INTO_OBJREF(val, iface::mathml_dom::MathMLContentElement,
+                         pw->getCaseValue(i));
+      StateLinearity piece;
+      FindLinearity(val, aContext, aTargets, piece);
+      MergeLinearity(aResult, piece);
+    }
+
+    ObjRef<iface::mathml_dom::MathMLContentElement> otherwise;
+    try
+    {
+      otherwise = already_AddRefd<iface::mathml_dom::MathMLContentElement>
+        (pw->otherwise());
+    }
+    catch (...)
+    {
+    }
+
+    if (otherwise != NULL)
+    {
+      StateLinearity piece;
+      FindLinearity(otherwise, aContext, aTargets, piece);
+      MergeLinearity(aResult, piece);
+    }
+    return;
+  }
+
+  if (apply == NULL)
+  {
+    DECLARE_QUERY_INTERFACE_OBJREF(csym, aExpr, mathml_dom::MathMLCsymbolElement);
+    DECLARE_QUERY_INTERFACE_OBJREF(pds, aExpr, mathml_dom::MathMLPredefinedSymbol);
+    if (csym == NULL && pds != NULL)
+      return;
+    throw NotDifferentiableError();
+  }
+
+  if (apply->nBoundVariables() != 0)
+    throw NotDifferentiableError();
+
+  std::vector<StateLinearity> args;
+  for (uint32_t i = 2, l = apply->nArguments(); i <= l; i++)
+  {
+    RETURN_INTO_OBJREF(arg, iface::mathml_dom::MathMLElement,
+                       apply->getArgument(i));
+    args.push_back(StateLinearity());
+    FindLinearity(arg, aContext, aTargets, args.back());
+  }
+
+  for (std::vector<StateLinearity>::iterator i = args.begin();
+       i != args.end(); i++)
+    aResult.mDependencies.insert((*i).mDependencies.begin(),
+                                 (*i).mDependencies.end());
+
+  if (opName == L"plus" || opName == L"minus")
+  {
+    for (std::vector<StateLinearity>::iterator i = args.begin();
+         i != args.end(); i++)
+      aResult.mNonlinear.insert((*i).mNonlinear.begin(),
+                                (*i).mNonlinear.end());
+    return;
+  }
+
+  if (opName == L"times")
+  {
+    // A product is linear in a state if only one factor depends on it, and
+    // that factor is linear in it...
+    std::set<uint32_t> seen;
+    for (std::vector<StateLinearity>::iterator i = args.begin();
+         i != args.end(); i++)
+    {
+      aResult.mNonlinear.insert((*i).mNonlinear.begin(),
+                                (*i).mNonlinear.end());
+      for (std::set<uint32_t>::iterator j = (*i).mDependencies.begin();
+           j != (*i).mDependencies.end(); j++)
+        if (!seen.insert(*j).second)
+          aResult.mNonlinear.insert(*j);
+    }
+    return;
+  }
+
+  if (opName == L"divide" && args.size() == 2)
+  {
+    aResult.mNonlinear.insert(args[0].mNonlinear.begin(),
+                              args[0].mNonlinear.end());
+    aResult.mNonlinear.insert(args[1].mDependencies.begin(),
+                              args[1].mDependencies.end());
+    return;
+  }
+
+  if (opName == L"power" && args.size() == 2)
+  {
+    RETURN_INTO_OBJREF(exponent, iface::mathml_dom::MathMLElement,
+                       apply->getArgument(3));
+    if (IsNumber(exponent, 1.0))
+    {
+      aResult.mNonlinear = args[0].mNonlinear;
+      return;
+    }
+  }
+
+  // Anything else is only linear in the states it doesn't depend on.
+  aResult.mNonlinear = aResult.mDependencies;
+}
+
+void
+CodeGenerationState::GenerateLinearCoefficients
+(
+ std::list<System*>& aRateOrder
+)
+{
+  if (!mDelayedTargs.empty())
+    return;
+
+  std::wstring code;
+  try
+  {
+    // Find the state variables whose rates are linear in themselves...
+    std::map<CDA_ComputationTarget*, StateLinearity> linearity;
+    std::set<uint32_t> linear;
+    for (std::list<System*>::iterator i = aRateOrder.begin();
+         i != aRateOrder.end(); i++)
+    {
+      System* sys = *i;
+      if (sys->mMathStatements.size() != 1)
+        throw NotDifferentiableError();
+
+      MathStatement* ms = *(sys->mMathStatements.begin());
+      ptr_tag<CDA_ComputationTarget> target = *(sys->mUnknowns.begin());
+      if (ms->mInvolvesDelays || target->mIsReset)
+        throw NotDifferentiableError();
+
+      std::list<Equation*> eqs;
+      if (ms->mType == MathStatement::EQUATION)
+        eqs.push_back(static_cast<Equation*>(ms));
+      else if (ms->mType == MathStatement::PIECEWISE)
+      {
+        Piecewise* pw = static_cast<Piecewise*>(ms);
+        for (std::list<std::pair<ptr_tag<Equation>, ptr_tag<MathMLMathStatement> > >
+               ::iterator j = pw->mPieces.begin(); j != pw->mPieces.end(); j++)
+          eqs.push_back((*j).first);
+      }
+      else
+        throw NotDifferentiableError();
+
+      StateLinearity& l = linearity[target];
+      for (std::list<Equation*>::iterator j = eqs.begin(); j != eqs.end(); j++)
+      {
+        if ((*j)->mLHS == NULL)
+          throw NotDifferentiableError();
+        StateLinearity piece;
+        FindLinearity((*j)->mRHS, (*j)->mContext, linearity, piece);
+        MergeLinearity(l, piece);
+      }
+
+      if (target->mDegree != 0 &&
+          l.mNonlinear.count(target->mAssignedIndex) == 0)
+        linear.insert(target->mAssignedIndex);
+    }
+
+    // ... and differentiate their rates with respect to them, and only them.
+    mJacobianColumns = &linear;
+    if (!linear.empty())
+      for (std::list<System*>::iterator i = aRateOrder.begin();
+           i != aRateOrder.end(); i++)
+      {
+        GenerateJacobianForSystem(code, *i);
+
+        ptr_tag<CDA_ComputationTarget> ct = *((*i)->mUnknowns.begin());
+        if (ct->mDegree == 0 || linear.count(ct->mAssignedIndex) == 0)
+          continue;
+
+        std::map<uint32_t, std::wstring>& temps = mJacobianTemporaries[ct];
+        std::map<uint32_t, std::wstring>::iterator j =
+          temps.find(ct->mAssignedIndex);
+        if (j == temps.end())
+          continue;
+
+        std::wstring name;
+        GenerateVariableName(name, mLinearCoefficientPattern,
+                             ct->mAssignedIndex);
+        AppendAssign(code, name, mTransform->wrapNumber((*j).second),
+                     ct->mVariable->name());
+      }
+
+    if (code != L"")
+      mCodeInfo->mLinearCoefficientsStr = mJacobianDeclarations + code;
+  }
+  catch (NotDifferentiableError&)
+  {
+    // Leave the string empty; the solver treats every state as non-linear.
+  }
+
+  mJacobianColumns = NULL;
+  mJacobianTemporaries.clear();
+  mJacobianDeclarations = L"";
+}
+
+void
+CodeGenerationState::GenerateResidualJacobian
+(
+ std::list<System*>& aEssentialOrder
+)
+{
+  // Residuals for rates saved as constants are handled specially in
+  // GenerateResiduals, and delays depend on past values...
+  if (!mDelayedTargs.empty() || !mRateNameBackup.empty())
+    return;
+
+  std::wstring code;
+  try
+  {
+    for (std::list<System*>::iterator i = aEssentialOrder.begin();
+         i != aEssentialOrder.end(); i++)
+      GenerateJacobianForSystem(code, *i);
+
+    // This needs to number the residuals the same way GenerateResiduals
+    // does...
+    uint32_t residNumber = mArrayOffset;
+    for (std::set<ptr_tag<MathStatement> >::iterator i =
+           mUnusedMathStatements.begin();
+         i != mUnusedMathStatements.end(); i++)
+    {
+      MathStatement* ms = *i;
+      if (ms->mType != MathStatement::PIECEWISE &&
+          ms->mType != MathStatement::EQUATION)
+        continue;
+      if (ms->mInvolvesDelays)
+        throw NotDifferentiableError();
+
+      std::list<std::pair<Equation*, MathMLMathStatement*> > pieces;
+      if (ms->mType == MathStatement::PIECEWISE)
+      {
+        Piecewise* pw = static_cast<Piecewise*>(ms);
+        for (std::list<std::pair<ptr_tag<Equation>, ptr_tag<MathMLMathStatement> > >
+               ::iterator j = pw->mPieces.begin(); j != pw->mPieces.end(); j++)
+          pieces.push_back(std::pair<Equation*, MathMLMathStatement*>
+                           ((*j).first, (*j).second));
+      }
+      else
+        pieces.push_back(std::pair<Equation*, MathMLMathStatement*>
+                         (static_cast<Equation*>(ms), NULL));
+
+      std::list<std::pair<std::wstring, std::wstring> > cases;
+      bool anyEntries = false;
+      for (std::list<std::pair<Equation*, MathMLMathStatement*> >::iterator j =
+             pieces.begin(); j != pieces.end(); j++)
+      {
+        Equation* eq = (*j).first;
+        SparseDerivative d, drhs;
+        Differentiate(eq->mLHS, eq->mContext, d);
+        Differentiate(eq->mRHS, eq->mContext, drhs);
+        RETURN_INTO_OBJREF(doc, iface::dom::Document, eq->mRHS->ownerDocument());
+        AddScaled(doc, d, drhs, NULL, true);
+
+        std::wstring statement;
+        for (SparseDerivative::iterator k = d.begin(); k != d.end(); k++)
+          AppendJacobianEntry(statement, residNumber, (*k).first,
+                              JacobianExpression((*k).second, eq->mContext),
+                              describeMaths(eq));
+        anyEntries |= !d.empty();
+
+        if ((*j).second == NULL)
+          code += statement;
+        else
+          cases.push_back(std::pair<std::wstring, std::wstring>
+                          (statement,
+                           JacobianExpression((*j).second->mMaths, ms->mContext)));
+      }
+
+      if (anyEntries && !cases.empty())
+        GenerateCasesIntoTemplate(code, cases);
+      residNumber++;
+    }
+
+    if (code != L"")
+      mCodeInfo->mJacobianStr = mJacobianDeclarations + code;
+  }
+  catch (NotDifferentiableError&)
+  {
+    // Leave the Jacobian string empty, so it is approximated numerically.
+  }
+
+  mJacobianTemporaries.clear();
+  mJacobianDeclarations = L"";
+}
+
+void
+CodeGenerationState::AddTargetDependencies
+(
+ CDA_ComputationTarget* aTarget,
+ std::map<CDA_ComputationTarget*, std::set<uint32_t> >& aDeps,
+ std::set<uint32_t>& aInto
+)
+{
+  std::map<CDA_ComputationTarget*, std::set<uint32_t> >::iterator i =
+    aDeps.find(aTarget);
+  if (i != aDeps.end())
+    aInto.insert((*i).second.begin(), (*i).second.end());
+  else if (mIDAStyle && aTarget->mDegree != 0 && aTarget->mUpDegree == NULL)
+    aInto.insert(aTarget->mAssignedIndex);
+  else if (aTarget->mEvaluationType == iface::cellml_services::STATE_VARIABLE ||
+           aTarget->mEvaluationType == iface::cellml_services::PSEUDOSTATE_VARIABLE)
+    aInto.insert(aTarget->mAssignedIndex);
+}
+
+void
+CodeGenerationState::ComputeSystemDependencies
+(
+ std::list<System*>& aOrder,
+ std::map<CDA_ComputationTarget*, std::set<uint32_t> >& aDeps
+)
+{
+  for (std::list<System*>::iterator i = aOrder.begin(); i != aOrder.end(); i++)
+  {
+    System* sys = *i;
+    std::set<uint32_t> deps;
+
+    // Everything a statement mentions, other than what it computes, is an
+    // input to the system (delayed variables included, as their past values
+    // still depend on the states)...
+    for (std::set<ptr_tag<MathStatement> >::iterator j =
+           sys->mMathStatements.begin(); j != sys->mMathStatements.end(); j++)
+    {
+      for (std::list<ptr_tag<CDA_ComputationTarget> >::iterator k =
+             (*j)->mTargets.begin(); k != (*j)->mTargets.end(); k++)
+        if (sys->mUnknowns.count(*k) == 0)
+          AddTargetDependencies(*k, aDeps, deps);
+      for (std::list<ptr_tag<CDA_ComputationTarget> >::iterator k =
+             (*j)->mDelayedTargets.begin(); k != (*j)->mDelayedTargets.end(); k++)
+        if (sys->mUnknowns.count(*k) == 0)
+          AddTargetDependencies(*k, aDeps, deps);
+    }
+    for (std::set<ptr_tag<CDA_ComputationTarget> >::iterator j =
+           sys->mKnowns.begin(); j != sys->mKnowns.end(); j++)
+      AddTargetDependencies(*j, aDeps, deps);
+
+    for (std::set<ptr_tag<CDA_ComputationTarget> >::iterator j =
+           sys->mUnknowns.begin(); j != sys->mUnknowns.end(); j++)
+      aDeps[*j] = deps;
+  }
+}
+
+void
+CodeGenerationState::ComputeRateDependencies(std::list<System*>& aRateOrder)
+{
+  std::map<CDA_ComputationTarget*, std::set<uint32_t> > deps;
+  ComputeSystemDependencies(aRateOrder, deps);
+
+  for (std::map<CDA_ComputationTarget*, std::set<uint32_t> >::iterator i =
+         deps.begin(); i != deps.end(); i++)
+    if ((*i).first->mDegree != 0)
+      mCodeInfo->mRateDependencies[(*i).first->mAssignedIndex]
+        .insert((*i).second.begin(), (*i).second.end());
+
+  // Rates which are copied from state variables (see
+  // GenerateStateToRateCascades)...
+  for (std::list<ptr_tag<CDA_ComputationTarget> >::iterator i =
+         mBaseTargets.begin(); i != mBaseTargets.end(); i++)
+  {
+    ptr_tag<CDA_ComputationTarget> ct = (*i)->mUpDegree;
+    if (ct == NULL)
+      continue;
+
+    for (; ct->mUpDegree != NULL; ct = ct->mUpDegree)
+      mCodeInfo->mRateDependencies[ct->mAssignedIndex - 1]
+        .insert(ct->mAssignedIndex);
+  }
+}
+
+void
+CodeGenerationState::ComputeResidualDependencies
+(
+ std::list<System*>& aEssentialOrder
+)
+{
+  std::map<CDA_ComputationTarget*, std::set<uint32_t> > deps;
+  ComputeSystemDependencies(aEssentialOrder, deps);
+
+  // This needs to number the residuals the same way GenerateResiduals does...
+  uint32_t residNumber = mArrayOffset;
+  for (std::set<ptr_tag<MathStatement> >::iterator i =
+         mUnusedMathStatements.begin();
+       i != mUnusedMathStatements.end(); i++)
+  {
+    MathStatement* ms = *i;
+    if (ms->mType != MathStatement::PIECEWISE &&
+        ms->mType != MathStatement::EQUATION)
+      continue;
+
+    std::set<uint32_t>& row = mCodeInfo->mRateDependencies[residNumber++];
+    for (std::list<ptr_tag<CDA_ComputationTarget> >::iterator j =
+           ms->mTargets.begin(); j != ms->mTargets.end(); j++)
+      AddTargetDependencies(*j, deps, row);
+    for (std::list<ptr_tag<CDA_ComputationTarget> >::iterator j =
+           ms->mDelayedTargets.begin(); j != ms->mDelayedTargets.end(); j++)
+      AddTargetDependencies(*j, deps, row);
+  }
+
+  // Residuals equating rates with the constants they were saved into...
+  for (std::list<std::pair<ptr_tag<CDA_ComputationTarget>, std::wstring> >
+         ::iterator i = mRateNameBackup.begin(); i != mRateNameBackup.end(); i++)
+    mCodeInfo->mRateDependencies[residNumber++].insert((*i).first->mAssignedIndex);
+}
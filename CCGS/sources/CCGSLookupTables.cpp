@@ -0,0 +1,439 @@
+#define MODULE_CONTAINS_CCGS
+#include "CCGSImplementation.hpp"
+#include <map>
+#include <list>
+#include <set>
+#include <cmath>
+#include "CodeGenerationState.hxx"
+#include "CodeGenerationError.hxx"
+#include "IfaceMathML_content_APISPEC.hxx"
+
+#define MATHML_NS L"http://www.w3.org/1998/Math/MathML"
+#define PASSTHROUGH_URL L"http://www.cellml.org/tools/api#passthrough"
+
+/*
+ * Lookup tables for the expensive subexpressions of a single state variable.
+ *
+ * Subexpressions of the rates and algebraic variables which depend only on
+ * the chosen variable and constants, and which involve a transcendental
+ * function, are tabulated over the requested range when the constants are
+ * set up, and are replaced in the maths with a passthrough csymbol holding
+ * the interpolating lookup. The original subexpressions are kept, so the
+ * Jacobian and linear coefficients are still taken from the exact maths.
+ */
+
+// The largest table we are prepared to make for a single subexpression.
+#define MAXIMUM_LOOKUP_TABLE_COUNT 10000000
+
+std::wstring
+formatExactNumber(double aValue)
+{
+  // Scoped locale change.
+  CNumericLocale locobj;
+
+  wchar_t buf[40];
+  if (aValue < 0)
+    any_swprintf(buf, 40, L"(%.17g)", aValue);
+  else
+    any_swprintf(buf, 40, L"%.17g", aValue);
+  return buf;
+}
+
+static std::wstring
+FormatLookupIndex(uint32_t aValue)
+{
+  // Scoped locale change.
+  CNumericLocale locobj;
+
+  wchar_t buf[30];
+  any_swprintf(buf, 30, L"%lu", aValue);
+  return buf;
+}
+
+// Replaces each <TAG> in aPattern which is in aTags; anything else is copied.
+static std::wstring
+ReplaceLookupTags(const std::wstring& aPattern,
+                  const std::map<std::wstring, std::wstring>& aTags)
+{
+  std::wstring ret;
+  for (size_t i = 0; i < aPattern.size();)
+  {
+    if (aPattern[i] == L'<')
+    {
+      size_t end = aPattern.find(L'>', i);
+      if (end != std::wstring::npos)
+      {
+        std::map<std::wstring, std::wstring>::const_iterator t =
+          aTags.find(aPattern.substr(i + 1, end - i - 1));
+        if (t != aTags.end())
+        {
+          ret += (*t).second;
+          i = end + 1;
+          continue;
+        }
+      }
+    }
+    ret += aPattern[i++];
+  }
+
+  return ret;
+}
+
+bool
+isContinuousOperator(const std::wstring& aOp)
+{
+  return aOp == L"plus" || aOp == L"minus" || aOp == L"times" ||
+    aOp == L"divide" || aOp == L"abs" || aOp == L"min" || aOp == L"max" ||
+    aOp == L"power" || aOp == L"root" || aOp == L"exp" || aOp == L"ln" ||
+    aOp == L"log" || aOp == L"sin" || aOp == L"cos" || aOp == L"tan" ||
+    aOp == L"sec" || aOp == L"csc" || aOp == L"cot" || aOp == L"sinh" ||
+    aOp == L"cosh" || aOp == L"tanh" || aOp == L"sech" || aOp == L"csch" ||
+    aOp == L"coth" || aOp == L"arcsin" || aOp == L"arccos" ||
+    aOp == L"arctan" || aOp == L"arcsec" || aOp == L"arccsc" ||
+    aOp == L"arccot" || aOp == L"arcsinh" || aOp == L"arccosh" ||
+    aOp == L"arctanh" || aOp == L"arcsech" || aOp == L"arccsch" ||
+    aOp == L"arccoth";
+}
+
+// Of the tabulatable operators, those worth replacing with a lookup.
+static bool
+IsExpensiveOperator(const std::wstring& aOp)
+{
+  return aOp != L"plus" && aOp != L"minus" && aOp != L"times" &&
+    aOp != L"divide" && aOp != L"abs" && aOp != L"min" && aOp != L"max";
+}
+
+static bool
+IsLookupCandidate(bool aTabulatable, bool aDependent, bool aExpensive)
+{
+  return aTabulatable && aDependent && aExpensive;
+}
+
+void
+CodeGenerationState::GenerateLookupTables(std::list<System*>& aSystems)
+{
+  if (mLookupTableVariable == NULL)
+    return;
+
+  RETURN_INTO_OBJREF(cvs, iface::cellml_services::ConnectedVariableSet,
+                     mCeVAS->findVariableSet(mLookupTableVariable));
+  if (cvs == NULL)
+    throw CodeGenerationError(L"The lookup table variable is not in the model.");
+  RETURN_INTO_OBJREF(sv, iface::cellml_api::CellMLVariable,
+                     cvs->sourceVariable());
+  std::map<iface::cellml_api::CellMLVariable*, ptr_tag<CDA_ComputationTarget> >
+    ::iterator ti = mTargetsBySource.find(sv);
+  if (ti == mTargetsBySource.end() ||
+      (*ti).second->mEvaluationType != iface::cellml_services::STATE_VARIABLE)
+    throw CodeGenerationError(L"Lookup tables can only be made against a "
+                              L"state variable.");
+
+  // Written this way so that NaNs are rejected too.
+  if (!(mLookupTableStep > 0.0) ||
+      !(mLookupTableMaximum > mLookupTableMinimum))
+    throw CodeGenerationError(L"The lookup table range is empty.");
+
+  double count =
+    ceil((mLookupTableMaximum - mLookupTableMinimum) / mLookupTableStep) + 1;
+  if (!(count <= MAXIMUM_LOOKUP_TABLE_COUNT))
+    throw CodeGenerationError(L"The lookup table would have too many entries.");
+
+  mLookupTableTarget = (*ti).second;
+  mLookupTableCount = static_cast<uint32_t>(count);
+
+  // Tables already made, keyed by the expression tabulated, so each
+  // subexpression is only tabulated once.
+  std::map<std::wstring, std::wstring> tables;
+  for (std::list<System*>::iterator i = aSystems.begin(); i != aSystems.end();
+       i++)
+    for (std::set<ptr_tag<MathStatement> >::iterator j =
+           (*i)->mMathStatements.begin();
+         j != (*i)->mMathStatements.end(); j++)
+      TabulateInStatement(*j, tables);
+}
+
+void
+CodeGenerationState::TabulateInStatement
+(
+ MathStatement* aStatement,
+ std::map<std::wstring, std::wstring>& aTables
+)
+{
+  if (aStatement->mType == MathStatement::PIECEWISE)
+  {
+    // The conditions are left alone, as tabulating them would move the
+    // switching points.
+    Piecewise* pw = static_cast<Piecewise*>(aStatement);
+    for (std::list<std::pair<ptr_tag<Equation>,
+                   ptr_tag<MathMLMathStatement> > >::iterator i =
+           pw->mPieces.begin();
+         i != pw->mPieces.end(); i++)
+      TabulateInStatement((*i).first, aTables);
+    return;
+  }
+
+  if (aStatement->mType != MathStatement::EQUATION)
+    return;
+
+  Equation* eq = static_cast<Equation*>(aStatement);
+  CopyMathsForRewriting(eq);
+  ObjRef<iface::mathml_dom::MathMLElement>* sides[] = { &eq->mLHS, &eq->mRHS };
+  for (uint32_t i = 0; i < 2; i++)
+  {
+    ObjRef<iface::mathml_dom::MathMLElement> side = *sides[i];
+    if (side == NULL)
+      continue;
+
+    bool dependent, expensive;
+    bool tabulatable = TabulateSubexpressions(side, eq->mContext, aTables,
+                                              dependent, expensive);
+    if (IsLookupCandidate(tabulatable, dependent, expensive))
+    {
+      RETURN_INTO_OBJREF(lookup, iface::mathml_dom::MathMLElement,
+                         MakeLookupTable(side, eq->mContext, aTables));
+      if (lookup != NULL)
+        side = lookup;
+    }
+
+    *sides[i] = side;
+  }
+}
+
+bool
+CodeGenerationState::TabulateSubexpressions
+(
+ iface::mathml_dom::MathMLElement* aExpr,
+ iface::cellml_api::CellMLComponent* aContext,
+ std::map<std::wstring, std::wstring>& aTables,
+ bool& aDependent,
+ bool& aExpensive
+)
+{
+  aDependent = false;
+  aExpensive = false;
+
+  DECLARE_QUERY_INTERFACE_OBJREF(ci, aExpr, mathml_dom::MathMLCiElement);
+  if (ci != NULL)
+  {
+    CDA_ComputationTarget* targ;
+    try
+    {
+      targ = FindReferencedTarget(aExpr, aContext);
+    }
+    catch (NotDifferentiableError&)
+    {
+      return false;
+    }
+
+    if (targ == mLookupTableTarget)
+    {
+      aDependent = true;
+      return true;
+    }
+
+    // Rates which are constant are only aliased as constants for now, so
+    // only true constants can go into tables.
+    return targ->mEvaluationType == iface::cellml_services::CONSTANT &&
+      targ->mDegree == 0;
+  }
+
+  DECLARE_QUERY_INTERFACE_OBJREF(cn, aExpr, mathml_dom::MathMLCnElement);
+  if (cn != NULL)
+    return true;
+
+  // Predefined constants such as pi...
+  DECLARE_QUERY_INTERFACE_OBJREF(csym, aExpr, mathml_dom::MathMLCsymbolElement);
+  DECLARE_QUERY_INTERFACE_OBJREF(pds, aExpr, mathml_dom::MathMLPredefinedSymbol);
+  if (csym == NULL && pds != NULL)
+    return true;
+
+  std::list<ObjRef<iface::mathml_dom::MathMLElement> > children;
+  bool tabulatable = false;
+
+  DECLARE_QUERY_INTERFACE_OBJREF(apply, aExpr, mathml_dom::MathMLApplyElement);
+  DECLARE_QUERY_INTERFACE_OBJREF(pw, aExpr, mathml_dom::MathMLPiecewiseElement);
+  if (apply != NULL)
+  {
+    RETURN_INTO_OBJREF(op, iface::mathml_dom::MathMLElement,
+                       apply->_cxx_operator());
+    DECLARE_QUERY_INTERFACE_OBJREF(opsym, op, mathml_dom::MathMLCsymbolElement);
+    if (opsym == NULL && apply->nBoundVariables() == 0)
+    {
+      RETURN_INTO_WSTRING(opName, op->localName());
+      // Interpolating between table entries only makes sense if the
+      // subexpression is continuous.
+      tabulatable = isContinuousOperator(opName);
+      aExpensive = tabulatable && IsExpensiveOperator(opName);
+    }
+
+    for (uint32_t i = 2, l = apply->nArguments(); i <= l; i++)
+      children.push_back(already_AddRefd<iface::mathml_dom::MathMLElement>
+                         (apply->getArgument(i)));
+  }
+  else if (pw != NULL)
+  {
+    RETURN_INTO_OBJREF(pnl, iface::mathml_dom::MathMLNodeList, pw->pieces());
+    for (uint32_t i = 1, l = pnl->length(); i <= l; i++)
+      children.push_back(already_AddRefd<iface::mathml_dom::MathMLElement>
+                         (pw->getCaseValue(i)));
+    try
+    {
+      children.push_back(already_AddRefd<iface::mathml_dom::MathMLElement>
+                         (pw->otherwise()));
+    }
+    catch (...)
+    {
+    }
+  }
+  else
+    return false;
+
+  std::list<std::pair<ObjRef<iface::mathml_dom::MathMLElement>, bool> >
+    candidates;
+  for (std::list<ObjRef<iface::mathml_dom::MathMLElement> >::iterator i =
+         children.begin();
+       i != children.end(); i++)
+  {
+    if (*i == NULL)
+      continue;
+
+    bool dependent, expensive;
+    bool t = TabulateSubexpressions(*i, aContext, aTables, dependent,
+                                    expensive);
+    tabulatable = tabulatable && t;
+    aDependent = aDependent || dependent;
+    aExpensive = aExpensive || expensive;
+    candidates.push_back
+      (std::pair<ObjRef<iface::mathml_dom::MathMLElement>, bool>
+       (*i, IsLookupCandidate(t, dependent, expensive)));
+  }
+
+  // If this whole expression can go in a table, our caller decides whether it
+  // should. Otherwise, the largest parts of it which can are replaced now.
+  if (tabulatable)
+    return true;
+
+  for (std::list<std::pair<ObjRef<iface::mathml_dom::MathMLElement>, bool> >
+         ::iterator i = candidates.begin();
+       i != candidates.end(); i++)
+  {
+    if (!(*i).second)
+      continue;
+
+    RETURN_INTO_OBJREF(lookup, iface::mathml_dom::MathMLElement,
+                       MakeLookupTable((*i).first, aContext, aTables));
+    if (lookup == NULL)
+      continue;
+
+    RETURN_INTO_OBJREF(parent, iface::dom::Node, (*i).first->parentNode());
+    parent->replaceChild(lookup, (*i).first)->release_ref();
+  }
+
+  return false;
+}
+
+already_AddRefd<iface::mathml_dom::MathMLElement>
+CodeGenerationState::MakeLookupTable
+(
+ iface::mathml_dom::MathMLElement* aExpr,
+ iface::cellml_api::CellMLComponent* aContext,
+ std::map<std::wstring, std::wstring>& aTables
+)
+{
+  RETURN_INTO_OBJREF(mr, iface::cellml_services::MaLaESResult,
+                     mTransform->transform(mCeVAS, mCUSES, mAnnoSet, aExpr,
+                                           aContext, NULL, NULL, 0));
+  RETURN_INTO_WSTRING(compileErrors, mr->compileErrors());
+  // Supplementary functions would have to be emitted alongside the table, so
+  // anything needing them is computed directly instead.
+  if (compileErrors != L"" || mr->supplementariesLength() != 0)
+    return NULL;
+  RETURN_INTO_WSTRING(expr, mr->expression());
+
+  std::wstring lookup;
+  std::map<std::wstring, std::wstring>::iterator ti = aTables.find(expr);
+  if (ti != aTables.end())
+    lookup = (*ti).second;
+  else
+  {
+    // The table is followed by the constant its error goes into.
+    uint32_t first = mArrayOffset + mCodeInfo->mConstantIndexCount;
+    uint32_t errorIndex = first + mLookupTableCount;
+    mCodeInfo->mConstantIndexCount += mLookupTableCount + 1;
+    mNextConstantIndex = errorIndex + 1;
+
+    std::wstring errorName;
+    GenerateVariableName(errorName, mConstantPattern, errorIndex);
+
+    RETURN_INTO_WSTRING(value, mLookupTableTarget->name());
+    std::map<std::wstring, std::wstring> tags;
+    tags.insert(std::pair<std::wstring, std::wstring>(L"VALUE", value));
+    tags.insert(std::pair<std::wstring, std::wstring>(L"EXPRESSION", expr));
+    tags.insert(std::pair<std::wstring, std::wstring>
+                (L"FIRST", FormatLookupIndex(first)));
+    tags.insert(std::pair<std::wstring, std::wstring>
+                (L"COUNT", FormatLookupIndex(mLookupTableCount)));
+    tags.insert(std::pair<std::wstring, std::wstring>
+                (L"MINIMUM", formatExactNumber(mLookupTableMinimum)));
+    tags.insert(std::pair<std::wstring, std::wstring>
+                (L"MAXIMUM", formatExactNumber(mLookupTableMaximum)));
+    tags.insert(std::pair<std::wstring, std::wstring>
+                (L"STEP", formatExactNumber(mLookupTableStep)));
+    tags.insert(std::pair<std::wstring, std::wstring>(L"ERROR", errorName));
+
+    mCodeInfo->mInitConstsStr += ReplaceLookupTags(mLookupTableBuildPattern,
+                                                   tags);
+    mCodeInfo->mLookupTableErrorIndices.push_back(errorIndex);
+
+    lookup = ReplaceLookupTags(mLookupTablePattern, tags);
+    aTables.insert(std::pair<std::wstring, std::wstring>(expr, lookup));
+  }
+
+  return MakePassthroughFor(aExpr, lookup);
+}
+
+// Replaces the sides of aEq with copies, the first time it is rewritten, so
+// the model itself is left untouched.
+void
+CodeGenerationState::CopyMathsForRewriting(Equation* aEq)
+{
+  if (!mCopiedEquations.insert(aEq).second)
+    return;
+
+  if (aEq->mLHS != NULL)
+  {
+    RETURN_INTO_OBJREF(n, iface::dom::Node, aEq->mLHS->cloneNode(true));
+    QUERY_INTERFACE(aEq->mLHS, n, mathml_dom::MathMLElement);
+  }
+
+  RETURN_INTO_OBJREF(n, iface::dom::Node, aEq->mRHS->cloneNode(true));
+  QUERY_INTERFACE(aEq->mRHS, n, mathml_dom::MathMLElement);
+}
+
+// Makes a passthrough csymbol to replace aExpr with, remembering aExpr as
+// what it replaced.
+already_AddRefd<iface::mathml_dom::MathMLElement>
+CodeGenerationState::MakePassthroughFor
+(
+ iface::mathml_dom::MathMLElement* aExpr,
+ const std::wstring& aText
+)
+{
+  RETURN_INTO_OBJREF(doc, iface::dom::Document, aExpr->ownerDocument());
+  RETURN_INTO_OBJREF(ptEl, iface::dom::Element,
+                     doc->createElementNS(MATHML_NS, L"csymbol"));
+  DECLARE_QUERY_INTERFACE_OBJREF(pt, ptEl, mathml_dom::MathMLCsymbolElement);
+  pt->definitionURL(PASSTHROUGH_URL);
+  std::wstring text = mTransform->wrapNumber(aText);
+  RETURN_INTO_OBJREF(pttn, iface::dom::Text,
+                     doc->createTextNode(text.c_str()));
+  pt->appendChild(pttn)->release_ref();
+
+  DECLARE_QUERY_INTERFACE_OBJREF(ret, pt, mathml_dom::MathMLElement);
+  mReplacedSubexpressions.insert
+    (std::pair<iface::mathml_dom::MathMLElement*,
+               ObjRef<iface::mathml_dom::MathMLElement> >(ret, aExpr));
+
+  ret->add_ref();
+  return ret.getPointer();
+}
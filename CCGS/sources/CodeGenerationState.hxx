@@ -129,6 +129,38 @@ public:
   const char* why() { return "assignmentOnly requested, but solve is required."; }
 };
 
+class NotDifferentiableError
+  : public std::exception
+{
+public:
+  NotDifferentiableError() {}
+  const char* why() { return "expression can't be differentiated symbolically."; }
+};
+
+/*
+ * A sparse vector of partial derivatives with respect to the state variables,
+ * keyed by state variable index. Columns which are absent are zero.
+ */
+typedef std::map<uint32_t, ObjRef<iface::mathml_dom::MathMLElement> >
+  SparseDerivative;
+
+/*
+ * The state variables an expression depends on, and those of them which its
+ * partial derivative with respect to them still depends on (i.e. those it is
+ * not linear in).
+ */
+struct StateLinearity
+{
+  std::set<uint32_t> mDependencies, mNonlinear;
+};
+
+// Describes a math statement for use in <XMLID> in generated code.
+std::wstring describeMaths(MathStatement* ms);
+// True for MathML operators which are continuous wherever they are defined.
+bool isContinuousOperator(const std::wstring& aOp);
+// Formats a number so it reads back exactly, bracketed if it is negative.
+std::wstring formatExactNumber(double aValue);
+
 class CodeGenerationState
 {
 public:
@@ -155,6 +187,9 @@ public:
                       std::wstring& aInfDelayedRatePattern,
                       std::wstring& aInfDelayedStatePattern,
                       std::wstring& aConditionVariablePattern,
+                      std::wstring& aJacobianEntryPattern,
+                      std::wstring& aLinearCoefficientPattern,
+                      std::wstring& aJacobianRateCoefficientName,
                       bool aTrackPiecewiseConditions,
                       uint32_t aArrayOffset,
                       iface::cellml_services::MaLaESTransform* aTransform,
@@ -184,6 +219,9 @@ public:
       mInfDelayedRatePattern(aInfDelayedRatePattern),
       mInfDelayedStatePattern(aInfDelayedStatePattern),
       mConditionVariablePattern(aConditionVariablePattern),
+      mJacobianEntryPattern(aJacobianEntryPattern),
+      mLinearCoefficientPattern(aLinearCoefficientPattern),
+      mJacobianRateCoefficientName(aJacobianRateCoefficientName),
       mTrackPiecewiseConditions(aTrackPiecewiseConditions),
       mArrayOffset(aArrayOffset),
       mTransform(aTransform),
@@ -196,9 +234,17 @@ public:
       mNextVOI(aArrayOffset),
       mNextConditionVariable(aArrayOffset),
       mNextSolveId(0),
+      mNextJacobianTemporary(0),
       mIDAStyle(aIDAStyle),
       mIsConstant(false),
-      mDryRun(false)
+      mDryRun(false),
+      mJacobianColumns(NULL),
+      mLookupTableMinimum(0.0),
+      mLookupTableMaximum(0.0),
+      mLookupTableStep(0.0),
+      mLookupTableTarget(NULL),
+      mLookupTableCount(0),
+      mHoistConstantSubexpressions(false)
   {
   }
 
@@ -297,42 +343,13 @@ public:
                                 std::set<ptr_tag<CDA_ComputationTarget> >& aCandidates,
                                 std::set<ptr_tag<CDA_ComputationTarget> >& aUnwanted,
                                 std::list<System*>& aSystems);
-  bool FindSmallSystem(
-                       std::set<ptr_tag<MathStatement> >& aUseEquations,
-                       std::set<ptr_tag<CDA_ComputationTarget> >& aUseVars,
-                       std::set<ptr_tag<CDA_ComputationTarget> >& aStart,
-                       std::set<ptr_tag<CDA_ComputationTarget> >& aCandidates,
-                       std::list<System*>& aSystems
-                      );
-
-  bool FindBigSystem(
-                     std::set<ptr_tag<MathStatement> >& aUseMathStatements,
-                     std::set<ptr_tag<CDA_ComputationTarget> >& aUseVars,
-                     std::set<ptr_tag<CDA_ComputationTarget> >& aStart,
-                     std::set<ptr_tag<CDA_ComputationTarget> >& aCandidates,
-                     std::list<System*>& aSystems
-                    );
-
-  bool RecursivelyTestSmallSystem(
-                                  std::set<ptr_tag<MathStatement> >& aSystem,
-                                  std::set<ptr_tag<MathStatement> >::iterator& aEqIt,
-                                  uint32_t aNeedToAdd,
-                                  std::set<ptr_tag<MathStatement> >& aUseMathStatements,
-                                  std::set<ptr_tag<CDA_ComputationTarget> >& aUseVars,
-                                  std::set<ptr_tag<CDA_ComputationTarget> >& aStart,
-                                  std::set<ptr_tag<CDA_ComputationTarget> >& aCandidates,
-                                  std::list<System*>& aSystems
-                                 );
-
-  bool RecursivelyTestBigSystem(
-                                std::set<ptr_tag<MathStatement> >& aNonSystem,
-                                std::set<ptr_tag<MathStatement> >::iterator& aEqIt,
-                                uint32_t aNeedToRemove,
-                                std::set<ptr_tag<MathStatement> >& aUseMathStatements,
-                                std::set<ptr_tag<CDA_ComputationTarget> >& aUseVars,
-                                std::set<ptr_tag<CDA_ComputationTarget> >& aStart,
-                                std::set<ptr_tag<CDA_ComputationTarget> >& aCandidates
-                               );
+  bool FindMinimalSystems(
+                          std::set<ptr_tag<MathStatement> >& aUseMathStatements,
+                          std::set<ptr_tag<CDA_ComputationTarget> >& aUseVars,
+                          std::set<ptr_tag<CDA_ComputationTarget> >& aStart,
+                          std::set<ptr_tag<CDA_ComputationTarget> >& aCandidates,
+                          std::list<System*>& aSystems
+                         );
 
   void BuildSystemsByTargetsRequired(std::list<System*>& aSystems,
                                      std::map<ptr_tag<CDA_ComputationTarget>, System*>&
@@ -342,20 +359,23 @@ public:
                           std::set<ptr_tag<CDA_ComputationTarget> >& aKnown,
                           std::list<System*>& aTargets,
                           std::map<ptr_tag<CDA_ComputationTarget>, System*>&
-                            aSysByTargReq
+                            aSysByTargReq,
+                          std::list<System*>* aOrder = NULL
                          );
   void GenerateCodeForSetByType
   (
    std::set<ptr_tag<CDA_ComputationTarget> >& aKnown,
    std::list<System*>& aSystems,
    std::map<ptr_tag<CDA_ComputationTarget>, System*>&
-     aSysByTargReq
+     aSysByTargReq,
+   std::list<System*>& aRateOrder
   );
   void GenerateStateToRateCascades();
   void GenerateInfDelayUpdates();
   void GenerateCasesIntoTemplate(std::wstring& aCodeTo,
                                  std::list<std::pair<std::wstring, std::wstring> >& aCases);
   void GenerateCodeForSystem(std::wstring& aCodeTo, System* aSys);
+  void GenerateVariablesFragment(System* aSys);
   iface::cellml_api::CellMLVariable* GetVariableInComponent
   (
    iface::cellml_api::CellMLComponent* aComp,
@@ -432,6 +452,82 @@ public:
   void TransformCaseCondition(iface::mathml_dom::MathMLElement* aEl,
                               iface::cellml_api::CellMLComponent* aContext);
   void GenerateRootInformation();
+
+  // Lookup tables (CCGSLookupTables.cpp)...
+  void GenerateLookupTables(std::list<System*>& aSystems);
+  void TabulateInStatement(MathStatement* aStatement,
+                           std::map<std::wstring, std::wstring>& aTables);
+  bool TabulateSubexpressions(iface::mathml_dom::MathMLElement* aExpr,
+                              iface::cellml_api::CellMLComponent* aContext,
+                              std::map<std::wstring, std::wstring>& aTables,
+                              bool& aDependent, bool& aExpensive);
+  already_AddRefd<iface::mathml_dom::MathMLElement>
+    MakeLookupTable(iface::mathml_dom::MathMLElement* aExpr,
+                    iface::cellml_api::CellMLComponent* aContext,
+                    std::map<std::wstring, std::wstring>& aTables);
+  already_AddRefd<iface::mathml_dom::MathMLElement>
+    MakePassthroughFor(iface::mathml_dom::MathMLElement* aExpr,
+                       const std::wstring& aText);
+  void CopyMathsForRewriting(Equation* aEq);
+
+  // Hoisting of constant subexpressions (CCGSConstantHoisting.cpp)...
+  void HoistConstantSubexpressions(std::list<System*>& aSystems);
+  void HoistInStatement(MathStatement* aStatement,
+                        std::map<std::wstring, std::wstring>& aHoisted);
+  bool HoistSubexpressions(iface::mathml_dom::MathMLElement* aExpr,
+                           iface::cellml_api::CellMLComponent* aContext,
+                           std::map<std::wstring, std::wstring>& aHoisted,
+                           bool& aFolded, double& aValue);
+  already_AddRefd<iface::mathml_dom::MathMLElement>
+    ReplaceConstantSubexpression(iface::mathml_dom::MathMLElement* aExpr,
+                                 iface::cellml_api::CellMLComponent* aContext,
+                                 std::map<std::wstring, std::wstring>& aHoisted,
+                                 bool aFolded, double aValue);
+
+  // Symbolic Jacobian generation (CCGSJacobian.cpp)...
+  void GenerateRatesJacobian(std::list<System*>& aRateOrder);
+  void GenerateResidualJacobian(std::list<System*>& aEssentialOrder);
+  void GenerateJacobianForSystem(std::wstring& aCodeTo, System* aSys);
+  void GenerateLinearCoefficients(std::list<System*>& aRateOrder);
+  void FindLinearity(iface::mathml_dom::MathMLElement* aExpr,
+                     iface::cellml_api::CellMLComponent* aContext,
+                     std::map<CDA_ComputationTarget*, StateLinearity>& aTargets,
+                     StateLinearity& aResult);
+  ptr_tag<CDA_ComputationTarget>
+    FindReferencedTarget(iface::mathml_dom::MathMLElement* aExpr,
+                         iface::cellml_api::CellMLComponent* aContext);
+  void DifferentiateAssignment(Equation* aEq,
+                               ptr_tag<CDA_ComputationTarget> aTarget,
+                               SparseDerivative& aResult);
+  void Differentiate(iface::mathml_dom::MathMLElement* aExpr,
+                     iface::cellml_api::CellMLComponent* aContext,
+                     SparseDerivative& aResult);
+  void DifferentiateApply(iface::mathml_dom::MathMLApplyElement* aApply,
+                          iface::cellml_api::CellMLComponent* aContext,
+                          SparseDerivative& aResult);
+  void DifferentiateVariable(iface::mathml_dom::MathMLElement* aExpr,
+                             iface::cellml_api::CellMLComponent* aContext,
+                             SparseDerivative& aResult);
+  double UnitsConversionFactor(iface::cellml_api::CellMLVariable* aFrom,
+                               iface::cellml_api::CellMLVariable* aTo);
+  std::wstring JacobianExpression(iface::mathml_dom::MathMLElement* aExpr,
+                                  iface::cellml_api::CellMLComponent* aContext);
+  void AssignJacobianTemporaries(std::wstring& aCodeTo,
+                                 std::map<uint32_t, std::wstring>& aTemps,
+                                 SparseDerivative& aDeriv,
+                                 iface::cellml_api::CellMLComponent* aContext,
+                                 const std::wstring& aXMLId);
+  std::wstring NewJacobianTemporary();
+  void AppendJacobianEntry(std::wstring& aCodeTo, uint32_t aRow,
+                           uint32_t aColumn, const std::wstring& aValue,
+                           const std::wstring& aXMLId);
+  void ComputeRateDependencies(std::list<System*>& aRateOrder);
+  void ComputeResidualDependencies(std::list<System*>& aEssentialOrder);
+  void ComputeSystemDependencies(std::list<System*>& aOrder,
+                                 std::map<CDA_ComputationTarget*, std::set<uint32_t> >& aDeps);
+  void AddTargetDependencies(CDA_ComputationTarget* aTarget,
+                             std::map<CDA_ComputationTarget*, std::set<uint32_t> >& aDeps,
+                             std::set<uint32_t>& aInto);
   void CheckInappropriateStateAssignments(std::list<System*>& aSystems);
 
   int mCompatLevel;
@@ -446,7 +542,8 @@ public:
     & mDeclareTemporaryPattern, & mConditionalAssignmentPattern, & mResidualPattern,
     & mConstrainedRateStateInfoPattern, & mUnconstrainedRateStateInfoPattern,
     & mInfDelayedRatePattern, & mInfDelayedStatePattern,
-    & mConditionVariablePattern;
+    & mConditionVariablePattern, & mJacobianEntryPattern,
+    & mLinearCoefficientPattern, & mJacobianRateCoefficientName;
   bool mTrackPiecewiseConditions;
   uint32_t mArrayOffset;
   ObjRef<iface::cellml_services::MaLaESTransform> mTransform;
@@ -466,7 +563,8 @@ public:
     mTargetsBySource;
   std::set<ptr_tag<CDA_ComputationTarget> > mBoundTargs, mLocallyBoundTargs, mDelayedTargs;
   uint32_t mNextConstantIndex, mNextStateVariableIndex,
-    mNextAlgebraicVariableIndex, mNextVOI, mNextConditionVariable, mNextSolveId;
+    mNextAlgebraicVariableIndex, mNextVOI, mNextConditionVariable, mNextSolveId,
+    mNextJacobianTemporary;
   std::list<std::pair<ptr_tag<CDA_ComputationTarget>, std::wstring> > mRateNameBackup;
   std::list<ptr_tag<CDA_ComputationTarget> > mInfDelayedTargets;
   bool mIDAStyle;
@@ -483,7 +581,31 @@ public:
   };
 
   std::list<RootInformation> mRootInformation;
+  // The temporaries holding the non-zero partial derivatives of each target
+  // computed so far, keyed by the state column they are with respect to.
+  std::map<ptr_tag<CDA_ComputationTarget>, std::map<uint32_t, std::wstring> >
+    mJacobianTemporaries;
+  std::wstring mJacobianDeclarations;
+  // The variablesString fragment computing each target computed there.
+  std::map<CDA_ComputationTarget*, uint32_t> mVariablesFragmentByTarget;
   bool mDryRun;
+  // If non-NULL, the only state columns partial derivatives are taken with
+  // respect to.
+  std::set<uint32_t>* mJacobianColumns;
+
+  ObjRef<iface::cellml_api::CellMLVariable> mLookupTableVariable;
+  double mLookupTableMinimum, mLookupTableMaximum, mLookupTableStep;
+  std::wstring mLookupTablePattern, mLookupTableBuildPattern;
+  CDA_ComputationTarget* mLookupTableTarget;
+  uint32_t mLookupTableCount;
+  bool mHoistConstantSubexpressions;
+  // The subexpressions replaced by lookups or hoisted constants, keyed by the
+  // passthrough csymbol they were replaced with, so they can still be
+  // differentiated.
+  std::map<iface::mathml_dom::MathMLElement*,
+           ObjRef<iface::mathml_dom::MathMLElement> > mReplacedSubexpressions;
+  // The equations whose sides are already copies that can be rewritten.
+  std::set<Equation*> mCopiedEquations;
 };
 
 #endif // _CodeGenerationState_hxx
@@ -54,7 +54,8 @@ TypeToString(iface::cellml_services::VariableEvaluationType vet)
 }
 
 void
-WriteCode(iface::cellml_services::CodeInformation* cci, uint32_t useida)
+WriteCode(iface::cellml_services::CodeInformation* cci, uint32_t useida,
+          uint32_t jacobian)
 {
   iface::cellml_services::ModelConstraintLevel mcl =
     cci->constraintLevel();
@@ -323,6 +324,24 @@ WriteCode(iface::cellml_services::CodeInformation* cci, uint32_t useida)
   printf(" * The rate and state arrays need %u entries.\n", cci->rateIndexCount());
   printf(" * The algebraic variables array needs %u entries.\n", cci->algebraicIndexCount());
   printf(" * The constant array needs %u entries.\n", cci->constantIndexCount());
+  std::vector<uint32_t> errorIndices = cci->lookupTableErrorIndices();
+  if (!errorIndices.empty())
+  {
+    printf(" * The lookup table errors are in constants");
+    for (std::vector<uint32_t>::iterator eii = errorIndices.begin();
+         eii != errorIndices.end(); eii++)
+      printf(" %u", *eii);
+    printf(".\n");
+  }
+  std::vector<uint32_t> hoistedIndices = cci->hoistedConstantIndices();
+  if (!hoistedIndices.empty())
+  {
+    printf(" * The hoisted subexpressions are in constants");
+    for (std::vector<uint32_t>::iterator hii = hoistedIndices.begin();
+         hii != hoistedIndices.end(); hii++)
+      printf(" %u", *hii);
+    printf(".\n");
+  }
   printf(" * Variable storage is as follows:\n");
   
   messages.clear();
@@ -426,6 +445,18 @@ WriteCode(iface::cellml_services::CodeInformation* cci, uint32_t useida)
            "double* ALGEBRAIC)\n"
            "{\n%S}\n", frag.c_str());
   }
+
+  if (jacobian)
+  {
+    frag = cci->jacobianString();
+    if (frag == L"")
+      printf("/* The Jacobian could not be found symbolically, so a finite"
+             " difference approximation is needed. */\n");
+    else
+      printf("void ComputeJacobian(double VOI, double* CONSTANTS, double* RATES, "
+             "double* STATES, double* ALGEBRAIC, double** JACOBIAN)\n"
+             "{\n%S}\n", frag.c_str());
+  }
 }
 
 void
@@ -477,17 +508,58 @@ doNameAnnotations(iface::cellml_api::Model* aModel,
   as->release_ref();
 }
 
+// Tabulates against the variable named by a spec of the form
+// component/variable,minimum,maximum,step.
+bool
+setLookupTable(iface::cellml_api::Model* aModel,
+               iface::cellml_services::CodeGenerator* aCG,
+               const char* aSpec)
+{
+  char compName[256], varName[256];
+  double minimum, maximum, step;
+  if (sscanf(aSpec, "%255[^/]/%255[^,],%lf,%lf,%lf", compName, varName,
+             &minimum, &maximum, &step) != 5)
+    return false;
+
+  std::wstring wcompName, wvarName;
+  for (const char* p = compName; *p; p++)
+    wcompName += static_cast<wchar_t>(*p);
+  for (const char* p = varName; *p; p++)
+    wvarName += static_cast<wchar_t>(*p);
+
+  iface::cellml_api::CellMLComponentSet* ccs = aModel->modelComponents();
+  iface::cellml_api::CellMLComponent* comp = ccs->getComponent(wcompName.c_str());
+  ccs->release_ref();
+  if (comp == NULL)
+    return false;
+
+  iface::cellml_api::CellMLVariableSet* vs = comp->variables();
+  comp->release_ref();
+  iface::cellml_api::CellMLVariable* v = vs->getVariable(wvarName.c_str());
+  vs->release_ref();
+  if (v == NULL)
+    return false;
+
+  aCG->setLookupTable(v, minimum, maximum, step);
+  v->release_ref();
+
+  return true;
+}
+
 int
 main(int argc, char** argv)
 {
   // Get the URL from which to load the model...
   if (argc < 2)
   {
-    printf("Usage: CellML2C modelURL\n");
+    printf("Usage: CellML2C modelURL [usenames] [useida]"
+           " [lookup_table component/variable,minimum,maximum,step]"
+           " [hoist] [jacobian]\n");
     return -1;
   }
 
-  uint32_t usenames = 0, useida = 0;
+  uint32_t usenames = 0, useida = 0, hoist = 0, jacobian = 0;
+  const char* lookupTable = NULL;
 
   for (int32_t i = 2; i < argc; i++)
   {
@@ -495,6 +567,12 @@ main(int argc, char** argv)
       usenames = 1;
     else if (!strcmp(argv[i], "useida"))
       useida = 1;
+    else if (!strcmp(argv[i], "lookup_table") && i + 1 < argc)
+      lookupTable = argv[++i];
+    else if (!strcmp(argv[i], "hoist"))
+      hoist = 1;
+    else if (!strcmp(argv[i], "jacobian"))
+      jacobian = 1;
   }
 
   wchar_t* URL;
@@ -545,6 +623,17 @@ main(int argc, char** argv)
   if (usenames)
     doNameAnnotations(mod, cg);
 
+  if (hoist)
+    cg->hoistConstantSubexpressions(true);
+
+  if (lookupTable != NULL && !setLookupTable(mod, cg, lookupTable))
+  {
+    printf("Can't find the variable to tabulate against in %s.\n", lookupTable);
+    cg->release_ref();
+    mod->release_ref();
+    return -1;
+  }
+
   iface::cellml_services::CodeInformation* cci = NULL;
   try
   {
@@ -575,7 +664,7 @@ main(int argc, char** argv)
   }
 
   // We now have the code information...
-  WriteCode(cci, useida);
+  WriteCode(cci, useida, jacobian);
   cci->release_ref();
 
   return 0;
@@ -5,70 +5,41 @@ DECLARE_EXTENSION_END(cis)
 
 INCLUDE_DIRECTORIES(CIS/sources)
 
-# Find clang and LLVM...
-IF(LLVM_INCLUDE_DIR)
-  # Already in cache, be silent
-  SET(LLVM_FIND_QUIETLY TRUE)
-ENDIF(LLVM_INCLUDE_DIR)
-
-FIND_PATH(LLVM_INCLUDE_DIR llvm/Constants.h
-  /usr/local/include
-  /usr/include
-)
-FIND_PATH(CLANG_INCLUDE_DIR clang/Basic/SourceLocation.h
-  /usr/local/include
-  /usr/include
-)
-
-SET(LLVM_LIBPATH /usr/local/lib /usr/lib)
-MARK_AS_ADVANCED(LLVM_LIBPATH)
-
-FIND_LIBRARY(LLVM_CORE_LIBRARY
-  NAMES LLVMCore
-  PATHS ${LLVM_LIBPATH}
-)
-FIND_LIBRARY(CLANG_BASIC_LIBRARY
-  NAMES clangBasic
-  PATHS ${LLVM_LIBPATH}
-)
-
-IF (LLVM_INCLUDE_DIR AND LLVM_CORE_LIBRARY AND CLANG_INCLUDE_DIR AND CLANG_BASIC_LIBRARY)
-   SET(LLVM_FOUND TRUE)
-
-   INCLUDE_DIRECTORIES(${LLVM_INCLUDE_DIR} ${CLANG_INCLUDE_DIR})
-
-   IF (NOT LLVM_FIND_QUIETLY)
-      MESSAGE(STATUS "Found LLVM: ${LLVM_CORE_LIBRARY}")
-   ENDIF (NOT LLVM_FIND_QUIETLY)
-
-   SET(LLVM_LIBRARIES)
-
-   SET(LLVM_PLAT_LIBS)
-   FOREACH(plat ARM CellSPU Hexagon MBlaze Mips MSP430 NVPTX PowerPC Sparc X86 XCore)
-     LIST(APPEND LLVM_PLAT_LIBS LLVM${plat}Desc LLVM${plat}CodeGen LLVM${plat}Info LLVM${plat}AsmPrinter LLVM${plat}Utils)
-   ENDFOREACH()
-
-   FOREACH(extraLLVM clangARCMigrate clangASTMatchers clangCodeGen clangDriver clangFrontend clangFrontendTool clangLex clangParse clangRewriteCore clangRewriteFrontend clangSerialization clangStaticAnalyzerCheckers clangStaticAnalyzerCore clangStaticAnalyzerFrontend clangTooling clangSema clangEdit clangAnalysis clangAST clangBasic ${LLVM_PLAT_LIBS} LLVMExecutionEngine LLVMArchive LLVMAsmPrinter LLVMBitReader LLVMBitWriter LLVMCodeGen LLVMCppBackendCodeGen LLVMCppBackendInfo LLVMDebugInfo LLVMInstCombine LLVMInstrumentation LLVMInterpreter LLVMJIT LLVMLinker LLVMMBlazeAsmParser LLVMMBlazeAsmPrinter LLVMMBlazeCodeGen LLVMMBlazeDesc LLVMMBlazeDisassembler LLVMMBlazeInfo LLVMMCDisassembler LLVMMCJIT LLVMObject LLVMRuntimeDyld LLVMScalarOpts LLVMSelectionDAG LLVMTableGen LLVMTarget LLVMTransformUtils LLVMVectorize LLVMXCoreCodeGen LLVMXCoreDesc LLVMXCoreInfo LLVMipa LLVMipo LLVMMC LLVMAnalysis LLVMMCParser LLVMAsmParser LLVMSupport)
-     FIND_LIBRARY(LLVM_${extraLLVM}_LIBRARY
-       NAMES ${extraLLVM}
-       PATHS ${LLVM_LIBPATH}
-       )
-     IF (${LLVM_${extraLLVM}_LIBRARY} STREQUAL "LLVM_${extraLLVM}_LIBRARY-NOTFOUND")
-       SET(${LLVM_${extraLLVM}_LIBRARY})
-     ELSE()
-       LIST(APPEND LLVM_LIBRARIES ${LLVM_${extraLLVM}_LIBRARY})
-     ENDIF()
-   ENDFOREACH()
-   SET(LLVM_LIBRARIES ${LLVM_LIBRARIES} ${LLVM_CORE_LIBRARY})
-ELSE(LLVM_INCLUDE_DIR AND LLVM_CORE_LIBRARY AND CLANG_INCLUDE_DIR AND CLANG_BASIC_LIBRARY)
-   SET(LLVM_FOUND FALSE)
+OPTION(ENABLE_CLANG_JIT "Compile models in-process with clang and the LLVM ORC JIT, rather than by running gcc (needs the clang and LLVM 14, 15 or 16 development packages)" OFF)
+MARK_AS_ADVANCED(ENABLE_CLANG_JIT)
+
+# Find clang and LLVM, which their CMake packages describe for us. The JIT
+# uses llvm::OptimizationLevel (new in LLVM 14) and JITEvaluatedSymbol,
+# llvm/Support/Host.h and CodeGenOpt::Aggressive (all gone after LLVM 16)...
+IF (ENABLE_CLANG_JIT)
+  FIND_PACKAGE(Clang CONFIG QUIET)
+  IF (Clang_FOUND AND NOT LLVM_VERSION_MAJOR LESS 14 AND NOT LLVM_VERSION_MAJOR GREATER 16)
+    SET(CLANG_JIT_USABLE TRUE)
+  ELSE (Clang_FOUND AND NOT LLVM_VERSION_MAJOR LESS 14 AND NOT LLVM_VERSION_MAJOR GREATER 16)
+    SET(CLANG_JIT_USABLE FALSE)
+    MESSAGE(SEND_ERROR "ENABLE_CLANG_JIT is enabled but can't find clang and LLVM 14, 15 or 16")
+  ENDIF (Clang_FOUND AND NOT LLVM_VERSION_MAJOR LESS 14 AND NOT LLVM_VERSION_MAJOR GREATER 16)
+ENDIF (ENABLE_CLANG_JIT)
+
+IF (ENABLE_CLANG_JIT AND CLANG_JIT_USABLE)
+   SET(CLANG_JIT_FOUND TRUE)
+
+   INCLUDE_DIRECTORIES(${LLVM_INCLUDE_DIRS} ${CLANG_INCLUDE_DIRS})
+   ADD_DEFINITIONS(${LLVM_DEFINITIONS})
+
+   MESSAGE(STATUS "Found LLVM ${LLVM_PACKAGE_VERSION}: ${LLVM_DIR}")
+
+   LLVM_MAP_COMPONENTS_TO_LIBNAMES(LLVM_LIBRARIES orcjit passes native)
+   IF (TARGET clang-cpp)
+     SET(CLANG_LIBRARIES clang-cpp)
+   ELSE (TARGET clang-cpp)
+     SET(CLANG_LIBRARIES clangCodeGen clangFrontend clangDriver clangSerialization clangParse clangSema clangAnalysis clangAST clangEdit clangLex clangBasic)
+   ENDIF (TARGET clang-cpp)
+ELSE (ENABLE_CLANG_JIT AND CLANG_JIT_USABLE)
+   SET(CLANG_JIT_FOUND FALSE)
    SET(LLVM_LIBRARIES )
-ENDIF(LLVM_INCLUDE_DIR AND LLVM_CORE_LIBRARY AND CLANG_INCLUDE_DIR AND CLANG_BASIC_LIBRARY)
-
-MARK_AS_ADVANCED(
-  CLANG_INCLUDE_DIR
-  LLVM_INCLUDE_DIR
-  )
+   SET(CLANG_LIBRARIES )
+ENDIF (ENABLE_CLANG_JIT AND CLANG_JIT_USABLE)
 
 OPTION(USE_SYSTEM_SUNDIALS "Use the SUNDIALS libraries found on the system, rather than the sources distributed with the API.")
 MARK_AS_ADVANCED(USE_SYSTEM_SUNDIALS)
@@ -132,6 +103,13 @@ ENDIF()
 ADD_LIBRARY(cis
   CIS/sources/CISImplementation.cxx
   CIS/sources/CISSolve.cxx
+  CIS/sources/CISResultStream.cxx
+  CIS/sources/CISThreadPool.cxx
+  CIS/sources/CISSolverSession.cxx
+  CIS/sources/CISBytecode.cxx
+  CIS/sources/CISJacobian.cxx
+  CIS/sources/CISDistribution.cxx
+  CIS/sources/CISQuadrature.cxx
   ${SUNDIALS_SOURCES}
   )
 ADD_CUSTOM_COMMAND(
@@ -0,0 +1,829 @@
+#define MODULE_CONTAINS_CIS
+#include "cda_compiler_support.h"
+#include "CISImplementation.hxx"
+#include "CISBytecode.hxx"
+#include "MaLaESBootstrap.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <cwchar>
+
+#include "CISModelSupport.h"
+
+#define MATHML_NS L"http://www.w3.org/1998/Math/MathML"
+#define UNCERTAINTY_NS L"http://www.cellml.org/uncertainty-1#"
+
+static const wchar_t* sCannotInterpret =
+  L"Model cannot be interpreted because it needs a non-linear solver, "
+  L"definite integrals or sampling";
+
+// Jump straight from each instruction to the next one's handler where the
+// compiler lets us take the address of a label...
+#ifdef __GNUC__
+#define BYTECODE_THREADED_DISPATCH
+#endif
+
+struct BytecodeError
+{
+  BytecodeError(const std::wstring& aMessage) : mMessage(aMessage) {}
+  std::wstring mMessage;
+};
+
+enum BytecodeFunctionKind
+{
+  // One argument, op DEST = A.
+  BYTECODE_UNARY,
+  // Two arguments, op DEST = A, B.
+  BYTECODE_BINARY,
+  // One or more arguments, combined left to right.
+  BYTECODE_FOLD,
+  // Two or more arguments, each compared to the next.
+  BYTECODE_CHAIN
+};
+
+struct BytecodeFunctionInfo
+{
+  const wchar_t* mName;
+  BytecodeOpcode mOpcode;
+  BytecodeFunctionKind mKind;
+};
+
+static const BytecodeFunctionInfo sBytecodeFunctions[] =
+{
+  {L"negate", BytecodeOpNegate, BYTECODE_UNARY},
+  {L"not", BytecodeOpNot, BYTECODE_UNARY},
+  {L"abs", BytecodeOpAbs, BYTECODE_UNARY},
+  {L"exp", BytecodeOpExp, BYTECODE_UNARY},
+  {L"ln", BytecodeOpLn, BYTECODE_UNARY},
+  {L"floor", BytecodeOpFloor, BYTECODE_UNARY},
+  {L"ceiling", BytecodeOpCeiling, BYTECODE_UNARY},
+  {L"factorial", BytecodeOpFactorial, BYTECODE_UNARY},
+  {L"sin", BytecodeOpSin, BYTECODE_UNARY},
+  {L"cos", BytecodeOpCos, BYTECODE_UNARY},
+  {L"tan", BytecodeOpTan, BYTECODE_UNARY},
+  {L"sinh", BytecodeOpSinh, BYTECODE_UNARY},
+  {L"cosh", BytecodeOpCosh, BYTECODE_UNARY},
+  {L"tanh", BytecodeOpTanh, BYTECODE_UNARY},
+  {L"arcsin", BytecodeOpArcSin, BYTECODE_UNARY},
+  {L"arccos", BytecodeOpArcCos, BYTECODE_UNARY},
+  {L"arctan", BytecodeOpArcTan, BYTECODE_UNARY},
+  {L"arcsinh", BytecodeOpArcSinh, BYTECODE_UNARY},
+  {L"arccosh", BytecodeOpArcCosh, BYTECODE_UNARY},
+  {L"arctanh", BytecodeOpArcTanh, BYTECODE_UNARY},
+  {L"minus", BytecodeOpSubtract, BYTECODE_BINARY},
+  {L"divide", BytecodeOpDivide, BYTECODE_BINARY},
+  {L"power", BytecodeOpPower, BYTECODE_BINARY},
+  {L"log", BytecodeOpLogBase, BYTECODE_BINARY},
+  {L"quotient", BytecodeOpQuotient, BYTECODE_BINARY},
+  {L"rem", BytecodeOpRemainder, BYTECODE_BINARY},
+  {L"factorof", BytecodeOpFactorOf, BYTECODE_BINARY},
+  {L"xor", BytecodeOpXor, BYTECODE_BINARY},
+  {L"neq", BytecodeOpNotEqual, BYTECODE_BINARY},
+  {L"plus", BytecodeOpAdd, BYTECODE_FOLD},
+  {L"times", BytecodeOpMultiply, BYTECODE_FOLD},
+  {L"min", BytecodeOpMinimum, BYTECODE_FOLD},
+  {L"max", BytecodeOpMaximum, BYTECODE_FOLD},
+  {L"gcd", BytecodeOpGcd, BYTECODE_FOLD},
+  {L"lcm", BytecodeOpLcm, BYTECODE_FOLD},
+  {L"and", BytecodeOpAnd, BYTECODE_FOLD},
+  {L"or", BytecodeOpOr, BYTECODE_FOLD},
+  {L"eq", BytecodeOpEqual, BYTECODE_CHAIN},
+  {L"lt", BytecodeOpLess, BYTECODE_CHAIN},
+  {L"leq", BytecodeOpLessEqual, BYTECODE_CHAIN},
+  {L"gt", BytecodeOpGreater, BYTECODE_CHAIN},
+  {L"geq", BytecodeOpGreaterEqual, BYTECODE_CHAIN}
+};
+
+void
+SetupBytecodeCodeGenStrings(iface::cellml_services::CodeGenerator* aCG)
+{
+  // Statements are either TARGET = EXPRESSION; (with ?= for constants that
+  // can be overridden), or if EXPRESSION { STATEMENTS } else if ...
+  aCG->assignPattern(L"<LHS> = <RHS>;\r\n");
+  aCG->assignConstantPattern(L"<LHS> ?= <RHS>;\r\n");
+  aCG->conditionalAssignmentPattern
+    (
+     L"if <CONDITION>\r\n"
+     L"{\r\n"
+     L"<STATEMENT>"
+     L"}\r\n"
+     L"<CASES>else if <CONDITION>\r\n"
+     L"{\r\n"
+     L"<STATEMENT>"
+     L"}\r\n"
+     L"</CASES>"
+    );
+  aCG->hoistConstantSubexpressions(true);
+
+  // Every operator is written as a call, so no precedence is needed to read
+  // the expressions back. Definite integrals are left as an unknown function,
+  // so that CompileBytecode rejects them.
+  ObjRef<iface::cellml_services::MaLaESBootstrap> mb(CreateMaLaESBootstrap());
+  ObjRef<iface::cellml_services::MaLaESTransform> transform
+    (
+     mb->compileTransformer(
+L"opengroup: (\r\n"
+L"closegroup: )\r\n"
+L"abs: #prec[H]abs(#expr1)\r\n"
+L"and: #prec[H]and(#exprs[,])\r\n"
+L"arccos: #prec[H]arccos(#expr1)\r\n"
+L"arccosh: #prec[H]arccosh(#expr1)\r\n"
+L"arccot: #prec[H]arctan(divide(1.0,#expr1))\r\n"
+L"arccoth: #prec[H]arctanh(divide(1.0,#expr1))\r\n"
+L"arccsc: #prec[H]arcsin(divide(1.0,#expr1))\r\n"
+L"arccsch: #prec[H]arcsinh(divide(1.0,#expr1))\r\n"
+L"arcsec: #prec[H]arccos(divide(1.0,#expr1))\r\n"
+L"arcsech: #prec[H]arccosh(divide(1.0,#expr1))\r\n"
+L"arcsin: #prec[H]arcsin(#expr1)\r\n"
+L"arcsinh: #prec[H]arcsinh(#expr1)\r\n"
+L"arctan: #prec[H]arctan(#expr1)\r\n"
+L"arctanh: #prec[H]arctanh(#expr1)\r\n"
+L"ceiling: #prec[H]ceiling(#expr1)\r\n"
+L"cos: #prec[H]cos(#expr1)\r\n"
+L"cosh: #prec[H]cosh(#expr1)\r\n"
+L"cot: #prec[H]divide(1.0,tan(#expr1))\r\n"
+L"coth: #prec[H]divide(1.0,tanh(#expr1))\r\n"
+L"csc: #prec[H]divide(1.0,sin(#expr1))\r\n"
+L"csch: #prec[H]divide(1.0,sinh(#expr1))\r\n"
+L"diff: #lookupDiffVariable\r\n"
+L"divide: #prec[H]divide(#expr1,#expr2)\r\n"
+L"eq: #prec[H]eq(#exprs[,])\r\n"
+L"exp: #prec[H]exp(#expr1)\r\n"
+L"factorial: #prec[H]factorial(#expr1)\r\n"
+L"factorof: #prec[H]factorof(#expr1,#expr2)\r\n"
+L"floor: #prec[H]floor(#expr1)\r\n"
+L"gcd: #prec[H]gcd(#exprs[,])\r\n"
+L"geq: #prec[H]geq(#exprs[,])\r\n"
+L"gt: #prec[H]gt(#exprs[,])\r\n"
+L"implies: #prec[H]or(not(#expr1),#expr2)\r\n"
+L"int: #prec[H]definite_integral(#expr1)\r\n"
+L"lcm: #prec[H]lcm(#exprs[,])\r\n"
+L"leq: #prec[H]leq(#exprs[,])\r\n"
+L"ln: #prec[H]ln(#expr1)\r\n"
+L"log: #prec[H]log(#expr1,#logbase)\r\n"
+L"lt: #prec[H]lt(#exprs[,])\r\n"
+L"max: #prec[H]max(#exprs[,])\r\n"
+L"min: #prec[H]min(#exprs[,])\r\n"
+L"minus: #prec[H]minus(#expr1,#expr2)\r\n"
+L"neq: #prec[H]neq(#expr1,#expr2)\r\n"
+L"not: #prec[H]not(#expr1)\r\n"
+L"or: #prec[H]or(#exprs[,])\r\n"
+L"plus: #prec[H]plus(#exprs[,])\r\n"
+L"power: #prec[H]power(#expr1,#expr2)\r\n"
+L"quotient: #prec[H]quotient(#expr1,#expr2)\r\n"
+L"rem: #prec[H]rem(#expr1,#expr2)\r\n"
+L"root: #prec[H]power(#expr1,divide(1.0,#degree))\r\n"
+L"sec: #prec[H]divide(1.0,cos(#expr1))\r\n"
+L"sech: #prec[H]divide(1.0,cosh(#expr1))\r\n"
+L"sin: #prec[H]sin(#expr1)\r\n"
+L"sinh: #prec[H]sinh(#expr1)\r\n"
+L"tan: #prec[H]tan(#expr1)\r\n"
+L"tanh: #prec[H]tanh(#expr1)\r\n"
+L"times: #prec[H]times(#exprs[,])\r\n"
+L"unary_minus: #prec[H]negate(#expr1)\r\n"
+L"units_conversion: #prec[H]plus(times(#expr1,#expr2),#expr3)\r\n"
+L"units_conversion_factor: #prec[H]times(#expr1,#expr2)\r\n"
+L"units_conversion_offset: #prec[H]plus(#expr1,#expr2)\r\n"
+L"xor: #prec[H]xor(#expr1,#expr2)\r\n"
+L"piecewise_first_case: #prec[H]piecewise(#expr1,#expr2,\r\n"
+L"piecewise_extra_case: #prec[H]#expr1,#expr2,\r\n"
+L"piecewise_otherwise: #prec[H]#expr1)\r\n"
+L"piecewise_no_otherwise: #prec[H]nan)\r\n"
+L"eulergamma: #prec[H]0.577215664901533\r\n"
+L"exponentiale: #prec[H]2.71828182845905\r\n"
+L"false: #prec[H]0.0\r\n"
+L"infinity: #prec[H]inf\r\n"
+L"notanumber: #prec[H]nan\r\n"
+L"pi: #prec[H]3.14159265358979\r\n"
+L"true: #prec[H]1.0\r\n"
+                           )
+    );
+  aCG->transform(transform);
+}
+
+class BytecodeCompiler
+{
+public:
+  BytecodeCompiler(BytecodeProgram& aProgram)
+    : mProgram(aProgram), mFunction(NULL), mPos(NULL)
+  {
+  }
+
+  void compile(const std::wstring& aCode, BytecodeFunction& aFunction);
+
+private:
+  void skipSpace();
+  bool accept(wchar_t aChar);
+  void expect(wchar_t aChar);
+  std::wstring readName();
+  uint32_t readIndex();
+  void fail(const std::wstring& aWhat);
+
+  uint32_t emit(BytecodeOpcode aOpcode, uint32_t aDest, uint32_t aA,
+                uint32_t aB);
+  void compileStatement();
+  void compileBlock();
+  void compileExpression(uint32_t aRegister);
+  void compileCall(const std::wstring& aName, uint32_t aRegister);
+  void compilePiecewise(uint32_t aRegister);
+  void loadNumber(double aValue, uint32_t aRegister);
+
+  BytecodeProgram& mProgram;
+  BytecodeFunction* mFunction;
+  const wchar_t* mPos;
+};
+
+void
+BytecodeCompiler::compile
+(
+ const std::wstring& aCode,
+ BytecodeFunction& aFunction
+)
+{
+  mFunction = &aFunction;
+  mPos = aCode.c_str();
+
+  skipSpace();
+  while (*mPos != 0)
+    compileStatement();
+
+  emit(BytecodeOpReturn, 0, 0, 0);
+}
+
+void
+BytecodeCompiler::skipSpace()
+{
+  while (true)
+  {
+    if (*mPos == L' ' || *mPos == L'\t' || *mPos == L'\r' || *mPos == L'\n')
+      mPos++;
+    else if (mPos[0] == L'/' && mPos[1] == L'*')
+    {
+      const wchar_t* end = wcsstr(mPos + 2, L"*/");
+      mPos = (end == NULL) ? mPos + wcslen(mPos) : end + 2;
+    }
+    else
+      return;
+  }
+}
+
+bool
+BytecodeCompiler::accept(wchar_t aChar)
+{
+  if (*mPos != aChar)
+    return false;
+
+  mPos++;
+  skipSpace();
+  return true;
+}
+
+void
+BytecodeCompiler::expect(wchar_t aChar)
+{
+  if (!accept(aChar))
+  {
+    wchar_t what[] = {L'\'', aChar, L'\'', 0};
+    fail(what);
+  }
+}
+
+std::wstring
+BytecodeCompiler::readName()
+{
+  const wchar_t* start = mPos;
+  while ((*mPos >= L'a' && *mPos <= L'z') || (*mPos >= L'A' && *mPos <= L'Z') ||
+         (*mPos >= L'0' && *mPos <= L'9' && mPos != start) || *mPos == L'_')
+    mPos++;
+
+  std::wstring name(start, mPos - start);
+  skipSpace();
+  return name;
+}
+
+uint32_t
+BytecodeCompiler::readIndex()
+{
+  expect(L'[');
+  wchar_t* end;
+  unsigned long index = wcstoul(mPos, &end, 10);
+  if (end == mPos)
+    fail(L"an array index");
+  mPos = end;
+  skipSpace();
+  expect(L']');
+  return index;
+}
+
+void
+BytecodeCompiler::fail(const std::wstring& aWhat)
+{
+  std::wstring near(mPos, std::min(wcslen(mPos), (size_t)40));
+  throw BytecodeError(L"Model cannot be interpreted: expected " + aWhat +
+                      L" in generated code at \"" + near + L"\"");
+}
+
+uint32_t
+BytecodeCompiler::emit
+(
+ BytecodeOpcode aOpcode,
+ uint32_t aDest,
+ uint32_t aA,
+ uint32_t aB
+)
+{
+  BytecodeInstruction i = {aOpcode, aDest, aA, aB};
+  mFunction->push_back(i);
+  return mFunction->size() - 1;
+}
+
+void
+BytecodeCompiler::compileStatement()
+{
+  std::wstring name = readName();
+
+  if (name == L"if")
+  {
+    std::vector<uint32_t> ends;
+    while (true)
+    {
+      compileExpression(0);
+      uint32_t skip = emit(BytecodeOpJumpIfZero, 0, 0, 0);
+      compileBlock();
+
+      const wchar_t* save = mPos;
+      if (readName() != L"else")
+      {
+        mPos = save;
+        (*mFunction)[skip].b = mFunction->size();
+        break;
+      }
+      ends.push_back(emit(BytecodeOpJump, 0, 0, 0));
+      (*mFunction)[skip].b = mFunction->size();
+      if (readName() != L"if")
+        fail(L"'if'");
+    }
+
+    for (std::vector<uint32_t>::iterator i = ends.begin(); i != ends.end(); i++)
+      (*mFunction)[*i].b = mFunction->size();
+    return;
+  }
+
+  BytecodeOpcode store = BytecodeOpStoreConstant;
+  if (name == L"CONSTANTS")
+    store = BytecodeOpStoreConstant;
+  else if (name == L"RATES")
+    store = BytecodeOpStoreRate;
+  else if (name == L"STATES")
+    store = BytecodeOpStoreState;
+  else if (name == L"ALGEBRAIC")
+    store = BytecodeOpStoreAlgebraic;
+  else
+    fail(L"an assignment");
+
+  uint32_t index = readIndex();
+  if (accept(L'?'))
+  {
+    if (store == BytecodeOpStoreConstant)
+      store = BytecodeOpOverrideConstant;
+  }
+  expect(L'=');
+  compileExpression(0);
+  expect(L';');
+  emit(store, index, 0, 0);
+}
+
+void
+BytecodeCompiler::compileBlock()
+{
+  expect(L'{');
+  while (!accept(L'}'))
+  {
+    if (*mPos == 0)
+      fail(L"'}'");
+    compileStatement();
+  }
+}
+
+void
+BytecodeCompiler::loadNumber(double aValue, uint32_t aRegister)
+{
+  mProgram.mNumbers.push_back(aValue);
+  emit(BytecodeOpLoadNumber, aRegister, mProgram.mNumbers.size() - 1, 0);
+}
+
+void
+BytecodeCompiler::compileExpression(uint32_t aRegister)
+{
+  // Leaves room for the few extra registers that compileCall uses.
+  if (aRegister + 4 > BYTECODE_REGISTER_COUNT)
+    throw BytecodeError(L"Model cannot be interpreted because its expressions "
+                        L"are nested too deeply");
+
+  if (accept(L'('))
+  {
+    compileExpression(aRegister);
+    expect(L')');
+    return;
+  }
+
+  if ((*mPos >= L'0' && *mPos <= L'9') || *mPos == L'.' || *mPos == L'-' ||
+      *mPos == L'+')
+  {
+    // Scoped locale change.
+    CNumericLocale locobj;
+
+    wchar_t* end;
+    double value = wcstod(mPos, &end);
+    if (end == mPos)
+      fail(L"a number");
+    mPos = end;
+    skipSpace();
+    loadNumber(value, aRegister);
+    return;
+  }
+
+  std::wstring name = readName();
+  if (name == L"")
+    fail(L"an expression");
+  else if (name == L"VOI")
+    emit(BytecodeOpLoadVOI, aRegister, 0, 0);
+  else if (name == L"CONSTANTS")
+    emit(BytecodeOpLoadConstant, aRegister, readIndex(), 0);
+  else if (name == L"RATES")
+    emit(BytecodeOpLoadRate, aRegister, readIndex(), 0);
+  else if (name == L"STATES")
+    emit(BytecodeOpLoadState, aRegister, readIndex(), 0);
+  else if (name == L"ALGEBRAIC")
+    emit(BytecodeOpLoadAlgebraic, aRegister, readIndex(), 0);
+  else if (name == L"inf")
+    loadNumber(strtod("INF", NULL), aRegister);
+  else if (name == L"nan")
+    loadNumber(strtod("NAN", NULL), aRegister);
+  else
+    compileCall(name, aRegister);
+}
+
+void
+BytecodeCompiler::compileCall(const std::wstring& aName, uint32_t aRegister)
+{
+  expect(L'(');
+  if (aName == L"piecewise")
+  {
+    compilePiecewise(aRegister);
+    return;
+  }
+
+  const BytecodeFunctionInfo* info = NULL;
+  for (size_t i = 0; i < sizeof(sBytecodeFunctions) / sizeof(sBytecodeFunctions[0]);
+       i++)
+    if (aName == sBytecodeFunctions[i].mName)
+    {
+      info = sBytecodeFunctions + i;
+      break;
+    }
+  if (info == NULL)
+    throw BytecodeError(L"Model cannot be interpreted because it uses " +
+                        aName);
+
+  switch (info->mKind)
+  {
+  case BYTECODE_UNARY:
+    compileExpression(aRegister);
+    emit(info->mOpcode, aRegister, aRegister, 0);
+    break;
+
+  case BYTECODE_BINARY:
+    compileExpression(aRegister);
+    expect(L',');
+    compileExpression(aRegister + 1);
+    emit(info->mOpcode, aRegister, aRegister, aRegister + 1);
+    break;
+
+  case BYTECODE_FOLD:
+    compileExpression(aRegister);
+    while (accept(L','))
+    {
+      compileExpression(aRegister + 1);
+      emit(info->mOpcode, aRegister, aRegister, aRegister + 1);
+    }
+    break;
+
+  case BYTECODE_CHAIN:
+    {
+      // Each argument is kept until it has been compared with the next one,
+      // and the comparisons are anded together.
+      uint32_t last = aRegister + 1, next = aRegister + 2,
+        compared = aRegister + 3;
+      compileExpression(last);
+      loadNumber(1.0, aRegister);
+      while (accept(L','))
+      {
+        compileExpression(next);
+        emit(info->mOpcode, compared, last, next);
+        emit(BytecodeOpAnd, aRegister, aRegister, compared);
+        emit(BytecodeOpMove, last, next, 0);
+      }
+    }
+    break;
+  }
+  expect(L')');
+}
+
+void
+BytecodeCompiler::compilePiecewise(uint32_t aRegister)
+{
+  // Alternating conditions and values, ending with the otherwise value. Only
+  // the value chosen is evaluated, as in the C code.
+  std::vector<uint32_t> ends;
+  while (true)
+  {
+    compileExpression(aRegister + 1);
+    if (accept(L')'))
+    {
+      emit(BytecodeOpMove, aRegister, aRegister + 1, 0);
+      break;
+    }
+    expect(L',');
+
+    uint32_t skip = emit(BytecodeOpJumpIfZero, 0, aRegister + 1, 0);
+    compileExpression(aRegister);
+    ends.push_back(emit(BytecodeOpJump, 0, 0, 0));
+    (*mFunction)[skip].b = mFunction->size();
+    expect(L',');
+  }
+
+  for (std::vector<uint32_t>::iterator i = ends.begin(); i != ends.end(); i++)
+    (*mFunction)[*i].b = mFunction->size();
+}
+
+bool
+CanInterpretMaths(iface::cellml_api::Model* aModel, std::wstring& aError)
+{
+  RETURN_INTO_OBJREF(ccs, iface::cellml_api::CellMLComponentSet,
+                     aModel->allComponents());
+  RETURN_INTO_OBJREF(cci, iface::cellml_api::CellMLComponentIterator,
+                     ccs->iterateComponents());
+  while (true)
+  {
+    RETURN_INTO_OBJREF(c, iface::cellml_api::CellMLComponent,
+                       cci->nextComponent());
+    if (c == NULL)
+      break;
+
+    RETURN_INTO_OBJREF(ml, iface::cellml_api::MathList, c->math());
+    RETURN_INTO_OBJREF(mei, iface::cellml_api::MathMLElementIterator,
+                       ml->iterate());
+    while (true)
+    {
+      RETURN_INTO_OBJREF(me, iface::mathml_dom::MathMLElement, mei->next());
+      if (me == NULL)
+        break;
+
+      RETURN_INTO_OBJREF(ints, iface::dom::NodeList,
+                         me->getElementsByTagNameNS(MATHML_NS, L"int"));
+      if (ints->length() != 0)
+      {
+        aError = sCannotInterpret;
+        return false;
+      }
+
+      RETURN_INTO_OBJREF(csymbols, iface::dom::NodeList,
+                         me->getElementsByTagNameNS(MATHML_NS, L"csymbol"));
+      for (uint32_t i = 0, l = csymbols->length(); i < l; i++)
+      {
+        RETURN_INTO_OBJREF(n, iface::dom::Node, csymbols->item(i));
+        DECLARE_QUERY_INTERFACE_OBJREF(el, n, dom::Element);
+        if (el == NULL)
+          continue;
+        RETURN_INTO_WSTRING(url, el->getAttribute(L"definitionURL"));
+        if (url.compare(0, wcslen(UNCERTAINTY_NS), UNCERTAINTY_NS) == 0)
+        {
+          aError = sCannotInterpret;
+          return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+bool
+CompileBytecode
+(
+ iface::cellml_services::CodeInformation* aCCI,
+ BytecodeProgram& aProgram,
+ std::wstring& aError
+)
+{
+  RETURN_INTO_WSTRING(funcs, aCCI->functionsString());
+  if (funcs != L"")
+  {
+    aError = sCannotInterpret;
+    return false;
+  }
+
+  aProgram.mAlgebraicCount = aCCI->algebraicIndexCount();
+
+  try
+  {
+    BytecodeCompiler compiler(aProgram);
+
+    RETURN_INTO_WSTRING(initConsts, aCCI->initConstsString());
+    compiler.compile(initConsts, aProgram.mSetupConstants);
+    RETURN_INTO_WSTRING(rates, aCCI->ratesString());
+    compiler.compile(rates, aProgram.mComputeRates);
+    RETURN_INTO_WSTRING(variables, aCCI->variablesString());
+    compiler.compile(variables, aProgram.mComputeVariables);
+
+    uint32_t fragmentCount = aCCI->variablesFragmentCount();
+    aProgram.mVariablesFragments.resize(fragmentCount);
+    for (uint32_t i = 0; i < fragmentCount; i++)
+    {
+      RETURN_INTO_WSTRING(fragment, aCCI->variablesFragmentString(i));
+      compiler.compile(fragment, aProgram.mVariablesFragments[i]);
+    }
+  }
+  catch (BytecodeError& be)
+  {
+    aError = be.mMessage;
+    return false;
+  }
+
+  return true;
+}
+
+void
+BytecodeProgram::run
+(
+ const BytecodeFunction& aFunction,
+ double VOI,
+ double* CONSTANTS,
+ double* RATES,
+ double* STATES,
+ double* ALGEBRAIC,
+ struct Override* OVERRIDES
+) const
+{
+  double r[BYTECODE_REGISTER_COUNT];
+  const double* numbers = mNumbers.empty() ? NULL : &mNumbers[0];
+  const BytecodeInstruction* code = &aFunction[0], * pc = code;
+
+#ifdef BYTECODE_THREADED_DISPATCH
+#define BYTECODE_LABEL_ADDRESS(name) &&Label##name,
+  static void* const labels[] = { BYTECODE_OPCODES(BYTECODE_LABEL_ADDRESS) };
+#undef BYTECODE_LABEL_ADDRESS
+#define CASE(name) Label##name:
+#define DISPATCH goto *labels[pc->opcode]
+  DISPATCH;
+#else
+#define CASE(name) case BytecodeOp##name:
+#define DISPATCH continue
+  for (;;)
+  switch (pc->opcode)
+  {
+#endif
+#define NEXT { pc++; DISPATCH; }
+#define UNARY(name, expr) CASE(name) { double a = r[pc->a]; r[pc->dest] = (expr); } NEXT
+#define BINARY(name, expr) CASE(name) { double a = r[pc->a], b = r[pc->b]; r[pc->dest] = (expr); } NEXT
+
+  CASE(Return)
+    return;
+  CASE(Jump)
+    pc = code + pc->b;
+    DISPATCH;
+  CASE(JumpIfZero)
+    if (r[pc->a] == 0.0)
+    {
+      pc = code + pc->b;
+      DISPATCH;
+    }
+    NEXT
+  CASE(Move) r[pc->dest] = r[pc->a]; NEXT
+  CASE(LoadNumber) r[pc->dest] = numbers[pc->a]; NEXT
+  CASE(LoadVOI) r[pc->dest] = VOI; NEXT
+  CASE(LoadConstant) r[pc->dest] = CONSTANTS[pc->a]; NEXT
+  CASE(LoadRate) r[pc->dest] = RATES[pc->a]; NEXT
+  CASE(LoadState) r[pc->dest] = STATES[pc->a]; NEXT
+  CASE(LoadAlgebraic) r[pc->dest] = ALGEBRAIC[pc->a]; NEXT
+  CASE(StoreConstant) CONSTANTS[pc->dest] = r[pc->a]; NEXT
+  CASE(OverrideConstant)
+    if (OVERRIDES == NULL || !OVERRIDES->isOverriden[pc->dest])
+      CONSTANTS[pc->dest] = r[pc->a];
+    NEXT
+  CASE(StoreRate) RATES[pc->dest] = r[pc->a]; NEXT
+  CASE(StoreState) STATES[pc->dest] = r[pc->a]; NEXT
+  CASE(StoreAlgebraic) ALGEBRAIC[pc->dest] = r[pc->a]; NEXT
+
+  UNARY(Negate, -a)
+  UNARY(Not, a == 0.0 ? 1.0 : 0.0)
+  UNARY(Abs, fabs(a))
+  UNARY(Exp, exp(a))
+  UNARY(Ln, log(a))
+  UNARY(Floor, floor(a))
+  UNARY(Ceiling, ceil(a))
+  UNARY(Factorial, factorial(a))
+  UNARY(Sin, sin(a))
+  UNARY(Cos, cos(a))
+  UNARY(Tan, tan(a))
+  UNARY(Sinh, sinh(a))
+  UNARY(Cosh, cosh(a))
+  UNARY(Tanh, tanh(a))
+  UNARY(ArcSin, asin(a))
+  UNARY(ArcCos, acos(a))
+  UNARY(ArcTan, atan(a))
+  UNARY(ArcSinh, asinh(a))
+  UNARY(ArcCosh, acosh(a))
+  UNARY(ArcTanh, atanh(a))
+
+  BINARY(Add, a + b)
+  BINARY(Subtract, a - b)
+  BINARY(Multiply, a * b)
+  BINARY(Divide, a / b)
+  BINARY(Power, pow(a, b))
+  BINARY(LogBase, arbitrary_log(a, b))
+  BINARY(Quotient, safe_quotient(a, b))
+  BINARY(Remainder, safe_remainder(a, b))
+  BINARY(FactorOf, safe_factorof(a, b))
+  BINARY(Gcd, gcd_pair(a, b))
+  BINARY(Lcm, lcm_pair(a, b))
+  BINARY(Minimum, b < a ? b : a)
+  BINARY(Maximum, b > a ? b : a)
+  BINARY(And, (a != 0.0 && b != 0.0) ? 1.0 : 0.0)
+  BINARY(Or, (a != 0.0 || b != 0.0) ? 1.0 : 0.0)
+  BINARY(Xor, ((a != 0.0) != (b != 0.0)) ? 1.0 : 0.0)
+  BINARY(Equal, a == b ? 1.0 : 0.0)
+  BINARY(NotEqual, a != b ? 1.0 : 0.0)
+  BINARY(Less, a < b ? 1.0 : 0.0)
+  BINARY(LessEqual, a <= b ? 1.0 : 0.0)
+  BINARY(Greater, a > b ? 1.0 : 0.0)
+  BINARY(GreaterEqual, a >= b ? 1.0 : 0.0)
+
+#ifndef BYTECODE_THREADED_DISPATCH
+  }
+#endif
+#undef BINARY
+#undef UNARY
+#undef NEXT
+#undef DISPATCH
+#undef CASE
+}
+
+static void
+BytecodeSetupConstants(double* CONSTANTS, double* RATES, double* STATES,
+                       struct Override* OVERRIDES, struct fail_info* failInfo)
+{
+  const BytecodeProgram* p = failInfo->bytecode;
+  // As in the C code, any algebraic variables the constants need are only
+  // kept until they are computed.
+  std::vector<double> algebraic(p->mAlgebraicCount + 1);
+  p->run(p->mSetupConstants, 0.0, CONSTANTS, RATES, STATES, &algebraic[0],
+         OVERRIDES);
+}
+
+static void
+BytecodeComputeRates(double VOI, double* CONSTANTS, double* RATES,
+                     double* STATES, double* ALGEBRAIC,
+                     struct fail_info* failInfo)
+{
+  const BytecodeProgram* p = failInfo->bytecode;
+  p->run(p->mComputeRates, VOI, CONSTANTS, RATES, STATES, ALGEBRAIC, NULL);
+}
+
+static void
+BytecodeComputeVariables(double VOI, double* CONSTANTS, double* RATES,
+                         double* STATES, double* ALGEBRAIC,
+                         struct fail_info* failInfo)
+{
+  const BytecodeProgram* p = failInfo->bytecode;
+  p->run(p->mComputeVariables, VOI, CONSTANTS, RATES, STATES, ALGEBRAIC, NULL);
+}
+
+static void
+BytecodeComputeSelectedVariables(double VOI, double* CONSTANTS, double* RATES,
+                                 double* STATES, double* ALGEBRAIC,
+                                 const char* NEEDED, struct fail_info* failInfo)
+{
+  const BytecodeProgram* p = failInfo->bytecode;
+  for (size_t i = 0; i < p->mVariablesFragments.size(); i++)
+    if (NEEDED[i])
+      p->run(p->mVariablesFragments[i], VOI, CONSTANTS, RATES, STATES,
+             ALGEBRAIC, NULL);
+}
+
+CompiledModelFunctions*
+SetupBytecodeModelFunctions()
+{
+  CompiledModelFunctions* cmf = new CompiledModelFunctions;
+  cmf->SetupConstants = BytecodeSetupConstants;
+  cmf->ComputeRates = BytecodeComputeRates;
+  cmf->ComputeVariables = BytecodeComputeVariables;
+  cmf->ComputeSelectedVariables = BytecodeComputeSelectedVariables;
+  // The solvers fall back to finite differences and to their own handling
+  // of discontinuities without these.
+  cmf->ComputeRatesBatch = NULL;
+  cmf->ComputeJacobian = NULL;
+  cmf->ComputeRootInformation = NULL;
+  cmf->ComputeLinearCoefficients = NULL;
+  return cmf;
+}
@@ -0,0 +1,90 @@
+#ifndef _CISBytecode_hxx
+#define _CISBytecode_hxx
+
+#include "Utilities.hxx"
+#include "IfaceCCGS.hxx"
+#include <string>
+#include <vector>
+
+struct Override;
+struct CompiledModelFunctions;
+
+/*
+ * A register machine for running models without a C compiler. The code
+ * generator is set up by SetupBytecodeCodeGenStrings to write the model in a
+ * simple prefix notation, which CompileBytecode then turns into instructions
+ * operating on a small file of registers and on the model's own arrays.
+ */
+#define BYTECODE_OPCODES(OP) \
+  OP(Return) OP(Jump) OP(JumpIfZero) OP(Move) \
+  OP(LoadNumber) OP(LoadVOI) OP(LoadConstant) OP(LoadRate) OP(LoadState) \
+  OP(LoadAlgebraic) OP(StoreConstant) OP(OverrideConstant) OP(StoreRate) \
+  OP(StoreState) OP(StoreAlgebraic) \
+  OP(Negate) OP(Not) OP(Abs) OP(Exp) OP(Ln) OP(Floor) OP(Ceiling) \
+  OP(Factorial) OP(Sin) OP(Cos) OP(Tan) OP(Sinh) OP(Cosh) OP(Tanh) \
+  OP(ArcSin) OP(ArcCos) OP(ArcTan) OP(ArcSinh) OP(ArcCosh) OP(ArcTanh) \
+  OP(Add) OP(Subtract) OP(Multiply) OP(Divide) OP(Power) OP(LogBase) \
+  OP(Quotient) OP(Remainder) OP(FactorOf) OP(Gcd) OP(Lcm) OP(Minimum) \
+  OP(Maximum) OP(And) OP(Or) OP(Xor) OP(Equal) OP(NotEqual) OP(Less) \
+  OP(LessEqual) OP(Greater) OP(GreaterEqual)
+
+#define BYTECODE_OPCODE_ENUM(name) BytecodeOp##name,
+enum BytecodeOpcode
+{
+  BYTECODE_OPCODES(BYTECODE_OPCODE_ENUM)
+  BytecodeOpcodeCount
+};
+#undef BYTECODE_OPCODE_ENUM
+
+// The size of the register file. Each statement starts again from register
+// zero, and an expression needs about one register per level of nesting.
+#define BYTECODE_REGISTER_COUNT 256
+
+/*
+ * DEST is a register, or for stores the index into the array. A and B are
+ * registers, except that loads read index A of their array (or of the
+ * program's numbers), and jumps go to instruction B (if register A is zero,
+ * for JumpIfZero).
+ */
+struct BytecodeInstruction
+{
+  uint32_t opcode, dest, a, b;
+};
+
+typedef std::vector<BytecodeInstruction> BytecodeFunction;
+
+class BytecodeProgram
+{
+public:
+  BytecodeProgram() : mAlgebraicCount(0) {}
+
+  void run(const BytecodeFunction& aFunction, double VOI, double* CONSTANTS,
+           double* RATES, double* STATES, double* ALGEBRAIC,
+           struct Override* OVERRIDES) const;
+
+  std::vector<double> mNumbers;
+  BytecodeFunction mSetupConstants, mComputeRates, mComputeVariables;
+  // One for each of the code information's variables fragments.
+  std::vector<BytecodeFunction> mVariablesFragments;
+  uint32_t mAlgebraicCount;
+};
+
+// Sets up a code generator to write code that CompileBytecode can read.
+void SetupBytecodeCodeGenStrings(iface::cellml_services::CodeGenerator* aCG);
+
+// Returns false, with a message in aError, if the model's maths has definite
+// integrals or samples from distributions. The code generator set up for the
+// interpreter can't write those, so this must be checked before its
+// constraint level is.
+bool CanInterpretMaths(iface::cellml_api::Model* aModel, std::wstring& aError);
+
+// Returns false, with a message in aError, if the code uses anything that
+// the interpreter can't run.
+bool CompileBytecode(iface::cellml_services::CodeInformation* aCCI,
+                     BytecodeProgram& aProgram, std::wstring& aError);
+
+// The returned functions find the program through the fail_info passed to
+// them, which must have its bytecode member set.
+CompiledModelFunctions* SetupBytecodeModelFunctions();
+
+#endif // _CISBytecode_hxx
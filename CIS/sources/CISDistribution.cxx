@@ -0,0 +1,204 @@
+#define MODULE_CONTAINS_CIS
+#include "CISDistribution.hxx"
+#include "CISImplementation.hxx"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// The most points in one table, and the most tables a model keeps.
+#define DISTRIBUTION_TABLE_MAX_POINTS 65536
+#define DISTRIBUTION_CACHE_SIZE 1024
+// How many times an interval of the starting points may be halved.
+#define DISTRIBUTION_MAX_DEPTH 40
+
+DistributionKey::DistributionKey
+(
+ DensityFunction aPDF, int aRootCount, DensityFunction* aRootFuncs,
+ double aLow, double aHigh, double aTolerance
+)
+{
+  // Keys are compared byte by byte, so the padding must be zero too.
+  memset(this, 0, sizeof(*this));
+  pdf = aPDF;
+  rootFuncs = aRootFuncs;
+  rootCount = aRootCount;
+  low = aLow;
+  high = aHigh;
+  tolerance = aTolerance;
+}
+
+double
+DistributionKey::probePoint(uint32_t i) const
+{
+  return low + (high - low) * (i + 0.5) / DISTRIBUTION_PROBE_COUNT;
+}
+
+bool
+DistributionKey::operator<(const DistributionKey& aOther) const
+{
+  return memcmp(this, &aOther, sizeof(*this)) < 0;
+}
+
+struct CDFInterval
+{
+  double a, fa, m, fm, b, fb;
+  uint32_t depth;
+};
+
+static bool
+RootBetween(int aRootCount, DensityFunction* aRootFuncs, double* aConstants,
+            double* aAlgebraic, struct fail_info* aFailInfo, double a, double b)
+{
+  for (int i = 0; i < aRootCount; i++)
+  {
+    double ga = aRootFuncs[i](a, aConstants, aAlgebraic, aFailInfo);
+    double gb = aRootFuncs[i](b, aConstants, aAlgebraic, aFailInfo);
+    if ((ga < 0.0 && gb > 0.0) || (ga > 0.0 && gb < 0.0))
+      return true;
+  }
+  return false;
+}
+
+bool
+InverseCDFTable::build
+(
+ DensityFunction aPDF, int aRootCount, DensityFunction* aRootFuncs,
+ double* aConstants, double* aAlgebraic, struct fail_info* aFailInfo,
+ const std::vector<double>& aStartPoints, double aTolerance
+)
+{
+  mX.clear();
+  mCDF.clear();
+
+#define PDF(x) std::max(0.0, aPDF(x, aConstants, aAlgebraic, aFailInfo))
+  std::vector<double> f(aStartPoints.size());
+  for (uint32_t i = 0; i < aStartPoints.size(); i++)
+    f[i] = PDF(aStartPoints[i]);
+  if (aFailInfo->failtype)
+    return false;
+
+  double range = aStartPoints.back() - aStartPoints.front();
+  double total = 0.0;
+  mX.push_back(aStartPoints.front());
+  mCDF.push_back(0.0);
+
+  // Simpson's rule over each interval and over its two halves, halving the
+  // interval until the difference, which is about fifteen times the error of
+  // the latter, is within its share of the tolerance, and until the c.d.f.
+  // at the midpoint is within the tolerance of the linear interpolation.
+  std::vector<CDFInterval> stack;
+  for (uint32_t i = 0; i + 1 < aStartPoints.size(); i++)
+  {
+    CDFInterval whole = { aStartPoints[i], f[i], 0.0, 0.0,
+                          aStartPoints[i + 1], f[i + 1], 0 };
+    whole.m = 0.5 * (whole.a + whole.b);
+    whole.fm = PDF(whole.m);
+    stack.push_back(whole);
+
+    while (!stack.empty())
+    {
+      CDFInterval iv = stack.back();
+      stack.pop_back();
+
+      double ml = 0.5 * (iv.a + iv.m), mr = 0.5 * (iv.m + iv.b);
+      double fml = PDF(ml), fmr = PDF(mr);
+      if (aFailInfo->failtype)
+        return false;
+
+      double s = (iv.b - iv.a) / 6.0 * (iv.fa + 4.0 * iv.fm + iv.fb);
+      double sl = (iv.m - iv.a) / 6.0 * (iv.fa + 4.0 * fml + iv.fm);
+      double sr = (iv.b - iv.m) / 6.0 * (iv.fm + 4.0 * fmr + iv.fb);
+
+      bool split =
+        iv.depth < DISTRIBUTION_MAX_DEPTH &&
+        mX.size() + 2 * stack.size() < DISTRIBUTION_TABLE_MAX_POINTS &&
+        ml > iv.a && mr < iv.b &&
+        (std::abs(sl + sr - s) > 15.0 * aTolerance * (iv.b - iv.a) / range ||
+         std::abs(sl - 0.5 * (sl + sr)) > aTolerance ||
+         RootBetween(aRootCount, aRootFuncs, aConstants, aAlgebraic,
+                     aFailInfo, iv.a, iv.b));
+      if (aFailInfo->failtype)
+        return false;
+
+      if (!split)
+      {
+        mX.push_back(iv.m);
+        mCDF.push_back(total + sl);
+        total += sl + sr;
+        mX.push_back(iv.b);
+        mCDF.push_back(total);
+        continue;
+      }
+
+      // The left half goes on top, so the points come out in order.
+      CDFInterval right = { iv.m, iv.fm, mr, fmr, iv.b, iv.fb, iv.depth + 1 };
+      CDFInterval left = { iv.a, iv.fa, ml, fml, iv.m, iv.fm, iv.depth + 1 };
+      stack.push_back(right);
+      stack.push_back(left);
+    }
+  }
+#undef PDF
+
+  if (!(total > 0.0) || !cdamath::isfinite(total))
+    return false;
+  for (std::vector<double>::iterator i = mCDF.begin(); i != mCDF.end(); i++)
+    *i /= total;
+
+  return true;
+}
+
+double
+InverseCDFTable::sample(double aU) const
+{
+  std::vector<double>::const_iterator i =
+    std::upper_bound(mCDF.begin(), mCDF.end(), aU);
+  if (i == mCDF.begin())
+    return mX.front();
+  if (i == mCDF.end())
+    return mX.back();
+
+  // mCDF[k - 1] <= aU < mCDF[k].
+  size_t k = i - mCDF.begin();
+  return mX[k - 1] + (mX[k] - mX[k - 1]) * (aU - mCDF[k - 1]) /
+    (mCDF[k] - mCDF[k - 1]);
+}
+
+DistributionTableCache::~DistributionTableCache()
+{
+  for (std::map<DistributionKey, InverseCDFTable*>::iterator i = mTables.begin();
+       i != mTables.end(); i++)
+    delete (*i).second;
+}
+
+double
+DistributionTableCache::tolerance()
+{
+  CDALock l(mMutex);
+  return mTolerance;
+}
+
+void
+DistributionTableCache::tolerance(double aTolerance)
+{
+  CDALock l(mMutex);
+  mTolerance = aTolerance;
+}
+
+const InverseCDFTable*
+DistributionTableCache::find(const DistributionKey& aKey)
+{
+  CDALock l(mMutex);
+  std::map<DistributionKey, InverseCDFTable*>::iterator i = mTables.find(aKey);
+  return (i == mTables.end()) ? NULL : (*i).second;
+}
+
+bool
+DistributionTableCache::add(const DistributionKey& aKey,
+                            InverseCDFTable* aTable)
+{
+  CDALock l(mMutex);
+  if (mTables.size() >= DISTRIBUTION_CACHE_SIZE)
+    return false;
+  return mTables.insert(std::pair<DistributionKey, InverseCDFTable*>
+                        (aKey, aTable)).second;
+}
@@ -0,0 +1,101 @@
+#ifndef _CISDistribution_hxx
+#define _CISDistribution_hxx
+
+#include "Utilities.hxx"
+#include <map>
+#include <vector>
+
+struct fail_info;
+
+typedef double (*DensityFunction)(double bvar, double* CONSTANTS,
+                                  double* ALGEBRAIC, struct fail_info*);
+
+// How far out the tabulated c.d.f. of a distribution may be, unless the
+// model says otherwise.
+#define DISTRIBUTION_DEFAULT_TOLERANCE 1E-6
+
+// The number of points inside its range at which a p.d.f. is evaluated to
+// tell it apart from others using the same code.
+#define DISTRIBUTION_PROBE_COUNT 32
+
+/*
+ * Identifies a tabulated distribution: the generated functions for it, the
+ * range in which its p.d.f. is non-zero, the values of its p.d.f. at
+ * DISTRIBUTION_PROBE_COUNT points evenly spread over that range, and the
+ * tolerance it was tabulated to. The generated code doesn't say which
+ * constants the p.d.f. depends on, so its values stand in for them.
+ */
+struct DistributionKey
+{
+  // Fills in everything but the probes, which are left for the caller.
+  DistributionKey(DensityFunction aPDF, int aRootCount,
+                  DensityFunction* aRootFuncs, double aLow, double aHigh,
+                  double aTolerance);
+
+  // The point at which probe i is taken.
+  double probePoint(uint32_t i) const;
+
+  bool operator<(const DistributionKey& aOther) const;
+
+  DensityFunction pdf;
+  DensityFunction* rootFuncs;
+  double rootCount, low, high, tolerance;
+  double probes[DISTRIBUTION_PROBE_COUNT];
+};
+
+/*
+ * The cumulative distribution function of a distribution, tabulated finely
+ * enough that interpolating linearly between the points is out by no more
+ * than the tolerance, so it can be inverted to sample from the distribution
+ * with a binary search.
+ */
+class InverseCDFTable
+{
+public:
+  InverseCDFTable() {}
+
+  // Tabulates aPDF over aStartPoints, which must be in order and cover the
+  // range in which it is non-zero, adding points where needed. Intervals
+  // in which any of aRootFuncs (marking where aPDF is discontinuous) changes
+  // sign are also split down as far as they go. Returns false if aPDF failed,
+  // leaving the failure in aFailInfo, or if it is zero throughout.
+  bool build(DensityFunction aPDF, int aRootCount, DensityFunction* aRootFuncs,
+             double* aConstants, double* aAlgebraic, struct fail_info* aFailInfo,
+             const std::vector<double>& aStartPoints, double aTolerance);
+
+  // The point at which the c.d.f. is aU, for aU in [0, 1].
+  double sample(double aU) const;
+
+private:
+  // mCDF[i] is the c.d.f. at mX[i], normalised to end at 1.
+  std::vector<double> mX, mCDF;
+};
+
+/*
+ * The tables for the distributions a compiled model has sampled from, kept
+ * for as long as the model so that every run and ensemble member sampling
+ * from the same distribution shares one.
+ */
+class DistributionTableCache
+{
+public:
+  DistributionTableCache() : mTolerance(DISTRIBUTION_DEFAULT_TOLERANCE) {}
+  ~DistributionTableCache();
+
+  double tolerance();
+  void tolerance(double aTolerance);
+
+  // Returns the table for aKey, or NULL if there is none.
+  const InverseCDFTable* find(const DistributionKey& aKey);
+
+  // Takes aTable, and returns true, unless the cache is full or already has
+  // a table for aKey, in which case the caller keeps it.
+  bool add(const DistributionKey& aKey, InverseCDFTable* aTable);
+
+private:
+  CDAMutex mMutex;
+  double mTolerance;
+  std::map<DistributionKey, InverseCDFTable*> mTables;
+};
+
+#endif // _CISDistribution_hxx
@@ -12,6 +12,8 @@
 #include <dlfcn.h>
 #include <sys/utsname.h>
 #include <unistd.h>
+#include <utime.h>
+#include <stdio.h>
 #else
 #include <io.h>
 #include <fcntl.h>
@@ -21,6 +23,8 @@
 #endif
 #include "CISImplementation.hxx"
 #include <fstream>
+#include <vector>
+#include <algorithm>
 #include "CISBootstrap.hpp"
 #ifdef _MSC_VER
 #include <direct.h>
@@ -34,55 +38,251 @@
 #undef min
 #undef max
 #ifdef ENABLE_CLANG
-#include "llvm/LLVMContext.h"
-#include "llvm/Module.h"
-#include "llvm/ADT/IntrusiveRefCntPtr.h"
-#include "llvm/ADT/OwningPtr.h"
-#include "llvm/ADT/SmallVector.h"
-#include "llvm/ExecutionEngine/ExecutionEngine.h"
-#include "llvm/ExecutionEngine/JIT.h"
-#include "llvm/Support/TargetSelect.h"
+#include "llvm/Config/llvm-config.h"
+#if LLVM_VERSION_MAJOR < 14 || LLVM_VERSION_MAJOR > 16
+#error "The clang JIT needs LLVM 14, 15 or 16"
+#endif
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/Host.h"
-#include "llvm/Support/Path.h"
-#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetMachine.h"
 
 #include "clang/Basic/Diagnostic.h"
 #include "clang/Basic/DiagnosticIDs.h"
 #include "clang/Basic/DiagnosticOptions.h"
 #include "clang/CodeGen/CodeGenAction.h"
-#include "clang/Driver/Compilation.h"
-#include "clang/Driver/Driver.h"
-#include "clang/Driver/Job.h"
-#include "clang/Driver/Tool.h"
-#include "clang/Driver/Util.h"
-#include "clang/Frontend/CompilerInvocation.h"
 #include "clang/Frontend/CompilerInstance.h"
-#include "clang/Frontend/TextDiagnosticPrinter.h"
-#include <clang/CodeGen/CodeGenAction.h>
-#include <llvm/Support/MemoryBuffer.h>
-#include <sstream>
+#include "clang/Frontend/CompilerInvocation.h"
+#include <memory>
+#endif
+
+#ifdef ENABLE_CLANG
+static std::wstring
+LLVMErrorToWString(llvm::Error aError)
+{
+  std::string msg = llvm::toString(std::move(aError));
+  std::wstring wmsg;
+  for (std::string::iterator i = msg.begin(); i != msg.end(); i++)
+    wmsg += (wchar_t)(unsigned char)*i;
+  return wmsg;
+}
+
+/*
+ * The JIT session shared by all models compiled in process. Each model gets
+ * its own dylib, so that it can be unloaded by itself, and each compilation
+ * has its own LLVM context, so that several models can be compiled at once.
+ */
+class ModelJIT
+{
+public:
+  // Returns NULL, with a message in aError, if there is no JIT for this host.
+  static ModelJIT* singleton(std::wstring& aError);
+
+  // Optimises aModule for the host and adds it to a new dylib.
+  llvm::orc::JITDylib* addModule(std::unique_ptr<llvm::Module> aModule,
+                                 std::unique_ptr<llvm::LLVMContext> aContext,
+                                 std::wstring& aError);
+  void* getSymbol(llvm::orc::JITDylib& aDylib, const char* aName);
+  void removeDylib(llvm::orc::JITDylib& aDylib);
+
+  // What clang should generate code for.
+  std::string mTriple, mCPU;
+  std::vector<std::string> mFeatures;
+
+private:
+  ModelJIT(llvm::orc::JITTargetMachineBuilder& aBuilder,
+           std::unique_ptr<llvm::orc::LLJIT> aJIT);
+
+  static CDAMutex sCreationMutex;
+  static ModelJIT* sJIT;
+
+  llvm::orc::JITTargetMachineBuilder mTargetMachineBuilder;
+  std::unique_ptr<llvm::orc::LLJIT> mJIT;
+  CDAMutex mMutex;
+  uint32_t mDylibCount;
+};
+
+CDAMutex ModelJIT::sCreationMutex;
+ModelJIT* ModelJIT::sJIT = NULL;
+
+ModelJIT::ModelJIT
+(
+ llvm::orc::JITTargetMachineBuilder& aBuilder,
+ std::unique_ptr<llvm::orc::LLJIT> aJIT
+)
+  : mTargetMachineBuilder(aBuilder), mJIT(std::move(aJIT)), mDylibCount(0)
+{
+  mTriple = mTargetMachineBuilder.getTargetTriple().str();
+  mCPU = mTargetMachineBuilder.getCPU();
+  mFeatures = mTargetMachineBuilder.getFeatures().getFeatures();
+}
+
+ModelJIT*
+ModelJIT::singleton(std::wstring& aError)
+{
+  CDALock l(sCreationMutex);
+  if (sJIT != NULL)
+    return sJIT;
+
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  // Generate code for the CPU we are actually running on...
+  llvm::Expected<llvm::orc::JITTargetMachineBuilder> builder =
+    llvm::orc::JITTargetMachineBuilder::detectHost();
+  if (!builder)
+  {
+    aError = L"Cannot set up LLVM for this machine: " +
+      LLVMErrorToWString(builder.takeError());
+    return NULL;
+  }
+  builder->setCodeGenOptLevel(llvm::CodeGenOpt::Aggressive);
+
+  // Compile threads make LLJIT give each compilation its own target machine,
+  // so models being looked up on different threads don't share one.
+  llvm::Expected<std::unique_ptr<llvm::orc::LLJIT> > jit =
+    llvm::orc::LLJITBuilder()
+      .setJITTargetMachineBuilder(*builder)
+      .setNumCompileThreads(CISThreadPool::processorCount())
+      .create();
+  if (!jit)
+  {
+    aError = L"Cannot create LLVM JIT: " + LLVMErrorToWString(jit.takeError());
+    return NULL;
+  }
+
+  sJIT = new ModelJIT(*builder, std::move(*jit));
+  return sJIT;
+}
+
+llvm::orc::JITDylib*
+ModelJIT::addModule
+(
+ std::unique_ptr<llvm::Module> aModule,
+ std::unique_ptr<llvm::LLVMContext> aContext,
+ std::wstring& aError
+)
+{
+  llvm::Expected<std::unique_ptr<llvm::TargetMachine> > tm =
+    mTargetMachineBuilder.createTargetMachine();
+  if (!tm)
+  {
+    aError = L"Cannot create LLVM target machine: " +
+      LLVMErrorToWString(tm.takeError());
+    return NULL;
+  }
+  aModule->setDataLayout((*tm)->createDataLayout());
+  aModule->setTargetTriple((*tm)->getTargetTriple().str());
+
+  // clang left the optimisation to us, so that the target machine can tell
+  // the vectoriser and friends what the host supports.
+  {
+    llvm::LoopAnalysisManager lam;
+    llvm::FunctionAnalysisManager fam;
+    llvm::CGSCCAnalysisManager cgam;
+    llvm::ModuleAnalysisManager mam;
+    llvm::PassBuilder pb(tm->get());
+    pb.registerModuleAnalyses(mam);
+    pb.registerCGSCCAnalyses(cgam);
+    pb.registerFunctionAnalyses(fam);
+    pb.registerLoopAnalyses(lam);
+    pb.crossRegisterProxies(lam, fam, cgam, mam);
+    llvm::ModulePassManager mpm =
+      pb.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3);
+    mpm.run(*aModule, mam);
+  }
+
+  std::string name = "model";
+  {
+    CDALock l(mMutex);
+    char buf[20];
+    any_snprintf(buf, sizeof(buf), "%u", mDylibCount++);
+    name += buf;
+  }
+
+  llvm::Expected<llvm::orc::JITDylib&> dylib = mJIT->createJITDylib(name);
+  if (!dylib)
+  {
+    aError = L"Cannot create LLVM dylib: " +
+      LLVMErrorToWString(dylib.takeError());
+    return NULL;
+  }
+
+  // The generated code calls the C library and CISModelSupport.h functions
+  // in this process...
+  llvm::Expected<std::unique_ptr<llvm::orc::DynamicLibrarySearchGenerator> >
+    generator = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess
+    (mJIT->getDataLayout().getGlobalPrefix());
+  if (!generator)
+  {
+    aError = L"Cannot resolve symbols for LLVM: " +
+      LLVMErrorToWString(generator.takeError());
+    removeDylib(*dylib);
+    return NULL;
+  }
+  dylib->addGenerator(std::move(*generator));
+
+  llvm::Error err =
+    mJIT->addIRModule(*dylib, llvm::orc::ThreadSafeModule(std::move(aModule),
+                                                          std::move(aContext)));
+  if (err)
+  {
+    aError = L"Cannot add the model to LLVM: " +
+      LLVMErrorToWString(std::move(err));
+    removeDylib(*dylib);
+    return NULL;
+  }
+
+  return &*dylib;
+}
+
+void*
+ModelJIT::getSymbol(llvm::orc::JITDylib& aDylib, const char* aName)
+{
+  // Models only define the optional functions they need...
+  llvm::Expected<llvm::JITEvaluatedSymbol> symbol = mJIT->lookup(aDylib, aName);
+  if (!symbol)
+  {
+    llvm::consumeError(symbol.takeError());
+    return NULL;
+  }
+  return (void*)(uintptr_t)symbol->getAddress();
+}
+
+void
+ModelJIT::removeDylib(llvm::orc::JITDylib& aDylib)
+{
+  llvm::consumeError(mJIT->getExecutionSession().removeJITDylib(aDylib));
+}
 #endif
 
 class CompiledModule {
 public:
 #ifdef ENABLE_CLANG
-  llvm::OwningPtr<llvm::Module> mModule;
-  llvm::OwningPtr<llvm::ExecutionEngine> mExecutionEngine;
-  std::list<llvm::Function*> mFunctions;
+  CompiledModule(llvm::orc::JITDylib* aDylib)
+    : mDylib(aDylib)
+  {
+  }
+
+  llvm::orc::JITDylib* mDylib;
 
   void*
   getSymbol(const char* aName)
   {
-    llvm::Function* f = mModule->getFunction(aName);
-    // mFunctions.push_back(f);
-    return mExecutionEngine->getPointerToFunction(f);
+    std::wstring ignore;
+    return ModelJIT::singleton(ignore)->getSymbol(*mDylib, aName);
   }
 
   ~CompiledModule()
   {
-    for (std::list<llvm::Function*>::iterator i = mFunctions.begin();
-         i != mFunctions.end(); i++)
-      delete (*i);
+    std::wstring ignore;
+    ModelJIT::singleton(ignore)->removeDylib(*mDylib);
   }
 #else
   void* mModule;
@@ -141,6 +341,219 @@ attempt_make_tempdir(const char* parentDir)
   }
 }
 
+#if !defined(ENABLE_CLANG) && !defined(WIN32)
+/*
+ * Compiled models are kept in an on-disk cache, named by a hash of the
+ * generated source and the compiler command line, so identical models don't
+ * have to go through the compiler again. The cache lives in
+ * $CELLML_CIS_CACHE_DIR (set it to an empty string to disable caching), or
+ * by default under $XDG_CACHE_HOME or ~/.cache. Entries are written under a
+ * temporary name and renamed into place, so concurrent users never see a
+ * partial file, and the least recently used entries are removed once the
+ * total size goes over $CELLML_CIS_CACHE_SIZE bytes. As the entries get
+ * loaded into the process, the cache is only used if the directory belongs
+ * to the user and nobody else can write to it.
+ */
+#define MODEL_CACHE_DEFAULT_SIZE (256 * 1024 * 1024)
+// Temporary files older than this (in seconds) were left by a process that
+// died before it could rename them into place.
+#define MODEL_CACHE_TMP_MAX_AGE 3600
+
+static std::string
+GetModelCacheDirectory()
+{
+  std::string dir;
+  const char* env = getenv("CELLML_CIS_CACHE_DIR");
+  if (env != NULL)
+    dir = env;
+  else
+  {
+    env = getenv("XDG_CACHE_HOME");
+    if (env != NULL && env[0] != 0)
+      dir = env;
+    else
+    {
+      env = getenv("HOME");
+      if (env == NULL || env[0] == 0)
+        return "";
+      dir = env;
+      dir += "/.cache";
+      mkdir(dir.c_str(), 0700);
+    }
+    dir += "/cellml-cis";
+  }
+
+  if (dir.empty())
+    return dir;
+  if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST)
+    return "";
+
+  struct stat st;
+  if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) ||
+      st.st_uid != getuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+    return "";
+  return dir;
+}
+
+static bool
+ComputeModelCacheKey(const std::string& aSourceFile, const std::string& aFlags,
+                     std::string& aKey)
+{
+  std::ifstream in(aSourceFile.c_str(), std::ios::in | std::ios::binary);
+  if (!in.good())
+    return false;
+
+  // Two FNV-1a hashes with different offset bases, giving a 128 bit key.
+  uint64_t h1 = 0xcbf29ce484222325ULL, h2 = 0x84222325cbf29ce4ULL;
+  const uint64_t prime = 0x100000001b3ULL;
+  std::string::const_iterator i;
+  for (i = aFlags.begin(); i != aFlags.end(); i++)
+  {
+    h1 = (h1 ^ static_cast<unsigned char>(*i)) * prime;
+    h2 = (h2 ^ static_cast<unsigned char>(*i)) * prime;
+  }
+  h1 *= prime;
+  h2 *= prime;
+
+  char buf[4096];
+  while (in.good())
+  {
+    in.read(buf, sizeof(buf));
+    std::streamsize n = in.gcount();
+    for (std::streamsize j = 0; j < n; j++)
+    {
+      h1 = (h1 ^ static_cast<unsigned char>(buf[j])) * prime;
+      h2 = (h2 ^ static_cast<unsigned char>(buf[j])) * prime;
+    }
+  }
+
+  char key[33];
+  snprintf(key, sizeof(key), "%016llx%016llx",
+           static_cast<unsigned long long>(h1),
+           static_cast<unsigned long long>(h2));
+  aKey = key;
+  return true;
+}
+
+struct ModelCacheEntry
+{
+  time_t mTime;
+  uint64_t mSize;
+  std::string mPath;
+
+  bool operator<(const ModelCacheEntry& aOther) const
+  {
+    return mTime < aOther.mTime;
+  }
+};
+
+static void
+TrimModelCache(const std::string& aDir)
+{
+  uint64_t limit = MODEL_CACHE_DEFAULT_SIZE;
+  const char* env = getenv("CELLML_CIS_CACHE_SIZE");
+  if (env != NULL && env[0] != 0)
+    limit = strtoull(env, NULL, 10);
+
+  DIR* d = opendir(aDir.c_str());
+  if (d == NULL)
+    return;
+
+  std::vector<ModelCacheEntry> entries;
+  uint64_t total = 0;
+  time_t now = time(NULL);
+  struct dirent* de;
+  while ((de = readdir(d)))
+  {
+    size_t l = strlen(de->d_name);
+    bool isTemporary = l >= 4 && !strcmp(de->d_name + l - 4, ".tmp");
+    if (!isTemporary && (l < 3 || strcmp(de->d_name + l - 3, ".so")))
+      continue;
+    ModelCacheEntry e;
+    e.mPath = aDir + "/" + de->d_name;
+    struct stat st;
+    if (stat(e.mPath.c_str(), &st) != 0)
+      continue;
+    if (isTemporary)
+    {
+      if (now - st.st_mtime > MODEL_CACHE_TMP_MAX_AGE)
+        unlink(e.mPath.c_str());
+      continue;
+    }
+    e.mTime = st.st_mtime;
+    e.mSize = st.st_size;
+    total += e.mSize;
+    entries.push_back(e);
+  }
+  closedir(d);
+
+  if (total <= limit)
+    return;
+
+  // Another process may be trimming at the same time, so failing to unlink
+  // something is not a problem.
+  std::sort(entries.begin(), entries.end());
+  for (std::vector<ModelCacheEntry>::iterator i = entries.begin();
+       i != entries.end() && total > limit; i++)
+  {
+    unlink((*i).mPath.c_str());
+    total -= (*i).mSize;
+  }
+}
+
+static void*
+LoadFromModelCache(const std::string& aCachePath)
+{
+  if (access(aCachePath.c_str(), R_OK) != 0)
+    return NULL;
+
+  void* t = dlopen(aCachePath.c_str(), RTLD_NOW);
+  if (t == NULL)
+  {
+    // A broken entry; get rid of it so it gets rebuilt.
+    unlink(aCachePath.c_str());
+    return NULL;
+  }
+
+  // Update the modification time so the least recently used entries go first.
+  utime(aCachePath.c_str(), NULL);
+  return t;
+}
+
+static void
+StoreInModelCache(const std::string& aDir, const std::string& aCachePath,
+                  const std::string& aBuilt)
+{
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%lu.%08x.tmp",
+           static_cast<unsigned long>(getpid()),
+           static_cast<unsigned int>(sharedRandom()->randomUInt32()));
+  std::string tmpPath = aCachePath + suffix;
+  {
+    std::ifstream in(aBuilt.c_str(), std::ios::in | std::ios::binary);
+    std::ofstream out(tmpPath.c_str(), std::ios::out | std::ios::binary);
+    if (!in.good() || !out.good())
+      return;
+    out << in.rdbuf();
+    out.close();
+    if (out.fail())
+    {
+      unlink(tmpPath.c_str());
+      return;
+    }
+  }
+
+  if (rename(tmpPath.c_str(), aCachePath.c_str()) != 0)
+  {
+    unlink(tmpPath.c_str());
+    return;
+  }
+
+  TrimModelCache(aDir);
+}
+#endif
+
+
 CompiledModelFunctions*
 SetupCompiledModelFunctions(CompiledModule* module)
 {
@@ -151,6 +564,15 @@ SetupCompiledModelFunctions(CompiledModule* module)
     module->getSymbol("ComputeRates");
   cmf->ComputeVariables = (void (*)(double,double*,double*,double*,double*,struct fail_info*))
     module->getSymbol("ComputeVariables");
+  cmf->ComputeSelectedVariables = (void (*)(double,double*,double*,double*,double*,const char*,struct fail_info*))
+    module->getSymbol("ComputeSelectedVariables");
+  cmf->ComputeRatesBatch = NULL;
+  cmf->ComputeJacobian = (void (*)(double,double*,double*,double*,double*,double**,struct fail_info*))
+    module->getSymbol("ComputeJacobian");
+  cmf->ComputeRootInformation = (void (*)(double,double*,double*,double*,double*,double*,struct fail_info*))
+    module->getSymbol("ComputeRootInformation");
+  cmf->ComputeLinearCoefficients = (void (*)(double,double*,double*,double*,double*,double*,struct fail_info*))
+    module->getSymbol("ComputeLinearCoefficients");
   return cmf;
 }
 
@@ -162,6 +584,8 @@ SetupIDACompiledModelFunctions(CompiledModule* module)
     module->getSymbol("SetupFixedConstants");
   cmf->EvaluateVariables = (void (*)(double, double*, double*, double*, double*, double*, struct fail_info*))
     module->getSymbol("EvaluateVariables");
+  cmf->EvaluateSelectedVariables = (void (*)(double, double*, double*, double*, double*, double*, const char*, struct fail_info*))
+    module->getSymbol("EvaluateSelectedVariables");
   cmf->EvaluateEssentialVariables = (void (*)(double, double*, double*, double*, double*, double*, double*, double*, struct fail_info*))
     module->getSymbol("EvaluateEssentialVariables");
   cmf->ComputeResiduals = (void (*)(double, double*, double*, double*, double*, double*, double*, double*, double*, struct fail_info*))
@@ -170,6 +594,8 @@ SetupIDACompiledModelFunctions(CompiledModule* module)
     module->getSymbol("ComputeRootInformation");
   cmf->SetupStateInfo = (void (*)(double*))
     module->getSymbol("SetupStateInfo");
+  cmf->ComputeJacobian = (void (*)(double, double, double*, double*, double*, double*, double*, double*, double*, double**, struct fail_info*))
+    module->getSymbol("ComputeJacobian");
   return cmf;
 }
 
@@ -180,114 +606,89 @@ CDA_CellMLIntegrationService::CompileSource
 )
 {
 #ifdef ENABLE_CLANG
-  LLVMLinkInJIT();
-  // This code is modified from the code in OpenCOR.
-
-  // Firstly use the driver as if we were going to do a compilation, but don't
-  // actually run the compilation (we just do this to get the arguments we need).
-  clang::DiagnosticsEngine diagnosticsEngine
-    (
-     llvm::IntrusiveRefCntPtr<clang::DiagnosticIDs>(new clang::DiagnosticIDs()),
-     NULL
-    );
-  clang::driver::Driver driver(
-                               "internal code compilation",
-                               llvm::sys::getDefaultTargetTriple(),
-                               "", true, diagnosticsEngine);
-
-  const char* args[] = { "internal code compilation", "-fsyntax-only", "-Wno-implicit-function-declaration", "-O3", sourceFile.c_str()
-                       };
-  llvm::OwningPtr<clang::driver::Compilation> compilation
-    (driver.BuildCompilation(llvm::ArrayRef<const char*>(args, sizeof(args)/sizeof(char*))));
+  std::wstring jitError;
+  ModelJIT* jit = ModelJIT::singleton(jitError);
+  if (jit == NULL)
+  {
+    lastError = jitError;
+    throw iface::cellml_api::CellMLException(jitError);
+  }
 
-  if (!compilation)
+  // Go straight to the frontend, targeting the host exactly. Optimisation
+  // happens once the module is in the JIT, with the host target machine.
+  std::vector<const char*> args;
+  args.push_back("-triple");
+  args.push_back(jit->mTriple.c_str());
+  args.push_back("-target-cpu");
+  args.push_back(jit->mCPU.c_str());
+  for (std::vector<std::string>::iterator i = jit->mFeatures.begin();
+       i != jit->mFeatures.end(); i++)
   {
-    mLastError = L"Cannot create an LLVM compiler driver.";
-    throw iface::cellml_api::CellMLException(L"Cannot create an LLVM compiler driver.");
+    args.push_back("-target-feature");
+    args.push_back(i->c_str());
   }
+  args.push_back("-O3");
+  args.push_back("-disable-llvm-passes");
+  args.push_back("-w");
+#ifdef ENABLE_FAST_MATH
+  args.push_back("-ffast-math");
+#endif
+  args.push_back(sourceFile.c_str());
 
-  const clang::driver::JobList &jobList =
-    compilation->getJobs();
-  const clang::driver::Command* command =
-    llvm::cast<clang::driver::Command>(*(compilation->getJobs().begin()));
-  const clang::driver::ArgStringList &commandArguments = command->getArguments();
-  llvm::OwningPtr<clang::CompilerInvocation> compilerInvocation(new clang::CompilerInvocation());
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticOptions> diagnosticOptions
+    (new clang::DiagnosticOptions());
+  clang::IgnoringDiagConsumer ignoreDiagnostics;
+  clang::DiagnosticsEngine diagnosticsEngine
+    (llvm::IntrusiveRefCntPtr<clang::DiagnosticIDs>(new clang::DiagnosticIDs()),
+     &*diagnosticOptions, &ignoreDiagnostics, false);
 
-  clang::CompilerInvocation::CreateFromArgs(*compilerInvocation.get(),
-                                            const_cast<const char **>(commandArguments.data()),
-                                            const_cast<const char **>(commandArguments.data())+
-                                            commandArguments.size(),
-                                            diagnosticsEngine);
+  std::shared_ptr<clang::CompilerInvocation> compilerInvocation
+    (new clang::CompilerInvocation());
+  if (!clang::CompilerInvocation::CreateFromArgs(*compilerInvocation, args,
+                                                 diagnosticsEngine))
+  {
+    lastError = L"Cannot set up the LLVM compiler.";
+    throw iface::cellml_api::CellMLException(lastError);
+  }
 
   // By default, Clang deliberately leaks memory so it is faster if it is
   // just going to exit anyway. Tell it not to do that.
-  compilerInvocation->getFrontendOpts().DisableFree = 0;
-
-    // Create a compiler instance to handle the actual work
+  compilerInvocation->getFrontendOpts().DisableFree = false;
 
-    clang::CompilerInstance compilerInstance;
-
-    compilerInstance.setInvocation(compilerInvocation.take());
-
-    // Create the compiler instance's diagnostics engine
-
-#ifdef DEBUG_LLVM
-    llvm::IntrusiveRefCntPtr<clang::DiagnosticOptions> diagnosticOptions = new clang::DiagnosticOptions();
-#endif
-    compilerInstance.createDiagnostics(int(commandArguments.size()),
-                                       const_cast<char **>(commandArguments.data()),
+  clang::CompilerInstance compilerInstance;
+  compilerInstance.setInvocation(compilerInvocation);
 #ifdef DEBUG_LLVM
-                                       new clang::TextDiagnosticPrinter(llvm::outs(), &*diagnosticOptions)
+  compilerInstance.createDiagnostics();
 #else
-                                       NULL
+  compilerInstance.createDiagnostics(new clang::IgnoringDiagConsumer());
 #endif
-                                      );
-    // Create an LLVM module
-
-    llvm::OwningPtr<CompiledModule> clangData(new CompiledModule());
-
-    clangData->mModule.reset
-      (new llvm::Module(sourceFile, llvm::getGlobalContext()));
-
-    // Initialise the native target, so not only can we then create a JIT
-    // execution engine, but more importantly its data layout will match that of
-    // our target platform...
-
-    llvm::InitializeNativeTarget();
-
-    // Create an execution engine
-
-    std::string whyFail;
-    clangData->mExecutionEngine.reset
-      (llvm::ExecutionEngine::createJIT(clangData->mModule.get(), &whyFail));
-
-    if (!clangData->mExecutionEngine)
-    {
-      wchar_t buffer[1024];
-      mbstowcs(buffer, whyFail.c_str(), 1024);
-      buffer[1023] = 0;
-      mLastError = std::wstring(L"Cannot create LLVM execution engine: ") + buffer;
-      throw iface::cellml_api::CellMLException(std::wstring(L"Cannot create LLVM execution engine: ") + buffer);
-    }
-
-    // Create and execute the frontend to generate the LLVM assembly code,
-    // making sure that all added functions end up in the same module
-
-    llvm::OwningPtr<clang::CodeGenAction> codeGenerationAction
-      (new clang::EmitLLVMOnlyAction(&clangData->mModule->getContext()));
 
-    codeGenerationAction->setLinkModule(clangData->mModule.take());
+  // Each compilation has its own context, which goes to the JIT with the
+  // module, so models can be compiled on several threads at once.
+  std::unique_ptr<llvm::LLVMContext> context(new llvm::LLVMContext());
+  clang::EmitLLVMOnlyAction codeGenerationAction(context.get());
+  if (!compilerInstance.ExecuteAction(codeGenerationAction))
+  {
+    lastError = L"Error generating code with LLVM.";
+    throw iface::cellml_api::CellMLException(lastError);
+  }
 
-    if (!compilerInstance.ExecuteAction(*codeGenerationAction))
-    {
-      mLastError = L"Error generating code with LLVM.";
-      throw iface::cellml_api::CellMLException(L"Error generating code with LLVM.");
-    }
+  std::unique_ptr<llvm::Module> module = codeGenerationAction.takeModule();
+  if (!module)
+  {
+    lastError = L"Error generating code with LLVM.";
+    throw iface::cellml_api::CellMLException(lastError);
+  }
 
-    // Switch from the source module to the linked module.
-    clangData->mModule.reset(codeGenerationAction->takeModule());
+  llvm::orc::JITDylib* dylib =
+    jit->addModule(std::move(module), std::move(context), jitError);
+  if (dylib == NULL)
+  {
+    lastError = jitError;
+    throw iface::cellml_api::CellMLException(jitError);
+  }
 
-    return clangData.take();
+  return new CompiledModule(dylib);
 #else // ENABLE_CLANG
   setvbuf(stdout, NULL, _IONBF, 0);
   std::string targ = destDir;
@@ -327,6 +728,7 @@ CDA_CellMLIntegrationService::CompileSource
     "-shared -o";
 #endif
 
+  std::string flags = cmd;
   cmd += targ;
   cmd += " ";
   cmd += sourceFile;
@@ -431,7 +833,35 @@ CDA_CellMLIntegrationService::CompileSource
   uname(&u);
 
   if (!strcmp(u.machine, "x86_64"))
+  {
     cmd += " -fPIC";
+    flags += " -fPIC";
+  }
+
+#ifdef __linux__
+  // -nodefaultlibs leaves out libgcc, which has the CPU detection used to
+  // choose between the target_clones of ComputeRatesBatch.
+  cmd += " -lgcc";
+  flags += " -lgcc";
+#endif
+
+  // See if an identical model has already been compiled with the same flags...
+  std::string cacheDir = GetModelCacheDirectory(), cachePath;
+  if (!cacheDir.empty())
+  {
+    std::string key;
+    if (ComputeModelCacheKey(sourceFile, flags, key))
+    {
+      cachePath = cacheDir + "/" + key + ".so";
+      void* cached = LoadFromModelCache(cachePath);
+      if (cached != NULL)
+      {
+        CompiledModule *mod = new CompiledModule();
+        mod->mModule = cached;
+        return mod;
+      }
+    }
+  }
 
   // Execute the command (i.e. compile the model)
 
@@ -465,6 +895,11 @@ CDA_CellMLIntegrationService::CompileSource
     throw iface::cellml_api::CellMLException(lastError);
   }
 
+#ifndef WIN32
+  if (!cachePath.empty())
+    StoreInModelCache(cacheDir, cachePath, targ);
+#endif
+
   CompiledModule *mod = new CompiledModule();
   mod->mModule = t;
   return mod;
@@ -479,13 +914,65 @@ CDA_CellMLCompiledModel::CDA_CellMLCompiledModel
  std::string& aDirname
 )
   : mModule(aModule), mModel(aModel), mCCI(aCCI),
-    mDirname(aDirname)
+    mDirname(aDirname), mJacobianLowerBandwidth(0),
+    mJacobianUpperBandwidth(0), mJacobianNonZeroCount(0)
+{
+  uint32_t n = aCCI->rateIndexCount();
+  std::vector<std::vector<uint32_t> > allDeps(n);
+  for (uint32_t row = 0; row < n; row++)
+  {
+    std::vector<uint32_t>& deps = allDeps[row];
+    deps = aCCI->rateDependencies(row);
+    mJacobianNonZeroCount += deps.size();
+    for (std::vector<uint32_t>::iterator i = deps.begin(); i != deps.end(); i++)
+    {
+      if (*i > row && *i - row > mJacobianUpperBandwidth)
+        mJacobianUpperBandwidth = *i - row;
+      else if (*i < row && row - *i > mJacobianLowerBandwidth)
+        mJacobianLowerBandwidth = row - *i;
+    }
+  }
+  mJacobianColouring.compute(allDeps);
+}
+
+// Below this many states, a dense factorisation is cheap whatever the
+// structure of the Jacobian...
+#define DENSE_SOLVER_SIZE_LIMIT 50
+// Use a band solver if the band is no wider than this fraction of the matrix.
+#define BAND_SOLVER_MAX_WIDTH_FRACTION 0.25
+// Use a Krylov solver if no more than this fraction of the matrix is
+// structurally non-zero.
+#define KRYLOV_SOLVER_MAX_DENSITY 0.1
+
+iface::cellml_services::LinearSolverType
+CDA_CellMLCompiledModel::chooseLinearSolver
+(
+ iface::cellml_services::LinearSolverType aRequested,
+ uint32_t aSize
+)
 {
+  if (aRequested != iface::cellml_services::LINEAR_SOLVER_AUTOMATIC)
+    return aRequested;
+
+  if (aSize <= DENSE_SOLVER_SIZE_LIMIT)
+    return iface::cellml_services::LINEAR_SOLVER_DENSE;
+
+  if (mJacobianLowerBandwidth + mJacobianUpperBandwidth + 1 <=
+      BAND_SOLVER_MAX_WIDTH_FRACTION * aSize)
+    return iface::cellml_services::LINEAR_SOLVER_BAND;
+
+  if (mJacobianNonZeroCount <= KRYLOV_SOLVER_MAX_DENSITY * aSize * aSize)
+    return iface::cellml_services::LINEAR_SOLVER_SPGMR;
+
+  return iface::cellml_services::LINEAR_SOLVER_DENSE;
 }
 
 CDA_CellMLCompiledModel::~CDA_CellMLCompiledModel()
 {
   delete mModule;
+  // Interpreted models never had any generated code to clean up.
+  if (mDirname.empty())
+    return;
 #ifdef WIN32
   struct _finddata_t d;
   intptr_t hd;
@@ -516,32 +1003,69 @@ CDA_CellMLCompiledModel::~CDA_CellMLCompiledModel()
   rmdir(mDirname.c_str());
 }
 
+std::vector<double>
+CDA_ODESolverModel::computeRatesBatch
+(
+ double voi,
+ const std::vector<double>& constants,
+ const std::vector<double>& states
+)
+  throw(std::exception&)
+{
+  if (mBatchWidth == 0 || mCMF->ComputeRatesBatch == NULL)
+    throw iface::cellml_api::CellMLException(L"Model was not compiled for batch evaluation");
+
+  uint32_t constSize = mCCI->constantIndexCount();
+  uint32_t rateSize = mCCI->rateIndexCount();
+  uint32_t algSize = mCCI->algebraicIndexCount();
+  if (constants.size() != constSize * mBatchWidth ||
+      states.size() != rateSize * mBatchWidth)
+    throw iface::cellml_api::CellMLException(L"Wrong number of values passed to computeRatesBatch");
+
+  // The condition variables go after the algebraic variables...
+  std::vector<double> c(constants), s(states), rates(rateSize * mBatchWidth),
+    algebraic((algSize + mConditionVariableCount) * mBatchWidth + 1);
+  struct fail_info failInfo;
+  mCMF->ComputeRatesBatch(voi, c.empty() ? NULL : &c[0],
+                          rates.empty() ? NULL : &rates[0],
+                          s.empty() ? NULL : &s[0], &algebraic[0], &failInfo);
+  if (failInfo.failtype)
+    throw iface::cellml_api::CellMLException(L"Batch rate evaluation failed");
+
+  return rates;
+}
+
 CDA_CellMLIntegrationRun::CDA_CellMLIntegrationRun
 (
 )
   : 
   mIsStarted(false),
   mStepType(iface::cellml_services::RUNGE_KUTTA_FEHLBERG_4_5),
+  mLinearSolverType(iface::cellml_services::LINEAR_SOLVER_AUTOMATIC),
+  mPriority(0), mNonlinearSolverThreads(1), mCacheDefiniteIntegrals(false),
   mEpsAbs(1E-6), mEpsRel(1E-6), mScalVar(1.0), mScalRate(0.0),
   mStepSizeMax(1.0), mStartBvar(0.0), mStopBvar(10.0), mMaxPointDensity(10000.0),
   mTabulationStepSize(0.0), mObserver(NULL), mCancelIntegration(false),
-  mPauseIntegration(false), mStrictTabulation(false)
+  mPauseIntegration(false), mStrictTabulation(false),
+  mInterpolateTabulation(false), mContinueSolver(false),
+  mExternalCancel(NULL), mSolveStarted(0.0)
 {
+#ifdef WIN32
+  mResumeEvent = CreateEvent(NULL, TRUE, TRUE, NULL);
+#else
+  pthread_mutex_init(&mPauseMutex, NULL);
+  pthread_cond_init(&mPauseCond, NULL);
+#endif
 }
 
 CDA_CellMLIntegrationRun::~CDA_CellMLIntegrationRun()
 {
-  if (mIsStarted)
-  {
 #ifdef WIN32
-    CloseHandle(mThreadPipes[0]);
-    CloseHandle(mThreadPipes[1]);
-    CloseHandle(mThreadSemaphore);
+  CloseHandle(mResumeEvent);
 #else
-    close(mThreadPipes[0]);
-    close(mThreadPipes[1]);
+  pthread_cond_destroy(&mPauseCond);
+  pthread_mutex_destroy(&mPauseMutex);
 #endif
-  }
   if (mObserver != NULL)
     mObserver->release_ref();
 }
@@ -565,67 +1089,195 @@ CDA_CellMLIntegrationRun::stepType
   mStepType = aStepType;
 }
 
-void
-CDA_CellMLIntegrationRun::setStepSizeControl
+iface::cellml_services::LinearSolverType
+CDA_CellMLIntegrationRun::linearSolverType
 (
- double epsAbs, double epsRel, double scalVar,
- double scalRate, double maxStep
 )
   throw (std::exception&)
 {
-  mEpsAbs = epsAbs;
-  mEpsRel = epsRel;
-  mScalVar = scalVar;
-  mScalRate = scalRate;
-  mStepSizeMax = maxStep;
+  return mLinearSolverType;
 }
 
 void
-CDA_CellMLIntegrationRun::setTabulationStepControl
+CDA_CellMLIntegrationRun::linearSolverType
 (
-  double tabulationStepSize, bool strictTabulation
+ iface::cellml_services::LinearSolverType aType
 )
+  throw(std::exception&)
+{
+  mLinearSolverType = aType;
+}
+
+int32_t
+CDA_CellMLIntegrationRun::priority()
   throw (std::exception&)
 {
-  mTabulationStepSize = tabulationStepSize;
-  mStrictTabulation = strictTabulation;
+  return mPriority;
 }
 
 void
-CDA_CellMLIntegrationRun::setResultRange
-(
- double startBvar, double stopBvar, double maxPointDensity
-)
+CDA_CellMLIntegrationRun::priority(int32_t aPriority)
   throw (std::exception&)
 {
-  mStartBvar = startBvar;
-  mStopBvar = stopBvar;
-  mMaxPointDensity = maxPointDensity;
+  mPriority = aPriority;
 }
 
-void
-CDA_CellMLIntegrationRun::setProgressObserver
-(
- iface::cellml_services::IntegrationProgressObserver* aIpo
-)
+bool
+CDA_CellMLIntegrationRun::continueSolver()
   throw (std::exception&)
 {
-  if (mObserver != NULL)
-    mObserver->release_ref();
-  mObserver = aIpo;
-  if (mObserver != NULL)
-    mObserver->add_ref();
+  return mContinueSolver;
 }
 
 void
-CDA_CellMLIntegrationRun::setOverride
-(
- iface::cellml_services::VariableEvaluationType aType,
- uint32_t variableIndex, double newValue
-)
+CDA_CellMLIntegrationRun::continueSolver(bool aContinue)
   throw (std::exception&)
 {
-  if (aType == iface::cellml_services::CONSTANT)
+  mContinueSolver = aContinue;
+}
+
+uint32_t
+CDA_CellMLIntegrationRun::nonlinearSolverThreads()
+  throw (std::exception&)
+{
+  return mNonlinearSolverThreads;
+}
+
+void
+CDA_CellMLIntegrationRun::nonlinearSolverThreads(uint32_t aThreads)
+  throw (std::exception&)
+{
+  mNonlinearSolverThreads = aThreads;
+}
+
+bool
+CDA_CellMLIntegrationRun::cacheDefiniteIntegrals()
+  throw (std::exception&)
+{
+  return mCacheDefiniteIntegrals;
+}
+
+void
+CDA_CellMLIntegrationRun::cacheDefiniteIntegrals(bool aCache)
+  throw (std::exception&)
+{
+  mCacheDefiniteIntegrals = aCache;
+}
+
+void
+CDA_CellMLIntegrationRun::setupNonlinearSolverThreading
+(
+ fail_info& aFailInfo, uint32_t aConstSize, uint32_t aRateSize,
+ uint32_t aStateSize, uint32_t aAlgSize
+)
+{
+  NonlinearSolverThreading& t = aFailInfo.nlsThreading;
+  t.threads = (mNonlinearSolverThreads == 0) ?
+    CISThreadPool::processorCount() : mNonlinearSolverThreads;
+  t.priority = mPriority;
+  t.constants = aConstSize;
+  t.rates = aRateSize;
+  t.states = aStateSize;
+  t.algebraic = aAlgSize;
+}
+
+void
+CDA_CellMLIntegrationRun::setStepSizeControl
+(
+ double epsAbs, double epsRel, double scalVar,
+ double scalRate, double maxStep
+)
+  throw (std::exception&)
+{
+  mEpsAbs = epsAbs;
+  mEpsRel = epsRel;
+  mScalVar = scalVar;
+  mScalRate = scalRate;
+  mStepSizeMax = maxStep;
+}
+
+void
+CDA_CellMLIntegrationRun::setTabulationStepControl
+(
+  double tabulationStepSize, bool strictTabulation
+)
+  throw (std::exception&)
+{
+  mTabulationStepSize = tabulationStepSize;
+  mStrictTabulation = strictTabulation;
+}
+
+bool
+CDA_CellMLIntegrationRun::interpolateTabulation()
+  throw (std::exception&)
+{
+  return mInterpolateTabulation;
+}
+
+void
+CDA_CellMLIntegrationRun::interpolateTabulation(bool aInterpolate)
+  throw (std::exception&)
+{
+  mInterpolateTabulation = aInterpolate;
+}
+
+void
+CDA_CellMLIntegrationRun::setResultBatching
+(
+ uint32_t maxPoints, uint32_t maxBytes, double maxLatency
+)
+  throw (std::exception&)
+{
+  mResultBatching.maxPoints = maxPoints;
+  mResultBatching.maxBytes = maxBytes;
+  mResultBatching.maxLatency = maxLatency;
+}
+
+void
+CDA_CellMLIntegrationRun::setResultRange
+(
+ double startBvar, double stopBvar, double maxPointDensity
+)
+  throw (std::exception&)
+{
+  mStartBvar = startBvar;
+  mStopBvar = stopBvar;
+  mMaxPointDensity = maxPointDensity;
+}
+
+void
+CDA_CellMLIntegrationRun::setProgressObserver
+(
+ iface::cellml_services::IntegrationProgressObserver* aIpo
+)
+  throw (std::exception&)
+{
+  if (mObserver != NULL)
+    mObserver->release_ref();
+  mObserver = aIpo;
+  if (mObserver != NULL)
+    mObserver->add_ref();
+}
+
+already_AddRefd<iface::cellml_services::IntegrationStatistics>
+CDA_CellMLIntegrationRun::statistics
+(
+)
+  throw (std::exception&)
+{
+  CDALock l(mStatisticsMutex);
+  return new CDA_IntegrationStatistics(mPublishedStatistics);
+}
+
+void
+CDA_CellMLIntegrationRun::setOverride
+(
+ iface::cellml_services::VariableEvaluationType aType,
+ uint32_t variableIndex, double newValue
+)
+  throw (std::exception&)
+{
+  if (aType == iface::cellml_services::CONSTANT)
   {
     mConstantOverrides.push_back(std::pair<uint32_t,double>
                                  (variableIndex, newValue));
@@ -639,6 +1291,18 @@ CDA_CellMLIntegrationRun::setOverride
     throw iface::cellml_api::CellMLException(L"Call to setOverride on a variable that is neither constant nor state variable");
 }
 
+void
+CDA_CellMLIntegrationRun::addOutputColumn
+(
+ iface::cellml_services::OutputColumnType aType,
+ uint32_t aIndex
+)
+  throw (std::exception&)
+{
+  mOutputColumns.push_back(std::pair<iface::cellml_services::OutputColumnType,
+                                     uint32_t>(aType, aIndex));
+}
+
 void
 CDA_CellMLIntegrationRun::start()
   throw (std::exception&)
@@ -647,17 +1311,10 @@ CDA_CellMLIntegrationRun::start()
     throw iface::cellml_api::CellMLException(L"Call to start() on an integration run that is already started.");
   mIsStarted = true;
 
-#ifdef WIN32
-  CreatePipe(mThreadPipes, mThreadPipes + 1, NULL, 0);
-  mThreadSemaphore = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
-#else
-  pipe(mThreadPipes);
-#endif
-
-  // The new thread accesses this, so must add_ref. Thread will release itself
+  // The task accesses this, so must add_ref. The task will release itself
   // before returning.
   add_ref();
-  startthread();
+  CISThreadPool::singleton()->submit(this, mPriority);
 }
 
 void
@@ -666,15 +1323,16 @@ CDA_CellMLIntegrationRun::stop()
 {
   if (!mIsStarted || mCancelIntegration)
     return;
-  mCancelIntegration = true;
 
-  int stop = 1;
+  // Wake the solver thread up if it is paused...
 #ifdef WIN32
-  DWORD outCount;
-  WriteFile(mThreadPipes[1], &stop, sizeof(stop), &outCount, NULL);
-  ReleaseSemaphore(mThreadSemaphore, 1, NULL);
+  mCancelIntegration = true;
+  SetEvent(mResumeEvent);
 #else
-  write(mThreadPipes[1], &stop, sizeof(stop));
+  pthread_mutex_lock(&mPauseMutex);
+  mCancelIntegration = true;
+  pthread_cond_signal(&mPauseCond);
+  pthread_mutex_unlock(&mPauseMutex);
 #endif
 }
 
@@ -684,15 +1342,14 @@ CDA_CellMLIntegrationRun::pause()
 {
   if (!mIsStarted || mCancelIntegration || mPauseIntegration)
     return;
-  mPauseIntegration = true;
 
-  int pause = 2;
 #ifdef WIN32
-  DWORD outCount;
-  WriteFile(mThreadPipes[1], &pause, sizeof(pause), &outCount, NULL);
-  ReleaseSemaphore(mThreadSemaphore, 1, NULL);
+  ResetEvent(mResumeEvent);
+  mPauseIntegration = true;
 #else
-  write(mThreadPipes[1], &pause, sizeof(pause));
+  pthread_mutex_lock(&mPauseMutex);
+  mPauseIntegration = true;
+  pthread_mutex_unlock(&mPauseMutex);
 #endif
 }
 
@@ -703,22 +1360,30 @@ CDA_CellMLIntegrationRun::resume()
   if (!mIsStarted || mCancelIntegration || !mPauseIntegration)
     return;
 
-  mPauseIntegration = false;
-  int resume = 3;
 #ifdef WIN32
-  DWORD outCount;
-  WriteFile(mThreadPipes[1], &resume, sizeof(resume), &outCount, NULL);
-  ReleaseSemaphore(mThreadSemaphore, 1, NULL);
+  mPauseIntegration = false;
+  SetEvent(mResumeEvent);
 #else
-  write(mThreadPipes[1], &resume, sizeof(resume));
+  pthread_mutex_lock(&mPauseMutex);
+  mPauseIntegration = false;
+  pthread_cond_signal(&mPauseCond);
+  pthread_mutex_unlock(&mPauseMutex);
 #endif
 }
 
 void
-CDA_ODESolverRun::runthread()
+CDA_ODESolverRun::runtask()
+{
+  integrate();
+  release_ref(); // Task is finishing, cancel the add_ref call before submit.
+}
+
+void
+CDA_ODESolverRun::integrate()
 {
   struct fail_info failInfo;
   double* constants = NULL, * buffer = NULL, * algebraic, * rates, * states;
+  double started = WallClockTime();
 
   try
   {
@@ -726,9 +1391,11 @@ CDA_ODESolverRun::runthread()
     uint32_t algSize = mModel->mCCI->algebraicIndexCount();
     uint32_t constSize = mModel->mCCI->constantIndexCount();
     uint32_t rateSize = mModel->mCCI->rateIndexCount();
+    uint32_t condVarSize = mModel->mConditionVariableCount;
 
     constants = new double[constSize];
-    buffer = new double[2 * rateSize + algSize + 1];
+    // The condition variables go after the algebraic variables.
+    buffer = new double[2 * rateSize + algSize + 1 + condVarSize];
 
     buffer[0] = mStartBvar;
     states = buffer + 1;
@@ -736,6 +1403,7 @@ CDA_ODESolverRun::runthread()
     algebraic = rates + rateSize;
 
     memset(rates, 0, rateSize * sizeof(double));
+    memset(algebraic + algSize, 0, condVarSize * sizeof(double));
 
     struct Override overrides;
     overrides.isOverriden = new bool[constSize];
@@ -753,6 +1421,12 @@ CDA_ODESolverRun::runthread()
       }
 
     struct fail_info failInfo;
+    failInfo.bytecode = mModel->mBytecode;
+    failInfo.statistics = &mStatistics;
+    failInfo.distributionTables = &mModel->mDistributionTables;
+    failInfo.cacheIntegrals = mCacheDefiniteIntegrals;
+    setupNonlinearSolverThreading(failInfo, constSize, rateSize, rateSize,
+                                  algSize + condVarSize);
     f->SetupConstants(constants, rates, states, &overrides, &failInfo);
     if (failInfo.failtype)
       throw iface::cellml_api::CellMLException(L"failInfo.failtype (internal)"); // Caught below.
@@ -764,29 +1438,43 @@ CDA_ODESolverRun::runthread()
          oli++)
       if ((*oli).first < rateSize)
         states[(*oli).first] = (*oli).second;
+    mStatistics.setupTime = WallClockTime() - started;
 
     if (mObserver != NULL)
     {
       std::vector<double> constantsVec(constants, constants + constSize);
+      double observerStarted = WallClockTime();
       mObserver->computedConstants(constantsVec);
+      mStatistics.observerTime = WallClockTime() - observerStarted;
     }
+    mSolveStarted = WallClockTime();
+
+    setupOutputColumns(mModel->mCCI);
+    // Ensemble members already run on a worker thread and their observer
+    // just gathers results, so they deliver them directly.
+    ResultStream stream(mObserver, outputRecordSize(rateSize, algSize),
+                        mResultBatching, mExternalCancel == NULL);
 
+    updateConditionVariables(f, mStartBvar, constants, rates, states,
+                             algebraic, algSize, NULL, &failInfo);
     f->ComputeRates(mStartBvar, constants, rates, states, algebraic, &failInfo);
-    f->ComputeVariables(mStartBvar, constants, rates, states, algebraic, &failInfo);
+    computeOutputVariables(f, mStartBvar, constants, rates, states, algebraic,
+                           &failInfo);
     if (failInfo.failtype)
       throw iface::cellml_api::CellMLException(L"failInfo.failtype (internal)"); // Caught below.
 
-    if (mObserver != NULL)
-    {
-      std::vector<double> resultsVec(buffer, buffer + 2 * rateSize + algSize + 1);
-      mObserver->results(resultsVec);
-    }
+    recordResult(stream, mStartBvar, states, rates, rateSize,
+                 algebraic, algSize);
 
     SolveODEProblem(f, constSize, constants, rateSize, rates, states,
-                    algSize, algebraic);
+                    algSize, algebraic, stream);
   }
   catch (...)
   {
+    {
+      CDALock l(mStatisticsMutex);
+      mPublishedStatistics = mStatistics;
+    }
     try
     {
       if (mObserver != NULL)
@@ -801,15 +1489,14 @@ CDA_ODESolverRun::runthread()
     delete [] constants;
   if (buffer != NULL)
     delete [] buffer;
-
-  release_ref(); // Thread is finishing, cancel the add_ref call before startthread.
 }
 
 void
-CDA_DAESolverRun::runthread()
+CDA_DAESolverRun::runtask()
 {
   std::string emsg = "Unknown error";
   double* constants = NULL, * buffer = NULL, * algebraic, * rates, * states, * condvars;
+  double started = WallClockTime();
 
   try
   {
@@ -847,54 +1534,471 @@ CDA_DAESolverRun::runthread()
         constants[(*oli).first] = (*oli).second;
       }
 
-    struct fail_info failInfo;
-    // Algebraic is needed for locally bound variables (e.g. for definite integrals).
-    f->SetupFixedConstants(constants, rates, states, algebraic, &overrides, &failInfo);
+    struct fail_info failInfo;
+    failInfo.statistics = &mStatistics;
+    failInfo.distributionTables = &mModel->mDistributionTables;
+    failInfo.cacheIntegrals = mCacheDefiniteIntegrals;
+    setupNonlinearSolverThreading(failInfo, constSize, rateSize, rateSize,
+                                  algSize);
+    // Algebraic is needed for locally bound variables (e.g. for definite integrals).
+    f->SetupFixedConstants(constants, rates, states, algebraic, &overrides, &failInfo);
+
+    // Now apply overrides...
+    for (oli = mIVOverrides.begin(); oli != mIVOverrides.end();
+         oli++)
+      if ((*oli).first < rateSize)
+        states[(*oli).first] = (*oli).second;
+
+    delete [] overrides.isOverriden;
+    mStatistics.setupTime = WallClockTime() - started;
+
+    if (mObserver != NULL)
+    {
+      std::vector<double> constVector(constants, constants + constSize);
+      double observerStarted = WallClockTime();
+      mObserver->computedConstants(constVector);
+      mStatistics.observerTime = WallClockTime() - observerStarted;
+    }
+    mSolveStarted = WallClockTime();
+
+    setupOutputColumns(mModel->mCCI);
+    SolveDAEProblem(f, constSize, constants, rateSize, rates, rateSize, states,
+                    algSize, algebraic, condVarSize, condvars);
+  }
+  catch (...)
+  {
+    {
+      CDALock l(mStatisticsMutex);
+      mPublishedStatistics = mStatistics;
+    }
+    try
+    {
+      if (mObserver != NULL)
+        mObserver->failed(emsg.c_str());
+    }
+    catch (...)
+    {
+    }
+  }
+
+  if (constants != NULL)
+    delete [] constants;
+  if (buffer != NULL)
+    delete [] buffer;
+
+  release_ref(); // Task is finishing, cancel the add_ref call before submit.
+}
+
+class EnsembleMemberObserver
+  : public iface::cellml_services::IntegrationProgressObserver
+{
+public:
+  EnsembleMemberObserver(CDA_ODESolverEnsembleRun* aEnsemble, uint32_t aMember)
+    : mEnsemble(aEnsemble), mMember(aMember)
+  {
+  }
+
+  CDA_IMPL_REFCOUNT;
+  CDA_IMPL_ID;
+  CDA_IMPL_QI1(cellml_services::IntegrationProgressObserver);
+
+  void computedConstants(const std::vector<double>& values)
+    throw (std::exception&)
+  {
+    mEnsemble->memberComputedConstants(mMember, values);
+  }
+
+  void results(const std::vector<double>& state)
+    throw (std::exception&)
+  {
+    mEnsemble->memberResults(mMember, state);
+  }
+
+  void done()
+    throw (std::exception&)
+  {
+    mEnsemble->memberDone(mMember);
+  }
+
+  void failed(const std::string& errorMessage)
+    throw (std::exception&)
+  {
+    mEnsemble->memberFailed(mMember, errorMessage);
+  }
+
+private:
+  CDA_ODESolverEnsembleRun* mEnsemble;
+  uint32_t mMember;
+};
+
+class EnsembleWorker
+  : public CISTask
+{
+public:
+  EnsembleWorker(CDA_ODESolverEnsembleRun* aEnsemble)
+    : mEnsemble(aEnsemble)
+  {
+    // The task accesses this, so must add_ref.
+    mEnsemble->add_ref();
+  }
+
+  void runtask()
+  {
+    mEnsemble->runMembers();
+    mEnsemble->release_ref();
+    delete this;
+  }
+
+private:
+  CDA_ODESolverEnsembleRun* mEnsemble;
+};
+
+CDA_ODESolverEnsembleRun::CDA_ODESolverEnsembleRun(CDA_ODESolverModel* aModel)
+  : mModel(aModel),
+    mStepType(iface::cellml_services::RUNGE_KUTTA_FEHLBERG_4_5),
+    mLinearSolverType(iface::cellml_services::LINEAR_SOLVER_AUTOMATIC),
+    mEpsAbs(1E-6), mEpsRel(1E-6), mScalVar(1.0), mScalRate(0.0),
+    mStepSizeMax(1.0), mStartBvar(0.0), mStopBvar(10.0), mMaxPointDensity(10000.0),
+    mTabulationStepSize(0.0), mStrictTabulation(false),
+    mInterpolateTabulation(false), mMemberCount(0),
+    mWorkerCount(CISThreadPool::processorCount()), mPriority(0),
+    mIsStarted(false), mCancel(false),
+    mNextMember(0), mActiveWorkers(0)
+{
+}
+
+CDA_ODESolverEnsembleRun::~CDA_ODESolverEnsembleRun()
+{
+}
+
+iface::cellml_services::ODEIntegrationStepType
+CDA_ODESolverEnsembleRun::stepType()
+  throw (std::exception&)
+{
+  return mStepType;
+}
+
+void
+CDA_ODESolverEnsembleRun::stepType
+(
+ iface::cellml_services::ODEIntegrationStepType aStepType
+)
+  throw (std::exception&)
+{
+  mStepType = aStepType;
+}
+
+iface::cellml_services::LinearSolverType
+CDA_ODESolverEnsembleRun::linearSolverType()
+  throw (std::exception&)
+{
+  return mLinearSolverType;
+}
+
+void
+CDA_ODESolverEnsembleRun::linearSolverType
+(
+ iface::cellml_services::LinearSolverType aType
+)
+  throw (std::exception&)
+{
+  mLinearSolverType = aType;
+}
+
+uint32_t
+CDA_ODESolverEnsembleRun::workerCount()
+  throw (std::exception&)
+{
+  return mWorkerCount;
+}
+
+void
+CDA_ODESolverEnsembleRun::workerCount(uint32_t aCount)
+  throw (std::exception&)
+{
+  if (mIsStarted)
+    return;
+  mWorkerCount = (aCount == 0) ? 1 : aCount;
+}
+
+int32_t
+CDA_ODESolverEnsembleRun::priority()
+  throw (std::exception&)
+{
+  return mPriority;
+}
+
+void
+CDA_ODESolverEnsembleRun::priority(int32_t aPriority)
+  throw (std::exception&)
+{
+  if (mIsStarted)
+    return;
+  mPriority = aPriority;
+}
+
+void
+CDA_ODESolverEnsembleRun::setStepSizeControl
+(
+ double epsAbs, double epsRel, double scalVar,
+ double scalRate, double maxStep
+)
+  throw (std::exception&)
+{
+  mEpsAbs = epsAbs;
+  mEpsRel = epsRel;
+  mScalVar = scalVar;
+  mScalRate = scalRate;
+  mStepSizeMax = maxStep;
+}
+
+void
+CDA_ODESolverEnsembleRun::setTabulationStepControl
+(
+  double tabulationStepSize, bool strictTabulation
+)
+  throw (std::exception&)
+{
+  mTabulationStepSize = tabulationStepSize;
+  mStrictTabulation = strictTabulation;
+}
+
+bool
+CDA_ODESolverEnsembleRun::interpolateTabulation()
+  throw (std::exception&)
+{
+  return mInterpolateTabulation;
+}
+
+void
+CDA_ODESolverEnsembleRun::interpolateTabulation(bool aInterpolate)
+  throw (std::exception&)
+{
+  mInterpolateTabulation = aInterpolate;
+}
+
+void
+CDA_ODESolverEnsembleRun::setResultBatching
+(
+ uint32_t maxPoints, uint32_t maxBytes, double maxLatency
+)
+  throw (std::exception&)
+{
+  mResultBatching.maxPoints = maxPoints;
+  mResultBatching.maxBytes = maxBytes;
+  mResultBatching.maxLatency = maxLatency;
+}
+
+void
+CDA_ODESolverEnsembleRun::setResultRange
+(
+ double startBvar, double stopBvar, double maxPointDensity
+)
+  throw (std::exception&)
+{
+  mStartBvar = startBvar;
+  mStopBvar = stopBvar;
+  mMaxPointDensity = maxPointDensity;
+}
+
+void
+CDA_ODESolverEnsembleRun::setProgressObserver
+(
+ iface::cellml_services::EnsembleProgressObserver* aEpo
+)
+  throw (std::exception&)
+{
+  CDALock l(mMutex);
+  mObserver = aEpo;
+}
+
+void
+CDA_ODESolverEnsembleRun::addOverrideColumn
+(
+ iface::cellml_services::VariableEvaluationType aType,
+ uint32_t variableIndex
+)
+  throw (std::exception&)
+{
+  if (mIsStarted)
+    throw iface::cellml_api::CellMLException(L"Call to addOverrideColumn on an ensemble run that is already started.");
+  if (aType != iface::cellml_services::CONSTANT &&
+      aType != iface::cellml_services::STATE_VARIABLE)
+    throw iface::cellml_api::CellMLException(L"Call to addOverrideColumn on a variable that is neither constant nor state variable");
+
+  mOverrideColumns.push_back
+    (std::pair<iface::cellml_services::VariableEvaluationType, uint32_t>
+     (aType, variableIndex));
+}
+
+void
+CDA_ODESolverEnsembleRun::addOutputColumn
+(
+ iface::cellml_services::OutputColumnType aType,
+ uint32_t aIndex
+)
+  throw (std::exception&)
+{
+  if (mIsStarted)
+    throw iface::cellml_api::CellMLException(L"Call to addOutputColumn on an ensemble run that is already started.");
+
+  mOutputColumns.push_back
+    (std::pair<iface::cellml_services::OutputColumnType, uint32_t>
+     (aType, aIndex));
+}
 
-    // Now apply overrides...
-    for (oli = mIVOverrides.begin(); oli != mIVOverrides.end();
-         oli++)
-      if ((*oli).first < rateSize)
-        states[(*oli).first] = (*oli).second;
+void
+CDA_ODESolverEnsembleRun::setOverrideValues
+(
+ uint32_t memberCount,
+ const std::vector<double>& values
+)
+  throw (std::exception&)
+{
+  if (mIsStarted)
+    throw iface::cellml_api::CellMLException(L"Call to setOverrideValues on an ensemble run that is already started.");
+  if (values.size() != memberCount * mOverrideColumns.size())
+    throw iface::cellml_api::CellMLException(L"Call to setOverrideValues with a number of values that isn't the number of members times the number of columns");
 
-    delete [] overrides.isOverriden;
+  mMemberCount = memberCount;
+  mOverrideValues = values;
+}
 
-    if (mObserver != NULL)
-    {
-      std::vector<double> constVector(constants, constants + constSize);
-      mObserver->computedConstants(constVector);
-    }
+void
+CDA_ODESolverEnsembleRun::start()
+  throw (std::exception&)
+{
+  if (mIsStarted)
+    throw iface::cellml_api::CellMLException(L"Call to start() on an ensemble run that is already started.");
+  mIsStarted = true;
 
-    SolveDAEProblem(f, constSize, constants, rateSize, rates, rateSize, states,
-                    algSize, algebraic, condVarSize, condvars);
+  uint32_t nWorkers = mWorkerCount;
+  if (nWorkers > mMemberCount)
+    nWorkers = mMemberCount;
+
+  if (nWorkers == 0)
+  {
+    CDALock l(mMutex);
+    if (mObserver != NULL)
+      mObserver->done();
+    return;
   }
-  catch (...)
+
+  mActiveWorkers = nWorkers;
+  for (uint32_t i = 0; i < nWorkers; i++)
+    CISThreadPool::singleton()->submit(new EnsembleWorker(this), mPriority);
+}
+
+void
+CDA_ODESolverEnsembleRun::stop()
+  throw (std::exception&)
+{
+  mCancel = true;
+}
+
+void
+CDA_ODESolverEnsembleRun::runMembers()
+{
+  while (true)
   {
-    try
-    {
-      if (mObserver != NULL)
-        mObserver->failed(emsg.c_str());
-    }
-    catch (...)
+    uint32_t member;
     {
+      CDALock l(mMutex);
+      if (mCancel || mNextMember >= mMemberCount)
+      {
+        if (--mActiveWorkers == 0 && mObserver != NULL)
+        {
+          try
+          {
+            mObserver->done();
+          }
+          catch (...)
+          {
+          }
+        }
+        return;
+      }
+      member = mNextMember++;
     }
+
+    runMember(member);
   }
+}
 
-  if (constants != NULL)
-    delete [] constants;
-  if (buffer != NULL)
-    delete [] buffer;
+void
+CDA_ODESolverEnsembleRun::runMember(uint32_t aMember)
+{
+  // The run is driven on this thread, so none of the usual thread, pipe or
+  // observer reference setup is needed.
+  RETURN_INTO_OBJREF(run, CDA_ODESolverRun, new CDA_ODESolverRun(mModel));
+  run->mStepType = mStepType;
+  run->mLinearSolverType = mLinearSolverType;
+  run->setStepSizeControl(mEpsAbs, mEpsRel, mScalVar, mScalRate, mStepSizeMax);
+  run->setTabulationStepControl(mTabulationStepSize, mStrictTabulation);
+  run->interpolateTabulation(mInterpolateTabulation);
+  run->mResultBatching = mResultBatching;
+  run->mOutputColumns = mOutputColumns;
+  run->setResultRange(mStartBvar, mStopBvar, mMaxPointDensity);
+
+  const double* row = mOverrideValues.empty() ? NULL :
+    &mOverrideValues[aMember * mOverrideColumns.size()];
+  for (uint32_t i = 0; i < mOverrideColumns.size(); i++)
+    run->setOverride(mOverrideColumns[i].first, mOverrideColumns[i].second,
+                     row[i]);
+
+  RETURN_INTO_OBJREF(o, EnsembleMemberObserver,
+                     new EnsembleMemberObserver(this, aMember));
+  run->setProgressObserver(o);
+  run->mExternalCancel = &mCancel;
+
+  run->integrate();
+}
 
-  release_ref(); // Thread is finishing, cancel the add_ref call before startthread.
+void
+CDA_ODESolverEnsembleRun::memberComputedConstants
+(
+ uint32_t aMember, const std::vector<double>& aValues
+)
+{
+  CDALock l(mMutex);
+  if (mObserver != NULL)
+    mObserver->computedConstants(aMember, aValues);
 }
 
 void
-CDA_CellMLIntegrationService::setupCodeEnvironment
+CDA_ODESolverEnsembleRun::memberResults
 (
- iface::cellml_services::CodeInformation* cci,
- std::string& dirname,
- std::string& sourcename,
- std::ofstream& ss
+ uint32_t aMember, const std::vector<double>& aState
+)
+{
+  CDALock l(mMutex);
+  if (mObserver != NULL)
+    mObserver->results(aMember, aState);
+}
+
+void
+CDA_ODESolverEnsembleRun::memberDone(uint32_t aMember)
+{
+  CDALock l(mMutex);
+  if (mObserver != NULL)
+    mObserver->memberDone(aMember);
+}
+
+void
+CDA_ODESolverEnsembleRun::memberFailed
+(
+ uint32_t aMember, const std::string& aErrorMessage
+)
+{
+  CDALock l(mMutex);
+  if (mObserver != NULL)
+    mObserver->memberFailed(aMember, aErrorMessage);
+}
+
+void
+CDA_CellMLIntegrationService::checkConstraintLevel
+(
+ iface::cellml_services::CodeInformation* cci
 )
 {
   iface::cellml_services::ModelConstraintLevel mcl = cci->constraintLevel();
@@ -911,6 +2015,18 @@ CDA_CellMLIntegrationService::setupCodeEnvironment
       throw iface::cellml_api::CellMLException(L"Model is underconstrained.");
     }
   }
+}
+
+void
+CDA_CellMLIntegrationService::setupCodeEnvironment
+(
+ iface::cellml_services::CodeInformation* cci,
+ std::string& dirname,
+ std::string& sourcename,
+ std::ofstream& ss
+)
+{
+  checkConstraintLevel(cci);
 
   // Create a temporary directory...
   const char* tmpenvs[] = {"TMPDIR", "TEMP", "TMP", NULL};
@@ -985,8 +2101,19 @@ CDA_CellMLIntegrationService::setupCodeEnvironment
      << "};" << std::endl
      << "#define LM_DIF_WORKSZ(npar, nmeas) (4*(nmeas) + 4*(npar) + "
     "(nmeas)*(npar) + (npar)*(npar))" << std::endl;
+}
 
-  std::wstring frag = cci->functionsString();
+// Writes the functions the model's code calls, such as those solving systems
+// of equations numerically. Anything their bodies use, such as CONDVAR or
+// lookup_table, must be written before this.
+void
+CDA_CellMLIntegrationService::writeFunctions
+(
+ iface::cellml_services::CodeInformation* aCCI,
+ std::ofstream& ss
+)
+{
+  std::wstring frag = aCCI->functionsString();
   size_t fragLen = wcstombs(NULL, frag.c_str(), 0) + 1;
   char* frag8 = new char[fragLen];
   wcstombs(frag8, frag.c_str(), fragLen);
@@ -1019,6 +2146,10 @@ CDA_CellMLIntegrationService::SetupCodeGenStrings(iface::cellml_services::CodeGe
 {
   ObjRef<iface::cellml_services::MaLaESBootstrap> mb(CreateMaLaESBootstrap());
 
+  // The solvers' dense matrices are stored as an array of column pointers.
+  aCGS->jacobianEntryPattern(L"JACOBIAN[<COLUMN>][<ROW>]");
+  aCGS->hoistConstantSubexpressions(true);
+
   if (aIsDebug)
   {
     aCGS->assignPattern(L"TryAssign(&(<LHS>), <RHS>, \"<XMLID>\", failInfo);\r\nif (getFailType(failInfo)) return FAIL_RETURN;\r\n");
@@ -1033,10 +2164,10 @@ CDA_CellMLIntegrationService::SetupCodeGenStrings(iface::cellml_services::CodeGe
      L"return value;\r\n}\r\n"
      L"double (*pdf_roots_<ID>[])(double bvar, double*, double*, struct fail_info* failInfo) = "
      L"{<FOREACH_ROOT>pdf_<ID>_root_<ROOTID>,<ROOTSUP>double pdf_<ID>_root_<ROOTID>"
-     L"(double bvar, double* CONSTANTS, double* ALGEBRAIC)\r\n"
+     L"(double bvar, double* CONSTANTS, double* ALGEBRAIC, struct fail_info* failInfo)\r\n"
      L"{\r\ndouble value; TryAssign(&value, <EXPR>, \"roots of probability density function\", failInfo);\r\n"
      L"if (getFailType(failInfo)) return FAIL_RETURN;\r\n"
-     L"return (<EXPR>);\r\n}\r\n</FOREACH_ROOT>};\r\n");
+     L"return value;\r\n}\r\n</FOREACH_ROOT>};\r\n");
   aCGS->solvePattern
     (
      L"rootfind_<ID>(VOI, CONSTANTS, RATES, STATES, ALGEBRAIC, failInfo);\r\n"
@@ -1050,19 +2181,21 @@ CDA_CellMLIntegrationService::SetupCodeGenStrings(iface::cellml_services::CodeGe
      L"#define RATES rfi->aRATES\r\n"
      L"#define STATES rfi->aSTATES\r\n"
      L"#define ALGEBRAIC rfi->aALGEBRAIC\r\n"
+     L"#define failInfo rfi->aFail\r\n"
      L"  <VAR> = *p;\r\n"
-     L"  TryAssign(hx, TryMinus(<LHS>, <RHS>), \"<XMLID>\", rfi->aFail);\r\n"
-     L"  if (getFailType(rfi->aFail)) return;\r\n"
+     L"  TryAssign(hx, TryMinus(<LHS>, <RHS>, failInfo), \"<XMLID>\", failInfo);\r\n"
+     L"  if (getFailType(failInfo)) return;\r\n"
      L"#undef VOI\r\n"
      L"#undef CONSTANTS\r\n"
      L"#undef RATES\r\n"
      L"#undef STATES\r\n"
      L"#undef ALGEBRAIC\r\n"
+     L"#undef failInfo\r\n"
      L"}\r\n"
      L"void rootfind_<ID>(double VOI, double* CONSTANTS, double* RATES, "
      L"double* STATES, double* ALGEBRAIC, struct fail_info* failInfo)\r\n"
      L"{\r\n"
-     L"  static double val = <IV>;\r\n"
+     L"  double val = <IV>;\r\n"
      L"  struct rootfind_info rfi;\r\n"
      L"  rfi.aVOI = VOI;\r\n"
      L"  rfi.aCONSTANTS = CONSTANTS;\r\n"
@@ -1101,7 +2234,7 @@ CDA_CellMLIntegrationService::SetupCodeGenStrings(iface::cellml_services::CodeGe
     L"double* STATES, double* ALGEBRAIC, struct fail_info* failInfo)\r\n"
     L"{\r\n"
     L"  /* Solver for equations: <EQUATIONS><XMLID><JOIN>, </EQUATIONS> */\r\n"
-    L"  static double p[<COUNT>] = {<EQUATIONS><IV><JOIN>,</EQUATIONS>};\r\n"
+    L"  double p[<COUNT>] = {<EQUATIONS><IV><JOIN>,</EQUATIONS>};\r\n"
     L"  struct rootfind_info rfi;\r\n"
     L"  rfi.aVOI = VOI;\r\n"
     L"  rfi.aCONSTANTS = CONSTANTS;\r\n"
@@ -1128,7 +2261,7 @@ CDA_CellMLIntegrationService::SetupCodeGenStrings(iface::cellml_services::CodeGe
     ObjRef<iface::cellml_services::IDACodeGenerator> idaCG(QueryInterface(aCGS));
     if (idaCG)
     {
-      idaCG->residualPattern(L"TryAssign(resid+<RNO>, TryMinus(<LHS>, <RHS>), \"<XMLID>\", failInfo);\r\nif (getFailType(failInfo)) return FAIL_RETURN;\r\n");
+      idaCG->residualPattern(L"TryAssign(resid+<RNO>, TryMinus(<LHS>, <RHS>, failInfo), \"<XMLID>\", failInfo);\r\nif (getFailType(failInfo)) return FAIL_RETURN;\r\n");
     }
 
   ObjRef<iface::cellml_services::MaLaESTransform> transform
@@ -1137,78 +2270,78 @@ CDA_CellMLIntegrationService::SetupCodeGenStrings(iface::cellml_services::CodeGe
 L"opengroup: (\r\n"
 L"closegroup: )\r\n"
 L"wrapvalue: CreateEDouble(#expr)\r\n"
-L"abs: #prec[H]TryAbs(#expr1)\r\n"
-L"and: #prec[H]TryAnd(#count, #exprs[,])\r\n"
-L"arccos: #prec[H]TryACos(#expr1)\r\n"
-L"arccosh: #prec[H]TryACosh(#expr1)\r\n"
-L"arccot: #prec[H]TryATan(#expr1)\r\n"
-L"arccoth: #prec[H]TryATanh(#expr1)\r\n"
-L"arccsc: #prec[H]TryASin(#expr1)\r\n"
-L"arccsch: #prec[H]TryASinh(#expr1)\r\n"
-L"arcsec: #prec[H]TryACos(#expr1)\r\n"
-L"arcsech: #prec[H]TryACosh(#expr1)\r\n"
-L"arcsin: #prec[H]TryASin(#expr1)\r\n"
-L"arcsinh: #prec[H]TryASinh(#expr1)\r\n"
-L"arctan: #prec[H]TryATan(#expr1)\r\n"
-L"arctanh: #prec[H]TryATanh(#expr1)\r\n"
-L"ceiling: #prec[H]TryCeil(#expr1)\r\n"
-L"cos: #prec[H]TryCos(#expr1)\r\n"
-L"cosh: #prec[H]TryCosh(#expr1)\r\n"
-L"cot: #prec[H]TryCot(#expr1)\r\n"
-L"coth: #prec[H]TryCoth(#expr1)\r\n"
-L"csc: #prec[H]TryCosec(#expr1)\r\n"
-L"csch: #prec[H]TrySinh(#expr1)\r\n"
+L"abs: #prec[H]TryAbs(#expr1, failInfo)\r\n"
+L"and: #prec[H]TryAnd(#count, (EDouble[]){#exprs[, ]}, failInfo)\r\n"
+L"arccos: #prec[H]TryACos(#expr1, failInfo)\r\n"
+L"arccosh: #prec[H]TryACosh(#expr1, failInfo)\r\n"
+L"arccot: #prec[H]TryACot(#expr1, failInfo)\r\n"
+L"arccoth: #prec[H]TryACoth(#expr1, failInfo)\r\n"
+L"arccsc: #prec[H]TryACsc(#expr1, failInfo)\r\n"
+L"arccsch: #prec[H]TryACsch(#expr1, failInfo)\r\n"
+L"arcsec: #prec[H]TryASec(#expr1, failInfo)\r\n"
+L"arcsech: #prec[H]TryASech(#expr1, failInfo)\r\n"
+L"arcsin: #prec[H]TryASin(#expr1, failInfo)\r\n"
+L"arcsinh: #prec[H]TryASinh(#expr1, failInfo)\r\n"
+L"arctan: #prec[H]TryATan(#expr1, failInfo)\r\n"
+L"arctanh: #prec[H]TryATanh(#expr1, failInfo)\r\n"
+L"ceiling: #prec[H]TryCeil(#expr1, failInfo)\r\n"
+L"cos: #prec[H]TryCos(#expr1, failInfo)\r\n"
+L"cosh: #prec[H]TryCosh(#expr1, failInfo)\r\n"
+L"cot: #prec[H]TryCot(#expr1, failInfo)\r\n"
+L"coth: #prec[H]TryCoth(#expr1, failInfo)\r\n"
+L"csc: #prec[H]TryCsc(#expr1, failInfo)\r\n"
+L"csch: #prec[H]TryCsch(#expr1, failInfo)\r\n"
 L"diff: #lookupDiffVariable\r\n"
-L"divide: #prec[H]TryDivide(#expr1, #expr2)\r\n"
-L"eq: #prec[H]TryEq(#count, #exprs[,])\r\n"
-L"exp: #prec[H]TryExp(#expr1)\r\n"
-L"factorial: #prec[H]TryFactorial(#expr1)\r\n"
-L"factorof: #prec[H]TryFactorOf(#expr1, #expr2)\r\n"
-L"floor: #prec[H]TryFloor(#expr1)\r\n"
-L"gcd: #prec[H]TryGCD(#count, #exprs[, ])\r\n"
-L"geq: #prec[H]TryGeq(#count, #exprs[, ])\r\n"
-L"gt: #prec[H]TryGt(#count, #exprs[, ])\r\n"
-L"implies: #prec[H]TryImplies(#expr1, #expr2)\r\n"
+L"divide: #prec[H]TryDivide(#expr1, #expr2, failInfo)\r\n"
+L"eq: #prec[H]TryEq(#count, (EDouble[]){#exprs[, ]}, failInfo)\r\n"
+L"exp: #prec[H]TryExp(#expr1, failInfo)\r\n"
+L"factorial: #prec[H]TryFactorial(#expr1, failInfo)\r\n"
+L"factorof: #prec[H]TryFactorOf(#expr1, #expr2, failInfo)\r\n"
+L"floor: #prec[H]TryFloor(#expr1, failInfo)\r\n"
+L"gcd: #prec[H]TryGCD(#count, (EDouble[]){#exprs[, ]}, failInfo)\r\n"
+L"geq: #prec[H]TryGeq(#count, (EDouble[]){#exprs[, ]}, failInfo)\r\n"
+L"gt: #prec[H]TryGt(#count, (EDouble[]){#exprs[, ]}, failInfo)\r\n"
+L"implies: #prec[H]TryImplies(#expr1, #expr2, failInfo)\r\n"
 L"int: #prec[H]TryDefint(func#unique1, VOI, CONSTANTS, RATES, STATES, ALGEBRAIC, &#bvarIndex, #lowlimit, #uplimit"
 L", failInfo)#supplement EDouble func#unique1(double VOI, "
 L"double* CONSTANTS, double* RATES, double* STATES, double* ALGEBRAIC, struct fail_info* failInfo) { return #expr1; }\r\n"
-L"lcm: #prec[H]TryLCM(#count, #exprs[, ])\r\n"
-L"leq: #prec[H]TryLeq(#count, #exprs[, ])\r\n"
-L"ln: #prec[H]TryLn(#expr1)\r\n"
-L"log: #prec[H]TryLogBase(#expr1, #logbase)\r\n"
-L"lt: #prec[H]TryLt(#count, #exprs[, ])\r\n"
-L"max: #prec[H]TryMax(#count, #exprs[, ])\r\n"
-L"min: #prec[H]TryMin(#count, #exprs[, ])\r\n"
-L"minus: #prec[H]TryMinus(#expr1, #expr2)\r\n"
-L"neq: #prec[H]TryNeq(#expr1, #expr2)\r\n"
-L"not: #prec[H]TryNot(#expr1)\r\n"
-L"or: #prec[H]TryOr(#count, #exprs[,])\r\n"
-L"plus: #prec[H]TryPlus(#count, #exprs[,])\r\n"
-L"power: #prec[H]TryPower(#expr1, #expr2)\r\n"
-L"quotient: #prec[H]TryQuotient(#expr1, #expr2)\r\n"
-L"rem: #prec[H]TryRem(#expr1, #expr2)\r\n"
-L"root: #prec[H]TryRoot(#expr1, #degree)\r\n"
-L"sec: #prec[H]TrySec(#expr1)\r\n"
-L"sech: #prec[900(0)]TrySech(#expr1)\r\n"
-L"sin: #prec[H]TrySin(#expr1)\r\n"
-L"sinh: #prec[H]TrySinh(#expr1)\r\n"
-L"tan: #prec[H]TryTan(#expr1)\r\n"
-L"tanh: #prec[H]TryTanh(#expr1)\r\n"
-L"times: #prec[H]TryTimes(#count, #exprs[,])\r\n"
-L"unary_minus: #prec[H]TryUnaryMinus(#expr1)\r\n"
-L"units_conversion: #prec[H]TryUnitsConversion(#expr1, #expr2, #expr3)\r\n"
-L"units_conversion_factor: #prec[H]TryUnitsConversion(#expr1, #expr2, 0.0)\r\n"
-L"units_conversion_offset: #prec[H]TryUnitsConversion(#expr1, 1.0, #expr2)\r\n"
-L"xor: #prec[H]TryXor(#expr1, #expr2)\r\n"
-L"piecewise_first_case: #prec[H]TryPiecewise(#expr1, #expr2, \r\n"
-L"piecewise_extra_case: #prec[H]1, #expr1, #expr2, \r\n"
-L"piecewise_otherwise: #prec[H]2, #expr1)\r\n"
-L"piecewise_no_otherwise: #prec[H]0)\r\n"
+L"lcm: #prec[H]TryLCM(#count, (EDouble[]){#exprs[, ]}, failInfo)\r\n"
+L"leq: #prec[H]TryLeq(#count, (EDouble[]){#exprs[, ]}, failInfo)\r\n"
+L"ln: #prec[H]TryLn(#expr1, failInfo)\r\n"
+L"log: #prec[H]TryLog(#expr1, #logbase, failInfo)\r\n"
+L"lt: #prec[H]TryLt(#count, (EDouble[]){#exprs[, ]}, failInfo)\r\n"
+L"max: #prec[H]TryMax(#count, (EDouble[]){#exprs[, ]}, failInfo)\r\n"
+L"min: #prec[H]TryMin(#count, (EDouble[]){#exprs[, ]}, failInfo)\r\n"
+L"minus: #prec[H]TryMinus(#expr1, #expr2, failInfo)\r\n"
+L"neq: #prec[H]TryNeq(#expr1, #expr2, failInfo)\r\n"
+L"not: #prec[H]TryNot(#expr1, failInfo)\r\n"
+L"or: #prec[H]TryOr(#count, (EDouble[]){#exprs[, ]}, failInfo)\r\n"
+L"plus: #prec[H]TryPlus(#count, (EDouble[]){#exprs[, ]}, failInfo)\r\n"
+L"power: #prec[H]TryPower(#expr1, #expr2, failInfo)\r\n"
+L"quotient: #prec[H]TryQuotient(#expr1, #expr2, failInfo)\r\n"
+L"rem: #prec[H]TryRem(#expr1, #expr2, failInfo)\r\n"
+L"root: #prec[H]TryRoot(#expr1, #degree, failInfo)\r\n"
+L"sec: #prec[H]TrySec(#expr1, failInfo)\r\n"
+L"sech: #prec[H]TrySech(#expr1, failInfo)\r\n"
+L"sin: #prec[H]TrySin(#expr1, failInfo)\r\n"
+L"sinh: #prec[H]TrySinh(#expr1, failInfo)\r\n"
+L"tan: #prec[H]TryTan(#expr1, failInfo)\r\n"
+L"tanh: #prec[H]TryTanh(#expr1, failInfo)\r\n"
+L"times: #prec[H]TryTimes(#count, (EDouble[]){#exprs[, ]}, failInfo)\r\n"
+L"unary_minus: #prec[H]TryUnaryMinus(#expr1, failInfo)\r\n"
+L"units_conversion: #prec[H]TryUnitsConversion(#expr1, #expr2, #expr3, failInfo)\r\n"
+L"units_conversion_factor: #prec[H]TryUnitsConversion(#expr1, #expr2, CreateEDouble(0.0), failInfo)\r\n"
+L"units_conversion_offset: #prec[H]TryUnitsConversion(#expr1, CreateEDouble(1.0), #expr2, failInfo)\r\n"
+L"xor: #prec[H]TryXor(#expr1, #expr2, failInfo)\r\n"
+L"piecewise_first_case: #prec[1000(5)](TryCondition(#expr1, failInfo) ? #expr2 : \r\n"
+L"piecewise_extra_case: #prec[1000(5)]TryCondition(#expr1, failInfo) ? #expr2 : \r\n"
+L"piecewise_otherwise: #prec[1000(5)]TryOtherwise(#expr1, failInfo))\r\n"
+L"piecewise_no_otherwise: #prec[1000(5)]TryNoOtherwise(failInfo))\r\n"
 L"eulergamma: #prec[H]CreateEDouble(0.577215664901533)\r\n"
 L"exponentiale: #prec[H]CreateEDouble(2.71828182845905)\r\n"
 L"false: #prec[H]CreateEDouble(0.0)\r\n"
-L"infinity: #prec[H]TryInfinity()\r\n"
-L"notanumber: #prec[H]TryNaN()\r\n"
+L"infinity: #prec[H]TryInfinity(failInfo)\r\n"
+L"notanumber: #prec[H]TryNaN(failInfo)\r\n"
 L"pi: #prec[H]CreateEDouble(3.14159265358979)\r\n"
 L"true: #prec[H]CreateEDouble(1.0)\r\n"
                             )
@@ -1250,7 +2383,7 @@ L"true: #prec[H]CreateEDouble(1.0)\r\n"
      L"void rootfind_<ID>(double VOI, double* CONSTANTS, double* RATES, "
      L"double* STATES, double* ALGEBRAIC, struct fail_info* failInfo)\r\n"
      L"{\r\n"
-     L"  static double val = <IV>;\r\n"
+     L"  double val = <IV>;\r\n"
      L"  struct rootfind_info rfi;\r\n"
      L"  rfi.aVOI = VOI;\r\n"
      L"  rfi.aCONSTANTS = CONSTANTS;\r\n"
@@ -1290,7 +2423,7 @@ L"true: #prec[H]CreateEDouble(1.0)\r\n"
        L"double* STATES, double* ALGEBRAIC, struct fail_info* failInfo)\r\n"
        L"{\r\n"
        L"  /* Solver for equations: <EQUATIONS><XMLID><JOIN>, </EQUATIONS> */\r\n"
-       L"  static double p[<COUNT>] = {<EQUATIONS><IV><JOIN>,</EQUATIONS>};\r\n"
+       L"  double p[<COUNT>] = {<EQUATIONS><IV><JOIN>,</EQUATIONS>};\r\n"
        L"  struct rootfind_info rfi;\r\n"
        L"  rfi.aVOI = VOI;\r\n"
        L"  rfi.aCONSTANTS = CONSTANTS;\r\n"
@@ -1394,7 +2527,9 @@ already_AddRefd<iface::cellml_services::ODESolverCompiledModel>
 CDA_CellMLIntegrationService::compileModelODEInternal
 (
  iface::cellml_api::Model* aModel,
- bool aIsDebug
+ bool aIsDebug,
+ uint32_t aBatchWidth,
+ const LookupTableSettings* aLookupTable
 )
   throw(std::exception&)
 {
@@ -1404,6 +2539,15 @@ CDA_CellMLIntegrationService::compileModelODEInternal
                      cgb->createCodeGenerator());
 
   SetupCodeGenStrings(cg, aIsDebug);
+  if (aLookupTable != NULL)
+    cg->setLookupTable(aLookupTable->mVariable, aLookupTable->mMinimum,
+                       aLookupTable->mMaximum, aLookupTable->mStep);
+
+  // Have piecewise conditions switched by CVODE's rootfinder, rather than
+  // having it step blindly through the discontinuities...
+  ObjRef<iface::cellml_services::IDACodeGenerator> idaCG(QueryInterface(cg));
+  if (idaCG)
+    idaCG->trackPiecewiseConditions(true);
 
   // Generate code information...
   ObjRef<iface::cellml_services::CodeInformation> cci;
@@ -1430,6 +2574,30 @@ CDA_CellMLIntegrationService::compileModelODEInternal
   std::string dirname, sourcename;
   setupCodeEnvironment(cci, dirname, sourcename, ss);
 
+  ObjRef<iface::cellml_services::IDACodeInformation> idaCCI(QueryInterface(cci));
+  uint32_t condVarSize = (idaCCI == NULL) ? 0 : idaCCI->conditionVariableCount();
+  if (condVarSize != 0)
+    ss << "#define CONDVAR (ALGEBRAIC + " << cci->algebraicIndexCount() << ")"
+       << std::endl;
+
+  // Linear interpolation into the tables made by setLookupTable. Positions
+  // rounding past the last interval use it, so the maximum is included.
+  if (!cci->lookupTableErrorIndices().empty())
+    ss << "static double lookup_table(const double* TABLE, int COUNT, "
+       << "double MINIMUM, double RECIPROCAL_STEP, double X)" << std::endl
+       << "{" << std::endl
+       << "  double position = (X - MINIMUM) * RECIPROCAL_STEP;" << std::endl
+       << "  int i = (int)position;" << std::endl
+       << "  if (i > COUNT - 2)" << std::endl
+       << "    i = COUNT - 2;" << std::endl
+       << "  else if (i < 0)" << std::endl
+       << "    i = 0;" << std::endl
+       << "  position -= i;" << std::endl
+       << "  return TABLE[i] + position * (TABLE[i + 1] - TABLE[i]);" << std::endl
+       << "}" << std::endl;
+
+  writeFunctions(cci, ss);
+
   ss << "void SetupConstants(double* CONSTANTS, double* RATES, "
     "double *STATES, struct Override* OVERRIDES, struct fail_info* failInfo)" << std::endl;
   std::wstring frag = cci->initConstsString();
@@ -1473,12 +2641,334 @@ CDA_CellMLIntegrationService::compileModelODEInternal
      << "}" << std::endl;
   delete [] frag8;
 
+  ss << "void ComputeSelectedVariables(double VOI, double* CONSTANTS, "
+     << "double* RATES, double* STATES, double* ALGEBRAIC, const char* NEEDED, "
+     << "struct fail_info* failInfo)" << std::endl;
+  writeSelectedVariables(cci, ss);
+
+  frag = cci->jacobianString();
+  if (frag != L"")
+  {
+    ss << "void ComputeJacobian(double VOI, double* CONSTANTS, double* RATES, "
+       << "double* STATES, double* ALGEBRAIC, double** JACOBIAN, "
+       << "struct fail_info* failInfo)" << std::endl;
+    fragLen = wcstombs(NULL, frag.c_str(), 0) + 1;
+    frag8 = new char[fragLen];
+    wcstombs(frag8, frag.c_str(), fragLen);
+    ss << "{" << std::endl
+       << "#define FAIL_RETURN" << std::endl
+       << frag8 << std::endl
+       << "#undef FAIL_RETURN" << std::endl
+       << "}" << std::endl;
+    delete [] frag8;
+  }
+
+  frag = cci->linearCoefficientsString();
+  if (frag != L"")
+  {
+    ss << "void ComputeLinearCoefficients(double VOI, double* CONSTANTS, "
+       << "double* RATES, double* STATES, double* ALGEBRAIC, "
+       << "double* LINEAR_COEFFICIENTS, struct fail_info* failInfo)"
+       << std::endl;
+    fragLen = wcstombs(NULL, frag.c_str(), 0) + 1;
+    frag8 = new char[fragLen];
+    wcstombs(frag8, frag.c_str(), fragLen);
+    ss << "{" << std::endl
+       << "#define FAIL_RETURN" << std::endl
+       << frag8 << std::endl
+       << "#undef FAIL_RETURN" << std::endl
+       << "}" << std::endl;
+    delete [] frag8;
+  }
+
+  if (condVarSize != 0)
+  {
+    ss << "#undef CONDVAR" << std::endl
+       << "void ComputeRootInformation(double VOI, double* CONSTANTS, "
+       << "double* RATES, double* STATES, double* ALGEBRAIC, double* CONDVAR, "
+       << "struct fail_info* failInfo)" << std::endl;
+    frag = idaCCI->rootInformationString();
+    fragLen = wcstombs(NULL, frag.c_str(), 0) + 1;
+    frag8 = new char[fragLen];
+    wcstombs(frag8, frag.c_str(), fragLen);
+    ss << "{" << std::endl
+       << "#define FAIL_RETURN" << std::endl
+       << frag8 << std::endl
+       << "#undef FAIL_RETURN" << std::endl
+       << "}" << std::endl;
+    delete [] frag8;
+  }
+
+  if (aBatchWidth != 0)
+    writeBatchRates(aModel, cci, aBatchWidth, ss);
+
   ss.close();
 
   CompiledModule* mod = CompileSource(dirname, sourcename, mLastError);
   CompiledModelFunctions* cmf = SetupCompiledModelFunctions(mod);
-  
-  return new CDA_ODESolverModel(mod, cmf, aModel, cci, dirname);
+  if (aBatchWidth != 0)
+    cmf->ComputeRatesBatch =
+      (void (*)(double,double*,double*,double*,double*, struct fail_info*))
+      mod->getSymbol("ComputeRatesBatch");
+
+  CDA_ODESolverModel* m = new CDA_ODESolverModel(mod, cmf, aModel, cci, dirname);
+  m->mBatchWidth = aBatchWidth;
+  m->mConditionVariableCount = condVarSize;
+  return m;
+}
+
+void
+CDA_CellMLIntegrationService::writeBatchRates
+(
+ iface::cellml_api::Model* aModel,
+ iface::cellml_services::CodeInformation* aCCI,
+ uint32_t aBatchWidth,
+ std::ofstream& ss
+)
+{
+  // Generate the rates again, this time addressing each variable as
+  // ARRAY[index][LANE], so that the same code can be put in a loop over the
+  // lanes of structure-of-arrays storage. Piecewise conditions are tracked
+  // just as they are for ComputeRates.
+  RETURN_INTO_OBJREF(cgb, iface::cellml_services::CodeGeneratorBootstrap,
+                     CreateCodeGeneratorBootstrap());
+  RETURN_INTO_OBJREF(cg, iface::cellml_services::CodeGenerator,
+                     cgb->createCodeGenerator());
+  SetupCodeGenStrings(cg, false);
+  cg->constantPattern(L"CONSTANTS[%][LANE]");
+  cg->stateVariableNamePattern(L"STATES[%][LANE]");
+  cg->algebraicVariableNamePattern(L"ALGEBRAIC[%][LANE]");
+  cg->rateNamePattern(L"RATES[%][LANE]");
+  ObjRef<iface::cellml_services::IDACodeGenerator> idaCG(QueryInterface(cg));
+  if (idaCG)
+  {
+    idaCG->trackPiecewiseConditions(true);
+    idaCG->conditionVariablePattern(L"CONDVAR[%][LANE]");
+  }
+
+  RETURN_INTO_OBJREF(bcci, iface::cellml_services::CodeInformation,
+                     cg->generateCode(aModel));
+  RETURN_INTO_WSTRING(funcs, bcci->functionsString());
+  if (funcs != L"")
+  {
+    ss.close();
+    mLastError = L"Model cannot be compiled for batch evaluation because "
+      L"its rates need a non-linear solver, definite integrals or sampling";
+    throw iface::cellml_api::CellMLException(mLastError);
+  }
+
+  ObjRef<iface::cellml_services::IDACodeInformation> idaCCI(QueryInterface(aCCI));
+  ObjRef<iface::cellml_services::IDACodeInformation> idaBCCI(QueryInterface(bcci));
+  uint32_t condVarSize = (idaCCI == NULL) ? 0 : idaCCI->conditionVariableCount();
+  if (!sameIndices(aCCI, bcci) ||
+      condVarSize != ((idaBCCI == NULL) ? 0 : idaBCCI->conditionVariableCount()))
+  {
+    ss.close();
+    mLastError = L"Model cannot be compiled for batch evaluation because "
+      L"its variables could not be given the same indices in both layouts";
+    throw iface::cellml_api::CellMLException(mLastError);
+  }
+
+  ss << "#define BATCH_WIDTH " << aBatchWidth << std::endl
+     << "#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 6 && "
+     << "defined(__x86_64__) && defined(__linux__)" << std::endl
+     << "__attribute__((target_clones(\"avx512f\",\"avx2\",\"default\")))" << std::endl
+     << "#endif" << std::endl
+     << "void ComputeRatesBatch(double VOI, double* CONSTANTS_SOA, "
+     << "double* RATES_SOA, double* STATES_SOA, double* ALGEBRAIC_SOA, "
+     << "struct fail_info* failInfo)" << std::endl;
+  std::wstring frag = bcci->ratesString();
+  size_t fragLen = wcstombs(NULL, frag.c_str(), 0) + 1;
+  char* frag8 = new char[fragLen];
+  wcstombs(frag8, frag.c_str(), fragLen);
+  ss << "{" << std::endl
+     << "  double (*CONSTANTS)[BATCH_WIDTH] = (double (*)[BATCH_WIDTH])CONSTANTS_SOA;" << std::endl
+     << "  double (*RATES)[BATCH_WIDTH] = (double (*)[BATCH_WIDTH])RATES_SOA;" << std::endl
+     << "  double (*STATES)[BATCH_WIDTH] = (double (*)[BATCH_WIDTH])STATES_SOA;" << std::endl
+     << "  double (*ALGEBRAIC)[BATCH_WIDTH] = (double (*)[BATCH_WIDTH])ALGEBRAIC_SOA;" << std::endl;
+  if (condVarSize != 0)
+    ss << "  double (*CONDVAR)[BATCH_WIDTH] = ALGEBRAIC + "
+       << aCCI->algebraicIndexCount() << ";" << std::endl;
+  ss << "  int LANE;" << std::endl
+     << "#pragma GCC ivdep" << std::endl
+     << "  for (LANE = 0; LANE < BATCH_WIDTH; LANE++)" << std::endl
+     << "  {" << std::endl
+     << "#define FAIL_RETURN" << std::endl;
+  // There is no solver history to hold the conditions, so set them from
+  // the states passed in, the way the solver does when it starts, before
+  // computing the rates with them. Like the solver, that takes a first pass
+  // through the rates if the roots depend on anything they compute.
+  if (condVarSize != 0)
+  {
+    std::wstring rootFrag = idaBCCI->rootInformationString();
+    size_t rootFragLen = wcstombs(NULL, rootFrag.c_str(), 0) + 1;
+    char* rootFrag8 = new char[rootFragLen];
+    wcstombs(rootFrag8, rootFrag.c_str(), rootFragLen);
+    if (rootFrag.find(L"ALGEBRAIC") != std::wstring::npos ||
+        rootFrag.find(L"RATES") != std::wstring::npos)
+      ss << frag8 << std::endl;
+    ss << rootFrag8 << std::endl;
+    delete [] rootFrag8;
+  }
+  ss << frag8 << std::endl
+     << "#undef FAIL_RETURN" << std::endl
+     << "  }" << std::endl
+     << "}" << std::endl
+     << "#undef BATCH_WIDTH" << std::endl;
+  delete [] frag8;
+}
+
+bool
+CDA_CellMLIntegrationService::sameIndices
+(
+ iface::cellml_services::CodeInformation* aCCI,
+ iface::cellml_services::CodeInformation* aOtherCCI
+)
+{
+  if (aCCI->constantIndexCount() != aOtherCCI->constantIndexCount() ||
+      aCCI->rateIndexCount() != aOtherCCI->rateIndexCount() ||
+      aCCI->algebraicIndexCount() != aOtherCCI->algebraicIndexCount())
+    return false;
+
+  // Both were generated from the same model, so the targets come out in the
+  // same order...
+  RETURN_INTO_OBJREF(cti, iface::cellml_services::ComputationTargetIterator,
+                     aCCI->iterateTargets());
+  RETURN_INTO_OBJREF(octi, iface::cellml_services::ComputationTargetIterator,
+                     aOtherCCI->iterateTargets());
+  while (true)
+  {
+    RETURN_INTO_OBJREF(ct, iface::cellml_services::ComputationTarget,
+                       cti->nextComputationTarget());
+    RETURN_INTO_OBJREF(oct, iface::cellml_services::ComputationTarget,
+                       octi->nextComputationTarget());
+    if (ct == NULL || oct == NULL)
+      return ct == NULL && oct == NULL;
+
+    RETURN_INTO_OBJREF(v, iface::cellml_api::CellMLVariable, ct->variable());
+    RETURN_INTO_OBJREF(ov, iface::cellml_api::CellMLVariable, oct->variable());
+    if (CDA_objcmp(v, ov) != 0 || ct->degree() != oct->degree() ||
+        ct->type() != oct->type() ||
+        ct->assignedIndex() != oct->assignedIndex())
+      return false;
+  }
+}
+
+void
+CDA_CellMLIntegrationService::writeSelectedVariables
+(
+ iface::cellml_services::CodeInformation* aCCI,
+ std::ofstream& ss
+)
+{
+  // Each system in the variables code is only run if it is flagged in
+  // NEEDED...
+  uint32_t fragmentCount = aCCI->variablesFragmentCount();
+  ss << "{" << std::endl
+     << "#define FAIL_RETURN" << std::endl;
+  for (uint32_t i = 0; i < fragmentCount; i++)
+  {
+    std::wstring frag = aCCI->variablesFragmentString(i);
+    size_t fragLen = wcstombs(NULL, frag.c_str(), 0) + 1;
+    char* frag8 = new char[fragLen];
+    wcstombs(frag8, frag.c_str(), fragLen);
+    ss << "if (NEEDED[" << i << "])" << std::endl
+       << "{" << std::endl
+       << frag8 << std::endl
+       << "}" << std::endl;
+    delete [] frag8;
+  }
+  ss << "#undef FAIL_RETURN" << std::endl
+     << "}" << std::endl;
+}
+
+already_AddRefd<iface::cellml_services::ODESolverCompiledModel>
+CDA_CellMLIntegrationService::compileBatchModelODE
+(
+ iface::cellml_api::Model* aModel,
+ uint32_t aBatchWidth
+)
+  throw(std::exception&)
+{
+  if (aBatchWidth == 0)
+  {
+    mLastError = L"Batch width must be at least one";
+    throw iface::cellml_api::CellMLException(mLastError);
+  }
+  return compileModelODEInternal(aModel, false, aBatchWidth);
+}
+
+already_AddRefd<iface::cellml_services::ODESolverCompiledModel>
+CDA_CellMLIntegrationService::compileModelODEWithLookupTable
+(
+ iface::cellml_api::Model* aModel,
+ iface::cellml_api::CellMLVariable* aVariable,
+ double aMinimum,
+ double aMaximum,
+ double aStep
+)
+  throw(std::exception&)
+{
+  LookupTableSettings lookup;
+  lookup.mVariable = aVariable;
+  lookup.mMinimum = aMinimum;
+  lookup.mMaximum = aMaximum;
+  lookup.mStep = aStep;
+  return compileModelODEInternal(aModel, false, 0, &lookup);
+}
+
+already_AddRefd<iface::cellml_services::ODESolverCompiledModel>
+CDA_CellMLIntegrationService::compileModelODEInterpreted
+(
+ iface::cellml_api::Model* aModel
+)
+  throw(std::exception&)
+{
+  RETURN_INTO_OBJREF(cgb, iface::cellml_services::CodeGeneratorBootstrap,
+                     CreateCodeGeneratorBootstrap());
+  RETURN_INTO_OBJREF(cg, iface::cellml_services::CodeGenerator,
+                     cgb->createCodeGenerator());
+  SetupBytecodeCodeGenStrings(cg);
+
+  ObjRef<iface::cellml_services::CodeInformation> cci;
+  try
+  {
+    cci = already_AddRefd<iface::cellml_services::CodeInformation>
+      (cg->generateCode(aModel));
+
+    std::wstring msg = cci->errorMessage();
+    if (msg != L"")
+    {
+      mLastError = msg;
+      throw iface::cellml_api::CellMLException(msg);
+    }
+  }
+  catch (...)
+  {
+    mLastError = L"Unexpected exception generating code";
+    throw iface::cellml_api::CellMLException(L"Unexpected exception generating code");
+  }
+
+  // Generating the code instantiates the imports, so all of the maths can be
+  // looked at now.
+  if (!CanInterpretMaths(aModel, mLastError))
+    throw iface::cellml_api::CellMLException(mLastError);
+
+  checkConstraintLevel(cci);
+
+  BytecodeProgram* program = new BytecodeProgram();
+  if (!CompileBytecode(cci, *program, mLastError))
+  {
+    delete program;
+    throw iface::cellml_api::CellMLException(mLastError);
+  }
+
+  std::string dirname;
+  CDA_ODESolverModel* m =
+    new CDA_ODESolverModel(NULL, SetupBytecodeModelFunctions(), aModel, cci,
+                           dirname);
+  m->mBytecode = program;
+  return m;
 }
 
 already_AddRefd<iface::cellml_services::DAESolverCompiledModel>
@@ -1539,6 +3029,7 @@ CDA_CellMLIntegrationService::compileModelDAEInternal
 
   std::string dirname, sourcename;
   setupCodeEnvironment(cci, dirname, sourcename, ss);
+  writeFunctions(cci, ss);
 
   ss << "void SetupFixedConstants(double* CONSTANTS, double* RATES, "
     "double *STATES, double *ALGEBRAIC, struct Override* OVERRIDES, "
@@ -1569,6 +3060,11 @@ CDA_CellMLIntegrationService::compileModelDAEInternal
      << "}" << std::endl;
   delete [] frag8;
 
+  ss << "void EvaluateSelectedVariables(double VOI, double* CONSTANTS, "
+     << "double* RATES, double* STATES, double* ALGEBRAIC, double* CONDVAR, "
+     << "const char* NEEDED, struct fail_info* failInfo)" << std::endl;
+  writeSelectedVariables(cci, ss);
+
   ss << "void EvaluateEssentialVariables(double VOI, double* CONSTANTS, double* RATES, "
      << "double* OLDRATES, double* STATES, double* OLDSTATES, double* ALGEBRAIC, "
      << "double* CONDVAR, struct fail_info* failInfo)" << std::endl;
@@ -1621,6 +3117,24 @@ CDA_CellMLIntegrationService::compileModelDAEInternal
      << "}" << std::endl;
   delete [] frag8;
 
+  frag = cci->jacobianString();
+  if (frag != L"")
+  {
+    ss << "void ComputeJacobian(double VOI, double CJ, double* CONSTANTS, "
+       << "double* RATES, double* OLDRATES, double* STATES, double* OLDSTATES, "
+       << "double* ALGEBRAIC, double* CONDVAR, double** JACOBIAN, "
+       << "struct fail_info* failInfo)" << std::endl;
+    fragLen = wcstombs(NULL, frag.c_str(), 0) + 1;
+    frag8 = new char[fragLen];
+    wcstombs(frag8, frag.c_str(), fragLen);
+    ss << "{" << std::endl
+       << "#define FAIL_RETURN" << std::endl
+       << frag8 << std::endl
+       << "#undef FAIL_RETURN" << std::endl
+       << "}" << std::endl;
+    delete [] frag8;
+  }
+
   ss.close();
 
   CompiledModule* mod = CompileSource(dirname, sourcename, mLastError);
@@ -1649,6 +3163,30 @@ CDA_CellMLIntegrationService::createDAEIntegrationRun
   return new CDA_DAESolverRun(unsafe_dynamic_cast<CDA_DAESolverModel*>(aModel));
 }
 
+already_AddRefd<iface::cellml_services::ODESolverEnsembleRun>
+CDA_CellMLIntegrationService::createODEEnsembleRun
+(
+ iface::cellml_services::ODESolverCompiledModel* aModel
+)
+  throw (std::exception&)
+{
+  return new CDA_ODESolverEnsembleRun(unsafe_dynamic_cast<CDA_ODESolverModel*>(aModel));
+}
+
+uint32_t
+CDA_CellMLIntegrationService::workerCount()
+  throw (std::exception&)
+{
+  return CISThreadPool::singleton()->workerCount();
+}
+
+void
+CDA_CellMLIntegrationService::workerCount(uint32_t aCount)
+  throw (std::exception&)
+{
+  CISThreadPool::singleton()->workerCount(aCount);
+}
+
 already_AddRefd<iface::cellml_services::CellMLIntegrationService>
 CreateIntegrationService()
 {
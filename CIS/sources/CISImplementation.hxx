@@ -1,7 +1,14 @@
 #include "IfaceCCGS.hxx"
 #include "IfaceCIS.hxx"
 #include <string>
+#include <vector>
 #include "cda_compiler_support.h"
+#include "CISResultStream.hxx"
+#include "CISThreadPool.hxx"
+#include "CISSolverSession.hxx"
+#include "CISBytecode.hxx"
+#include "CISJacobian.hxx"
+#include "CISDistribution.hxx"
 
 #undef ENABLE_CONTEXT
 #ifdef ENABLE_CONTEXT
@@ -12,12 +19,79 @@ extern void UnloadCIS(void);
 
 class CompiledModule;
 
+class NonlinearSolverWorkspaces;
+class EDoubleErrors;
+class AdaptiveQuadrature;
+
+// The counts and times behind IntegrationStatistics.
+struct RunStatistics
+{
+  RunStatistics()
+    : rhsEvaluations(0), jacobianEvaluations(0), steps(0), rejectedSteps(0),
+      nonlinearIterations(0), nonlinearConvergenceFailures(0), rootsFound(0),
+      algebraicSolveIterations(0), setupTime(0.0), solveTime(0.0),
+      computeVariablesTime(0.0), observerTime(0.0) {}
+
+  uint64_t rhsEvaluations, jacobianEvaluations, steps, rejectedSteps,
+    nonlinearIterations, nonlinearConvergenceFailures, rootsFound,
+    algebraicSolveIterations;
+  double setupTime, solveTime, computeVariablesTime, observerTime;
+};
+
+// How do_nonlinearsolve may use other threads to search for a solution.
+struct NonlinearSolverThreading
+{
+  NonlinearSolverThreading()
+    : threads(1), priority(0), constants(0), rates(0), states(0),
+      algebraic(0) {}
+
+  uint32_t threads;
+  // The priority of the tasks submitted to the shared threads.
+  int32_t priority;
+  // The sizes of the model's arrays, each thread working on its own copies.
+  uint32_t constants, rates, states, algebraic;
+};
+
 // This is used opaquely from generated C code, which uses the C API to fail_info
 // below.
 struct fail_info {
-  fail_info() { failtype = 0; }
+  fail_info() : failtype(0), nlsWorkspaces(NULL), edoubleErrors(NULL),
+                bytecode(NULL), statistics(NULL), distributionTables(NULL),
+                quadrature(NULL), cacheIntegrals(false) {}
+  ~fail_info();
   int failtype;
   std::string failmsg;
+  // Nonlinear solver state kept for as long as this fail_info (and hence the
+  // run using it) lives; created on demand by do_nonlinearsolve.
+  NonlinearSolverWorkspaces* nlsWorkspaces;
+  // Why the values computed by debug models are not finite; created on demand
+  // by EDoubleCause.
+  EDoubleErrors* edoubleErrors;
+  // The program run by the functions from SetupBytecodeModelFunctions, for
+  // models compiled with compileModelODEInterpreted.
+  const BytecodeProgram* bytecode;
+  // Where do_nonlinearsolve counts its iterations; NULL outside of runs.
+  RunStatistics* statistics;
+  NonlinearSolverThreading nlsThreading;
+  // Where SampleUsingPDF keeps the tables it makes; if NULL, it makes a new
+  // one for every sample.
+  DistributionTableCache* distributionTables;
+  // The workspace for definite integrals, created on demand by defint and
+  // TryDefint, which cache their results in it if cacheIntegrals is set.
+  AdaptiveQuadrature* quadrature;
+  bool cacheIntegrals;
+
+private:
+  fail_info(const fail_info&);
+  fail_info& operator=(const fail_info&);
+};
+
+// What the generated code passes do_nonlinearsolve to hand on to the
+// functions it solves; as declared by setupCodeEnvironment.
+struct rootfind_info
+{
+  double aVOI, * aCONSTANTS, * aRATES, * aSTATES, * aALGEBRAIC;
+  struct fail_info* aFail;
 };
 
 struct Override
@@ -27,6 +101,13 @@ struct Override
   bool* isOverriden;
 };
 
+// The lookup table requested through compileModelODEWithLookupTable.
+struct LookupTableSettings
+{
+  iface::cellml_api::CellMLVariable* mVariable;
+  double mMinimum, mMaximum, mStep;
+};
+
 struct CompiledModelFunctions
 {
   void (*SetupConstants)(double* CONSTANTS, double* RATES, double* STATES, struct Override*, struct fail_info*);
@@ -34,6 +115,35 @@ struct CompiledModelFunctions
                       double* STATES, double* ALGEBRAIC, struct fail_info*);
   void (*ComputeVariables)(double VOI, double* CONSTANTS, double* RATES,
                           double* STATES, double* ALGEBRAIC, struct fail_info*);
+  // As for ComputeVariables, but only runs the fragments of the CCGS
+  // variablesString flagged in NEEDED.
+  void (*ComputeSelectedVariables)(double VOI, double* CONSTANTS, double* RATES,
+                                   double* STATES, double* ALGEBRAIC,
+                                   const char* NEEDED, struct fail_info*);
+  // Only present in models compiled with a batch width; the arrays are in
+  // structure-of-arrays layout.
+  void (*ComputeRatesBatch)(double VOI, double* CONSTANTS, double* RATES,
+                            double* STATES, double* ALGEBRAIC, struct fail_info*);
+  // NULL if no analytic Jacobian could be generated. JACOBIAN is an array of
+  // column pointers, and must be zeroed by the caller.
+  void (*ComputeJacobian)(double VOI, double* CONSTANTS, double* RATES,
+                          double* STATES, double* ALGEBRAIC, double** JACOBIAN,
+                          struct fail_info*);
+  // NULL if the model has no piecewise conditions. Computes the functions
+  // whose roots switch each condition variable into CONDVAR. The functions
+  // above use the condition variables stored after the algebraic variables,
+  // which only change when the solver restarts at a root.
+  void (*ComputeRootInformation)(double VOI, double* CONSTANTS, double* RATES,
+                                 double* STATES, double* ALGEBRAIC,
+                                 double* CONDVAR, struct fail_info*);
+  // NULL if no state variable's rate is linear in it. Sets the partial
+  // derivative of each such rate with respect to its state variable in
+  // COEFFICIENTS, leaving the other entries alone. Must be called after
+  // ComputeRates.
+  void (*ComputeLinearCoefficients)(double VOI, double* CONSTANTS,
+                                    double* RATES, double* STATES,
+                                    double* ALGEBRAIC, double* COEFFICIENTS,
+                                    struct fail_info*);
 };
 
 struct IDACompiledModelFunctions
@@ -43,6 +153,10 @@ struct IDACompiledModelFunctions
   void (*EvaluateVariables)(double VOI, double* CONSTANTS, double* RATES,
                            double *STATES, double* ALGEBRAIC, double* CONDVAR,
                            struct fail_info*);
+  void (*EvaluateSelectedVariables)(double VOI, double* CONSTANTS, double* RATES,
+                                    double *STATES, double* ALGEBRAIC,
+                                    double* CONDVAR, const char* NEEDED,
+                                    struct fail_info*);
   void (*EvaluateEssentialVariables)(double VOI, double* CONSTANTS, double* RATES,
                                     double* OLDRATES, double* STATES,
                                     double* OLDSTATES, double* ALGEBRAIC,
@@ -57,6 +171,13 @@ struct IDACompiledModelFunctions
                                 double* ALGEBRAIC, double* CONDVAR,
                                 struct fail_info*);
   void (*SetupStateInfo)(double * SI);
+  // NULL if no analytic Jacobian could be generated. Computes
+  // dresid/dSTATES + CJ dresid/dRATES into the zeroed column pointers in
+  // JACOBIAN.
+  void (*ComputeJacobian)(double VOI, double CJ, double* CONSTANTS,
+                          double* RATES, double* OLDRATES, double* STATES,
+                          double* OLDSTATES, double* ALGEBRAIC, double* CONDVAR,
+                          double** JACOBIAN, struct fail_info*);
 };
 
 class CDA_CellMLCompiledModel
@@ -89,12 +210,53 @@ public:
     return mCCI.getPointer();
   }
 
+  double distributionTolerance()
+    throw(std::exception&)
+  {
+    return mDistributionTables.tolerance();
+  }
+
+  void distributionTolerance(double aTolerance)
+    throw(std::exception&)
+  {
+    mDistributionTables.tolerance(aTolerance);
+  }
+
+  virtual uint32_t batchWidth()
+    throw(std::exception&)
+  {
+    return 0;
+  }
+
+  virtual std::vector<double> computeRatesBatch(double voi,
+                                                const std::vector<double>& constants,
+                                                const std::vector<double>& states)
+    throw(std::exception&)
+  {
+    throw iface::cellml_api::CellMLException(L"Model was not compiled for batch evaluation");
+  }
+
   // These are not available directly across CORBA, but read-only access is
   // allowed within the same module...
   CompiledModule* mModule;
   ObjRef<iface::cellml_api::Model> mModel;
   ObjRef<iface::cellml_services::CodeInformation> mCCI;
   std::string mDirname;
+
+  // The structure of the Jacobian, as described by mCCI->rateDependencies.
+  uint32_t mJacobianLowerBandwidth, mJacobianUpperBandwidth;
+  uint32_t mJacobianNonZeroCount;
+  // For finite difference Jacobians, when there is no analytic one.
+  JacobianColouring mJacobianColouring;
+
+  // Solver memory left over from earlier runs of this model.
+  SolverSessionCache mSolverSessions;
+  // The distributions runs of this model have sampled from.
+  DistributionTableCache mDistributionTables;
+
+  iface::cellml_services::LinearSolverType
+  chooseLinearSolver(iface::cellml_services::LinearSolverType aRequested,
+                     uint32_t aSize);
 };
 
 class CDA_ODESolverModel
@@ -108,13 +270,25 @@ public:
    iface::cellml_services::CodeInformation* aCCI,
    std::string& aDirname
   )
-    : CDA_CellMLCompiledModel(aModule, aModel, aCCI, aDirname), mCMF(aCMF)
+    : CDA_CellMLCompiledModel(aModule, aModel, aCCI, aDirname), mCMF(aCMF),
+      mBatchWidth(0), mConditionVariableCount(0), mBytecode(NULL)
   {}
 
-  ~CDA_ODESolverModel() { delete mCMF; }
+  ~CDA_ODESolverModel() { delete mCMF; delete mBytecode; }
 
   CDA_IMPL_QI2(cellml_services::CellMLCompiledModel, cellml_services::ODESolverCompiledModel);
+
+  uint32_t batchWidth() throw(std::exception&) { return mBatchWidth; }
+  std::vector<double> computeRatesBatch(double voi,
+                                        const std::vector<double>& constants,
+                                        const std::vector<double>& states)
+    throw(std::exception&);
+
   CompiledModelFunctions* mCMF;
+  uint32_t mBatchWidth;
+  uint32_t mConditionVariableCount;
+  // Non-NULL if mCMF interprets this rather than calling generated code.
+  BytecodeProgram* mBytecode;
 };
 
 class CDA_DAESolverModel
@@ -138,10 +312,87 @@ public:
   IDACompiledModelFunctions* mCMF;
 };
 
+class CDA_IntegrationStatistics
+  : public iface::cellml_services::IntegrationStatistics
+{
+public:
+  CDA_IntegrationStatistics(const RunStatistics& aStatistics)
+    : mStatistics(aStatistics)
+  {
+  }
+
+  CDA_IMPL_REFCOUNT;
+  CDA_IMPL_ID;
+  CDA_IMPL_QI1(cellml_services::IntegrationStatistics);
+
+  uint64_t rhsEvaluations() throw(std::exception&)
+  {
+    return mStatistics.rhsEvaluations;
+  }
+
+  uint64_t jacobianEvaluations() throw(std::exception&)
+  {
+    return mStatistics.jacobianEvaluations;
+  }
+
+  uint64_t steps() throw(std::exception&)
+  {
+    return mStatistics.steps;
+  }
+
+  uint64_t rejectedSteps() throw(std::exception&)
+  {
+    return mStatistics.rejectedSteps;
+  }
+
+  uint64_t nonlinearIterations() throw(std::exception&)
+  {
+    return mStatistics.nonlinearIterations;
+  }
+
+  uint64_t nonlinearConvergenceFailures() throw(std::exception&)
+  {
+    return mStatistics.nonlinearConvergenceFailures;
+  }
+
+  uint64_t rootsFound() throw(std::exception&)
+  {
+    return mStatistics.rootsFound;
+  }
+
+  uint64_t algebraicSolveIterations() throw(std::exception&)
+  {
+    return mStatistics.algebraicSolveIterations;
+  }
+
+  double setupTime() throw(std::exception&)
+  {
+    return mStatistics.setupTime;
+  }
+
+  double solveTime() throw(std::exception&)
+  {
+    return mStatistics.solveTime;
+  }
+
+  double computeVariablesTime() throw(std::exception&)
+  {
+    return mStatistics.computeVariablesTime;
+  }
+
+  double observerTime() throw(std::exception&)
+  {
+    return mStatistics.observerTime;
+  }
+
+private:
+  RunStatistics mStatistics;
+};
+
 class CDA_CellMLIntegrationRun
   : public iface::cellml_services::ODESolverRun,
     public iface::cellml_services::DAESolverRun,
-    public CDAThread
+    public CISTask
 {
 public:
   CDA_CellMLIntegrationRun();
@@ -160,41 +411,98 @@ public:
                           double scalRate, double maxStep) throw (std::exception&);
   void setTabulationStepControl(double tabulationStepSize, bool strictTabulation)
     throw (std::exception&);
+  bool interpolateTabulation() throw (std::exception&);
+  void interpolateTabulation(bool aInterpolate) throw (std::exception&);
+  void setResultBatching(uint32_t maxPoints, uint32_t maxBytes,
+                         double maxLatency) throw (std::exception&);
   void setResultRange(double startBvar, double stopBvar, double incrementBvar)
     throw (std::exception&);
+  iface::cellml_services::LinearSolverType linearSolverType()
+    throw (std::exception&);
+  void linearSolverType(iface::cellml_services::LinearSolverType aType)
+    throw (std::exception&);
+  int32_t priority() throw (std::exception&);
+  void priority(int32_t aPriority) throw (std::exception&);
+  bool continueSolver() throw (std::exception&);
+  void continueSolver(bool aContinue) throw (std::exception&);
+  uint32_t nonlinearSolverThreads() throw (std::exception&);
+  void nonlinearSolverThreads(uint32_t aThreads) throw (std::exception&);
+  bool cacheDefiniteIntegrals() throw (std::exception&);
+  void cacheDefiniteIntegrals(bool aCache) throw (std::exception&);
   void setProgressObserver(iface::cellml_services::IntegrationProgressObserver*
                            aIpo)
     throw (std::exception&);
+  already_AddRefd<iface::cellml_services::IntegrationStatistics> statistics()
+    throw (std::exception&);
   void setOverride(iface::cellml_services::VariableEvaluationType aType,
                    uint32_t variableIndex, double newValue)
     throw (std::exception&);
+  void addOutputColumn(iface::cellml_services::OutputColumnType aType,
+                       uint32_t aIndex)
+    throw (std::exception&);
   void start() throw (std::exception&);
   void stop() throw (std::exception&);
   void pause() throw (std::exception&);
   void resume() throw (std::exception&);
 
 protected:
-  virtual void runthread() = 0;
+  virtual void runtask() = 0;
 
 protected:
   bool mIsStarted;
+  // The solver thread only waits on these while paused; otherwise it just
+  // polls mCancelIntegration and mPauseIntegration.
 #ifdef WIN32
-  HANDLE mThreadPipes[2];
-  HANDLE mThreadSemaphore;
+  HANDLE mResumeEvent;
 #else
-  int mThreadPipes[2];
+  pthread_mutex_t mPauseMutex;
+  pthread_cond_t mPauseCond;
 #endif
 
   iface::cellml_services::ODEIntegrationStepType mStepType;
+  iface::cellml_services::LinearSolverType mLinearSolverType;
+  int32_t mPriority;
+  uint32_t mNonlinearSolverThreads;
+  bool mCacheDefiniteIntegrals;
   double mEpsAbs, mEpsRel, mScalVar, mScalRate, mStepSizeMax;
   double mStartBvar, mStopBvar, mMaxPointDensity, mTabulationStepSize;
   iface::cellml_services::IntegrationProgressObserver* mObserver;
   typedef std::list<std::pair<uint32_t,double> > OverrideList;
   OverrideList mConstantOverrides, mIVOverrides;
-  bool mCancelIntegration, mPauseIntegration;
-  bool mStrictTabulation;
+  volatile bool mCancelIntegration, mPauseIntegration;
+  bool mStrictTabulation, mInterpolateTabulation, mContinueSolver;
+  ResultBatching mResultBatching;
+  // Set when the run belongs to an ensemble, which cancels it through this
+  // flag instead of through stop().
+  const volatile bool* mExternalCancel;
+  typedef std::vector<std::pair<iface::cellml_services::OutputColumnType,
+                                uint32_t> > OutputColumnList;
+  OutputColumnList mOutputColumns;
+  // Flags the variablesString fragments needed for the output columns. Empty
+  // if none are needed.
+  std::vector<char> mNeededFragments;
+  // Only the thread running the solver touches mStatistics, and it copies
+  // them to mPublishedStatistics, which statistics() reads, as each result is
+  // recorded and when the run finishes. mStatistics.observerTime only has the
+  // time spent in computedConstants; the rest is kept by the result stream.
+  RunStatistics mStatistics, mPublishedStatistics;
+  CDAMutex mStatisticsMutex;
+  double mSolveStarted;
 
   bool checkPauseOrCancellation();
+  // Lets the nonlinear solves made with aFailInfo spread their random
+  // restarts over mNonlinearSolverThreads threads.
+  void setupNonlinearSolverThreading(fail_info& aFailInfo, uint32_t aConstSize,
+                                     uint32_t aRateSize, uint32_t aStateSize,
+                                     uint32_t aAlgSize);
+  void publishStatistics(ResultStream& aStream);
+  // Finishes aStream, and publishes the final statistics.
+  void finishStatistics(ResultStream& aStream);
+  void setupOutputColumns(iface::cellml_services::CodeInformation* aCCI);
+  uint32_t outputRecordSize(uint32_t aRateSize, uint32_t aAlgSize);
+  void recordResult(ResultStream& aStream, double aVOI, const double* aStates,
+                    const double* aRates, uint32_t aRateSize,
+                    const double* aAlgebraic, uint32_t aAlgSize);
 };
 
 class CDA_ODESolverRun
@@ -208,14 +516,32 @@ protected:
   ObjRef<CDA_ODESolverModel> mModel;
   void SolveODEProblem(CompiledModelFunctions* f, uint32_t constSize,
                        double* constants, uint32_t rateSize, double* rates,
-                       double* states, uint32_t algSize, double* algebraic);
+                       double* states, uint32_t algSize, double* algebraic,
+                       ResultStream& aStream);
   void SolveODEProblemGSL(CompiledModelFunctions* f, uint32_t constSize,
                        double* constants, uint32_t rateSize, double* rates,
-                       double* states, uint32_t algSize, double* algebraic);
+                       double* states, uint32_t algSize, double* algebraic,
+                       ResultStream& aStream);
   void SolveODEProblemCVODE(CompiledModelFunctions* f, uint32_t constSize,
                        double* constants, uint32_t rateSize, double* rates,
-                       double* states, uint32_t algSize, double* algebraic);
-  void runthread();
+                       double* states, uint32_t algSize, double* algebraic,
+                       ResultStream& aStream);
+  void SolveODEProblemRushLarsen(CompiledModelFunctions* f, uint32_t constSize,
+                       double* constants, uint32_t rateSize, double* rates,
+                       double* states, uint32_t algSize, double* algebraic,
+                       ResultStream& aStream);
+  void computeOutputVariables(CompiledModelFunctions* f, double voi,
+                              double* constants, double* rates, double* states,
+                              double* algebraic, struct fail_info* failInfo);
+  void updateConditionVariables(CompiledModelFunctions* f, double voi,
+                                double* constants, double* rates,
+                                double* states, double* algebraic,
+                                uint32_t algSize, const int* rootDirections,
+                                struct fail_info* failInfo);
+  void integrate();
+  void runtask();
+
+  friend class CDA_ODESolverEnsembleRun;
 };
 
 class CDA_DAESolverRun
@@ -227,7 +553,11 @@ public:
   CDA_IMPL_QI2(cellml_services::CellMLIntegrationRun, cellml_services::DAESolverRun);
 protected:
   ObjRef<CDA_DAESolverModel> mModel;
-  void runthread();
+  void evaluateOutputVariables(IDACompiledModelFunctions* f, double voi,
+                               double* constants, double* rates,
+                               double* states, double* algebraic,
+                               double* condvars, struct fail_info* failInfo);
+  void runtask();
 
   void SolveDAEProblem(IDACompiledModelFunctions* f, uint32_t constSize,
                        double* constants, uint32_t rateSize, double* rates,
@@ -235,6 +565,86 @@ protected:
                        uint32_t condVarSize, double* condvars);
 };
 
+class CDA_ODESolverEnsembleRun
+  : public iface::cellml_services::ODESolverEnsembleRun
+{
+public:
+  CDA_ODESolverEnsembleRun(CDA_ODESolverModel* aModel);
+  ~CDA_ODESolverEnsembleRun();
+
+  CDA_IMPL_REFCOUNT;
+  CDA_IMPL_ID;
+  CDA_IMPL_QI1(cellml_services::ODESolverEnsembleRun);
+
+  iface::cellml_services::ODEIntegrationStepType stepType()
+    throw (std::exception&);
+  void stepType(iface::cellml_services::ODEIntegrationStepType ist)
+    throw (std::exception&);
+  iface::cellml_services::LinearSolverType linearSolverType()
+    throw (std::exception&);
+  void linearSolverType(iface::cellml_services::LinearSolverType aType)
+    throw (std::exception&);
+  uint32_t workerCount() throw (std::exception&);
+  void workerCount(uint32_t aCount) throw (std::exception&);
+  int32_t priority() throw (std::exception&);
+  void priority(int32_t aPriority) throw (std::exception&);
+
+  void setStepSizeControl(double epsAbs, double epsRel, double scalVar,
+                          double scalRate, double maxStep) throw (std::exception&);
+  void setTabulationStepControl(double tabulationStepSize, bool strictTabulation)
+    throw (std::exception&);
+  bool interpolateTabulation() throw (std::exception&);
+  void interpolateTabulation(bool aInterpolate) throw (std::exception&);
+  void setResultBatching(uint32_t maxPoints, uint32_t maxBytes,
+                         double maxLatency) throw (std::exception&);
+  void setResultRange(double startBvar, double stopBvar, double maxPointDensity)
+    throw (std::exception&);
+  void setProgressObserver(iface::cellml_services::EnsembleProgressObserver* aEpo)
+    throw (std::exception&);
+  void addOverrideColumn(iface::cellml_services::VariableEvaluationType aType,
+                         uint32_t variableIndex)
+    throw (std::exception&);
+  void addOutputColumn(iface::cellml_services::OutputColumnType aType,
+                       uint32_t aIndex)
+    throw (std::exception&);
+  void setOverrideValues(uint32_t memberCount, const std::vector<double>& values)
+    throw (std::exception&);
+  void start() throw (std::exception&);
+  void stop() throw (std::exception&);
+
+  // Called on the worker threads...
+  void runMembers();
+  void memberComputedConstants(uint32_t aMember, const std::vector<double>& aValues);
+  void memberResults(uint32_t aMember, const std::vector<double>& aState);
+  void memberDone(uint32_t aMember);
+  void memberFailed(uint32_t aMember, const std::string& aErrorMessage);
+
+private:
+  void runMember(uint32_t aMember);
+
+  ObjRef<CDA_ODESolverModel> mModel;
+  iface::cellml_services::ODEIntegrationStepType mStepType;
+  iface::cellml_services::LinearSolverType mLinearSolverType;
+  double mEpsAbs, mEpsRel, mScalVar, mScalRate, mStepSizeMax;
+  double mStartBvar, mStopBvar, mMaxPointDensity, mTabulationStepSize;
+  bool mStrictTabulation, mInterpolateTabulation;
+  ResultBatching mResultBatching;
+  ObjRef<iface::cellml_services::EnsembleProgressObserver> mObserver;
+  std::vector<std::pair<iface::cellml_services::VariableEvaluationType, uint32_t> >
+    mOverrideColumns;
+  std::vector<double> mOverrideValues;
+  std::vector<std::pair<iface::cellml_services::OutputColumnType, uint32_t> >
+    mOutputColumns;
+  uint32_t mMemberCount, mWorkerCount;
+  int32_t mPriority;
+  bool mIsStarted;
+  volatile bool mCancel;
+
+  // Protects mNextMember and mActiveWorkers, and serialises observer calls.
+  CDAMutex mMutex;
+  uint32_t mNextMember, mActiveWorkers;
+};
+
 class CDA_CellMLIntegrationService
   : public iface::cellml_services::CellMLIntegrationService
 #ifdef ENABLE_CONTEXT
@@ -277,6 +687,18 @@ public:
   already_AddRefd<iface::cellml_services::ODESolverCompiledModel>
   compileDebugModelODE(iface::cellml_api::Model* aModel)
     throw(std::exception&);
+  already_AddRefd<iface::cellml_services::ODESolverCompiledModel>
+  compileBatchModelODE(iface::cellml_api::Model* aModel, uint32_t aBatchWidth)
+    throw(std::exception&);
+  already_AddRefd<iface::cellml_services::ODESolverCompiledModel>
+  compileModelODEWithLookupTable(iface::cellml_api::Model* aModel,
+                                 iface::cellml_api::CellMLVariable* aVariable,
+                                 double aMinimum, double aMaximum,
+                                 double aStep)
+    throw(std::exception&);
+  already_AddRefd<iface::cellml_services::ODESolverCompiledModel>
+  compileModelODEInterpreted(iface::cellml_api::Model* aModel)
+    throw(std::exception&);
   already_AddRefd<iface::cellml_services::DAESolverCompiledModel>
   compileDebugModelDAE(iface::cellml_api::Model* aModel)
     throw(std::exception&);
@@ -287,7 +709,12 @@ public:
   already_AddRefd<iface::cellml_services::DAESolverRun>
   createDAEIntegrationRun(iface::cellml_services::DAESolverCompiledModel* aModel)
     throw(std::exception&);
+  already_AddRefd<iface::cellml_services::ODESolverEnsembleRun>
+  createODEEnsembleRun(iface::cellml_services::ODESolverCompiledModel* aModel)
+    throw(std::exception&);
   
+  uint32_t workerCount() throw(std::exception&);
+  void workerCount(uint32_t aCount) throw(std::exception&);
   std::wstring lastError() throw(std::exception&)
   {
     return mLastError;
@@ -334,15 +761,27 @@ public:
 
 private:
   already_AddRefd<iface::cellml_services::ODESolverCompiledModel>
-  compileModelODEInternal(iface::cellml_api::Model* aModel, bool aIsDebug)
+  compileModelODEInternal(iface::cellml_api::Model* aModel, bool aIsDebug,
+                          uint32_t aBatchWidth = 0,
+                          const LookupTableSettings* aLookupTable = NULL)
     throw(std::exception&);
   already_AddRefd<iface::cellml_services::DAESolverCompiledModel>
   compileModelDAEInternal(iface::cellml_api::Model* aModel, bool aIsDebug)
     throw(std::exception&);
 
+  void checkConstraintLevel(iface::cellml_services::CodeInformation* cci);
   CompiledModule* CompileSource(std::string& destDir, std::string& sourceFile,
                                 std::wstring& lastError);
   void SetupCodeGenStrings(iface::cellml_services::CodeGenerator* aCGS, bool aIsDebug);
+  void writeBatchRates(iface::cellml_api::Model* aModel,
+                       iface::cellml_services::CodeInformation* aCCI,
+                       uint32_t aBatchWidth, std::ofstream& ss);
+  bool sameIndices(iface::cellml_services::CodeInformation* aCCI,
+                   iface::cellml_services::CodeInformation* aOtherCCI);
+  void writeSelectedVariables(iface::cellml_services::CodeInformation* aCCI,
+                              std::ofstream& ss);
+  void writeFunctions(iface::cellml_services::CodeInformation* aCCI,
+                      std::ofstream& ss);
   std::wstring mLastError;
 #ifdef ENABLE_CONTEXT
   void (*mUnload)();
@@ -0,0 +1,166 @@
+#define MODULE_CONTAINS_CIS
+#include "CISJacobian.hxx"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+void
+JacobianColouring::compute
+(
+ const std::vector<std::vector<uint32_t> >& aDependencies
+)
+{
+  uint32_t n = aDependencies.size();
+
+  // Turn the rows around into columns...
+  mColumnStart.assign(n + 1, 0);
+  for (uint32_t row = 0; row < n; row++)
+    for (std::vector<uint32_t>::const_iterator i = aDependencies[row].begin();
+         i != aDependencies[row].end(); i++)
+      if (*i < n)
+        mColumnStart[*i + 1]++;
+  for (uint32_t col = 0; col < n; col++)
+    mColumnStart[col + 1] += mColumnStart[col];
+  mRows.resize(mColumnStart[n]);
+  std::vector<uint32_t> fill(mColumnStart.begin(), mColumnStart.end() - 1);
+  for (uint32_t row = 0; row < n; row++)
+    for (std::vector<uint32_t>::const_iterator i = aDependencies[row].begin();
+         i != aDependencies[row].end(); i++)
+      if (*i < n)
+        mRows[fill[*i]++] = row;
+
+  // Colour the columns greedily, the columns with the most non-zeros first,
+  // giving each the lowest colour not used by a column sharing a row with it.
+  std::vector<std::pair<uint32_t, uint32_t> > order;
+  for (uint32_t col = 0; col < n; col++)
+    order.push_back(std::pair<uint32_t, uint32_t>
+                    (n - (mColumnStart[col + 1] - mColumnStart[col]), col));
+  std::sort(order.begin(), order.end());
+
+  const uint32_t uncoloured = (uint32_t)-1;
+  std::vector<uint32_t> colour(n, uncoloured);
+  // forbidden[c] == col + 1 if colour c clashes with column col.
+  std::vector<uint32_t> forbidden(n + 1, 0);
+  uint32_t colours = 0;
+  for (std::vector<std::pair<uint32_t, uint32_t> >::iterator i = order.begin();
+       i != order.end(); i++)
+  {
+    uint32_t col = i->second;
+    for (uint32_t r = mColumnStart[col]; r < mColumnStart[col + 1]; r++)
+    {
+      const std::vector<uint32_t>& rowDeps = aDependencies[mRows[r]];
+      for (std::vector<uint32_t>::const_iterator j = rowDeps.begin();
+           j != rowDeps.end(); j++)
+        if (*j < n && colour[*j] != uncoloured)
+          forbidden[colour[*j]] = col + 1;
+    }
+
+    uint32_t c = 0;
+    while (forbidden[c] == col + 1)
+      c++;
+    colour[col] = c;
+    if (c + 1 > colours)
+      colours = c + 1;
+  }
+
+  mColourStart.assign(colours + 1, 0);
+  for (uint32_t col = 0; col < n; col++)
+    mColourStart[colour[col] + 1]++;
+  for (uint32_t c = 0; c < colours; c++)
+    mColourStart[c + 1] += mColourStart[c];
+  mColourColumns.resize(n);
+  fill.assign(mColourStart.begin(), mColourStart.end() - 1);
+  for (uint32_t col = 0; col < n; col++)
+    mColourColumns[fill[colour[col]]++] = col;
+}
+
+ColouredJacobian::ColouredJacobian(const JacobianColouring& aColouring)
+  : mEvaluations(0), mColouring(aColouring), mStates(aColouring.size()),
+    mRates(aColouring.size()), mBaseValue(aColouring.size()),
+    mPerturbedValue(aColouring.size()), mIncrements(aColouring.size()),
+    mValue(NULL)
+{
+}
+
+int
+ColouredJacobian::compute
+(
+ JacobianFunction aFunction, void* aData, double aVOI,
+ const double* aStates, const double* aRates, double aRateFactor,
+ const double* aValue, const double* aWeights, double* aJacobian,
+ size_t aRowStride, size_t aColumnStride
+)
+{
+  uint32_t n = mColouring.size();
+  if (n == 0)
+    return 0;
+
+  memcpy(&mStates[0], aStates, n * sizeof(double));
+  double* rates = NULL;
+  if (aRates != NULL)
+  {
+    memcpy(&mRates[0], aRates, n * sizeof(double));
+    rates = &mRates[0];
+  }
+
+  if (aValue == NULL)
+  {
+    mEvaluations++;
+    int ret = aFunction(aVOI, &mStates[0], rates, &mBaseValue[0], aData);
+    if (ret != 0)
+      return ret;
+    aValue = &mBaseValue[0];
+  }
+  mValue = aValue;
+
+  // The usual square root of the unit roundoff, relative to the size of the
+  // state variable, or to the solver's tolerance for it if that is bigger.
+  double srur = sqrt(std::numeric_limits<double>::epsilon());
+  for (uint32_t c = 0; c < mColouring.colourCount(); c++)
+  {
+    uint32_t first = mColouring.mColourStart[c],
+      last = mColouring.mColourStart[c + 1];
+    for (uint32_t k = first; k < last; k++)
+    {
+      uint32_t col = mColouring.mColourColumns[k];
+      double scale = std::abs(aStates[col]);
+      if (aWeights != NULL && aWeights[col] > 0.0)
+        scale = std::max(scale, 1.0 / aWeights[col]);
+      if (scale == 0.0)
+        scale = 1.0;
+      // Make the increment exactly representable, so the quotient is right.
+      volatile double perturbed = aStates[col] + srur * scale;
+      mIncrements[col] = perturbed - aStates[col];
+      mStates[col] = perturbed;
+      if (rates != NULL)
+        rates[col] = aRates[col] + aRateFactor * mIncrements[col];
+    }
+
+    mEvaluations++;
+    int ret = aFunction(aVOI, &mStates[0], rates, &mPerturbedValue[0], aData);
+
+    for (uint32_t k = first; k < last; k++)
+    {
+      uint32_t col = mColouring.mColourColumns[k];
+      mStates[col] = aStates[col];
+      if (rates != NULL)
+        rates[col] = aRates[col];
+      if (ret != 0)
+        continue;
+
+      double* column = aJacobian + col * aColumnStride;
+      for (uint32_t r = mColouring.mColumnStart[col];
+           r < mColouring.mColumnStart[col + 1]; r++)
+      {
+        uint32_t row = mColouring.mRows[r];
+        column[row * aRowStride] =
+          (mPerturbedValue[row] - aValue[row]) / mIncrements[col];
+      }
+    }
+    if (ret != 0)
+      return ret;
+  }
+
+  return 0;
+}
@@ -0,0 +1,77 @@
+#ifndef _CISJacobian_hxx
+#define _CISJacobian_hxx
+
+#include "Utilities.hxx"
+#include <vector>
+
+/*
+ * A grouping of the columns of a sparse Jacobian such that no two columns in
+ * the same group (colour) have a non-zero in the same row (Curtis, Powell and
+ * Reid). All the state variables of one colour can then be perturbed at
+ * once, and the change in each rate (or residual) put down to the only state
+ * variable of that colour it depends on.
+ */
+class JacobianColouring
+{
+public:
+  JacobianColouring() {}
+
+  // aDependencies[row] lists the columns that row depends on, as
+  // CodeInformation::rateDependencies does.
+  void compute(const std::vector<std::vector<uint32_t> >& aDependencies);
+
+  uint32_t size() const { return mColumnStart.empty() ? 0 : mColumnStart.size() - 1; }
+  uint32_t colourCount() const { return mColourStart.empty() ? 0 : mColourStart.size() - 1; }
+
+  // The columns of colour c are mColourColumns[mColourStart[c]] up to (but
+  // not including) mColourColumns[mColourStart[c + 1]].
+  std::vector<uint32_t> mColourStart, mColourColumns;
+  // Likewise, the rows with a non-zero in column j, from mColumnStart[j].
+  std::vector<uint32_t> mColumnStart, mRows;
+};
+
+// Evaluates the rates (or residuals) at aStates (and, for DAEs, aRates) into
+// aResult, returning non-zero on failure.
+typedef int (*JacobianFunction)(double aVOI, double* aStates, double* aRates,
+                                double* aResult, void* aData);
+
+/*
+ * A finite difference Jacobian using a JacobianColouring, which needs one
+ * evaluation per colour rather than one per state variable. The workspaces
+ * are allocated once, for use by every Jacobian evaluation of a run.
+ */
+class ColouredJacobian
+{
+public:
+  ColouredJacobian(const JacobianColouring& aColouring);
+
+  /*
+   * Sets the structurally non-zero entries of the Jacobian of aFunction at
+   * aStates; entry (row i, column j) is at aJacobian[i * aRowStride + j *
+   * aColumnStride], and the other entries are left alone. aValue is
+   * aFunction at aStates, or NULL to evaluate it first. If aRates is not
+   * NULL, rate j is perturbed by aRateFactor times the perturbation of state
+   * j, as IDA wants. aWeights are the solver's error weights, or NULL, and
+   * keep the perturbations of small state variables sensible. Returns
+   * whatever aFunction returned if it failed, or zero.
+   */
+  int compute(JacobianFunction aFunction, void* aData, double aVOI,
+              const double* aStates, const double* aRates,
+              double aRateFactor, const double* aValue,
+              const double* aWeights, double* aJacobian,
+              size_t aRowStride, size_t aColumnStride);
+
+  // aFunction at the states most recently passed to compute.
+  const double* value() const { return mValue; }
+
+  // The number of times compute has called its function.
+  uint64_t mEvaluations;
+
+private:
+  const JacobianColouring& mColouring;
+  std::vector<double> mStates, mRates, mBaseValue, mPerturbedValue,
+    mIncrements;
+  const double* mValue;
+};
+
+#endif // _CISJacobian_hxx
@@ -17,74 +17,393 @@ CDA_EXPORT_PRE void failAddCause(struct fail_info*, const char*) CDA_EXPORT_POST
 CDA_EXPORT_PRE int getFailType(struct fail_info* aFail) CDA_EXPORT_POST;
 
 struct Override;
-struct EDoubleStruct;
-typedef struct EDoubleStruct* EDouble;
 
-CDA_EXPORT_PRE EDouble CreateEDouble(double aValue) CDA_EXPORT_POST;
-CDA_EXPORT_PRE double UseEDouble(EDouble aValue, struct fail_info* aFail, const char* aContext) CDA_EXPORT_POST;
-CDA_EXPORT_PRE void TryAssign(double* aDest, EDouble aValue, const char* aContext, struct fail_info* aFail) CDA_EXPORT_POST;
+/*
+ * The values computed by models compiled for debugging. error is zero, or
+ * (only when value is not finite) a number which the fail_info the value was
+ * computed with can turn back into an explanation of why.
+ */
+typedef struct EDouble
+{
+  double value;
+  unsigned int error;
+} EDouble;
+
+/* The slow paths of the operations below, used only once something has gone
+ * wrong. Each returns a new error which adds aCause to aCausedBy; the
+ * argument forms start the cause with "the <aArgument>th ". */
+CDA_EXPORT_PRE unsigned int EDoubleCause(struct fail_info* aFail, unsigned int aCausedBy, const char* aCause) CDA_EXPORT_POST;
+CDA_EXPORT_PRE unsigned int EDoubleArgumentCause(struct fail_info* aFail, unsigned int aCausedBy, int aArgument, const char* aCause) CDA_EXPORT_POST;
+CDA_EXPORT_PRE void EDoubleFailure(struct fail_info* aFail, unsigned int aCausedBy, const char* aCause) CDA_EXPORT_POST;
+CDA_EXPORT_PRE void EDoubleAssignFailure(struct fail_info* aFail, unsigned int aCausedBy, const char* aContext) CDA_EXPORT_POST;
+
+/* Generated code may be compiled with -ffast-math, so test the bits. */
+static __inline int EDoubleIsFinite(double aValue)
+{
+  union { double asDouble; unsigned long long asBits; } bits;
+  bits.asDouble = aValue;
+  return (bits.asBits & 0x7FF0000000000000ULL) != 0x7FF0000000000000ULL;
+}
+
+static __inline int EDoubleIsNaN(double aValue)
+{
+  union { double asDouble; unsigned long long asBits; } bits;
+  bits.asDouble = aValue;
+  return (bits.asBits & 0x7FFFFFFFFFFFFFFFULL) > 0x7FF0000000000000ULL;
+}
+
+static __inline double EDoubleNaNValue(void)
+{
+  union { double asDouble; unsigned long long asBits; } bits;
+  bits.asBits = 0x7FF8000000000000ULL;
+  return bits.asDouble;
+}
+
+static __inline int EDoubleFirstNonFinite(int aCount, const EDouble* aInputs)
+{
+  int i;
+  for (i = 0; i < aCount; i++)
+    if (!EDoubleIsFinite(aInputs[i].value))
+      break;
+  return i;
+}
+
+static __inline EDouble CreateEDouble(double aValue)
+{
+  EDouble result;
+  result.value = aValue;
+  result.error = 0;
+  return result;
+}
+
+static __inline double UseEDouble(EDouble aValue, struct fail_info* aFail, const char* aContext)
+{
+  if (!EDoubleIsFinite(aValue.value))
+    EDoubleFailure(aFail, aValue.error, aContext);
+  return aValue.value;
+}
+
+static __inline void TryAssign(double* aDest, EDouble aValue, const char* aContext, struct fail_info* aFail)
+{
+  if (!EDoubleIsFinite(aValue.value))
+    EDoubleAssignFailure(aFail, aValue.error, aContext);
+  *aDest = aValue.value;
+}
+
+static __inline EDouble TryAbs(EDouble aInput, struct fail_info* aFail)
+{
+  if (!EDoubleIsFinite(aInput.value))
+    aInput.error = EDoubleCause(aFail, aInput.error, "taking absolute of a non-finite number");
+  if (aInput.value < 0.0)
+    aInput.value = -aInput.value;
+  return aInput;
+}
+
+static __inline EDouble TryPlus(int aCount, const EDouble* aInputs, struct fail_info* aFail)
+{
+  EDouble result = CreateEDouble(0.0);
+  int i;
+  for (i = 0; i < aCount; i++)
+    result.value += aInputs[i].value;
+  if (!EDoubleIsFinite(result.value))
+  {
+    i = EDoubleFirstNonFinite(aCount, aInputs);
+    if (i < aCount)
+      result.error = EDoubleArgumentCause(aFail, aInputs[i].error, i + 1, "argument to a 'plus' operation is not finite");
+    else
+      result.error = EDoubleCause(aFail, 0, "plus operation overflowed");
+  }
+  return result;
+}
+
+static __inline EDouble TryTimes(int aCount, const EDouble* aInputs, struct fail_info* aFail)
+{
+  EDouble result = CreateEDouble(1.0);
+  int i;
+  for (i = 0; i < aCount; i++)
+    result.value *= aInputs[i].value;
+  if (!EDoubleIsFinite(result.value))
+  {
+    i = EDoubleFirstNonFinite(aCount, aInputs);
+    if (i < aCount)
+      result.error = EDoubleArgumentCause(aFail, aInputs[i].error, i + 1, "argument to a 'times' operation is not finite");
+    else
+      result.error = EDoubleCause(aFail, 0, "times operation overflowed");
+  }
+  return result;
+}
+
+static __inline EDouble TryMinus(EDouble aInput1, EDouble aInput2, struct fail_info* aFail)
+{
+  EDouble result = CreateEDouble(aInput1.value - aInput2.value);
+  if (EDoubleIsFinite(result.value))
+    ;
+  else if (!EDoubleIsFinite(aInput1.value))
+    result.error = EDoubleCause(aFail, aInput1.error, "the first operand to minus is not finite");
+  else if (!EDoubleIsFinite(aInput2.value))
+    result.error = EDoubleCause(aFail, aInput2.error, "the second operand to minus is not finite");
+  else
+    result.error = EDoubleCause(aFail, 0, "an overflow in the result of minus");
+  return result;
+}
+
+static __inline EDouble TryDivide(EDouble aInput1, EDouble aInput2, struct fail_info* aFail)
+{
+  EDouble result = CreateEDouble(aInput1.value / aInput2.value);
+  if (EDoubleIsFinite(result.value))
+    ;
+  else if (!EDoubleIsFinite(aInput1.value))
+    result.error = EDoubleCause(aFail, aInput1.error, "numerator to divide is not finite");
+  else if (!EDoubleIsFinite(aInput2.value))
+    result.error = EDoubleCause(aFail, aInput2.error, "denominator to divide is not finite");
+  else if (aInput2.value == 0.0)
+    result.error = EDoubleCause(aFail, 0, "division by zero");
+  else
+    result.error = EDoubleCause(aFail, 0, "result of divide was overflow");
+  return result;
+}
+
+static __inline EDouble TryUnaryMinus(EDouble aInput, struct fail_info* aFail)
+{
+  if (!EDoubleIsFinite(aInput.value))
+    aInput.error = EDoubleCause(aFail, aInput.error, "input to unary minus operator is not finite");
+  aInput.value = -aInput.value;
+  return aInput;
+}
+
+static __inline EDouble TryUnitsConversion(EDouble aValue, EDouble aMultiplier, EDouble aOffset, struct fail_info* aFail)
+{
+  EDouble result = CreateEDouble(aValue.value * aMultiplier.value + aOffset.value);
+  if (EDoubleIsFinite(result.value))
+    ;
+  else if (!EDoubleIsFinite(aValue.value))
+    result.error = aValue.error;
+  else if (!EDoubleIsFinite(aMultiplier.value))
+    result.error = EDoubleCause(aFail, aMultiplier.error, "invalid conversion multiplier");
+  else if (!EDoubleIsFinite(aOffset.value))
+    result.error = EDoubleCause(aFail, aOffset.error, "invalid conversion offset");
+  else
+    result.error = EDoubleCause(aFail, 0, "overflow during units conversion");
+  return result;
+}
+
+static __inline EDouble TryAnd(int aCount, const EDouble* aInputs, struct fail_info* aFail)
+{
+  EDouble result = CreateEDouble(1.0);
+  int i = EDoubleFirstNonFinite(aCount, aInputs);
+  if (i < aCount)
+  {
+    result.value = EDoubleNaNValue();
+    result.error = EDoubleArgumentCause(aFail, aInputs[i].error, i + 1, "argument to an 'and' operation is not finite");
+    return result;
+  }
+  for (i = 0; i < aCount; i++)
+    if (aInputs[i].value == 0.0)
+      result.value = 0.0;
+  return result;
+}
+
+static __inline EDouble TryOr(int aCount, const EDouble* aInputs, struct fail_info* aFail)
+{
+  EDouble result = CreateEDouble(0.0);
+  int i = EDoubleFirstNonFinite(aCount, aInputs);
+  if (i < aCount)
+  {
+    result.value = EDoubleNaNValue();
+    result.error = EDoubleArgumentCause(aFail, aInputs[i].error, i + 1, "argument to an 'or' operation is not finite");
+    return result;
+  }
+  for (i = 0; i < aCount; i++)
+    if (aInputs[i].value != 0.0)
+      result.value = 1.0;
+  return result;
+}
+
+static __inline EDouble TryNot(EDouble aInput, struct fail_info* aFail)
+{
+  if (!EDoubleIsFinite(aInput.value))
+    aInput.error = EDoubleCause(aFail, aInput.error, "the operand to not is not finite");
+  else
+    aInput.value = (aInput.value == 0.0) ? 1.0 : 0.0;
+  return aInput;
+}
+
+static __inline EDouble TryXor(EDouble aInput1, EDouble aInput2, struct fail_info* aFail)
+{
+  if (!EDoubleIsFinite(aInput1.value))
+    aInput1.error = EDoubleCause(aFail, aInput1.error, "first input to xor is not finite");
+  else if (!EDoubleIsFinite(aInput2.value))
+  {
+    aInput1.value = aInput2.value;
+    aInput1.error = EDoubleCause(aFail, aInput2.error, "second input to xor is not finite");
+  }
+  else
+    aInput1.value = ((aInput1.value != 0.0) != (aInput2.value != 0.0)) ? 1.0 : 0.0;
+  return aInput1;
+}
+
+static __inline EDouble TryImplies(EDouble aInput1, EDouble aInput2, struct fail_info* aFail)
+{
+  if (!EDoubleIsFinite(aInput1.value))
+    aInput1.error = EDoubleCause(aFail, aInput1.error, "first input to implies is not finite");
+  else if (!EDoubleIsFinite(aInput2.value))
+  {
+    aInput1.value = aInput2.value;
+    aInput1.error = EDoubleCause(aFail, aInput2.error, "second input to implies is not finite");
+  }
+  else
+    aInput1.value = ((aInput1.value == 0.0) || (aInput2.value != 0.0)) ? 1.0 : 0.0;
+  return aInput1;
+}
+
+/* The relations, which all give NaN if any argument is NaN. The switch goes
+ * away once TryEq and the rest are inlined. */
+enum EDoubleRelationType
+{
+  EDOUBLE_EQ, EDOUBLE_GEQ, EDOUBLE_GT, EDOUBLE_LEQ, EDOUBLE_LT
+};
+
+static __inline EDouble EDoubleRelation(int aCount, const EDouble* aInputs, enum EDoubleRelationType aType,
+                                        const char* aCause, struct fail_info* aFail)
+{
+  EDouble result = CreateEDouble(1.0);
+  int i, holds;
+  for (i = 0; i < aCount; i++)
+  {
+    if (EDoubleIsNaN(aInputs[i].value))
+    {
+      result.value = aInputs[i].value;
+      result.error = EDoubleArgumentCause(aFail, aInputs[i].error, i + 1, aCause);
+      return result;
+    }
+    if (i == 0)
+      continue;
+    switch (aType)
+    {
+    case EDOUBLE_EQ:
+      holds = aInputs[i - 1].value == aInputs[i].value;
+      break;
+    case EDOUBLE_GEQ:
+      holds = aInputs[i - 1].value >= aInputs[i].value;
+      break;
+    case EDOUBLE_GT:
+      holds = aInputs[i - 1].value > aInputs[i].value;
+      break;
+    case EDOUBLE_LEQ:
+      holds = aInputs[i - 1].value <= aInputs[i].value;
+      break;
+    default:
+      holds = aInputs[i - 1].value < aInputs[i].value;
+      break;
+    }
+    if (!holds)
+      result.value = 0.0;
+  }
+  return result;
+}
+
+static __inline EDouble TryEq(int aCount, const EDouble* aInputs, struct fail_info* aFail)
+{
+  return EDoubleRelation(aCount, aInputs, EDOUBLE_EQ, "argument to equals is not a number", aFail);
+}
+
+static __inline EDouble TryGeq(int aCount, const EDouble* aInputs, struct fail_info* aFail)
+{
+  return EDoubleRelation(aCount, aInputs, EDOUBLE_GEQ, "argument to geq is not a number", aFail);
+}
+
+static __inline EDouble TryGt(int aCount, const EDouble* aInputs, struct fail_info* aFail)
+{
+  return EDoubleRelation(aCount, aInputs, EDOUBLE_GT, "argument to gt is not a number", aFail);
+}
+
+static __inline EDouble TryLeq(int aCount, const EDouble* aInputs, struct fail_info* aFail)
+{
+  return EDoubleRelation(aCount, aInputs, EDOUBLE_LEQ, "argument to leq is not a number", aFail);
+}
+
+static __inline EDouble TryLt(int aCount, const EDouble* aInputs, struct fail_info* aFail)
+{
+  return EDoubleRelation(aCount, aInputs, EDOUBLE_LT, "argument to lt is not a number", aFail);
+}
+
+static __inline EDouble TryNeq(EDouble aInput1, EDouble aInput2, struct fail_info* aFail)
+{
+  if (EDoubleIsNaN(aInput1.value))
+    aInput1.error = EDoubleCause(aFail, aInput1.error, "the first operand to neq is not a number");
+  else if (EDoubleIsNaN(aInput2.value))
+  {
+    aInput1.value = aInput2.value;
+    aInput1.error = EDoubleCause(aFail, aInput2.error, "the second operand to neq is not a number");
+  }
+  else
+    aInput1.value = (aInput1.value != aInput2.value) ? 1.0 : 0.0;
+  return aInput1;
+}
+
+/* Piecewise expressions are chains of ?:, as in release code. A condition
+ * which is not finite fails the statement it is in straight away. */
+static __inline int TryCondition(EDouble aCondition, struct fail_info* aFail)
+{
+  if (!EDoubleIsFinite(aCondition.value))
+  {
+    EDoubleFailure(aFail, aCondition.error, "a piecewise condition is not finite");
+    return 0;
+  }
+  return aCondition.value != 0.0;
+}
+
+static __inline EDouble TryOtherwise(EDouble aValue, struct fail_info* aFail)
+{
+  if (!EDoubleIsFinite(aValue.value))
+    aValue.error = EDoubleCause(aFail, aValue.error, "otherwise case on piecewise is not finite");
+  return aValue;
+}
+
 CDA_EXPORT_PRE void TryOverrideAssign(double* aDest, EDouble aValue, const char* aContext, struct Override* aOverrides, struct fail_info* aFail) CDA_EXPORT_POST;
 CDA_EXPORT_PRE void OverrideAssign(double* aDest, double aValue, struct Override* aOverrides) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryAbs(double aInput, struct fail_info* aFail) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryAnd(int count, ...) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryACos(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryACosh(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryACot(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryACoth(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryACsc(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryACsch(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryASec(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryASech(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryASin(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryASinh(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryATan(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryATanh(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryCeil(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryCos(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryCosh(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryCot(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryCoth(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryCsc(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryCsch(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryDivide(EDouble aInput1, EDouble aInput2) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryEq(int count, ...) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryExp(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryFactorial(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryFactorOf(EDouble aInput1, EDouble aInput2) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryFloor(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryGCD(int count, ...) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryGeq(int count, ...) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryGt(int count, ...) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryImplies(EDouble aInput1, EDouble aInput2) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryLCM(int count, ...) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryLeq(int count, ...) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryLn(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryLog(EDouble aInput1, EDouble aInput2) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryLt(int count, ...) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryMax(int count, ...) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryMin(int count, ...) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryMinus(EDouble aInput1, EDouble aInput2) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryNeq(EDouble aInput1, EDouble aInput2) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryNot(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryOr(int count, ...) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryPlus(int count, ...) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryPower(EDouble aInput1, EDouble aInput2) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryQuotient(EDouble aInput1, EDouble aInput2) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryRem(EDouble aInput1, EDouble aInput2) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryRoot(EDouble aInput1, EDouble aInput2) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TrySec(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TrySech(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TrySin(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TrySinh(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryTan(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryTanh(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryTimes(int count, ...) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryUnaryMinus(EDouble aInput) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryUnitsConversion(EDouble value, EDouble mup, EDouble offset) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryXor(EDouble aInput1, EDouble aInput2) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryPiecewise(EDouble firstCond, EDouble firstValue, ...) CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryInfinity() CDA_EXPORT_POST;
-CDA_EXPORT_PRE EDouble TryNaN() CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryACos(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryACosh(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryACot(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryACoth(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryACsc(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryACsch(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryASec(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryASech(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryASin(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryASinh(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryATan(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryATanh(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryCeil(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryCos(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryCosh(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryCot(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryCoth(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryCsc(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryCsch(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryExp(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryFactorial(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryFactorOf(EDouble aInput1, EDouble aInput2, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryFloor(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryGCD(int aCount, const EDouble* aInputs, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryLCM(int aCount, const EDouble* aInputs, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryLn(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryLog(EDouble aInput1, EDouble aInput2, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryMax(int aCount, const EDouble* aInputs, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryMin(int aCount, const EDouble* aInputs, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryPower(EDouble aInput1, EDouble aInput2, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryQuotient(EDouble aInput1, EDouble aInput2, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryRem(EDouble aInput1, EDouble aInput2, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryRoot(EDouble aInput1, EDouble aInput2, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TrySec(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TrySech(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TrySin(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TrySinh(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryTan(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryTanh(EDouble aInput, struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryNoOtherwise(struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryInfinity(struct fail_info* aFail) CDA_EXPORT_POST;
+CDA_EXPORT_PRE EDouble TryNaN(struct fail_info* aFail) CDA_EXPORT_POST;
 CDA_EXPORT_PRE EDouble TryDefint(EDouble (*f)(double VOI,double *C,double *R,double *S,double *A, struct fail_info*),
                                 double VOI,double *C,double *R,double *S,double *A,double *V,
                                 EDouble lowV, EDouble highV,
@@ -0,0 +1,198 @@
+#define MODULE_CONTAINS_CIS
+#include "CISQuadrature.hxx"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// The most intervals one integral is split into, and the most integrals a
+// run keeps in its cache.
+#define QUADRATURE_MAX_INTERVALS 1000
+#define QUADRATURE_CACHE_SIZE 4096
+
+// The Kronrod points in [0, 1] (the odd ones are also the Gauss points), and
+// the weights of the 15 point Kronrod and 7 point Gauss rules, from QUADPACK.
+static const double kronrodPoints[8] =
+{
+  0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+  0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+  0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+  0.207784955007898467600689403773245, 0.000000000000000000000000000000000
+};
+static const double kronrodWeights[8] =
+{
+  0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+  0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+  0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+  0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+};
+static const double gaussWeights[4] =
+{
+  0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+  0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+};
+
+QuadratureKey::QuadratureKey(const void* aIntegrand, double aLow, double aHigh)
+{
+  // Keys are compared byte by byte, so the padding must be zero too.
+  memset(this, 0, sizeof(*this));
+  integrand = aIntegrand;
+  low = aLow;
+  high = aHigh;
+}
+
+bool
+QuadratureKey::operator<(const QuadratureKey& aOther) const
+{
+  return memcmp(this, &aOther, sizeof(*this)) < 0;
+}
+
+int
+AdaptiveQuadrature::rule
+(
+ IntegrandFunction aFunction, void* aData, Interval& aInterval,
+ double* aValues
+)
+{
+  double centre = 0.5 * (aInterval.a + aInterval.b);
+  double halfLength = 0.5 * (aInterval.b - aInterval.a);
+
+  double f[QUADRATURE_KRONROD_POINTS];
+  for (uint32_t i = 0; i < 7; i++)
+  {
+    double dx = halfLength * kronrodPoints[i];
+    int ret;
+    if ((ret = aFunction(centre - dx, &f[i], aData)) != 0 ||
+        (ret = aFunction(centre + dx, &f[14 - i], aData)) != 0)
+      return ret;
+  }
+  int ret = aFunction(centre, &f[7], aData);
+  if (ret != 0)
+    return ret;
+  mEvaluations += QUADRATURE_KRONROD_POINTS;
+
+  double kronrod = kronrodWeights[7] * f[7], gauss = gaussWeights[3] * f[7];
+  double absolute = kronrodWeights[7] * std::abs(f[7]);
+  for (uint32_t i = 0; i < 7; i++)
+  {
+    kronrod += kronrodWeights[i] * (f[i] + f[14 - i]);
+    absolute += kronrodWeights[i] * (std::abs(f[i]) + std::abs(f[14 - i]));
+    if (i % 2 == 1)
+      gauss += gaussWeights[i / 2] * (f[i] + f[14 - i]);
+  }
+  double mean = 0.5 * kronrod;
+  double variation = kronrodWeights[7] * std::abs(f[7] - mean);
+  for (uint32_t i = 0; i < 7; i++)
+    variation += kronrodWeights[i] *
+      (std::abs(f[i] - mean) + std::abs(f[14 - i] - mean));
+
+  // QUADPACK's error estimate, which scales the difference between the two
+  // rules down when it is small next to the variation of the integrand, but
+  // never below what rounding could account for.
+  halfLength = std::abs(halfLength);
+  double error = std::abs((kronrod - gauss) * halfLength);
+  variation *= halfLength;
+  absolute *= halfLength;
+  if (variation != 0.0 && error != 0.0)
+    error = variation * std::min(1.0, pow(200.0 * error / variation, 1.5));
+  double epsilon = std::numeric_limits<double>::epsilon();
+  if (absolute > std::numeric_limits<double>::min() / (50.0 * epsilon))
+    error = std::max(50.0 * epsilon * absolute, error);
+
+  aInterval.integral = kronrod * 0.5 * (aInterval.b - aInterval.a);
+  aInterval.error = error;
+  if (aValues != NULL)
+    memcpy(aValues, f, sizeof(f));
+  return 0;
+}
+
+// Counts the integrals in progress, including on the way out of an error.
+struct QuadratureDepth
+{
+  QuadratureDepth(uint32_t& aDepth) : mDepth(aDepth) { mDepth++; }
+  ~QuadratureDepth() { mDepth--; }
+  uint32_t& mDepth;
+};
+
+int
+AdaptiveQuadrature::integrate
+(
+ IntegrandFunction aFunction, void* aData, const void* aIntegrand,
+ double aLow, double aHigh, double aEpsAbs, double aEpsRel, double* aResult
+)
+{
+  QuadratureDepth depth(mDepth);
+  if (mHeaps.size() < mDepth)
+    mHeaps.resize(mDepth);
+  std::vector<Interval>& heap = mHeaps[mDepth - 1];
+  heap.clear();
+
+  Interval whole = { aLow, aHigh, 0.0, 0.0 };
+  QuadratureKey key(aIntegrand, aLow, aHigh);
+  int ret = rule(aFunction, aData, whole,
+                 aIntegrand == NULL ? NULL : key.values);
+  if (ret != 0)
+    return ret;
+
+  if (aIntegrand != NULL)
+  {
+    std::map<QuadratureKey, double>::iterator i = mCache.find(key);
+    if (i != mCache.end())
+    {
+      mCacheHits++;
+      *aResult = (*i).second;
+      return 0;
+    }
+  }
+
+  heap.push_back(whole);
+  double integral = whole.integral, error = whole.error;
+  ret = QUADRATURE_NOT_CONVERGED;
+  while (true)
+  {
+    if (error <= std::max(aEpsAbs, aEpsRel * std::abs(integral)))
+    {
+      ret = 0;
+      break;
+    }
+    if (heap.size() >= QUADRATURE_MAX_INTERVALS)
+      break;
+
+    std::pop_heap(heap.begin(), heap.end());
+    Interval worst = heap.back();
+    heap.pop_back();
+
+    double m = 0.5 * (worst.a + worst.b);
+    if (m == worst.a || m == worst.b)
+    {
+      // The interval can't be halved any more.
+      heap.push_back(worst);
+      std::push_heap(heap.begin(), heap.end());
+      break;
+    }
+
+    Interval left = { worst.a, m, 0.0, 0.0 }, right = { m, worst.b, 0.0, 0.0 };
+    int fret;
+    if ((fret = rule(aFunction, aData, left, NULL)) != 0 ||
+        (fret = rule(aFunction, aData, right, NULL)) != 0)
+      return fret;
+
+    integral += left.integral + right.integral - worst.integral;
+    error += left.error + right.error - worst.error;
+    heap.push_back(left);
+    std::push_heap(heap.begin(), heap.end());
+    heap.push_back(right);
+    std::push_heap(heap.begin(), heap.end());
+  }
+
+  // Add the intervals up afresh, rather than trusting the running total.
+  integral = 0.0;
+  for (std::vector<Interval>::iterator i = heap.begin(); i != heap.end(); i++)
+    integral += (*i).integral;
+  *aResult = integral;
+
+  if (ret == 0 && aIntegrand != NULL && mCache.size() < QUADRATURE_CACHE_SIZE)
+    mCache.insert(std::pair<QuadratureKey, double>(key, integral));
+
+  return ret;
+}
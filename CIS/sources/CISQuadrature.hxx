@@ -0,0 +1,89 @@
+#ifndef _CISQuadrature_hxx
+#define _CISQuadrature_hxx
+
+#include "Utilities.hxx"
+#include <deque>
+#include <map>
+#include <vector>
+
+// Evaluates the integrand at aX into aValue, returning non-zero on failure.
+typedef int (*IntegrandFunction)(double aX, double* aValue, void* aData);
+
+// The number of points in each Gauss-Kronrod rule.
+#define QUADRATURE_KRONROD_POINTS 15
+
+// Returned by AdaptiveQuadrature::integrate if the error estimate could not be
+// brought within the tolerance.
+#define QUADRATURE_NOT_CONVERGED -2
+
+/*
+ * Identifies a cached integral: the integrand, the limits, and the values of
+ * the integrand at the Kronrod points between them. The generated code doesn't
+ * say which variables an integrand depends on, so its values stand in for
+ * them.
+ */
+struct QuadratureKey
+{
+  // Fills in everything but the values, which are left for the caller.
+  QuadratureKey(const void* aIntegrand, double aLow, double aHigh);
+
+  bool operator<(const QuadratureKey& aOther) const;
+
+  const void* integrand;
+  double low, high;
+  double values[QUADRATURE_KRONROD_POINTS];
+};
+
+/*
+ * Adaptive 15 point Gauss-Kronrod quadrature (as in QUADPACK's QAG), with the
+ * workspace allocated once, for use by every integral evaluated by a run.
+ */
+class AdaptiveQuadrature
+{
+public:
+  AdaptiveQuadrature() : mEvaluations(0), mCacheHits(0), mDepth(0) {}
+
+  /*
+   * Integrates aFunction from aLow to aHigh into aResult, repeatedly halving
+   * the interval with the largest error estimate until the estimates add up
+   * to no more than the larger of aEpsAbs and aEpsRel times the integral. If
+   * aIntegrand is not NULL, the result is cached under it, the limits and the
+   * values of aFunction at the Kronrod points of the whole range, and later
+   * integrals matching all of those are looked up rather than refined. Returns
+   * zero, whatever aFunction returned if it failed, or QUADRATURE_NOT_CONVERGED
+   * (leaving the best estimate in aResult). aFunction may integrate again.
+   */
+  int integrate(IntegrandFunction aFunction, void* aData,
+                const void* aIntegrand, double aLow, double aHigh,
+                double aEpsAbs, double aEpsRel, double* aResult);
+
+  // The number of times integrate has called its function, and the number of
+  // integrals found in the cache.
+  uint64_t mEvaluations, mCacheHits;
+
+private:
+  struct Interval
+  {
+    double a, b, integral, error;
+
+    // Orders a heap with the largest error first.
+    bool operator<(const Interval& aOther) const
+    {
+      return error < aOther.error;
+    }
+  };
+
+  // Applies the rule over [aInterval.a, aInterval.b], leaving the values of
+  // the integrand at the Kronrod points in aValues if it is not NULL.
+  int rule(IntegrandFunction aFunction, void* aData, Interval& aInterval,
+           double* aValues);
+
+  // One heap of intervals for each integral in progress, with the integrals
+  // inside integrands further along; a deque, so that adding one doesn't move
+  // those in use.
+  std::deque<std::vector<Interval> > mHeaps;
+  uint32_t mDepth;
+  std::map<QuadratureKey, double> mCache;
+};
+
+#endif // _CISQuadrature_hxx
@@ -0,0 +1,223 @@
+#define MODULE_CONTAINS_CIS
+#include "CISResultStream.hxx"
+#include <algorithm>
+#ifndef WIN32
+#include <sys/time.h>
+#endif
+
+#ifdef WIN32
+#define RESULT_STREAM_BARRIER() MemoryBarrier()
+#else
+#define RESULT_STREAM_BARRIER() __sync_synchronize()
+#endif
+
+// How many records to make room for in each block when no size limit is set.
+#define DEFAULT_BLOCK_POINTS 1024
+
+ResultStream::ResultStream
+(
+ iface::cellml_services::IntegrationProgressObserver* aObserver,
+ uint32_t aRecordSize, const ResultBatching& aBatching, bool aThreaded
+)
+  : mObserver(aObserver), mRecordSize(aRecordSize), mBatching(aBatching),
+    mThreaded(aThreaded), mFinished(false), mHead(0), mTail(0), mPointsInBlock(0),
+    mBlockStarted(0.0), mObserverTime(0.0), mFinishing(false),
+    mConsumerSleeping(false), mConsumerDone(false)
+{
+  // Make room for a whole batch in every block up front, so recording
+  // doesn't allocate unless the observer falls behind...
+  uint32_t points = DEFAULT_BLOCK_POINTS;
+  if (mBatching.maxBytes != 0)
+    points = std::max(1u, (uint32_t)(mBatching.maxBytes /
+                                      (mRecordSize * sizeof(double))));
+  if (mBatching.maxPoints != 0 && mBatching.maxPoints < points)
+    points = mBatching.maxPoints;
+  for (uint32_t i = 0; i < (mThreaded ? RING_SIZE : 1); i++)
+    mBlocks[i].reserve(points * mRecordSize);
+
+  if (!mThreaded)
+    return;
+
+#ifdef WIN32
+  mWakeConsumer = CreateEvent(NULL, FALSE, FALSE, NULL);
+  mConsumerExited = CreateEvent(NULL, TRUE, FALSE, NULL);
+#else
+  pthread_mutex_init(&mWaitMutex, NULL);
+  pthread_cond_init(&mWaitCond, NULL);
+#endif
+  startthread();
+}
+
+ResultStream::~ResultStream()
+{
+  if (!mFinished)
+    finish();
+
+  if (!mThreaded)
+    return;
+
+#ifdef WIN32
+  CloseHandle(mWakeConsumer);
+  CloseHandle(mConsumerExited);
+#else
+  pthread_cond_destroy(&mWaitCond);
+  pthread_mutex_destroy(&mWaitMutex);
+#endif
+}
+
+void
+ResultStream::endRecord()
+{
+  if (mPointsInBlock++ == 0 && mBatching.maxLatency > 0.0)
+    mBlockStarted = WallClockTime();
+
+  if ((mBatching.maxPoints != 0 && mPointsInBlock >= mBatching.maxPoints) ||
+      (mBatching.maxBytes != 0 &&
+       (mBlocks[mHead].size() + mRecordSize) * sizeof(double) >
+       mBatching.maxBytes) ||
+      (mBatching.maxLatency > 0.0 &&
+       WallClockTime() - mBlockStarted >= mBatching.maxLatency))
+    publish();
+}
+
+void
+ResultStream::publish()
+{
+  if (!mThreaded)
+  {
+    deliver(mBlocks[mHead]);
+    mBlocks[mHead].clear();
+    mPointsInBlock = 0;
+    return;
+  }
+
+  uint32_t next = (mHead + 1) % RING_SIZE;
+  RESULT_STREAM_BARRIER();
+  // If the ring is full, just keep adding to this block...
+  if (next == mTail)
+    return;
+
+  mHead = next;
+  mPointsInBlock = 0;
+
+  RESULT_STREAM_BARRIER();
+  if (mConsumerSleeping)
+  {
+#ifdef WIN32
+    SetEvent(mWakeConsumer);
+#else
+    pthread_mutex_lock(&mWaitMutex);
+    pthread_cond_signal(&mWaitCond);
+    pthread_mutex_unlock(&mWaitMutex);
+#endif
+  }
+}
+
+void
+ResultStream::finish()
+{
+  if (mFinished)
+    return;
+  mFinished = true;
+
+  if (mThreaded)
+  {
+#ifdef WIN32
+    mFinishing = true;
+    SetEvent(mWakeConsumer);
+    WaitForSingleObject(mConsumerExited, INFINITE);
+#else
+    pthread_mutex_lock(&mWaitMutex);
+    mFinishing = true;
+    pthread_cond_broadcast(&mWaitCond);
+    while (!mConsumerDone)
+      pthread_cond_wait(&mWaitCond, &mWaitMutex);
+    pthread_mutex_unlock(&mWaitMutex);
+#endif
+  }
+
+  // The delivery thread has delivered every published block and gone away, so
+  // the partly filled block can be delivered from here.
+  deliver(mBlocks[mHead]);
+  mBlocks[mHead].clear();
+  mPointsInBlock = 0;
+}
+
+void
+ResultStream::runthread()
+{
+  while (true)
+  {
+    RESULT_STREAM_BARRIER();
+    if (mTail != mHead)
+    {
+      deliver(mBlocks[mTail]);
+      mBlocks[mTail].clear();
+      RESULT_STREAM_BARRIER();
+      mTail = (mTail + 1) % RING_SIZE;
+      continue;
+    }
+
+    if (mFinishing)
+      break;
+
+    // Nothing to do, so sleep until the solver publishes a block. The solver
+    // only signals if it sees mConsumerSleeping set after publishing, so
+    // mHead has to be checked again after setting it.
+#ifdef WIN32
+    mConsumerSleeping = true;
+    RESULT_STREAM_BARRIER();
+    if (mTail == mHead && !mFinishing)
+      WaitForSingleObject(mWakeConsumer, INFINITE);
+    mConsumerSleeping = false;
+#else
+    pthread_mutex_lock(&mWaitMutex);
+    mConsumerSleeping = true;
+    RESULT_STREAM_BARRIER();
+    if (mTail == mHead && !mFinishing)
+      pthread_cond_wait(&mWaitCond, &mWaitMutex);
+    mConsumerSleeping = false;
+    pthread_mutex_unlock(&mWaitMutex);
+#endif
+  }
+
+  // This object may be deleted as soon as finish() sees this, so nothing may
+  // touch it afterwards.
+#ifdef WIN32
+  SetEvent(mConsumerExited);
+#else
+  pthread_mutex_lock(&mWaitMutex);
+  mConsumerDone = true;
+  pthread_cond_broadcast(&mWaitCond);
+  pthread_mutex_unlock(&mWaitMutex);
+#endif
+}
+
+void
+ResultStream::deliver(std::vector<double>& aBlock)
+{
+  if (mObserver == NULL || aBlock.empty())
+    return;
+
+  double started = WallClockTime();
+  try
+  {
+    mObserver->results(aBlock);
+  }
+  catch (...)
+  {
+  }
+  mObserverTime += WallClockTime() - started;
+}
+
+double
+WallClockTime()
+{
+#ifdef WIN32
+  return GetTickCount() / 1000.0;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1E-6;
+#endif
+}
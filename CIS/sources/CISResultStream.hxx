@@ -0,0 +1,103 @@
+#ifndef _CISResultStream_hxx
+#define _CISResultStream_hxx
+
+#include "Utilities.hxx"
+#include "IfaceCIS.hxx"
+#include <vector>
+#ifndef WIN32
+#include <pthread.h>
+#endif
+
+// Seconds since some fixed point, for timing.
+double WallClockTime();
+
+/*
+ * Limits on how many results are batched up before they are delivered to the
+ * observer; a batch is delivered as soon as any limit is reached. A limit of
+ * zero is not applied.
+ */
+struct ResultBatching
+{
+  ResultBatching()
+    : maxPoints(0), maxBytes(2 * 1024 * 1024), maxLatency(1.0) {}
+
+  uint32_t maxPoints, maxBytes;
+  double maxLatency;
+};
+
+/*
+ * Carries results from the thread running the solver to a progress observer.
+ * Records are appended to the block at the head of a fixed ring of blocks,
+ * which keep their storage once it has been allocated. Full blocks are handed
+ * to a delivery thread through a single-producer, single-consumer queue, and
+ * passed to the observer as they are, without being copied.
+ *
+ * The solver never waits for the observer: if the ring is full, it carries on
+ * growing the block it is filling until the delivery thread frees a slot.
+ */
+class ResultStream
+  : public CDAThread
+{
+public:
+  // If aThreaded is false, there is no delivery thread, and each block is
+  // delivered on the solver thread as soon as it is full.
+  ResultStream(iface::cellml_services::IntegrationProgressObserver* aObserver,
+               uint32_t aRecordSize, const ResultBatching& aBatching,
+               bool aThreaded);
+  ~ResultStream();
+
+  // A record is written with one or more calls to append, followed by one
+  // call to endRecord...
+  void append(const double* aData, uint32_t aCount)
+  {
+    mBlocks[mHead].insert(mBlocks[mHead].end(), aData, aData + aCount);
+  }
+
+  void append(double aValue)
+  {
+    mBlocks[mHead].push_back(aValue);
+  }
+
+  void endRecord();
+
+  // Delivers everything recorded so far, and waits for the delivery thread to
+  // finish. No more records may be written afterwards. The destructor calls
+  // this if it hasn't been called already.
+  void finish();
+
+  // The time spent in the observer's results method so far.
+  double observerTime() const { return mObserverTime; }
+
+protected:
+  void runthread();
+
+private:
+  enum { RING_SIZE = 4 };
+
+  void publish();
+  void deliver(std::vector<double>& aBlock);
+
+  iface::cellml_services::IntegrationProgressObserver* mObserver;
+  uint32_t mRecordSize;
+  ResultBatching mBatching;
+  bool mThreaded, mFinished;
+
+  std::vector<double> mBlocks[RING_SIZE];
+  // Blocks mTail up to (but not including) mHead are waiting to be delivered;
+  // only the solver writes mHead, and only the delivery thread writes mTail.
+  volatile uint32_t mHead, mTail;
+  uint32_t mPointsInBlock;
+  double mBlockStarted;
+  // Only written by whichever thread delivers results.
+  volatile double mObserverTime;
+
+  volatile bool mFinishing, mConsumerSleeping, mConsumerDone;
+#ifdef WIN32
+  HANDLE mWakeConsumer, mConsumerExited;
+#else
+  pthread_mutex_t mWaitMutex;
+  pthread_cond_t mWaitCond;
+#endif
+};
+
+#endif // _CISResultStream_hxx
@@ -4,8 +4,11 @@
 #include "cda_compiler_support.h"
 #include <limits>
 #include <sstream>
+#include <map>
+#include <algorithm>
 #include "Utilities.hxx"
 #include "CISImplementation.hxx"
+#include "CISQuadrature.hxx"
 #ifdef ENABLE_GSL_INTEGRATORS
 #include <gsl/gsl_odeiv.h>
 #include <gsl/gsl_errno.h>
@@ -26,15 +29,19 @@
 #undef M
 #include <cvode/cvode.h>
 #include <ida/ida.h>
-// #include <ida/ida_spgmr.h>
+#include <ida/ida_spgmr.h>
 #include <ida/ida_dense.h>
+#include <ida/ida_band.h>
+#include <ida/ida_bbdpre.h>
 // #include <ida/ida_sptfqmr.h>
 
 #include <nvector/nvector_serial.h>
 #include <sundials/sundials_nvector.h>
 #include <sundials/sundials_types.h>
 #include <cvode/cvode_dense.h>
-#include <cvode/cvode_dense.h>
+#include <cvode/cvode_band.h>
+#include <cvode/cvode_spgmr.h>
+#include <cvode/cvode_bandpre.h>
 
 #include <kinsol/kinsol.h>
 #include <kinsol/kinsol_spgmr.h>
@@ -78,8 +85,28 @@ struct EvaluationInformation
                        double* STATES, double* ALGEBRAIC, struct fail_info*);
   void (*ComputeVariables)(double VOI, double* CONSTANTS, double* RATES,
                            double* STATES, double* ALGEBRAIC, struct fail_info*);
+  void (*ComputeJacobian)(double VOI, double* CONSTANTS, double* RATES,
+                          double* STATES, double* ALGEBRAIC, double** JACOBIAN,
+                          struct fail_info*);
+  void (*ComputeRootInformation)(double VOI, double* CONSTANTS, double* RATES,
+                                 double* STATES, double* ALGEBRAIC,
+                                 double* CONDVAR, struct fail_info*);
+  // Set when the Jacobian is found by finite differences in CIS, rather than
+  // by the model or by the solver itself.
+  ColouredJacobian* colouredJacobian;
+  void* solver;
 };
 
+static int
+EvaluateRatesForJacobian(double aVOI, double* aStates, double* aRates,
+                         double* aResult, void* aData)
+{
+  EvaluationInformation* ei = reinterpret_cast<EvaluationInformation*>(aData);
+  ei->ComputeRates(aVOI, ei->constants, aResult, aStates, ei->algebraic,
+                   ei->failInfo);
+  return ei->failInfo->failtype;
+}
+
 #ifdef ENABLE_GSL_INTEGRATORS
 int
 EvaluateRatesGSL(double voi, const double vars[],
@@ -110,36 +137,14 @@ EvaluateJacobianGSL
 )
 {
   EvaluationInformation* ei = reinterpret_cast<EvaluationInformation*>(params);
-  
-  // Back up the states, so we can perturb them...
-  double* states = new double[ei->rateSize];
-  memcpy(states, vars, ei->rateSizeBytes);
-
-  double* rate0 = new double[ei->rateSize];
-  double* rate1 = new double[ei->rateSize];
-
-  // Initial rates...
-  ei->ComputeRates(voi, ei->constants, rate0, states,
-                   ei->algebraic);
-
-  uint32_t i, j;
-  for (i = 0; i < ei->rateSize; i++)
-  {
-    double perturb = vars[i] * 1E-10;
-    if (perturb == 0)
-      perturb = 1E-90;
-
-    states[i] = vars[i] + perturb;
-
-    ei->ComputeRates(voi, ei->constants, rate1, states, ei->algebraic);
-
-    for (j = 0; j < ei->rateSize; j++)
-    {
-      jac[i * ei->rateSize + j] = (rate1[j] - rate0[j]) / perturb;
-    }
 
-    states[i] = vars[i];
-  }
+  // GSL wants the Jacobian by rows, and all of it.
+  memset(jac, 0, ei->rateSize * ei->rateSizeBytes);
+  if (ei->colouredJacobian->compute(EvaluateRatesForJacobian, ei, voi, vars,
+                                    NULL, 0.0, NULL, NULL, jac, ei->rateSize,
+                                    1) != 0)
+    return GSL_FAILURE;
+  const double* rate0 = ei->colouredJacobian->value();
 
   // Now perturb the VOI and see what happens...
   double perturb = voi * 1E-13;
@@ -147,16 +152,13 @@ EvaluateJacobianGSL
     perturb = 1E-90;
   double newvoi = voi + perturb;
 
-  ei->ComputeRates(newvoi, ei->constants, rate1, states, ei->algebraic);
-
-  for (i = 0; i < ei->rateSize; i++)
-  {
-    rates[i] = (rate1[i] - rate0[i]) / perturb;
-  }
+  ei->ComputeRates(newvoi, ei->constants, rates, const_cast<double*>(vars),
+                   ei->algebraic, ei->failInfo);
+  if (ei->failInfo->failtype)
+    return GSL_FAILURE;
 
-  delete [] rate0;
-  delete [] rate1;
-  delete [] states;
+  for (uint32_t i = 0; i < ei->rateSize; i++)
+    rates[i] = (rates[i] - rate0[i]) / perturb;
 
   return GSL_SUCCESS;
 }
@@ -200,62 +202,251 @@ EvaluateRatesCVODE(double bound, N_Vector varsV, N_Vector ratesV, void* params)
   return ei->failInfo->failtype;
 }
 
-// Don't cache more than 2MB of variables (assuming 8 bytes per variable). This
-// leaves a little bit of room in the 2MB for CORBA overhead.
-#define VARIABLE_STORAGE_LIMIT 262016
-// Don't cache for more than 1 second...
-#define VARIABLE_TIME_LIMIT 1
+static int
+EvaluateJacobianCVODE(long int N, double bound, N_Vector varsV, N_Vector ratesV,
+                      DlsMat Jac, void* params, N_Vector tmp1, N_Vector tmp2,
+                      N_Vector tmp3)
+{
+  EvaluationInformation* ei = reinterpret_cast<EvaluationInformation*>(params);
 
-bool
-CDA_CellMLIntegrationRun::checkPauseOrCancellation()
+  // The Jacobian may refer to algebraic variables, so bring them up to date
+  // first.
+  ei->ComputeRates(bound, ei->constants, ei->rates, N_VGetArrayPointer_Serial(varsV),
+                   ei->algebraic, ei->failInfo);
+  if (ei->failInfo->failtype)
+    return ei->failInfo->failtype;
+
+  ei->ComputeJacobian(bound, ei->constants, ei->rates,
+                      N_VGetArrayPointer_Serial(varsV), ei->algebraic,
+                      Jac->cols, ei->failInfo);
+  return ei->failInfo->failtype;
+}
+
+static int
+EvaluateColouredJacobianCVODE(long int N, double bound, N_Vector varsV,
+                              N_Vector ratesV, DlsMat Jac, void* params,
+                              N_Vector tmp1, N_Vector tmp2, N_Vector tmp3)
 {
-#ifndef WIN32
-  fd_set pipeset;
-  FD_ZERO(&pipeset);
-  FD_SET(mThreadPipes[0], &pipeset);
-  struct timeval to;
-#endif
-  while (true)
-  {
-#ifdef WIN32
-    if (WaitForSingleObject(mThreadSemaphore, 0) != WAIT_OBJECT_0)
-      return false;
-#else
-    to.tv_sec = 0;
-    to.tv_usec = 0;
-    if (select(mThreadPipes[0] + 1, &pipeset, NULL, NULL, &to) == 0)
-      return false;
-#endif
+  EvaluationInformation* ei = reinterpret_cast<EvaluationInformation*>(params);
 
-    int command;
-#ifdef WIN32
-    DWORD readLen;
-    ReadFile(mThreadPipes[0], &command, sizeof(command), &readLen, NULL);
-#else
-    read(mThreadPipes[0], &command, sizeof(command));
-#endif
+  // The error weights set the scale of the perturbations, as in CVODE's own
+  // difference quotients.
+  CVodeGetErrWeights(ei->solver, tmp1);
+  return ei->colouredJacobian->compute
+    (EvaluateRatesForJacobian, ei, bound, N_VGetArrayPointer_Serial(varsV),
+     NULL, 0.0, N_VGetArrayPointer_Serial(ratesV),
+     N_VGetArrayPointer_Serial(tmp1), Jac->data, 1, Jac->ldim);
+}
+
+static int
+EvaluateRootsCVODE(double bound, N_Vector varsV, double* gout, void* params)
+{
+  EvaluationInformation* ei = reinterpret_cast<EvaluationInformation*>(params);
+
+  // As for the Jacobian, the roots may refer to algebraic variables.
+  ei->ComputeRates(bound, ei->constants, ei->rates, N_VGetArrayPointer_Serial(varsV),
+                   ei->algebraic, ei->failInfo);
+  if (ei->failInfo->failtype)
+    return ei->failInfo->failtype;
+
+  ei->ComputeRootInformation(bound, ei->constants, ei->rates,
+                             N_VGetArrayPointer_Serial(varsV), ei->algebraic,
+                             gout, ei->failInfo);
+  return ei->failInfo->failtype;
+}
 
-    if (command == 1) // Cancel
-      return true;
-    else if (command == 2) // Pause
+// The half-bandwidth of the banded Jacobian approximation used to precondition
+// the Krylov solvers.
+#define KRYLOV_PRECONDITIONER_BANDWIDTH 2
+
+void
+CDA_CellMLIntegrationRun::setupOutputColumns
+(
+ iface::cellml_services::CodeInformation* aCCI
+)
+{
+  uint32_t rateSize = aCCI->rateIndexCount();
+  uint32_t algSize = aCCI->algebraicIndexCount();
+  mNeededFragments.clear();
+  if (mOutputColumns.empty())
+    return;
+
+  std::vector<uint32_t> algebraicColumns;
+  for (OutputColumnList::iterator i = mOutputColumns.begin();
+       i != mOutputColumns.end(); i++)
+  {
+    if ((*i).first == iface::cellml_services::OUTPUT_ALGEBRAIC)
     {
-      while (command == 2)
+      if ((*i).second >= algSize)
+        throw iface::cellml_api::CellMLException(L"Output column index out of range");
+      algebraicColumns.push_back((*i).second);
+    }
+    else if ((*i).second >= rateSize)
+      throw iface::cellml_api::CellMLException(L"Output column index out of range");
+  }
+
+  std::vector<uint32_t> fragments(aCCI->variablesFragmentsFor(algebraicColumns));
+  if (!fragments.empty())
+  {
+    mNeededFragments.resize(aCCI->variablesFragmentCount(), 0);
+    for (std::vector<uint32_t>::iterator i = fragments.begin();
+         i != fragments.end(); i++)
+      mNeededFragments[*i] = 1;
+  }
+}
+
+uint32_t
+CDA_CellMLIntegrationRun::outputRecordSize(uint32_t aRateSize, uint32_t aAlgSize)
+{
+  if (mOutputColumns.empty())
+    return aRateSize * 2 + aAlgSize + 1;
+  return mOutputColumns.size() + 1;
+}
+
+void
+CDA_CellMLIntegrationRun::recordResult
+(
+ ResultStream& aStream, double aVOI, const double* aStates,
+ const double* aRates, uint32_t aRateSize,
+ const double* aAlgebraic, uint32_t aAlgSize
+)
+{
+  aStream.append(aVOI);
+  if (mOutputColumns.empty())
+  {
+    aStream.append(aStates, aRateSize);
+    aStream.append(aRates, aRateSize);
+    aStream.append(aAlgebraic, aAlgSize);
+  }
+  else
+  {
+    for (OutputColumnList::iterator i = mOutputColumns.begin();
+         i != mOutputColumns.end(); i++)
+      switch ((*i).first)
       {
+      case iface::cellml_services::OUTPUT_STATE:
+        aStream.append(aStates[(*i).second]);
+        break;
+      case iface::cellml_services::OUTPUT_RATE:
+        aStream.append(aRates[(*i).second]);
+        break;
+      case iface::cellml_services::OUTPUT_ALGEBRAIC:
+        aStream.append(aAlgebraic[(*i).second]);
+        break;
+      }
+  }
+  aStream.endRecord();
+
+  mStatistics.solveTime = WallClockTime() - mSolveStarted;
+  publishStatistics(aStream);
+}
+
+void
+CDA_CellMLIntegrationRun::publishStatistics(ResultStream& aStream)
+{
+  CDALock l(mStatisticsMutex);
+  mPublishedStatistics = mStatistics;
+  mPublishedStatistics.observerTime += aStream.observerTime();
+}
+
+void
+CDA_CellMLIntegrationRun::finishStatistics(ResultStream& aStream)
+{
+  mStatistics.solveTime = WallClockTime() - mSolveStarted;
+  aStream.finish();
+  publishStatistics(aStream);
+}
+
+void
+CDA_ODESolverRun::computeOutputVariables
+(
+ CompiledModelFunctions* f, double voi, double* constants, double* rates,
+ double* states, double* algebraic, struct fail_info* failInfo
+)
+{
+  double started = WallClockTime();
+
+  // ComputeRates has already computed everything the rates need, so if only
+  // some columns are wanted, only the code leading to them needs running.
+  if (mOutputColumns.empty() || f->ComputeSelectedVariables == NULL)
+    f->ComputeVariables(voi, constants, rates, states, algebraic, failInfo);
+  else if (!mNeededFragments.empty())
+    f->ComputeSelectedVariables(voi, constants, rates, states, algebraic,
+                                &mNeededFragments[0], failInfo);
+
+  mStatistics.computeVariablesTime += WallClockTime() - started;
+}
+
+void
+CDA_ODESolverRun::updateConditionVariables
+(
+ CompiledModelFunctions* f, double voi, double* constants, double* rates,
+ double* states, double* algebraic, uint32_t algSize,
+ const int* rootDirections, struct fail_info* failInfo
+)
+{
+  if (f->ComputeRootInformation == NULL)
+    return;
+
+  // The roots may depend on algebraic variables, so bring those up to date
+  // first...
+  double* condvars = algebraic + algSize;
+  f->ComputeRates(voi, constants, rates, states, algebraic, failInfo);
+  f->ComputeRootInformation(voi, constants, rates, states, algebraic, condvars,
+                            failInfo);
+
+  // A condition sitting right on its root has to be put on the side it is
+  // heading towards, or it would not switch until the next root.
+  if (rootDirections == NULL)
+    return;
+  for (uint32_t i = 0; i < mModel->mConditionVariableCount; i++)
+    if (condvars[i] == 0 && rootDirections[i] != 0)
+      condvars[i] = rootDirections[i] * 1E-100;
+}
+
+void
+CDA_DAESolverRun::evaluateOutputVariables
+(
+ IDACompiledModelFunctions* f, double voi, double* constants, double* rates,
+ double* states, double* algebraic, double* condvars,
+ struct fail_info* failInfo
+)
+{
+  double started = WallClockTime();
+
+  if (mOutputColumns.empty() || f->EvaluateSelectedVariables == NULL)
+    f->EvaluateVariables(voi, constants, rates, states, algebraic, condvars,
+                         failInfo);
+  else if (!mNeededFragments.empty())
+    f->EvaluateSelectedVariables(voi, constants, rates, states, algebraic,
+                                 condvars, &mNeededFragments[0], failInfo);
+
+  mStatistics.computeVariablesTime += WallClockTime() - started;
+}
+
+bool
+CDA_CellMLIntegrationRun::checkPauseOrCancellation()
+{
+  // This is called after every step, so the common case of neither being
+  // paused nor cancelled must stay cheap...
+  if (mExternalCancel != NULL && *mExternalCancel)
+    return true;
+  if (mCancelIntegration)
+    return true;
+  if (!mPauseIntegration)
+    return false;
+
 #ifdef WIN32
-        if (WaitForSingleObject(mThreadSemaphore, INFINITE) != WAIT_OBJECT_0)
-          return false;
-        ReadFile(mThreadPipes[0], &command, sizeof(command),
-                 &readLen, NULL);
+  while (mPauseIntegration && !mCancelIntegration)
+    WaitForSingleObject(mResumeEvent, INFINITE);
 #else
-        read(mThreadPipes[0], &command, sizeof(command));
+  pthread_mutex_lock(&mPauseMutex);
+  while (mPauseIntegration && !mCancelIntegration)
+    pthread_cond_wait(&mPauseCond, &mPauseMutex);
+  pthread_mutex_unlock(&mPauseMutex);
 #endif
-        if (command == 1) // Cancel
-          return true;
-        else if (command == 3) // Resume
-          break;
-      }
-    }
-  }
+
+  return mCancelIntegration;
 }
 
 #define NR_RANDOM_STARTS_MAX 100000
@@ -268,17 +459,30 @@ CDA_ODESolverRun::SolveODEProblemGSL
 (
  CompiledModelFunctions* f, uint32_t constSize,
  double* constants, uint32_t rateSize, double* rates,
- double* states, uint32_t algSize, double* algebraic
+ double* states, uint32_t algSize, double* algebraic,
+ ResultStream& aStream
 )
 {
   gsl_odeiv_system sys;
   EvaluationInformation ei;
+  struct fail_info failInfo;
+  failInfo.bytecode = mModel->mBytecode;
+  failInfo.statistics = &mStatistics;
+  failInfo.distributionTables = &mModel->mDistributionTables;
+  failInfo.cacheIntegrals = mCacheDefiniteIntegrals;
+  // The condition variables go after the algebraic variables.
+  setupNonlinearSolverThreading(failInfo, constSize, rateSize, rateSize,
+                                algSize + mModel->mConditionVariableCount);
 
   sys.dimension = rateSize;
   sys.params = reinterpret_cast<void*>(&ei);
 
   sys.function = EvaluateRatesGSL;
   sys.jacobian = EvaluateJacobianGSL;
+  ColouredJacobian colouredJacobian(mModel->mJacobianColouring);
+  ei.colouredJacobian = &colouredJacobian;
+  ei.solver = NULL;
+  ei.failInfo = &failInfo;
   ei.constants = constants;
   ei.states = states;
   ei.rates = rates;
@@ -340,11 +544,6 @@ CDA_ODESolverRun::SolveODEProblemGSL
   double voi = mStartBvar;
   double stepSize = 1E-6;
 
-  uint32_t recsize = rateSize * 2 + algSize + 1;
-  uint32_t storageCapacity = (VARIABLE_STORAGE_LIMIT / recsize) * recsize;
-  double* storage = new double[storageCapacity];
-  uint32_t storageExpiry = time(0) + VARIABLE_TIME_LIMIT;
-  uint32_t storageSize = 0;
 
   double lastVOI = 0.0 /* initialised only to avoid extraneous warning. */;
   bool isFirst = true;
@@ -370,9 +569,16 @@ CDA_ODESolverRun::SolveODEProblemGSL
 
     gsl_odeiv_evolve_apply(e, c, s, &sys, &voi, bhl,
                            &stepSize, states);
+    mStatistics.steps = e->count;
+    mStatistics.rejectedSteps = e->failed_steps;
     if (checkPauseOrCancellation())
       break;
 
+    // There is no rootfinding here, so just switch over any piecewise
+    // conditions which changed during the step.
+    updateConditionVariables(f, voi, constants, rates, states, algebraic,
+                             algSize, NULL, &failInfo);
+
     if (isFirst)
       isFirst = false;
     else if (voi - lastVOI < minReportForDensity && !floatsEqual(voi, nextStopPoint, tabulationRelativeTolerance))
@@ -390,35 +596,12 @@ CDA_ODESolverRun::SolveODEProblemGSL
     // purposes...
     f->ComputeVariables(voi, constants, rates, states, algebraic);
 
-    // Add to storage...
-    storage[storageSize] = voi;
-    memcpy(storage + storageSize + 1, states, rateSize * sizeof(double));
-    memcpy(storage + storageSize + 1 + rateSize, rates,
-           rateSize * sizeof(double));
-    memcpy(storage + storageSize + 1 + rateSize * 2, algebraic,
-           algSize * sizeof(double));
-
-    storageSize += recsize;
-
-    // Are we ready to send?
-    uint32_t timeNow = time(0);
-    if (timeNow >= storageExpiry || storageSize == storageCapacity)
-    {
-      if (mObserver != NULL)
-        mObserver->results(storageSize, storage);
-      storageExpiry = timeNow + VARIABLE_TIME_LIMIT;
-      storageSize = 0;
-    }
-  }
-  if (storageSize != 0 && mObserver != NULL)
-  {
-    mObserver->results(storageSize, storage);
+    recordResult(aStream, voi, states, rates, rateSize, algebraic, algSize);
   }
+  finishStatistics(aStream);
   if (mObserver != NULL)
     mObserver->done();
 
-  delete [] storage;
-
   // Free gsl structures...
   gsl_odeiv_evolve_free(e);
   gsl_odeiv_control_free(c);
@@ -441,46 +624,266 @@ cda_ida_error_handler(int error_code, const char* module,
   setFailure(reinterpret_cast<struct fail_info*>(eh_data), msg, -1);
 }
 
+/*
+ * Follows the counters kept by CVODE or IDA, for the statistics of a run.
+ * Reinitialising the integrator zeroes them (the linear solver's counters
+ * only at its next step), so the counts from before each reinitialisation are
+ * kept, and a session carried on from an earlier run starts with that run's
+ * counts, which are taken off.
+ */
+class SolverCounts
+{
+public:
+  SolverCounts(bool aIsIDA, bool aHasLinearSolver,
+               iface::cellml_services::LinearSolverType aLinearSolver)
+    : mIsIDA(aIsIDA), mHasLinearSolver(aHasLinearSolver),
+      mLinearSolver(aLinearSolver), mExtraRhsEvaluations(NULL)
+  {
+    for (uint32_t i = 0; i < COUNTER_COUNT; i++)
+    {
+      mBefore[i] = 0;
+      mBase[i] = 0;
+    }
+  }
+
+  // Evaluations made on the solver's behalf, such as by a ColouredJacobian,
+  // which its own counters miss.
+  void
+  countExtraEvaluations(const uint64_t* aEvaluations)
+  {
+    mExtraRhsEvaluations = aEvaluations;
+  }
+
+  // Called when carrying on from an earlier run without reinitialising.
+  void
+  continuing(void* aSolver)
+  {
+    read(aSolver, mBase);
+  }
+
+  // Called just before reinitialising the integrator.
+  void
+  reinitialising(void* aSolver)
+  {
+    long counts[COUNTER_COUNT];
+    read(aSolver, counts);
+    for (uint32_t i = 0; i < COUNTER_COUNT; i++)
+    {
+      mBefore[i] += counts[i] - mBase[i];
+      mBase[i] = 0;
+    }
+  }
+
+  // Called after each step.
+  void
+  store(void* aSolver, RunStatistics& aStatistics)
+  {
+    long counts[COUNTER_COUNT];
+    read(aSolver, counts);
+    for (uint32_t i = 0; i < COUNTER_COUNT; i++)
+      counts[i] -= mBase[i];
+
+    aStatistics.rhsEvaluations = mBefore[RHS_EVALUATIONS] +
+      counts[RHS_EVALUATIONS];
+    if (mExtraRhsEvaluations != NULL)
+      aStatistics.rhsEvaluations += *mExtraRhsEvaluations;
+    aStatistics.jacobianEvaluations = mBefore[JACOBIAN_EVALUATIONS] +
+      counts[JACOBIAN_EVALUATIONS];
+    aStatistics.steps = mBefore[STEPS] + counts[STEPS];
+    aStatistics.rejectedSteps = mBefore[REJECTED_STEPS] +
+      counts[REJECTED_STEPS];
+    aStatistics.nonlinearIterations = mBefore[NONLINEAR_ITERATIONS] +
+      counts[NONLINEAR_ITERATIONS];
+    aStatistics.nonlinearConvergenceFailures = mBefore[CONVERGENCE_FAILURES] +
+      counts[CONVERGENCE_FAILURES];
+  }
+
+private:
+  enum
+  {
+    RHS_EVALUATIONS, JACOBIAN_EVALUATIONS, STEPS, REJECTED_STEPS,
+    NONLINEAR_ITERATIONS, CONVERGENCE_FAILURES, COUNTER_COUNT
+  };
+
+  void
+  read(void* aSolver, long* aCounts)
+  {
+    long linearRhsEvaluations = 0;
+    for (uint32_t i = 0; i < COUNTER_COUNT; i++)
+      aCounts[i] = 0;
+
+    if (mIsIDA)
+    {
+      IDAGetNumResEvals(aSolver, &aCounts[RHS_EVALUATIONS]);
+      IDAGetNumSteps(aSolver, &aCounts[STEPS]);
+      IDAGetNumErrTestFails(aSolver, &aCounts[REJECTED_STEPS]);
+      IDAGetNumNonlinSolvIters(aSolver, &aCounts[NONLINEAR_ITERATIONS]);
+      IDAGetNumNonlinSolvConvFails(aSolver, &aCounts[CONVERGENCE_FAILURES]);
+      if (mLinearSolver == iface::cellml_services::LINEAR_SOLVER_SPGMR)
+      {
+        IDASpilsGetNumPrecEvals(aSolver, &aCounts[JACOBIAN_EVALUATIONS]);
+        IDASpilsGetNumResEvals(aSolver, &linearRhsEvaluations);
+      }
+      else
+      {
+        IDADlsGetNumJacEvals(aSolver, &aCounts[JACOBIAN_EVALUATIONS]);
+        IDADlsGetNumResEvals(aSolver, &linearRhsEvaluations);
+      }
+    }
+    else
+    {
+      CVodeGetNumRhsEvals(aSolver, &aCounts[RHS_EVALUATIONS]);
+      CVodeGetNumSteps(aSolver, &aCounts[STEPS]);
+      CVodeGetNumErrTestFails(aSolver, &aCounts[REJECTED_STEPS]);
+      CVodeGetNumNonlinSolvIters(aSolver, &aCounts[NONLINEAR_ITERATIONS]);
+      CVodeGetNumNonlinSolvConvFails(aSolver, &aCounts[CONVERGENCE_FAILURES]);
+      // Asking for the linear solver's counters without one is an error.
+      if (mHasLinearSolver &&
+          mLinearSolver == iface::cellml_services::LINEAR_SOLVER_SPGMR)
+      {
+        CVSpilsGetNumPrecEvals(aSolver, &aCounts[JACOBIAN_EVALUATIONS]);
+        CVSpilsGetNumRhsEvals(aSolver, &linearRhsEvaluations);
+      }
+      else if (mHasLinearSolver)
+      {
+        CVDlsGetNumJacEvals(aSolver, &aCounts[JACOBIAN_EVALUATIONS]);
+        CVDlsGetNumRhsEvals(aSolver, &linearRhsEvaluations);
+      }
+    }
+
+    aCounts[RHS_EVALUATIONS] += linearRhsEvaluations;
+  }
+
+  bool mIsIDA, mHasLinearSolver;
+  iface::cellml_services::LinearSolverType mLinearSolver;
+  const uint64_t* mExtraRhsEvaluations;
+  uint64_t mBefore[COUNTER_COUNT];
+  long mBase[COUNTER_COUNT];
+};
+
 void
 CDA_ODESolverRun::SolveODEProblemCVODE
 (
  CompiledModelFunctions* f, uint32_t constSize,
  double* constants, uint32_t rateSize, double* rates,
- double* states, uint32_t algSize, double* algebraic
+ double* states, uint32_t algSize, double* algebraic,
+ ResultStream& aStream
 )
 {
   N_Vector y = NULL;
-  if (rateSize != 0)
-    y = N_VMake_Serial(rateSize, states);
   void* solver = NULL;
+  SolverSession* session = NULL;
   struct fail_info failInfo;
+  failInfo.bytecode = mModel->mBytecode;
+  failInfo.statistics = &mStatistics;
+  failInfo.distributionTables = &mModel->mDistributionTables;
+  failInfo.cacheIntegrals = mCacheDefiniteIntegrals;
+  // The condition variables go after the algebraic variables.
+  setupNonlinearSolverThreading(failInfo, constSize, rateSize, rateSize,
+                                algSize + mModel->mConditionVariableCount);
+
+  EvaluationInformation ei;
+  ei.failInfo = &failInfo;
+
+  uint32_t condVarSize = (f->ComputeRootInformation == NULL) ? 0 :
+    mModel->mConditionVariableCount;
+  std::vector<int> rootDirections(condVarSize);
+  bool atRoot = false;
+
+  // Only BDF_IMPLICIT_1_5_SOLVE uses a linear solver.
+  iface::cellml_services::LinearSolverType linearSolver =
+    mModel->chooseLinearSolver(mLinearSolverType, rateSize);
+  SolverCounts counts(false,
+                      mStepType == iface::cellml_services::BDF_IMPLICIT_1_5_SOLVE,
+                      linearSolver);
+
+  // Without an analytic Jacobian, a coloured one takes fewer evaluations of
+  // the rates than CVODE's own difference quotients, as long as there are
+  // fewer colours than states. CVODE's band solver already differences
+  // columns a bandwidth apart together.
+  ColouredJacobian colouredJacobian(mModel->mJacobianColouring);
+  bool useColouredJacobian = f->ComputeJacobian == NULL &&
+    mModel->mJacobianColouring.size() == rateSize &&
+    mModel->mJacobianColouring.colourCount() < rateSize;
+  ei.colouredJacobian = &colouredJacobian;
+  ei.solver = NULL;
+  counts.countExtraEvaluations(&colouredJacobian.mEvaluations);
 
   if (rateSize != 0)
   {
-    switch (mStepType)
+    session = mModel->mSolverSessions.checkOut(false, mStepType, linearSolver,
+                                               rateSize, mStartBvar, states,
+                                               constants, constSize, mEpsRel,
+                                               mEpsAbs);
+    bool fresh = (session->mSolver == NULL);
+    if (fresh)
     {
-    case iface::cellml_services::ADAMS_MOULTON_1_12:
-      solver = CVodeCreate(CV_ADAMS, CV_FUNCTIONAL);
-      break;
-    case iface::cellml_services::BDF_IMPLICIT_1_5_SOLVE:
-    default:
-      solver = CVodeCreate(CV_BDF, CV_NEWTON);
-      break;
+      session->mY = N_VMake_Serial(rateSize, states);
+      switch (mStepType)
+      {
+      case iface::cellml_services::ADAMS_MOULTON_1_12:
+        session->mSolver = CVodeCreate(CV_ADAMS, CV_FUNCTIONAL);
+        break;
+      case iface::cellml_services::BDF_IMPLICIT_1_5_SOLVE:
+      default:
+        session->mSolver = CVodeCreate(CV_BDF, CV_NEWTON);
+        break;
+      }
     }
+    else
+      N_VSetArrayPointer_Serial(states, session->mY);
+    solver = session->mSolver;
+    y = session->mY;
 
     CVodeSetErrHandlerFn(solver, cda_cvode_error_handler, &failInfo);
-  }
-
-  EvaluationInformation ei;
-  ei.failInfo = &failInfo;
 
-  if (rateSize != 0)
-  {
-    CVodeInit(solver, EvaluateRatesCVODE, mStartBvar, y);
-    CVodeSStolerances(solver, mEpsRel, mEpsAbs);
-    if (mStepType == iface::cellml_services::BDF_IMPLICIT_1_5_SOLVE)
-      CVDense(solver, rateSize);
+    // A session left by an earlier run keeps its linear solver, and only needs
+    // its history resetting, unless this run carries straight on from it.
+    bool continuing = !fresh && mContinueSolver &&
+      session->canContinueFrom(mStartBvar, states, constants, constSize,
+                               mEpsRel, mEpsAbs);
+    if (continuing)
+      counts.continuing(solver);
+    else if (!fresh)
+      CVodeReInit(solver, mStartBvar, y);
+    else
+    {
+      CVodeInit(solver, EvaluateRatesCVODE, mStartBvar, y);
+      if (condVarSize != 0)
+        CVodeRootInit(solver, condVarSize, EvaluateRootsCVODE);
+      if (mStepType == iface::cellml_services::BDF_IMPLICIT_1_5_SOLVE)
+      {
+        long int mu = mModel->mJacobianUpperBandwidth,
+          ml = mModel->mJacobianLowerBandwidth;
+        switch (linearSolver)
+        {
+        case iface::cellml_services::LINEAR_SOLVER_BAND:
+          CVBand(solver, rateSize, mu, ml);
+          break;
+        case iface::cellml_services::LINEAR_SOLVER_SPGMR:
+          mu = std::min(mu, (long int)KRYLOV_PRECONDITIONER_BANDWIDTH);
+          ml = std::min(ml, (long int)KRYLOV_PRECONDITIONER_BANDWIDTH);
+          CVSpgmr(solver, PREC_LEFT, 0);
+          CVBandPrecInit(solver, rateSize, mu, ml);
+          break;
+        case iface::cellml_services::LINEAR_SOLVER_DENSE:
+        default:
+          CVDense(solver, rateSize);
+          if (f->ComputeJacobian != NULL)
+            CVDlsSetDenseJacFn(solver, EvaluateJacobianCVODE);
+          else if (useColouredJacobian)
+            CVDlsSetDenseJacFn(solver, EvaluateColouredJacobianCVODE);
+          break;
+        }
+      }
+    }
+    // Setting the tolerances leaves CVODE to set up its error weights again
+    // on its first step, which a solver carrying on won't take, so it keeps
+    // the tolerances it already has (which are the same).
+    if (!continuing)
+      CVodeSStolerances(solver, mEpsRel, mEpsAbs);
     CVodeSetUserData(solver, &ei);
+    ei.solver = solver;
   }
 
   ei.constants = constants;
@@ -491,12 +894,8 @@ CDA_ODESolverRun::SolveODEProblemCVODE
   ei.rateSizeBytes = rateSize * sizeof(double);
   ei.ComputeRates = f->ComputeRates;
   ei.ComputeVariables = f->ComputeVariables;
-  
-  uint32_t recsize = rateSize * 2 + algSize + 1;
-  uint32_t storageCapacity = (VARIABLE_STORAGE_LIMIT / recsize) * recsize;
-  double* storage = new double[storageCapacity];
-  uint32_t storageExpiry = time(0) + VARIABLE_TIME_LIMIT;
-  uint32_t storageSize = 0;
+  ei.ComputeJacobian = f->ComputeJacobian;
+  ei.ComputeRootInformation = f->ComputeRootInformation;
 
   double voi = mStartBvar;
   double lastVOI = 0.0 /* initialised only to avoid extraneous warning. */;
@@ -509,26 +908,107 @@ CDA_ODESolverRun::SolveODEProblemCVODE
   if (mTabulationStepSize == 0.0)
     nextStopPoint = mStopBvar;
 
+  // Reset rules make the states jump at the end of a step, which the
+  // interpolating polynomial knows nothing of, so such models still step to
+  // each tabulation point.
+  bool interpolate = mInterpolateTabulation && mTabulationStepSize != 0.0 &&
+    !mModel->mCCI->hasResetRules();
+  // A reused session may still have a limit from an earlier run; 0 clears it.
+  if (rateSize != 0)
+    CVodeSetMaxStep(solver, interpolate ? mStepSizeMax : 0.0);
+
   if (rateSize != 0)
   {
     while (voi < mStopBvar)
     {
       double bhl = mStopBvar;
-      if (mStepSizeMax != 0.0 && bhl - voi > mStepSizeMax)
-        bhl = voi + mStepSizeMax;
-      if(bhl > nextStopPoint)
-        bhl = nextStopPoint;
+      if (!interpolate)
+      {
+        if (mStepSizeMax != 0.0 && bhl - voi > mStepSizeMax)
+          bhl = voi + mStepSizeMax;
+        if(bhl > nextStopPoint)
+          bhl = nextStopPoint;
+      }
       
       CVodeSetStopTime(solver, bhl);
-      if (CVode(solver, bhl, y, &voi, CV_ONE_STEP) < 0)
+      int ret = CVode(solver, bhl, y, &voi, CV_ONE_STEP);
+      counts.store(solver, mStatistics);
+      if (ret < 0)
       {
         if (!failInfo.failtype)
           setFailure(&failInfo, "CVODE failure", -1);
         break;
       }
+      atRoot = (ret == CV_ROOT_RETURN);
+      if (atRoot)
+        mStatistics.rootsFound++;
       
       if (checkPauseOrCancellation())
         break;
+
+      bool tabulated = false;
+      if (interpolate)
+      {
+        // Fill in the tabulation points this step went past from the
+        // interpolating polynomial. A point at a root belongs to the
+        // conditions after the switch, so it waits until they are updated.
+        while (nextStopPoint <= mStopBvar &&
+               (nextStopPoint < voi ||
+                floatsEqual(voi, nextStopPoint, tabulationRelativeTolerance)) &&
+               !(atRoot &&
+                 floatsEqual(voi, nextStopPoint, tabulationRelativeTolerance)))
+        {
+          double tabVOI = std::min(nextStopPoint, voi);
+          CVodeGetDky(solver, tabVOI, 0, y);
+          nextStopPoint = (mTabulationStepSize * ++tabStepNumber) + mStartBvar;
+          lastVOI = tabVOI;
+          tabulated = true;
+
+          f->    ComputeRates(tabVOI, constants, rates, states, algebraic, &failInfo);
+          computeOutputVariables(f, tabVOI, constants, rates, states, algebraic,
+                                 &failInfo);
+
+          recordResult(aStream, tabVOI, states, rates, rateSize,
+                       algebraic, algSize);
+        }
+
+        // Put back the solution at the end of the step...
+        if (tabulated)
+          CVodeGetDky(solver, voi, 0, y);
+      }
+
+      if (atRoot)
+      {
+        // Switch over the piecewise conditions this step found roots for
+        // before anything at the discontinuity is recorded, and start the
+        // solver again from there.
+        CVodeGetRootInfo(solver, &rootDirections[0]);
+        updateConditionVariables(f, voi, constants, rates, states, algebraic,
+                                 algSize, &rootDirections[0], &failInfo);
+        counts.reinitialising(solver);
+        CVodeReInit(solver, voi, y);
+      }
+
+      if (interpolate)
+      {
+        if (atRoot && nextStopPoint <= mStopBvar &&
+            floatsEqual(voi, nextStopPoint, tabulationRelativeTolerance))
+        {
+          nextStopPoint = (mTabulationStepSize * ++tabStepNumber) + mStartBvar;
+          lastVOI = voi;
+          tabulated = true;
+
+          f->    ComputeRates(voi, constants, rates, states, algebraic, &failInfo);
+          computeOutputVariables(f, voi, constants, rates, states, algebraic,
+                                 &failInfo);
+
+          recordResult(aStream, voi, states, rates, rateSize,
+                       algebraic, algSize);
+        }
+
+        if (mStrictTabulation || (tabulated && floatsEqual(voi, lastVOI, tabulationRelativeTolerance)))
+          continue;
+      }
       
       if (isFirst)
         isFirst = false;
@@ -544,37 +1024,25 @@ CDA_ODESolverRun::SolveODEProblemCVODE
       lastVOI = voi;
 
       f->    ComputeRates(voi, constants, rates, states, algebraic, &failInfo);
-      f->ComputeVariables(voi, constants, rates, states, algebraic, &failInfo);
+      computeOutputVariables(f, voi, constants, rates, states, algebraic,
+                             &failInfo);
 
-      // Add to storage...
-      storage[storageSize] = voi;
-      memcpy(storage + storageSize + 1, states, rateSize * sizeof(double));
-      memcpy(storage + storageSize + 1 + rateSize, rates,
-             rateSize * sizeof(double));
-      memcpy(storage + storageSize + 1 + rateSize * 2, algebraic,
-             algSize * sizeof(double));
-
-      storageSize += recsize;
-
-      // Are we ready to send?
-      uint32_t timeNow = time(0);
-      if (timeNow >= storageExpiry || storageSize == storageCapacity)
-      {
-        if (mObserver != NULL)
-        {
-          std::vector<double> resultsVector(storage, storage + storageSize);
-          mObserver->results(resultsVector);
-        }
-        storageExpiry = timeNow + VARIABLE_TIME_LIMIT;
-        storageSize = 0;
-      }
+      recordResult(aStream, voi, states, rates, rateSize, algebraic, algSize);
     }
   }
-  if (storageSize != 0 && mObserver != NULL)
+
+  // This has to happen before the observer hears the run is done, as it may
+  // start the next run straight away.
+  if (rateSize != 0)
   {
-    std::vector<double> resultsVector(storage, storage + storageSize);
-    mObserver->results(resultsVector);
+    if (!failInfo.failtype && voi >= mStopBvar && !atRoot)
+      session->setEnd(voi, states, constants, constSize, mEpsRel, mEpsAbs);
+    else
+      session->mCanContinue = false;
+    mModel->mSolverSessions.checkIn(session);
   }
+
+  finishStatistics(aStream);
   if (mObserver != NULL)
   {
     if (failInfo.failtype)
@@ -582,13 +1050,127 @@ CDA_ODESolverRun::SolveODEProblemCVODE
     else
       mObserver->done();
   }
+}
+
+void
+CDA_ODESolverRun::SolveODEProblemRushLarsen
+(
+ CompiledModelFunctions* f, uint32_t constSize,
+ double* constants, uint32_t rateSize, double* rates,
+ double* states, uint32_t algSize, double* algebraic,
+ ResultStream& aStream
+)
+{
+  struct fail_info failInfo;
+  failInfo.bytecode = mModel->mBytecode;
+  failInfo.statistics = &mStatistics;
+  failInfo.distributionTables = &mModel->mDistributionTables;
+  failInfo.cacheIntegrals = mCacheDefiniteIntegrals;
+  // The condition variables go after the algebraic variables.
+  setupNonlinearSolverThreading(failInfo, constSize, rateSize, rateSize,
+                                algSize + mModel->mConditionVariableCount);
+
+  double stepSize = mStepSizeMax;
+  if (stepSize == 0.0)
+    stepSize = mTabulationStepSize;
+  if (stepSize <= 0.0)
+  {
+    finishStatistics(aStream);
+    if (mObserver != NULL)
+      mObserver->failed("RUSH_LARSEN needs a maximum or tabulation step size");
+    return;
+  }
 
-  delete [] storage;
+  // The partial derivative of each rate with respect to its own state
+  // variable, which stays zero for those which aren't linear in themselves,
+  // so that they take forward Euler steps. There is a spare entry so that it
+  // is never empty.
+  std::vector<double> coefficients(rateSize + 1, 0.0);
 
-  if (rateSize != 0)
+  double voi = mStartBvar;
+  double lastVOI = 0.0 /* initialised only to avoid extraneous warning. */;
+  bool isFirst = true;
+
+  double minReportForDensity = (mStopBvar - mStartBvar) / mMaxPointDensity;
+  uint32_t tabStepNumber = 1;
+  double nextStopPoint = mTabulationStepSize + voi;
+  if (mTabulationStepSize == 0.0)
+    nextStopPoint = mStopBvar;
+
+  while (voi < mStopBvar)
+  {
+    double bhl = voi + stepSize;
+    if (bhl > nextStopPoint || floatsEqual(bhl, nextStopPoint,
+                                           tabulationRelativeTolerance))
+      bhl = nextStopPoint;
+    if (bhl > mStopBvar || floatsEqual(bhl, mStopBvar,
+                                       tabulationRelativeTolerance))
+    {
+      nextStopPoint = mStopBvar;
+      bhl = mStopBvar;
+    }
+    double h = bhl - voi;
+
+    f->ComputeRates(voi, constants, rates, states, algebraic, &failInfo);
+    mStatistics.rhsEvaluations++;
+    if (f->ComputeLinearCoefficients != NULL)
+    {
+      f->ComputeLinearCoefficients(voi, constants, rates, states, algebraic,
+                                   &coefficients[0], &failInfo);
+      mStatistics.jacobianEvaluations++;
+    }
+    if (failInfo.failtype)
+      break;
+
+    // For a rate a + b y, with a and b taken as fixed over the step, the
+    // exact solution is y + (a + b y) (exp(b h) - 1) / b. As b h goes to zero,
+    // this becomes the Euler step, which is also more accurate than the
+    // cancellation in exp(b h) - 1 there.
+    for (uint32_t i = 0; i < rateSize; i++)
+    {
+      double bh = coefficients[i] * h;
+      if (fabs(bh) > 1E-8)
+        states[i] += rates[i] * h * (exp(bh) - 1.0) / bh;
+      else
+        states[i] += rates[i] * h;
+    }
+    voi = bhl;
+    mStatistics.steps++;
+
+    if (checkPauseOrCancellation())
+      break;
+
+    // Switch over any piecewise conditions which changed during the step.
+    updateConditionVariables(f, voi, constants, rates, states, algebraic,
+                             algSize, NULL, &failInfo);
+
+    if (isFirst)
+      isFirst = false;
+    else if (voi - lastVOI < minReportForDensity && !floatsEqual(voi, nextStopPoint, tabulationRelativeTolerance))
+      continue;
+
+    if(mStrictTabulation && !floatsEqual(voi, nextStopPoint, tabulationRelativeTolerance))
+      continue;
+
+    if (voi==nextStopPoint)
+      nextStopPoint = (mTabulationStepSize * ++tabStepNumber) + mStartBvar;
+
+    lastVOI = voi;
+
+    f->ComputeRates(voi, constants, rates, states, algebraic, &failInfo);
+    computeOutputVariables(f, voi, constants, rates, states, algebraic,
+                           &failInfo);
+
+    recordResult(aStream, voi, states, rates, rateSize, algebraic, algSize);
+  }
+
+  finishStatistics(aStream);
+  if (mObserver != NULL)
   {
-    CVodeFree(&solver);
-    N_VDestroy(y);
+    if (failInfo.failtype)
+      mObserver->failed(failInfo.failmsg);
+    else
+      mObserver->done();
   }
 }
 
@@ -601,7 +1183,8 @@ CDA_ODESolverRun::SolveODEProblem
 (
  CompiledModelFunctions* f, uint32_t constSize,
  double* constants, uint32_t rateSize, double* rates,
- double* states, uint32_t algSize, double* algebraic
+ double* states, uint32_t algSize, double* algebraic,
+ ResultStream& aStream
 )
 {
 #ifdef DEBUG_MODE
@@ -611,13 +1194,19 @@ CDA_ODESolverRun::SolveODEProblem
   if (mStepType == iface::cellml_services::ADAMS_MOULTON_1_12 ||
       mStepType == iface::cellml_services::BDF_IMPLICIT_1_5_SOLVE)
     SolveODEProblemCVODE(f, constSize, constants, rateSize, rates, states,
-                         algSize, algebraic);
+                         algSize, algebraic, aStream);
+  else if (mStepType == iface::cellml_services::RUSH_LARSEN)
+    SolveODEProblemRushLarsen(f, constSize, constants, rateSize, rates, states,
+                              algSize, algebraic, aStream);
   else
 #ifdef ENABLE_GSL_INTEGRATORS
     SolveODEProblemGSL(f, constSize, constants, rateSize, rates, states,
-                         algSize, algebraic);
+                         algSize, algebraic, aStream);
 #else
+  {
+    finishStatistics(aStream);
     mObserver->failed("GSL integrators are disabled.");
+  }
 #endif
 }
 
@@ -626,60 +1215,6 @@ int getFailType(struct fail_info* aFail)
   return aFail->failtype;
 }
 
-struct PDFInformation
-{
-  double (*pdf)(double bvar, double* constants, double* algebraic,
-                struct fail_info*);
-  double* constants, * algebraic, uplimit;
-  double target;
-  int nroots;
-  struct fail_info* failInfo;
-  double (**rootFuncs)(double bvar, double* CONSTANTS, double* ALGEBRAIC,
-                       struct fail_info*);
-  double lowBoundary, highBoundary;
-};
-
-#define BUMPFLOATUP(x) (x > 0) ? x*(1+1E-15) : x*(1-1E-15)
-#define MAX(x,y) (x>y)?x:y
-#define MIN(x,y) (x<y)?x:y
-
-static int integrandForPDF(double t, N_Vector varsV, N_Vector ratesV, void* data)
-{
-  struct PDFInformation* info = (struct PDFInformation*)data;
-
-  // The first rate is the integrand...
-  *N_VGetArrayPointer_Serial(ratesV) =
-    info->pdf(t, info->constants, info->algebraic, info->failInfo);
-
-#ifdef DEBUG_UNCERT
-  printf("PDF' at %.100g = %.100g\n", t, *N_VGetArrayPointer_Serial(ratesV));
-#endif
-
-  return info->failInfo->failtype;
-}
-
-static int rootfuncForPDF(double t, N_Vector varsV, double *gout, void* data)
-{
-  struct PDFInformation* info = (struct PDFInformation*)data;
-  double tp1 = 1.0 + t;
-  // We transform the integral from a limit between -infinity and uplimit into
-  // one between -1 and 0...
-  double tprime = info->uplimit + t / tp1;
-
-  for (int i = 0; i < info->nroots; i++)
-  {
-    gout[i] = info->rootFuncs[i](tprime, info->constants, info->algebraic, info->failInfo);
-
-    if (info->failInfo->failtype)
-      return info->failInfo->failtype;
-#ifdef DEBUG_UNCERT
-    printf("gout[%d] = %g at t = %g, t' = %g\n", i, gout[i], t, tprime);
-#endif
-  }
-
-  return 0;
-}
-
 static void
 recordKINSOLError(int code, const char *module,
                   const char *function, char *msg,
@@ -688,54 +1223,6 @@ recordKINSOLError(int code, const char *module,
   setFailure(reinterpret_cast<struct fail_info*>(dat), msg, -1);
 }
 
-static int minfuncForPDF(N_Vector pVec, N_Vector hxVec, void *adata)
-{
-  int ret;
-  struct PDFInformation* info = (struct PDFInformation*)adata;
-  info->uplimit = NV_Ith_S(pVec, 0);
-  NV_Ith_S(hxVec, 0) = 0;
-
-  if (!cdamath::isfinite(info->uplimit))
-    return 1;
-
-  void* cv = CVodeCreate(CV_BDF, CV_NEWTON);
-  CVodeInit(cv, integrandForPDF, info->lowBoundary, hxVec);
-  CVodeSetErrHandlerFn(cv, recordKINSOLError, info->failInfo);
-  CVodeSetMaxStep(cv, (info->highBoundary - info->lowBoundary) / 1000);
-  CVodeSetMaxNumSteps(cv, 10000);
-  CVodeSStolerances(cv, 1E-10, 1E-10);
-  CVodeSetUserData(cv, info);
-  CVDense(cv, 1);
-
-  if (info->nroots != 0)
-    CVodeRootInit(cv, info->nroots, rootfuncForPDF);
-
-  double tret;
-#ifdef DEBUG_UNCERT
-  printf("Running CVode to integrate between %f and %f\n", info->lowBoundary, MIN(info->highBoundary, info->uplimit));
-#endif
-  while (true)
-  {
-    ret = CVode(cv, MIN(info->highBoundary, info->uplimit), hxVec, &tret, CV_NORMAL);
-    if (ret != CV_ROOT_RETURN)
-      break;
-
-    tret = BUMPFLOATUP(tret); // TODO adjust this based on error tolerance.
-#ifdef DEBUG_UNCERT
-    printf("Reinitialising at %g\n", tret);
-#endif
-    CVodeReInit(cv, tret, hxVec);
-  }
-#ifdef DEBUG_UNCERT
-  printf("C.D.F.(%f) = %f, ret = %d\n", NV_Ith_S(pVec, 0), NV_Ith_S(hxVec, 0), ret);
-#endif
-  CVodeFree(&cv);
-
-  NV_Ith_S(hxVec, 0) -= info->target;
-
-  return (ret < 0) ? 1 : 0;
-}
-
 // A table of points that cover a wide range of double values at logarithmic
 // spacing, to assist with finding where a p.d.f. is non-zero. For the algorithms
 // here to work, the p.d.f. must not have any islands where it is non-zero that don't
@@ -857,14 +1344,6 @@ SampleUsingPDF(double (*pdf)(double bvar, double* CONSTANTS, double* ALGEBRAIC,
                double* CONSTANTS, double* ALGEBRAIC,
                struct fail_info* failInfo)
 {
-  struct PDFInformation pdfi;
-  pdfi.constants = CONSTANTS;
-  pdfi.algebraic = ALGEBRAIC;
-  pdfi.pdf = pdf;
-  pdfi.target = sharedRandom()->randomDoubleU01();
-  pdfi.nroots = nroots;
-  pdfi.rootFuncs = rootFuncs;
-  pdfi.failInfo = failInfo;
   double p;
 
   // We assume that the p.d.f. is zero except in a finite range. Find that range:
@@ -872,7 +1351,7 @@ SampleUsingPDF(double (*pdf)(double bvar, double* CONSTANTS, double* ALGEBRAIC,
   for (int attempt = 0; attempt < 2048; attempt++)
   {
     clearFailure(failInfo);
-    if (pdfi.pdf(samplePoints[attempt], CONSTANTS, ALGEBRAIC, failInfo) >= 1E-100)
+    if (pdf(samplePoints[attempt], CONSTANTS, ALGEBRAIC, failInfo) >= 1E-100)
     {
       lowestNonZero = attempt;
       break;
@@ -894,7 +1373,7 @@ SampleUsingPDF(double (*pdf)(double bvar, double* CONSTANTS, double* ALGEBRAIC,
 
   for (int attempt = 2047; attempt >= 0; attempt--)
   {
-    if (pdfi.pdf(samplePoints[attempt], CONSTANTS, ALGEBRAIC, failInfo) >= 1E-100)
+    if (pdf(samplePoints[attempt], CONSTANTS, ALGEBRAIC, failInfo) >= 1E-100)
     {
       clearFailure(failInfo);
       highestNonZero = attempt;
@@ -910,71 +1389,71 @@ SampleUsingPDF(double (*pdf)(double bvar, double* CONSTANTS, double* ALGEBRAIC,
   }
 
   double lowlim = samplePoints[lowestNonZero - 1], uplim = samplePoints[lowestNonZero];
-  for (p = (lowlim + uplim) / 2.0; (uplim - lowlim) / (MAX(1E-6, MAX(std::abs(uplim), std::abs(lowlim)))) > 1E-6;
+  for (p = (lowlim + uplim) / 2.0; (uplim - lowlim) / (std::max(1E-6, std::max(std::abs(uplim), std::abs(lowlim)))) > 1E-6;
        p = (lowlim + uplim) / 2.0)
   {
-    if (pdfi.pdf(p, CONSTANTS, ALGEBRAIC, failInfo) >= 1E-100)
+    if (pdf(p, CONSTANTS, ALGEBRAIC, failInfo) >= 1E-100)
       uplim = p;
     else
       lowlim = p;
   }
-  pdfi.lowBoundary = p;
-#ifdef DEBUG_UNCERT
-  printf("p.d.f low zero boundary in (%g,%g): %g\n", lowlim, uplim, p);
-#endif
+  double lowBoundary = p;
 
   lowlim = samplePoints[highestNonZero], uplim = samplePoints[highestNonZero + 1];
-  for (p = (lowlim + uplim) / 2.0; (uplim - lowlim) / (MAX(1E-6, MAX(std::abs(uplim), std::abs(lowlim)))) > 1E-6;
+  for (p = (lowlim + uplim) / 2.0; (uplim - lowlim) / (std::max(1E-6, std::max(std::abs(uplim), std::abs(lowlim)))) > 1E-6;
        p = (lowlim + uplim) / 2.0)
   {
-    if (pdfi.pdf(p, CONSTANTS, ALGEBRAIC, failInfo) >= 1E-100)
+    if (pdf(p, CONSTANTS, ALGEBRAIC, failInfo) >= 1E-100)
       lowlim = p;
     else
       uplim = p;
   }
-  pdfi.highBoundary = p;
-#ifdef DEBUG_UNCERT
-  printf("p.d.f high zero boundary in (%g,%g): %g\n", lowlim, uplim, p);
-#endif
-
-  lowlim = pdfi.lowBoundary;
-  uplim = pdfi.highBoundary;
+  double highBoundary = p;
+  if (failInfo->failtype)
+    return strtod("NAN", NULL);
 
-  double hx;
-  N_Vector hxVec = N_VMake_Serial(1, &hx);
-  N_Vector pVec = N_VMake_Serial(1, &p);
+  // Runs keep the tables for their model, so that later samples from the
+  // same distribution, by this run or any other, just look it up.
+  DistributionTableCache* cache = failInfo->distributionTables;
+  DistributionKey key(pdf, nroots, rootFuncs, lowBoundary, highBoundary,
+                      (cache == NULL) ? DISTRIBUTION_DEFAULT_TOLERANCE :
+                      cache->tolerance());
+  for (uint32_t i = 0; i < DISTRIBUTION_PROBE_COUNT; i++)
+    key.probes[i] = pdf(key.probePoint(i), CONSTANTS, ALGEBRAIC, failInfo);
+  if (failInfo->failtype)
+    return strtod("NAN", NULL);
 
-  for (p = (lowlim + uplim) / 2.0; (uplim - lowlim) / (MAX(1E-6, MAX(std::abs(uplim), std::abs(lowlim)))) > 1E-6;
-       p = (lowlim + uplim) / 2.0)
-  {
-#ifdef DEBUG_UNCERT
-    printf("Trying p = %g (in (%g, %g)): ", p, lowlim, uplim);
-#endif
-    if (minfuncForPDF(pVec, hxVec, (void*)&pdfi))
+  const InverseCDFTable* table = (cache == NULL) ? NULL : cache->find(key);
+  InverseCDFTable* newTable = NULL;
+  if (table == NULL)
+  {
+    // Start from the sample points in the range, so that the tabulation
+    // sees every scale the range covers.
+    std::vector<double> startPoints;
+    startPoints.push_back(lowBoundary);
+    for (int i = lowestNonZero; i <= highestNonZero; i++)
+      if (samplePoints[i] > lowBoundary && samplePoints[i] < highBoundary)
+        startPoints.push_back(samplePoints[i]);
+    startPoints.push_back(highBoundary);
+
+    newTable = new InverseCDFTable();
+    if (!newTable->build(pdf, nroots, rootFuncs, CONSTANTS, ALGEBRAIC,
+                         failInfo, startPoints, key.tolerance))
     {
-#ifdef DEBUG_UNCERT
-      printf("minfunc failed!\n");
-#endif
-      p = strtod("NAN", NULL);
-      failAddCause(failInfo, "Error finding valid range for p.d.f.");
-      break;
+      delete newTable;
+      if (!failInfo->failtype)
+        setFailure(failInfo, "The p.d.f. does not have a finite, non-zero integral.", -1);
+      failAddCause(failInfo, "Error tabulating the c.d.f. of the p.d.f.");
+      return strtod("NAN", NULL);
     }
-
-#ifdef DEBUG_UNCERT
-    printf("hx = %g\n", hx);
-#endif
-
-    if (std::abs(hx) < 1E-6)
-      break;
-
-    if (hx < 0)
-      lowlim = p;
-    else
-      uplim = p;
+    table = newTable;
+    if (cache != NULL && cache->add(key, newTable))
+      newTable = NULL;
   }
 
-  N_VDestroy(hxVec);
-  N_VDestroy(pVec);
+  p = table->sample(sharedRandom()->randomDoubleU01());
+  if (newTable != NULL)
+    delete newTable;
 
   return p;
 }
@@ -998,7 +1477,7 @@ struct DefintDebugInformation
 struct DAEEvaluationInformation
 {
   double* constants, * rates, * oldrates, * algebraic, * states, * oldstates, * condvars;
-  uint32_t condVarSize;
+  uint32_t condVarSize, stateSize;
   void (*ComputeResiduals)(double VOI, double* CONSTANTS, double* RATES, double* OLDRATES,
                           double* STATES, double* OLDSTATES, double* ALGEBRAIC,
                            double* CONDVAR, double* resids, struct fail_info* failInfo);
@@ -1012,7 +1491,14 @@ struct DAEEvaluationInformation
   void (*EvaluateVariables)(double VOI, double* CONSTANTS, double* RATES,
                             double* STATES, double* ALGEBRAIC, double* CONDVAR,
                             struct fail_info* failInfo);
+  void (*ComputeJacobian)(double VOI, double CJ, double* CONSTANTS,
+                          double* RATES, double* OLDRATES, double* STATES,
+                          double* OLDSTATES, double* ALGEBRAIC, double* CONDVAR,
+                          double** JACOBIAN, struct fail_info* failInfo);
   struct fail_info* failInfo;
+  // As for EvaluationInformation.
+  ColouredJacobian* colouredJacobian;
+  void* solver;
 
   ~DAEEvaluationInformation()
   {
@@ -1020,12 +1506,10 @@ struct DAEEvaluationInformation
 };
 
 static int
-ida_resfn(double t, N_Vector yy, N_Vector yp, N_Vector resval, void* userdata)
+EvaluateResidualsIDA(double t, double* states, double* rates, double* resids,
+                     void* userdata)
 {
   DAEEvaluationInformation * d = reinterpret_cast<DAEEvaluationInformation*>(userdata);
-  double *states = N_VGetArrayPointer(yy);
-  double * rates = N_VGetArrayPointer(yp);
-  double * resids = N_VGetArrayPointer(resval);
   d->EvaluateEssentialVariables(t, d->constants, rates, d->oldrates, states,
                                 d->oldstates, d->algebraic, d->condvars, d->failInfo);
   if (d->failInfo->failtype != 0)
@@ -1036,7 +1520,7 @@ ida_resfn(double t, N_Vector yy, N_Vector yp, N_Vector resval, void* userdata)
                       d->algebraic, d->condvars, resids, d->failInfo);
   if (d->failInfo->failtype == 0)
   {
-    for (unsigned int i = 0; i < NV_LENGTH_S(resval); i++)
+    for (unsigned int i = 0; i < d->stateSize; i++)
       if (!(resids[i] < 1E200)) // Clip the data to deal with NaN / inf / -inf.
         resids[i] = 1E200;
       else if (!(resids[i] > -1E200))
@@ -1045,6 +1529,55 @@ ida_resfn(double t, N_Vector yy, N_Vector yp, N_Vector resval, void* userdata)
   return d->failInfo->failtype;
 }
 
+static int
+ida_resfn(double t, N_Vector yy, N_Vector yp, N_Vector resval, void* userdata)
+{
+  return EvaluateResidualsIDA(t, N_VGetArrayPointer(yy), N_VGetArrayPointer(yp),
+                              N_VGetArrayPointer(resval), userdata);
+}
+
+static int
+ida_bbd_localfn(long int Nlocal, double t, N_Vector yy, N_Vector yp,
+                N_Vector gval, void* userdata)
+{
+  return ida_resfn(t, yy, yp, gval, userdata);
+}
+
+static int
+ida_jacfn(long int N, double t, double c_j, N_Vector yy, N_Vector yp,
+          N_Vector resval, DlsMat Jac, void* userdata, N_Vector tmp1,
+          N_Vector tmp2, N_Vector tmp3)
+{
+  DAEEvaluationInformation * d = reinterpret_cast<DAEEvaluationInformation*>(userdata);
+  double *states = N_VGetArrayPointer(yy);
+  double * rates = N_VGetArrayPointer(yp);
+  d->EvaluateEssentialVariables(t, d->constants, rates, d->oldrates, states,
+                                d->oldstates, d->algebraic, d->condvars, d->failInfo);
+  if (d->failInfo->failtype != 0)
+    return d->failInfo->failtype;
+
+  d->ComputeJacobian(t, c_j, d->constants, rates, d->oldrates, states,
+                     d->oldstates, d->algebraic, d->condvars, Jac->cols,
+                     d->failInfo);
+  return d->failInfo->failtype;
+}
+
+static int
+ida_colouredjacfn(long int N, double t, double c_j, N_Vector yy, N_Vector yp,
+                  N_Vector resval, DlsMat Jac, void* userdata, N_Vector tmp1,
+                  N_Vector tmp2, N_Vector tmp3)
+{
+  DAEEvaluationInformation * d = reinterpret_cast<DAEEvaluationInformation*>(userdata);
+
+  // Perturbing state j by h moves rate j by c_j * h, as IDA's own difference
+  // quotients do.
+  IDAGetErrWeights(d->solver, tmp1);
+  return d->colouredJacobian->compute
+    (EvaluateResidualsIDA, d, t, N_VGetArrayPointer(yy), N_VGetArrayPointer(yp),
+     c_j, N_VGetArrayPointer(resval), N_VGetArrayPointer(tmp1), Jac->data, 1,
+     Jac->ldim);
+}
+
 static int
 ida_rootfn(double t, N_Vector y, N_Vector yp, double *gout, void *userdata)
 {
@@ -1202,6 +1735,11 @@ CDA_DAESolverRun::SolveDAEProblem
 )
 {
   struct fail_info failInfo;
+  failInfo.statistics = &mStatistics;
+  failInfo.distributionTables = &mModel->mDistributionTables;
+  failInfo.cacheIntegrals = mCacheDefiniteIntegrals;
+  setupNonlinearSolverThreading(failInfo, constSize, rateSize, stateSize,
+                                algSize);
   double* icinfo = new double[stateSize];
   N_Vector params = N_VNew_Serial(stateSize);
   N_Vector ones = N_VNew_Serial(stateSize);
@@ -1210,24 +1748,52 @@ CDA_DAESolverRun::SolveDAEProblem
 
   MersenneTwister searchRandom(RANDOM_SEED);
 
-  void* idamem = IDACreate();
   double voi = mStartBvar;
 
-  uint32_t recsize = rateSize * 2 + algSize + 1;
-  uint32_t storageCapacity = (VARIABLE_STORAGE_LIMIT / recsize) * recsize;
-  double* storage = new double[storageCapacity];
-  uint32_t storageExpiry = time(0) + VARIABLE_TIME_LIMIT;
-  uint32_t storageSize = 0;
+  // Ensemble members already run on a worker thread and their observer just
+  // gathers results, so they deliver them directly.
+  ResultStream stream(mObserver, outputRecordSize(rateSize, algSize),
+                      mResultBatching, mExternalCancel == NULL);
   N_Vector y0 = NULL, dy0 = NULL;
+  void* idamem = NULL;
+  SolverSession* session = NULL;
+  iface::cellml_services::LinearSolverType linearSolver =
+    mModel->chooseLinearSolver(mLinearSolverType, stateSize);
+  SolverCounts counts(true, true, linearSolver);
+  // Whether idamem has been (re)initialised for this run yet.
+  bool idaStarted = false;
 
   if (rateSize != 0)
   {
-    y0 = N_VMake_Serial(stateSize, states);
-    dy0 = N_VMake_Serial(rateSize, rates);
+    session = mModel->mSolverSessions.checkOut
+      (true, mStepType, linearSolver, stateSize, voi, states, constants,
+       constSize, mEpsRel, mEpsAbs);
+    if (session->mY == NULL)
+    {
+      session->mY = N_VMake_Serial(stateSize, states);
+      session->mYP = N_VMake_Serial(rateSize, rates);
+    }
+    else
+    {
+      N_VSetArrayPointer_Serial(states, session->mY);
+      N_VSetArrayPointer_Serial(rates, session->mYP);
+    }
+    y0 = session->mY;
+    dy0 = session->mYP;
+    idamem = session->mSolver;
   }
 
   DAEEvaluationInformation ei;
 
+  // As for CVODE, IDA's band solver already groups its difference quotients.
+  ColouredJacobian colouredJacobian(mModel->mJacobianColouring);
+  bool useColouredJacobian = f->ComputeJacobian == NULL &&
+    mModel->mJacobianColouring.size() == stateSize &&
+    mModel->mJacobianColouring.colourCount() < stateSize;
+  ei.colouredJacobian = &colouredJacobian;
+  ei.solver = idamem;
+  counts.countExtraEvaluations(&colouredJacobian.mEvaluations);
+
   ei.failInfo = &failInfo;
   ei.constants = constants;
   ei.states = states;
@@ -1238,9 +1804,11 @@ CDA_DAESolverRun::SolveDAEProblem
   ei.ComputeRootInformation = f->ComputeRootInformation;
   ei.EvaluateEssentialVariables = f->EvaluateEssentialVariables;
   ei.EvaluateVariables = f->EvaluateVariables;
+  ei.ComputeJacobian = f->ComputeJacobian;
   ei.oldrates = new double[rateSize];
   ei.oldstates = new double[stateSize];
   ei.condVarSize = condVarSize;
+  ei.stateSize = stateSize;
   memcpy(ei.oldrates, rates, rateSize * sizeof(double));
   memcpy(ei.oldstates, states, stateSize * sizeof(double));
 
@@ -1279,6 +1847,7 @@ CDA_DAESolverRun::SolveDAEProblem
   double minReportForDensity = (mStopBvar - mStartBvar) / mMaxPointDensity;
   uint32_t tabStepNumber = 0;
   double nextStopPoint = mTabulationStepSize == 0.0 ? mStopBvar : voi;
+  bool interpolate = mInterpolateTabulation && mTabulationStepSize != 0.0;
 
   if (rateSize > 0)
   {
@@ -1287,14 +1856,16 @@ CDA_DAESolverRun::SolveDAEProblem
     {
       restart = false;
       
+      // Finding the sensitivities evaluates the conditions again, so only
+      // push those sitting on a root to its far side afterwards.
       f->ComputeRootInformation(voi, constants, rates, ei.oldrates, states, ei.oldstates,
                                 algebraic, condvars, &failInfo);
+      DetermineRateOrStateSensitivity(hx, stateSize, &ivf);
       for (uint32_t i = 0; i < condVarSize; i++)
       {
         if (condvars[i] == 0 && roots[i] != 0)
           condvars[i] = roots[i] * 1E-100;
       }
-      DetermineRateOrStateSensitivity(hx, stateSize, &ivf);
       // printf("Just determined sensitivity array:\n");
       // for (uint32_t i = 0; i < stateSize; i++)
       //   printf("  sens[%u] = %g\n", i, icinfo[i]);
@@ -1338,9 +1909,6 @@ CDA_DAESolverRun::SolveDAEProblem
         failInfo.failtype = lastKINFail.failtype;
         failInfo.failmsg = lastKINFail.failmsg;
         failAddCause(&failInfo, "Could not find a starting point where the initial value solver converges");
-
-        // Apparently IDAFree after IDACreate but before IDAInit fails, so lets IDAInit...
-        IDAInit(idamem, ida_resfn, /* t0 = */voi, y0, dy0);
         break;
       }
         
@@ -1349,22 +1917,58 @@ CDA_DAESolverRun::SolveDAEProblem
       
       f->ComputeRootInformation(voi, constants, rates, ei.oldrates, states, ei.oldstates,
                                 algebraic, condvars, &failInfo);
+      DetermineRateOrStateSensitivity(hx, stateSize, &ivf);
       for (uint32_t i = 0; i < condVarSize; i++)
       {
         if (condvars[i] == 0 && roots[i] != 0)
           condvars[i] = roots[i] * 1E-100;
       }
-      DetermineRateOrStateSensitivity(hx, stateSize, &ivf);
 
-      IDAInit(idamem, ida_resfn, /* t0 = */voi, y0, dy0);
-      IDASetMaxConvFails(idamem, 100);
-      IDARootInit(idamem, condVarSize, ida_rootfn);
+      // Restarts, and runs given a session left by an earlier run, keep the
+      // solver's memory and linear solver and just reinitialise it.
+      if (idamem != NULL)
+      {
+        if (idaStarted)
+          counts.reinitialising(idamem);
+        IDASetErrHandlerFn(idamem, cda_ida_error_handler, &failInfo);
+        IDAReInit(idamem, /* t0 = */voi, y0, dy0);
+      }
+      else
+      {
+        idamem = session->mSolver = IDACreate();
+        IDASetErrHandlerFn(idamem, cda_ida_error_handler, &failInfo);
+        IDAInit(idamem, ida_resfn, /* t0 = */voi, y0, dy0);
+        IDASetMaxConvFails(idamem, 100);
+        IDARootInit(idamem, condVarSize, ida_rootfn);
+        long int mu = mModel->mJacobianUpperBandwidth,
+          ml = mModel->mJacobianLowerBandwidth;
+        switch (session->mLinearSolver)
+        {
+        case iface::cellml_services::LINEAR_SOLVER_BAND:
+          IDABand(idamem, stateSize, mu, ml);
+          break;
+        case iface::cellml_services::LINEAR_SOLVER_SPGMR:
+          mu = std::min(mu, (long int)KRYLOV_PRECONDITIONER_BANDWIDTH);
+          ml = std::min(ml, (long int)KRYLOV_PRECONDITIONER_BANDWIDTH);
+          IDASpgmr(idamem, 0);
+          IDABBDPrecInit(idamem, stateSize, mu, ml, mu, ml, 0.0,
+                         ida_bbd_localfn, NULL);
+          break;
+        case iface::cellml_services::LINEAR_SOLVER_DENSE:
+        default:
+          IDADense(idamem, stateSize);
+          if (f->ComputeJacobian != NULL)
+            IDADlsSetDenseJacFn(idamem, ida_jacfn);
+          else if (useColouredJacobian)
+            IDADlsSetDenseJacFn(idamem, ida_colouredjacfn);
+          break;
+        }
+      }
       IDASStolerances(idamem, mEpsRel, mEpsAbs);
-      // IDASpgmr(idamem, 0);
-      // IDASptfqmr(idamem, 0);
-      IDADense(idamem, stateSize);
-      IDASetErrHandlerFn(idamem, cda_ida_error_handler, &failInfo);
       IDASetUserData(idamem, &ei);
+      ei.solver = idamem;
+      IDASetMaxStep(idamem, interpolate ? mStepSizeMax : 0.0);
+      idaStarted = true;
 
       bool firstAfterRestart = true;
 
@@ -1375,14 +1979,10 @@ CDA_DAESolverRun::SolveDAEProblem
              floatsEqual(voi, nextStopPoint, tabulationRelativeTolerance) ||
              voi >= nextStopPoint || voi >= mStopBvar))
         {
-          f->EvaluateVariables(voi, constants, rates, states, algebraic, condvars, &failInfo);
-          storage[storageSize] = voi;
-          memcpy(storage + storageSize + 1, states, rateSize * sizeof(double));
-          memcpy(storage + storageSize + 1 + rateSize, rates,
-                 rateSize * sizeof(double));
-          memcpy(storage + storageSize + 1 + rateSize * 2, algebraic,
-                 algSize * sizeof(double));
-          storageSize += recsize;
+          evaluateOutputVariables(f, voi, constants, rates, states, algebraic,
+                                  condvars, &failInfo);
+          recordResult(stream, voi, states, rates, rateSize,
+                       algebraic, algSize);
           
           nextStopPoint = mTabulationStepSize == 0.0 ? mStopBvar :
             (mTabulationStepSize * ++tabStepNumber) + mStartBvar;
@@ -1393,14 +1993,18 @@ CDA_DAESolverRun::SolveDAEProblem
           break;
         
         double bhl = mStopBvar;
-        if (mStepSizeMax != 0.0 && bhl - voi > mStepSizeMax)
-          bhl = voi + mStepSizeMax;
-        if(bhl > nextStopPoint)
-          bhl = nextStopPoint;
+        if (!interpolate)
+        {
+          if (mStepSizeMax != 0.0 && bhl - voi > mStepSizeMax)
+            bhl = voi + mStepSizeMax;
+          if(bhl > nextStopPoint)
+            bhl = nextStopPoint;
+        }
         
         IDASetStopTime(idamem, bhl);
 
         int ret = IDASolve(idamem, bhl, &voi, y0, dy0, IDA_ONE_STEP);
+        counts.store(idamem, mStatistics);
 
         if (ret < 0)
         {
@@ -1411,6 +2015,7 @@ CDA_DAESolverRun::SolveDAEProblem
         if (ret == IDA_ROOT_RETURN)
         {
           // printf("Root hit at %g... restarting...\n",  voi);
+          mStatistics.rootsFound++;
           restart = true;
           ivf.voi0 = voi;
           IDAGetRootInfo(idamem, roots);
@@ -1421,6 +2026,43 @@ CDA_DAESolverRun::SolveDAEProblem
       
         if (checkPauseOrCancellation())
           break;
+
+        if (interpolate)
+        {
+          // Fill in the tabulation points this step went past from the
+          // interpolating polynomial. A point at a root is left for the
+          // restart to record, once the conditions have been switched.
+          bool tabulated = false;
+          while (nextStopPoint <= mStopBvar &&
+                 (nextStopPoint < voi ||
+                  floatsEqual(voi, nextStopPoint, tabulationRelativeTolerance)) &&
+                 !(restart &&
+                   floatsEqual(voi, nextStopPoint, tabulationRelativeTolerance)))
+          {
+            double tabVOI = std::min(nextStopPoint, voi);
+            IDAGetDky(idamem, tabVOI, 0, y0);
+            IDAGetDky(idamem, tabVOI, 1, dy0);
+            nextStopPoint = (mTabulationStepSize * ++tabStepNumber) + mStartBvar;
+            lastVOI = tabVOI;
+            tabulated = true;
+
+            evaluateOutputVariables(f, tabVOI, constants, rates, states,
+                                    algebraic, condvars, &failInfo);
+
+            recordResult(stream, tabVOI, states, rates, rateSize,
+                         algebraic, algSize);
+          }
+
+          // Put back the solution at the end of the step...
+          if (tabulated)
+          {
+            IDAGetDky(idamem, voi, 0, y0);
+            IDAGetDky(idamem, voi, 1, dy0);
+          }
+
+          if (mStrictTabulation || (tabulated && floatsEqual(voi, lastVOI, tabulationRelativeTolerance)))
+            continue;
+        }
       
         if (isFirst)
           isFirst = false;
@@ -1430,36 +2072,22 @@ CDA_DAESolverRun::SolveDAEProblem
         if(mStrictTabulation && !floatsEqual(voi, nextStopPoint, tabulationRelativeTolerance))
           continue;
       
-        if (voi==nextStopPoint)
+        // The restart records a point at the root itself.
+        if (voi==nextStopPoint && !restart)
           nextStopPoint = (mTabulationStepSize * ++tabStepNumber) + mStartBvar;
       
         lastVOI = voi;
       
-        f->EvaluateVariables(voi, constants, rates, states, algebraic, condvars, &failInfo);
-      
-        if (!restart)
-        {
-          // Add to storage...
-          storage[storageSize] = voi;
-          memcpy(storage + storageSize + 1, states, rateSize * sizeof(double));
-          memcpy(storage + storageSize + 1 + rateSize, rates,
-                 rateSize * sizeof(double));
-          memcpy(storage + storageSize + 1 + rateSize * 2, algebraic,
-                 algSize * sizeof(double));
-          storageSize += recsize;
-        }
-      
-        // Are we ready to send?
-        uint32_t timeNow = time(0);
-        if (timeNow >= storageExpiry || storageSize == storageCapacity)
+        // The restart finds its initial values from all the variables, so
+        // only cut down the work at points that are just being recorded.
+        if (restart)
+          f->EvaluateVariables(voi, constants, rates, states, algebraic, condvars, &failInfo);
+        else
         {
-          if (mObserver != NULL)
-          {
-            std::vector<double> resultsVector(storage, storage + storageSize);
-            mObserver->results(resultsVector);
-          }
-          storageExpiry = timeNow + VARIABLE_TIME_LIMIT;
-          storageSize = 0;
+          evaluateOutputVariables(f, voi, constants, rates, states, algebraic,
+                                  condvars, &failInfo);
+          recordResult(stream, voi, states, rates, rateSize,
+                       algebraic, algSize);
         }
       }
     }
@@ -1475,20 +2103,10 @@ CDA_DAESolverRun::SolveDAEProblem
   N_VDestroy(ones);
   N_VDestroy(params);
 
-  if (storageSize != 0 && mObserver != NULL)
-  {
-    std::vector<double> resultsVector(storage, storage + storageSize);
-    mObserver->results(resultsVector);
-  }
-
-  delete [] storage;
-
   if (rateSize != 0)
-  {
-    IDAFree(&idamem);
-    N_VDestroy(y0);
-    N_VDestroy(dy0);
-  }
+    mModel->mSolverSessions.checkIn(session);
+
+  finishStatistics(stream);
 
   if (mObserver != NULL)
   {
@@ -1499,84 +2117,167 @@ CDA_DAESolverRun::SolveDAEProblem
   }
 }
 
-int
-EvaluateDefintCVODE(double x, N_Vector varsV, N_Vector ratesV, void* params)
+static int
+EvaluateDefint(double x, double* aValue, void* aData)
 {
-  DefintInformation* ei = reinterpret_cast<DefintInformation*>(params);
+  DefintInformation* ei = reinterpret_cast<DefintInformation*>(aData);
   *(ei->var) = x;
-  *N_VGetArrayPointer_Serial(ratesV) = ei->f(ei->voi, ei->constants, ei->rates, ei->states,
-                                             ei->algebraic, ei->failInfo);
+  *aValue = ei->f(ei->voi, ei->constants, ei->rates, ei->states,
+                  ei->algebraic, ei->failInfo);
   return ei->failInfo->failtype;
 }
 
-struct EDoubleStruct {
-  EDoubleStruct(double aValue) : mValue(aValue) {}
+// Why the values computed by debug models are not finite. Errors are interned
+// as (cause, caused by) pairs, so the table only grows with the number of
+// distinct ways the model fails, not with how often it fails; the messages are
+// only put together when a failure is reported.
+class EDoubleErrors
+{
+public:
+  EDoubleErrors()
+  {
+    // Error zero is no error at all.
+    mCauses.push_back("");
+    mErrors.push_back(std::pair<uint32_t, uint32_t>(0, 0));
+  }
+
+  uint32_t
+  add(uint32_t aCausedBy, const std::string& aCause)
+  {
+    if (aCausedBy >= mErrors.size())
+      aCausedBy = 0;
 
-  EDouble addCause(const std::string& aCause) {
-    if (mWhyError == "")
-      mWhyError = aCause;
+    std::map<std::string, uint32_t>::iterator c = mCauseIds.find(aCause);
+    uint32_t cause;
+    if (c == mCauseIds.end())
+    {
+      cause = mCauses.size();
+      mCauses.push_back(aCause);
+      mCauseIds.insert(std::pair<std::string, uint32_t>(aCause, cause));
+    }
     else
-      mWhyError = aCause + ", caused by " + mWhyError;
-    return this;
+      cause = c->second;
+
+    std::pair<uint32_t, uint32_t> error(cause, aCausedBy);
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t>::iterator e =
+      mErrorIds.find(error);
+    if (e != mErrorIds.end())
+      return e->second;
+
+    uint32_t id = mErrors.size();
+    mErrors.push_back(error);
+    mErrorIds.insert(std::pair<std::pair<uint32_t, uint32_t>, uint32_t>
+                     (error, id));
+    return id;
   }
 
-  EDouble noError() {
-    mWhyError = "";
-    return this;
+  std::string
+  describe(uint32_t aError)
+  {
+    std::string why;
+    while (aError != 0 && aError < mErrors.size())
+    {
+      if (!why.empty())
+        why += ", caused by ";
+      why += mCauses[mErrors[aError].first];
+      aError = mErrors[aError].second;
+    }
+    return why;
   }
 
-  double mValue;
-  std::string mWhyError;
+private:
+  std::vector<std::string> mCauses;
+  std::map<std::string, uint32_t> mCauseIds;
+  std::vector<std::pair<uint32_t, uint32_t> > mErrors;
+  std::map<std::pair<uint32_t, uint32_t>, uint32_t> mErrorIds;
 };
 
-int
-EvaluateDefintDebugCVODE(double x, N_Vector varsV, N_Vector ratesV, void* params)
+static EDoubleErrors*
+GetEDoubleErrors(struct fail_info* aFail)
 {
-  DefintDebugInformation* ei = reinterpret_cast<DefintDebugInformation*>(params);
-  *(ei->var) = x;
-  EDouble v = ei->f(ei->voi, ei->constants, ei->rates, ei->states,
-                    ei->algebraic, ei->failInfo);
-  *N_VGetArrayPointer_Serial(ratesV) = v->mValue;
-  if (!cdamath::isfinite(v->mValue))
-  {
-    v->addCause("evaluating definite integral integrand");
-    setFailure(ei->failInfo, v->mWhyError.c_str(), 1);
-  }
-  delete v;
-  return ei->failInfo->failtype;
+  if (aFail->edoubleErrors == NULL)
+    aFail->edoubleErrors = new EDoubleErrors();
+  return aFail->edoubleErrors;
 }
 
-EDouble
-CreateEDouble(double aValue)
+unsigned int
+EDoubleCause(struct fail_info* aFail, unsigned int aCausedBy, const char* aCause)
 {
-  return new EDoubleStruct(aValue);
+  return GetEDoubleErrors(aFail)->add(aCausedBy, aCause);
 }
 
-double
-UseEDouble(EDouble aValue, struct fail_info* aFail, const char* aContext)
+void putIth(int i, std::ostream& aStr)
 {
-  if (!cdamath::isfinite(aValue->mValue))
+  aStr << i;
+  switch (i % 100)
   {
-    aValue->addCause(aContext);
-    setFailure(aFail, aValue->mWhyError.c_str(), -1);
+  case 11:
+  case 12:
+  case 13:
+    aStr << "th";
+    break;
+  default:
+    switch (i % 10)
+    {
+    case 1:
+      aStr << "st";
+      break;
+    case 2:
+      aStr << "nd";
+      break;
+    case 3:
+      aStr << "rd";
+      break;
+    default:
+      aStr << "th";
+      break;
+    }
   }
+}
 
-  double result = aValue->mValue;
+unsigned int
+EDoubleArgumentCause(struct fail_info* aFail, unsigned int aCausedBy,
+                     int aArgument, const char* aCause)
+{
+  std::stringstream ssCause;
+  ssCause << "the ";
+  putIth(aArgument, ssCause);
+  ssCause << " " << aCause;
+  return GetEDoubleErrors(aFail)->add(aCausedBy, ssCause.str());
+}
 
-  delete aValue;  
-  return result;
+void
+EDoubleFailure(struct fail_info* aFail, unsigned int aCausedBy, const char* aCause)
+{
+  EDoubleErrors* errors = GetEDoubleErrors(aFail);
+  setFailure(aFail, errors->describe(errors->add(aCausedBy, aCause)).c_str(),
+             -1);
 }
 
-void TryAssign(double* aDest, EDouble aValue, const char* aContext, struct fail_info* aFail)
+void
+EDoubleAssignFailure(struct fail_info* aFail, unsigned int aCausedBy,
+                     const char* aContext)
 {
-  if (!cdamath::isfinite(aValue->mValue))
+  EDoubleFailure(aFail, aCausedBy, (std::string("Computed value for ") +
+                                    aContext + " is not finite").c_str());
+}
+
+static int
+EvaluateDefintDebug(double x, double* aValue, void* aData)
+{
+  DefintDebugInformation* ei = reinterpret_cast<DefintDebugInformation*>(aData);
+  *(ei->var) = x;
+  EDouble v = ei->f(ei->voi, ei->constants, ei->rates, ei->states,
+                    ei->algebraic, ei->failInfo);
+  *aValue = v.value;
+  if (!cdamath::isfinite(v.value))
   {
-    aValue->addCause(std::string("Computed value for ") + aContext + " is not finite");
-    setFailure(aFail, aValue->mWhyError.c_str(), -1);
+    EDoubleErrors* errors = GetEDoubleErrors(ei->failInfo);
+    setFailure(ei->failInfo, errors->describe
+               (errors->add(v.error, "evaluating definite integral integrand")).c_str(),
+               1);
   }
-  
-  *aDest = aValue->mValue;
-  delete aValue;
+  return ei->failInfo->failtype;
 }
 
 void TryOverrideAssign(double* aDest, EDouble aValue, const char* aContext,
@@ -1592,14 +2293,7 @@ void TryOverrideAssign(double* aDest, EDouble aValue, const char* aContext,
     }
   }
 
-  if (!cdamath::isfinite(aValue->mValue))
-  {
-    aValue->addCause(std::string("Computed value for ") + aContext + " is not finite");
-    setFailure(aFail, aValue->mWhyError.c_str(), -1);
-  }
-  
-  *aDest = aValue->mValue;
-  delete aValue;
+  TryAssign(aDest, aValue, aContext, aFail);
 }
 
 void OverrideAssign(double* aDest, double aValue, struct Override* aOverride)
@@ -1616,1279 +2310,615 @@ void OverrideAssign(double* aDest, double aValue, struct Override* aOverride)
   *aDest = aValue;
 }
 
-void putIth(int i, std::ostream& aStr)
-{
-  aStr << i;
-  switch (i % 100)
-  {
-  case 1:
-    aStr << "th";
-    break;
-  default:
-    switch (i % 10)
-    {
-    case 1:
-      aStr << "st";
-      break;
-    case 2:
-      aStr << "nd";
-      break;
-    case 3:
-      aStr << "rd";
-      break;
-    default:
-      aStr << "th";
-      break;
-    }
-  }
-}
+// The operations below only look for a reason once their result has turned
+// out not to be finite, which keeps them cheap while the model is behaving.
 
-EDouble TryAbs(EDouble aInput)
+EDouble TryACos(EDouble aInput, struct fail_info* aFail)
 {
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("taking absolute of a non-finite number");
-  else
-    aInput->noError();
+  EDouble result = CreateEDouble(std::acos(aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-  aInput->mValue = std::abs(aInput->mValue);
-  return aInput;
+  if (!cdamath::isfinite(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "argument to arccos is not finite");
+  else if (aInput.value > 1.0)
+    result.error = EDoubleCause(aFail, 0, "argument to arccos is >1");
+  else if (aInput.value < -1.0)
+    result.error = EDoubleCause(aFail, 0, "argument to arccos is < -1");
+  return result;
 }
 
-EDouble TryAnd(int count, ...)
+EDouble TryACosh(EDouble aInput, struct fail_info* aFail)
 {
-  va_list val;
-  int badidx = -1;
-  EDouble badInput;
-  EDouble result = new EDoubleStruct(true);
-
-  va_start(val, count);
-  for (int i = 0; i < count; i++)
-  {
-    EDouble v = va_arg(val, EDouble);
-    if (!cdamath::isfinite(v->mValue))
-    {
-      if (badidx == -1)
-      {
-        badidx = i + 1;
-        badInput = v;
-      }
-      else
-        delete v;
-    }
-    else
-    {
-      result->mValue = ((result->mValue!=0.0) && (v->mValue != 0.0)) ? 1.0 : 0.0;
-      delete v;
-    }
-  }
-  va_end(val);
-
-  if (badidx != -1)
-  {
-    std::stringstream ssError;
-    ssError << "the ";
-    putIth(badidx, ssError);
-    ssError << " argument to an 'and' operation is not finite";
-    badInput->addCause(ssError.str());
-    result->mWhyError = badInput->mWhyError;
-    result->mValue =
-      std::numeric_limits<double>::quiet_NaN();
-    delete badInput;
-  }
+  EDouble result = CreateEDouble(cdamath::acosh(aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
+  if (!cdamath::isfinite(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "argument to arccosh is not finite");
+  else if (aInput.value < 1.0)
+    result.error = EDoubleCause(aFail, 0, "argument to arccosh is <1");
   return result;
 }
 
-EDouble TryACos(EDouble aInput)
+EDouble TryACot(EDouble aInput, struct fail_info* aFail)
 {
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("argument to arccos is not finite");
-  else if (aInput->mValue > 1.0)
-    aInput->noError()->addCause("argument to arccos is >1");
-  else if (aInput->mValue < -1.0)
-    aInput->noError()->addCause("argument to arccos is < -1");
-
-  aInput->mValue = std::acos(aInput->mValue);
-  return aInput;
+  // Note: acot(0) = pi/2, it isn't an error.
+  EDouble result = CreateEDouble(std::atan(1.0 / aInput.value));
+  if (cdamath::isnan(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "argument to arccot is NaN");
+  return result;
 }
 
-EDouble TryACosh(EDouble aInput)
+EDouble TryACoth(EDouble aInput, struct fail_info* aFail)
 {
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("argument to arccosh is not finite");
-  else if (aInput->mValue < 1.0)
-    aInput->noError()->addCause("argument to arccosh is <1");
-  else
-    aInput->noError();
+  EDouble result = CreateEDouble(cdamath::atanh(1.0 / aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-  aInput->mValue = cdamath::acosh(aInput->mValue);
-  return aInput;
+  if (cdamath::isnan(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to arccoth is not finite");
+  else if (aInput.value == 0.0)
+    result.error = EDoubleCause(aFail, 0, "input to arccoth is zero");
+  else if (aInput.value > -1.0 && aInput.value < 1.0)
+    result.error = EDoubleCause(aFail, 0, "input to arccoth is in (-1.0, 1.0)");
+  return result;
 }
 
-EDouble TryACot(EDouble aInput)
+EDouble TryACsc(EDouble aInput, struct fail_info* aFail)
 {
-  if (cdamath::isnan(aInput->mValue))
-    aInput->addCause("argument to arccot is NaN");
-  else
-    aInput->noError();
+  EDouble result = CreateEDouble(std::asin(1.0 / aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-  // Note: acot(0) = pi/2, it isn't an error.
-  aInput->mValue = std::atan(1.0/aInput->mValue);
-  return aInput;
+  if (cdamath::isnan(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to arccosec is NaN");
+  else if (aInput.value > -1.0 && aInput.value < 1.0)
+    result.error = EDoubleCause(aFail, 0, "input to arccosec is in (-1.0, 1.0)");
+  return result;
 }
 
-EDouble TryACoth(EDouble aInput)
+EDouble TryACsch(EDouble aInput, struct fail_info* aFail)
 {
-  if (cdamath::isnan(aInput->mValue))
-    aInput->addCause("input to arccoth is not finite");
-  else if (aInput->mValue == 0.0)
-    aInput->noError()->addCause("input to arccoth is zero");
-  else
-    aInput->noError();
+  EDouble result = CreateEDouble(cdamath::asinh(1.0 / aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-  aInput->mValue = cdamath::atanh(1.0/aInput->mValue);
-  return aInput;
+  if (cdamath::isnan(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to arccosech is NaN");
+  else
+    result.error = EDoubleCause(aFail, 0, "input to arccosech is too close to zero - would overflow");
+  return result;
 }
 
-EDouble TryACsc(EDouble aInput)
+EDouble TryASec(EDouble aInput, struct fail_info* aFail)
 {
-  if (cdamath::isnan(aInput->mValue))
-    aInput->addCause("input to arccosec is NaN");
-  else if (aInput->mValue > -1.0 && aInput->mValue < 1.0)
-    aInput->noError()->addCause("input to arccosec is in (-1.0, 1.0)");
+  EDouble result = CreateEDouble(std::acos(1.0 / aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-  aInput->mValue = std::asin(1.0/aInput->mValue);
-  return aInput;
+  if (cdamath::isnan(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to arcsec is NaN");
+  else if (aInput.value > -1.0 && aInput.value < 1.0)
+    result.error = EDoubleCause(aFail, 0, "input to arcsec is in (-1.0, 1.0)");
+  return result;
 }
 
-EDouble TryACsch(EDouble aInput)
+EDouble TryASech(EDouble aInput, struct fail_info* aFail)
 {
-  if (cdamath::isnan(aInput->mValue))
-    aInput->addCause("input to arccosech is NaN");
-  else if (aInput->mValue > -1.488E-8 && aInput->mValue < 7.459E-155)
-    aInput->noError()->addCause("input to arccosech is too close to zero - would overflow");
-  else
-    aInput->noError();
-
-  aInput->mValue = cdamath::asinh(1.0/aInput->mValue);
-  return aInput;
-}
+  EDouble result = CreateEDouble(cdamath::acosh(1.0 / aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-EDouble TryASec(EDouble aInput)
-{
-  if (!cdamath::isnan(aInput->mValue))
-    aInput->addCause("input to arcsec is NaN");
-  else if (aInput->mValue > -1.0 && aInput->mValue < 1.0)
-    aInput->noError()->addCause("input to arcsec is in (-1.0, 1.0)");
+  if (!cdamath::isfinite(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to arcsech is not finite");
+  else if (aInput.value > 1.0)
+    result.error = EDoubleCause(aFail, 0, "input to arcsech is >1");
+  else if (aInput.value <= 0.0)
+    result.error = EDoubleCause(aFail, 0, "input to arcsech is <= 0");
   else
-    aInput->noError();
-
-  aInput->mValue = std::acos(1.0/aInput->mValue);
-  return aInput;
+    result.error = EDoubleCause(aFail, 0, "input to arcsech too close to zero so function will overflow");
+  return result;
 }
 
-EDouble TryASech(EDouble aInput)
+EDouble TryASin(EDouble aInput, struct fail_info* aFail)
 {
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to arcsech is not finite");
-  else if (aInput->mValue > 1)
-    aInput->noError()->addCause("input to arcsech is >1");
-  else if (aInput->mValue <= 0)
-    aInput->noError()->addCause("input to arcsech is <= 0");
-  else if (aInput->mValue < 1.113E-308)
-    aInput->noError()->addCause("input to arcsech too close to zero so function will overflow");
-  else
-    aInput->noError();
+  EDouble result = CreateEDouble(std::asin(aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-  aInput->mValue = cdamath::acosh(1.0 / aInput->mValue);
-  return aInput;
+  if (!cdamath::isfinite(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to asin is not finite.");
+  else if (aInput.value > 1.0 || aInput.value < -1.0)
+    result.error = EDoubleCause(aFail, 0, "input to asin lies out [-1.0, 1.0]");
+  return result;
 }
 
-EDouble TryASin(EDouble aInput)
+EDouble TryASinh(EDouble aInput, struct fail_info* aFail)
 {
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to asin is not finite.");
-  else if (aInput->mValue > 1.0 || aInput->mValue < -1.0)
-    aInput->noError()->addCause("input to asin lies out [-1.0, 1.0]");
-  else
-    aInput->noError();
-
-  aInput->mValue = std::asin(aInput->mValue);
-  return aInput;
-}
+  EDouble result = CreateEDouble(cdamath::asinh(aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-EDouble TryASinh(EDouble aInput)
-{
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to asinh is not finite");
-  else if (aInput->mValue < -6.710E7)
-    aInput->noError()->addCause("input to asinh is too small, causing output to overflow");
-  else if (aInput->mValue > 1.340E154)
-    aInput->noError()->addCause("input to asinh is too large, causing output to overflow");
+  if (!cdamath::isfinite(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to asinh is not finite");
+  else if (aInput.value < 0.0)
+    result.error = EDoubleCause(aFail, 0, "input to asinh is too small, causing output to overflow");
   else
-    aInput->noError();
-
-  aInput->mValue = cdamath::asinh(aInput->mValue);
-  return aInput;
+    result.error = EDoubleCause(aFail, 0, "input to asinh is too large, causing output to overflow");
+  return result;
 }
 
-EDouble TryATan(EDouble aInput)
+EDouble TryATan(EDouble aInput, struct fail_info* aFail)
 {
-  if (cdamath::isnan(aInput->mValue))
-    aInput->addCause("input to atan is notanumber");
-  else
-    aInput->noError();
-  
-  aInput->mValue = std::atan(aInput->mValue);
-  return aInput;
+  EDouble result = CreateEDouble(std::atan(aInput.value));
+  if (cdamath::isnan(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to atan is notanumber");
+  return result;
 }
 
-EDouble TryATanh(EDouble aInput)
+EDouble TryATanh(EDouble aInput, struct fail_info* aFail)
 {
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to atanh is not finite");
-  else if (aInput->mValue <= -1.0)
-    aInput->noError()->addCause("input to atanh is <= -1.0");
-  else if (aInput->mValue >= 1.0)
-    aInput->noError()->addCause("input to atanh is >= 1.0");
-  else
-    aInput->noError();
+  EDouble result = CreateEDouble(cdamath::atanh(aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-  aInput->mValue = std::atan(aInput->mValue);
-  return aInput;
+  if (!cdamath::isfinite(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to atanh is not finite");
+  else if (aInput.value <= -1.0)
+    result.error = EDoubleCause(aFail, 0, "input to atanh is <= -1.0");
+  else if (aInput.value >= 1.0)
+    result.error = EDoubleCause(aFail, 0, "input to atanh is >= 1.0");
+  return result;
 }
 
-EDouble TryCeil(EDouble aInput)
+EDouble TryCeil(EDouble aInput, struct fail_info* aFail)
 {
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to ceil is not finite.");
-  else
-    aInput->noError();
-
-  aInput->mValue = std::ceil(aInput->mValue);
+  if (!cdamath::isfinite(aInput.value))
+    aInput.error = EDoubleCause(aFail, aInput.error, "input to ceil is not finite.");
+  aInput.value = std::ceil(aInput.value);
   return aInput;
 }
 
-EDouble TryCos(EDouble aInput)
+EDouble TryCos(EDouble aInput, struct fail_info* aFail)
 {
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to cos is not finite.");
-  else
-    aInput->noError();
-
-  aInput->mValue = std::cos(aInput->mValue);
+  if (!cdamath::isfinite(aInput.value))
+    aInput.error = EDoubleCause(aFail, aInput.error, "input to cos is not finite.");
+  aInput.value = std::cos(aInput.value);
   return aInput;
 }
 
-EDouble TryCosh(EDouble aInput)
+EDouble TryCosh(EDouble aInput, struct fail_info* aFail)
 {
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to cosh is not finite.");
-  else if (aInput->mValue > 710.0)
-    aInput->noError()->addCause("input to cosh is too large, output would overflow.");
-  else if (aInput->mValue < -710.0)
-    aInput->noError()->addCause("input to cosh is too small, output would overflow.");
-  else
-    aInput->noError();
+  EDouble result = CreateEDouble(std::cosh(aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-  aInput->mValue = std::cosh(aInput->mValue);
-  return aInput;
-}
-
-#define PI 3.141592653589793
-
-EDouble TryCot(EDouble aInput)
-{
-  double normInput = aInput->mValue - floor(aInput->mValue / PI) * PI;
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to cot is not finite.");
-  else if (normInput == 0)
-    aInput->noError()->addCause("input to cot is a multiple of pi");
+  if (!cdamath::isfinite(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to cosh is not finite.");
+  else if (aInput.value > 0.0)
+    result.error = EDoubleCause(aFail, 0, "input to cosh is too large, output would overflow.");
   else
-    aInput->noError();
-
-  aInput->mValue = 1.0/std::tan(aInput->mValue);
-  return aInput;
+    result.error = EDoubleCause(aFail, 0, "input to cosh is too small, output would overflow.");
+  return result;
 }
 
-EDouble TryCoth(EDouble aInput)
+EDouble TryCot(EDouble aInput, struct fail_info* aFail)
 {
-  if (cdamath::isnan(aInput->mValue))
-    aInput->addCause("input to coth is not a number");
-  else if (aInput->mValue > -5.563E-309 && aInput->mValue < 5.563E-309)
-    aInput->noError()->
-      addCause("input to coth is too close to zero so output would overflow");
-  else
-    aInput->noError();
-
-  aInput->mValue = 1.0/std::tanh(aInput->mValue);
-  return aInput;
-}
+  EDouble result = CreateEDouble(1.0 / std::tan(aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-EDouble TryCsc(EDouble aInput)
-{
-  double normInput = aInput->mValue - floor(aInput->mValue / PI) * PI;
-  if (cdamath::isnan(aInput->mValue))
-    aInput->addCause("input to cosec is not a number");
-  else if (normInput == 0)
-    aInput->noError()->addCause("input to cosec is multiple of pi");
+  if (!cdamath::isfinite(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to cot is not finite.");
   else
-    aInput->noError();
-
-  aInput->mValue = 1.0 / std::sin(aInput->mValue);
-  return aInput;
+    result.error = EDoubleCause(aFail, 0, "input to cot is a multiple of pi");
+  return result;
 }
 
-EDouble TryCsch(EDouble aInput)
+EDouble TryCoth(EDouble aInput, struct fail_info* aFail)
 {
-  if (cdamath::isnan(aInput->mValue))
-    aInput->addCause("input to cosech is not a number");
-  else if (aInput->mValue > -5.563E-309 &&
-           aInput->mValue < 5.563E-309)
-    aInput->noError()->addCause("input to cosech is too close to zero, would overflow");
-  else
-    aInput->noError();
-
-  aInput->mValue = 1.0 / cdamath::asinh(aInput->mValue);
-  return aInput;
-}
+  EDouble result = CreateEDouble(1.0 / std::tanh(aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-EDouble TryDivide(EDouble aInput1, EDouble aInput2)
-{
-  double rawresult = aInput1->mValue / aInput2->mValue;
-  if (!cdamath::isfinite(aInput1->mValue))
-    aInput1->addCause("numerator to divide is not finite");
-  else if (!cdamath::isfinite(aInput2->mValue))
-  {
-    aInput2->addCause("denominator to divide is not finite");
-    aInput1->mWhyError = aInput2->mWhyError;
-  }
-  else if (aInput2->mValue == 0.0)
-  {
-    aInput1->mWhyError = aInput2->mWhyError;
-    aInput1->addCause("division by zero");
-  }
-  else if (rawresult == 0.0 && aInput1->mValue != 0.0)
-    aInput1->addCause("result of divide was underflow");
-  else if (!cdamath::isfinite(rawresult))
-    aInput1->addCause("result of divide was overflow");
+  if (cdamath::isnan(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to coth is not a number");
   else
-    aInput1->noError();
-
-  delete aInput2;
-
-  aInput1->mValue = rawresult;
-  return aInput1;
+    result.error = EDoubleCause(aFail, 0, "input to coth is too close to zero so output would overflow");
+  return result;
 }
 
-EDouble TryEq(int count, ...)
+EDouble TryCsc(EDouble aInput, struct fail_info* aFail)
 {
-  EDouble result = new EDoubleStruct(1.0);
-  double allEqualTo;
-
-  va_list val;
-
-  va_start(val, count);
-  for (int i = 0; i < count; i++)
-  {
-    EDouble eval = va_arg(val, EDouble);
-    if (i != 0 && eval->mValue != allEqualTo)
-      result->mValue = 0.0;
-    else if (i == 0)
-      allEqualTo = eval->mValue;
-    if (cdamath::isnan(eval->mValue))
-    {
-      result->mWhyError = eval->mWhyError;
-      std::stringstream ssCause;
-      ssCause << "the ";
-      putIth(i + 1, ssCause);
-      ssCause << " argument to equals is not a number";
-      result->addCause(ssCause.str());
-      result->mValue = eval->mValue;
-    }
-    delete eval;
-  }
-
-  va_end(val);
+  EDouble result = CreateEDouble(1.0 / std::sin(aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
+  if (!cdamath::isfinite(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to cosec is not finite");
+  else
+    result.error = EDoubleCause(aFail, 0, "input to cosec is multiple of pi");
   return result;
 }
 
-EDouble TryExp(EDouble aInput)
+EDouble TryCsch(EDouble aInput, struct fail_info* aFail)
 {
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to exp is not finite");
-  else if (aInput->mValue > 7.097E2)
-    aInput->noError()->addCause("input to exp is too big (overflow)");
-  else
-    aInput->noError();
-
-  aInput->mValue = std::exp(aInput->mValue);
-  return aInput;
-}
+  EDouble result = CreateEDouble(1.0 / std::sinh(aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-EDouble TryFactorial(EDouble aInput)
-{
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to factorial is not finite");
-  else if (aInput->mValue > 170.6)
-    aInput->noError()->addCause("input to factorial is too big (overflow)");
+  if (cdamath::isnan(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to cosech is not a number");
   else
-    aInput->noError();
-
-  aInput->mValue = factorial(aInput->mValue);
-  return aInput;
+    result.error = EDoubleCause(aFail, 0, "input to cosech is too close to zero, would overflow");
+  return result;
 }
 
-EDouble TryFactorOf(EDouble aInput1, EDouble aInput2)
+EDouble TryExp(EDouble aInput, struct fail_info* aFail)
 {
-  if (!cdamath::isfinite(aInput2->mValue))
-    aInput2->addCause("numerator to factorof is not finite");
-  else if (!cdamath::isfinite(aInput1->mValue))
-  {
-    aInput2->mWhyError = aInput1->mWhyError;
-    aInput2->addCause("denominator to factorof is not finite");
-  }
-  else if (aInput1->mValue == 0.0)
-  {
-    aInput2->mWhyError = aInput1->mWhyError;
-    aInput2->addCause("attempt to use factorof with a denominator of zero");
-  }
-
-  double divResult = aInput2->mValue / aInput1->mValue;
-  aInput2->mValue = divResult == std::floor(divResult);
-  delete aInput1;
-
-  return aInput2;
-}
+  EDouble result = CreateEDouble(std::exp(aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-EDouble TryFloor(EDouble aInput)
-{
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to floor is not finite");
+  if (!cdamath::isfinite(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to exp is not finite");
   else
-    aInput->noError();
-
-  aInput->mValue = std::floor(aInput->mValue);
-  return aInput;
+    result.error = EDoubleCause(aFail, 0, "input to exp is too big (overflow)");
+  return result;
 }
 
-EDouble TryGCD(int count, ...)
+EDouble TryFactorial(EDouble aInput, struct fail_info* aFail)
 {
-  if (count == 0)
-    return new EDoubleStruct(1.0);
-
-  va_list parameters;
+  EDouble result = CreateEDouble(factorial(aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-  va_start(parameters, count);
-  EDouble res = va_arg(parameters, EDouble);
-  if (!cdamath::isfinite(res->mValue))
-    res->addCause("input to GCD is not finite");
+  if (!cdamath::isfinite(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to factorial is not finite");
   else
-    res->noError();
-
-  while (--count)
-  {
-    EDouble newRes = va_arg(parameters, EDouble);
-    if (!cdamath::isfinite(newRes->mValue) && res->mWhyError == "")
-    {
-      res->mWhyError = newRes->mWhyError;
-      res->addCause("input to GCD is not finite");
-    }
-    res->mValue = gcd_pair(res->mValue, newRes->mValue);
-    delete newRes;
-  }
-
-  va_end(parameters);
-  return res;
+    result.error = EDoubleCause(aFail, 0, "input to factorial is too big (overflow)");
+  return result;
 }
 
-EDouble TryGeq(int count, ...)
+EDouble TryFactorOf(EDouble aInput1, EDouble aInput2, struct fail_info* aFail)
 {
-  EDouble result = new EDoubleStruct(1.0);
-  double allGt;
-
-  va_list val;
-
-  va_start(val, count);
-  for (int i = 0; i < count; i++)
+  EDouble result = CreateEDouble(0.0);
+  if (!cdamath::isfinite(aInput2.value))
   {
-    EDouble eval = va_arg(val, EDouble);
-    if (i != 0 && allGt < eval->mValue)
-      result->mValue = 0.0;
-    allGt = eval->mValue;
-    if (cdamath::isnan(eval->mValue))
-    {
-      result->mWhyError = eval->mWhyError;
-      std::stringstream ssCause;
-      ssCause << "the ";
-      putIth(i + 1, ssCause);
-      ssCause << " argument to geq is not a number";
-      result->addCause(ssCause.str());
-      result->mValue = eval->mValue;
-    }
-    delete eval;
+    result.value = aInput2.value;
+    result.error = EDoubleCause(aFail, aInput2.error, "numerator to factorof is not finite");
   }
-
-  va_end(val);
-
-  return result;
-}
-
-EDouble TryGt(int count, ...)
-{
-  EDouble result = new EDoubleStruct(1.0);
-  double allGt;
-
-  va_list val;
-
-  va_start(val, count);
-  for (int i = 0; i < count; i++)
+  else if (!cdamath::isfinite(aInput1.value))
   {
-    EDouble eval = va_arg(val, EDouble);
-    if (i != 0 && allGt <= eval->mValue)
-      result->mValue = 0.0;
-    allGt = eval->mValue;
-    if (cdamath::isnan(eval->mValue))
-    {
-      result->mWhyError = eval->mWhyError;
-      std::stringstream ssCause;
-      ssCause << "the ";
-      putIth(i + 1, ssCause);
-      ssCause << " argument to gt is not a number";
-      result->addCause(ssCause.str());
-      result->mValue = eval->mValue;
-    }
-    delete eval;
+    result.value = aInput1.value;
+    result.error = EDoubleCause(aFail, aInput1.error, "denominator to factorof is not finite");
   }
-
-  va_end(val);
-
-  return result;
-}
-
-EDouble TryImplies(EDouble aInput1, EDouble aInput2)
-{
-  if (!cdamath::isfinite(aInput1->mValue))
-    aInput1->addCause("first input to implies is not finite");
-  else if (!cdamath::isfinite(aInput2->mValue))
-    aInput1->addCause("second input to implies is not finite");
-    
-  aInput1->mValue =
-    ((aInput1->mValue == 0.0) || (aInput2->mValue != 0.0)) ? 1.0 : 0.0;
-
-  delete aInput2;
-  return aInput1;
-}
-
-EDouble TryLCM(int count, ...)
-{
-  if (count == 0)
-    return new EDoubleStruct(1.0);
-
-  va_list parameters;
-
-  va_start(parameters, count);
-  EDouble res = va_arg(parameters, EDouble);
-  if (!cdamath::isfinite(res->mValue))
-    res->addCause("input to LCM is not finite");
-  else
-    res->noError();
-
-  while (--count)
+  else if (aInput1.value == 0.0)
   {
-    EDouble newRes = va_arg(parameters, EDouble);
-    if (!cdamath::isfinite(newRes->mValue) && res->mWhyError == "")
-    {
-      res->mWhyError = newRes->mWhyError;
-      res->addCause("input to LCM is not finite");
-    }
-    res->mValue = lcm_pair(res->mValue, newRes->mValue);
-    delete newRes;
+    result.value = std::numeric_limits<double>::quiet_NaN();
+    result.error = EDoubleCause(aFail, 0, "attempt to use factorof with a denominator of zero");
   }
-
-  va_end(parameters);
-  return res;
-}
-
-EDouble TryLeq(int count, ...)
-{
-  EDouble result = new EDoubleStruct(1.0);
-  double allGt;
-
-  va_list val;
-
-  va_start(val, count);
-  for (int i = 0; i < count; i++)
+  else
   {
-    EDouble eval = va_arg(val, EDouble);
-    if (i != 0 && allGt > eval->mValue)
-      result->mValue = 0.0;
-    allGt = eval->mValue;
-    if (cdamath::isnan(eval->mValue))
-    {
-      result->mWhyError = eval->mWhyError;
-      std::stringstream ssCause;
-      ssCause << "the ";
-      putIth(i + 1, ssCause);
-      ssCause << " argument to leq is not a number";
-      result->addCause(ssCause.str());
-      result->mValue = eval->mValue;
-    }
-    delete eval;
+    double divResult = aInput2.value / aInput1.value;
+    result.value = (divResult == std::floor(divResult)) ? 1.0 : 0.0;
   }
-
-  va_end(val);
-
   return result;
 }
 
-EDouble TryLn(EDouble aInput)
+EDouble TryFloor(EDouble aInput, struct fail_info* aFail)
 {
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to natural log is not finite");
-  else if (aInput->mValue <= 0)
-    aInput->addCause("input to natural log is not positive");
-  aInput->mValue = std::log(aInput->mValue);
+  if (!cdamath::isfinite(aInput.value))
+    aInput.error = EDoubleCause(aFail, aInput.error, "input to floor is not finite");
+  aInput.value = std::floor(aInput.value);
   return aInput;
 }
 
-EDouble TryLog(EDouble aInput1, EDouble aInput2)
+EDouble TryGCD(int aCount, const EDouble* aInputs, struct fail_info* aFail)
 {
-  if (!cdamath::isfinite(aInput1->mValue))
-    aInput1->addCause("input to log is not finite");
-  else if (!cdamath::isfinite(aInput2->mValue))
+  EDouble result = CreateEDouble(1.0);
+  for (int i = 0; i < aCount; i++)
   {
-    aInput1->mWhyError = aInput2->mWhyError;
-    aInput1->addCause("base to log is not finite");
-  }
-  else if (aInput1->mValue <= 0)
-    aInput1->noError()->addCause("input to natural log is not positive");
-  else if (aInput2->mValue <= 0)
-    aInput1->noError()->addCause("base to natural log is not positive");
-  
-  aInput1->mValue = std::log(aInput1->mValue) / std::log(aInput2->mValue);
-  delete aInput2;
-  return aInput1;
-}
-
-EDouble TryLt(int count, ...)
-{
-  EDouble result = new EDoubleStruct(1.0);
-  double allGt;
-
-  va_list val;
-
-  va_start(val, count);
-  for (int i = 0; i < count; i++)
-  {
-    EDouble eval = va_arg(val, EDouble);
-    if (i != 0 && allGt >= eval->mValue)
-      result->mValue = 0.0;
-    allGt = eval->mValue;
-    if (cdamath::isnan(eval->mValue))
+    if (!cdamath::isfinite(aInputs[i].value))
     {
-      result->mWhyError = eval->mWhyError;
-      std::stringstream ssCause;
-      ssCause << "the ";
-      putIth(i + 1, ssCause);
-      ssCause << " argument to lt is not a number";
-      result->addCause(ssCause.str());
-      result->mValue = eval->mValue;
+      result.value = aInputs[i].value;
+      result.error = EDoubleCause(aFail, aInputs[i].error, "input to GCD is not finite");
+      return result;
     }
-    delete eval;
+    result.value = (i == 0) ? aInputs[i].value : gcd_pair(result.value, aInputs[i].value);
   }
-
-  va_end(val);
-
   return result;
 }
 
-EDouble TryMax(int count, ...)
+EDouble TryLCM(int aCount, const EDouble* aInputs, struct fail_info* aFail)
 {
-  if (count == 0)
+  EDouble result = CreateEDouble(1.0);
+  for (int i = 0; i < aCount; i++)
   {
-    EDouble ret = new EDoubleStruct(strtod("NAN", NULL));
-    ret->addCause("maximum of zero expressions");
-    return ret;
-  }
-  bool hadErr = false;
-
-  va_list val;
-  va_start(val, count);
-  EDouble value = va_arg(val, EDouble);
-  if (cdamath::isnan(value->mValue))
-  {
-    value->addCause("first argument to max is not a number");
-    hadErr = true;
-  }
-  else if (cdamath::isinf(value->mValue) && value->mValue > 0)
-  {
-    value->addCause("first argument to max is +infinity");
-    hadErr = true;
-  }
-  
-  for (int i = 1; i < count; i++)
-  {
-    EDouble nextVal = va_arg(val, EDouble);
-    if (cdamath::isnan(nextVal->mValue) || (cdamath::isinf(nextVal->mValue) && nextVal->mValue > 0))
+    if (!cdamath::isfinite(aInputs[i].value))
     {
-      value->mValue = nextVal->mValue;
-      if (!hadErr)
-      {
-        value->mWhyError = nextVal->mWhyError;
-        std::stringstream ssError;
-        ssError << "the ";
-        putIth(i + 1, ssError);
-        ssError << " argument to max is ";
-        if (cdamath::isnan(nextVal->mValue))
-          ssError << "not a number";
-        else
-          ssError << "+infinity";
-        value->addCause(ssError.str());
-      }
+      result.value = aInputs[i].value;
+      result.error = EDoubleCause(aFail, aInputs[i].error, "input to LCM is not finite");
+      return result;
     }
-    else
-      value->mValue = (nextVal->mValue > value->mValue) ? nextVal->mValue : value->mValue;
-    delete nextVal;
+    result.value = (i == 0) ? aInputs[i].value : lcm_pair(result.value, aInputs[i].value);
   }
-
-  if (!hadErr && cdamath::isinf(value->mValue))
-    value->addCause("all arguments to max are negative infinity");
-  else
-    value->noError();
-
-  va_end(val);
-
-  return value;
+  return result;
 }
 
-EDouble TryMin(int count, ...)
+EDouble TryLn(EDouble aInput, struct fail_info* aFail)
 {
-  if (count == 0)
-  {
-    EDouble ret = new EDoubleStruct(strtod("NAN", NULL));
-    ret->addCause("maximum of zero expressions");
-    return ret;
-  }
-  bool hadErr = false;
+  EDouble result = CreateEDouble(std::log(aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-  va_list val;
-  va_start(val, count);
-  EDouble value = va_arg(val, EDouble);
-  if (cdamath::isnan(value->mValue))
-  {
-    value->addCause("first argument to min is not a number");
-    hadErr = true;
-  }
-  else if (cdamath::isinf(value->mValue) && value->mValue < 0)
-  {
-    value->addCause("first argument to min is negative infinity");
-    hadErr = true;
-  }
-  
-  for (int i = 1; i < count; i++)
-  {
-    EDouble nextVal = va_arg(val, EDouble);
-    if (cdamath::isnan(nextVal->mValue) || (cdamath::isinf(nextVal->mValue) && nextVal->mValue < 0))
-    {
-      value->mValue = nextVal->mValue;
-      if (!hadErr)
-      {
-        value->mWhyError = nextVal->mWhyError;
-        std::stringstream ssError;
-        ssError << "the ";
-        putIth(i + 1, ssError);
-        ssError << " argument to min is ";
-        if (cdamath::isnan(nextVal->mValue))
-          ssError << "not a number";
-        else
-          ssError << "+infinity";
-        value->addCause(ssError.str());
-      }
-    }
-    else
-      value->mValue = (nextVal->mValue < value->mValue) ? nextVal->mValue : value->mValue;
-    delete nextVal;
-  }
-
-  if (!hadErr && cdamath::isinf(value->mValue))
-    value->addCause("all arguments to min are +infinity");
+  if (!cdamath::isfinite(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to natural log is not finite");
   else
-    value->noError();
-
-  va_end(val);
-
-  return value;
-}
-
-EDouble TryMinus(EDouble aInput1, EDouble aInput2)
-{
-  double result = aInput1->mValue - aInput2->mValue;
-  if (!cdamath::isfinite(aInput1->mValue))
-    aInput1->addCause("the first operand to minus is not finite");
-  else if (!cdamath::isfinite(aInput2->mValue))
-  {
-    aInput1->mWhyError = aInput2->mWhyError;
-    aInput1->addCause("the second operand to minus is not finite");
-  }
-  else if (!cdamath::isfinite(result))
-    aInput1->noError()->addCause("an overflow in the result of minus");
-
-  aInput1->mValue = result;
-  delete aInput2;
-  return aInput1;
-}
-
-EDouble TryNeq(EDouble aInput1, EDouble aInput2)
-{
-  double result = (aInput1->mValue != aInput2->mValue) ? 1.0 : 0.0;
-
-  if (cdamath::isnan(aInput1->mValue))
-  {
-    aInput1->addCause("the first operand to neq is not a number");
-    result = aInput1->mValue;
-  }
-  else if (!cdamath::isnan(aInput2->mValue))
-  {
-    aInput1->mWhyError = aInput2->mWhyError;
-    aInput1->addCause("the second operand to neq is not a number");
-    result = aInput2->mValue;
-  }
-
-  aInput1->mValue = result;
-  delete aInput2;
-  return aInput1;
-}
-
-EDouble TryNot(EDouble aInput)
-{
-  double result = (aInput->mValue == 0.0) ? 1.0 : 0.0;
-
-  if (!cdamath::isfinite(aInput->mValue))
-  {
-    aInput->addCause("the operand to not is not finite");
-    result = aInput->mValue;
-  }
-
-  aInput->mValue = result;
-  return aInput;
+    result.error = EDoubleCause(aFail, 0, "input to natural log is not positive");
+  return result;
 }
 
-EDouble TryOr(int count, ...)
-{
-  va_list val;
-  int badidx = -1;
-  EDouble badInput;
-  EDouble result = new EDoubleStruct(0.0);
-
-  va_start(val, count);
-  for (int i = 0; i < count; i++)
-  {
-    EDouble v = va_arg(val, EDouble);
-    if (!cdamath::isfinite(v->mValue))
-    {
-      if (badidx == -1)
-      {
-        badidx = i + 1;
-        badInput = v;
-      }
-      else
-        delete v;
-    }
-    else
-    {
-      result->mValue = ((result->mValue!=0.0) || (v->mValue != 0.0)) ? 1.0 : 0.0;
-      delete v;
-    }
-  }
-  va_end(val);
-
-  if (badidx != -1)
-  {
-    std::stringstream ssError;
-    ssError << "the ";
-    putIth(badidx, ssError);
-    ssError << " argument to an 'or' operation is not finite";
-    badInput->addCause(ssError.str());
-    result->mWhyError = badInput->mWhyError;
-    result->mValue =
-      std::numeric_limits<double>::quiet_NaN();
-    delete badInput;
-  }
+EDouble TryLog(EDouble aInput1, EDouble aInput2, struct fail_info* aFail)
+{
+  EDouble result = CreateEDouble(std::log(aInput1.value) / std::log(aInput2.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
+  if (!cdamath::isfinite(aInput1.value))
+    result.error = EDoubleCause(aFail, aInput1.error, "input to log is not finite");
+  else if (!cdamath::isfinite(aInput2.value))
+    result.error = EDoubleCause(aFail, aInput2.error, "base to log is not finite");
+  else if (aInput1.value <= 0.0)
+    result.error = EDoubleCause(aFail, 0, "input to log is not positive");
+  else if (aInput2.value <= 0.0)
+    result.error = EDoubleCause(aFail, 0, "base to log is not positive");
+  else
+    result.error = EDoubleCause(aFail, 0, "base to log is one");
   return result;
 }
 
-EDouble TryPlus(int count, ...)
+EDouble TryMax(int aCount, const EDouble* aInputs, struct fail_info* aFail)
 {
-  va_list val;
-  int badidx = -1;
-  EDouble badInput;
-  EDouble result = new EDoubleStruct(0.0);
-
-  va_start(val, count);
-  for (int i = 0; i < count; i++)
+  EDouble result = CreateEDouble(std::numeric_limits<double>::quiet_NaN());
+  if (aCount == 0)
   {
-    EDouble v = va_arg(val, EDouble);
-    result->mValue += v->mValue;
-    if (!cdamath::isfinite(v->mValue))
-    {
-      if (badidx == -1)
-      {
-        badidx = i + 1;
-        badInput = v;
-      }
-      else
-        delete v;
-    }
-    else
-      delete v;
+    result.error = EDoubleCause(aFail, 0, "maximum of zero expressions");
+    return result;
   }
-  va_end(val);
 
-  if (badidx != -1)
+  for (int i = 0; i < aCount; i++)
   {
-    std::stringstream ssError;
-    ssError << "the ";
-    putIth(badidx, ssError);
-    ssError << " argument to a 'plus' operation is not finite";
-    badInput->addCause(ssError.str());
-    result->mWhyError = badInput->mWhyError;
-    delete badInput;
+    double v = aInputs[i].value;
+    if (cdamath::isnan(v) || (cdamath::isinf(v) && v > 0))
+    {
+      result.value = v;
+      result.error = EDoubleArgumentCause
+        (aFail, aInputs[i].error, i + 1, cdamath::isnan(v) ?
+         "argument to max is not a number" : "argument to max is +infinity");
+      return result;
+    }
+    if (i == 0 || v > result.value)
+      result.value = v;
   }
-  else if (!cdamath::isfinite(result->mValue))
-    result->noError()->addCause("plus operation overflowed");
 
+  if (cdamath::isinf(result.value))
+    result.error = EDoubleCause(aFail, 0, "all arguments to max are negative infinity");
   return result;
 }
 
-EDouble TryPower(EDouble aInput1, EDouble aInput2)
+EDouble TryMin(int aCount, const EDouble* aInputs, struct fail_info* aFail)
 {
-  double result = pow(aInput1->mValue, aInput2->mValue);
-  if (!cdamath::isfinite(aInput1->mValue))
-    aInput1->addCause("the first operand to power is not finite");
-  else if (!cdamath::isfinite(aInput2->mValue))
+  EDouble result = CreateEDouble(std::numeric_limits<double>::quiet_NaN());
+  if (aCount == 0)
   {
-    aInput1->mWhyError = aInput2->mWhyError;
-    aInput1->addCause("the second operand to power is not finite");
+    result.error = EDoubleCause(aFail, 0, "minimum of zero expressions");
+    return result;
   }
-  else if (!cdamath::isfinite(result))
-    aInput1->noError()->addCause("an overflow in the result of power");
-
-  aInput1->mValue = result;
-  delete aInput2;
-  return aInput1;
-}
 
-EDouble TryQuotient(EDouble aInput1, EDouble aInput2)
-{
-  double result = floor(aInput1->mValue / aInput2->mValue);
-  if (!cdamath::isfinite(aInput1->mValue))
-    aInput1->addCause("the first operand to quotient is not finite");
-  else if (!cdamath::isfinite(aInput2->mValue))
+  for (int i = 0; i < aCount; i++)
   {
-    aInput1->mWhyError = aInput2->mWhyError;
-    aInput1->addCause("the second operand to quotient is not finite");
+    double v = aInputs[i].value;
+    if (cdamath::isnan(v) || (cdamath::isinf(v) && v < 0))
+    {
+      result.value = v;
+      result.error = EDoubleArgumentCause
+        (aFail, aInputs[i].error, i + 1, cdamath::isnan(v) ?
+         "argument to min is not a number" : "argument to min is negative infinity");
+      return result;
+    }
+    if (i == 0 || v < result.value)
+      result.value = v;
   }
-  else if (aInput2->mValue == 0.0)
-    aInput1->noError()->addCause("the second operand to quotient is zero");
-  else if (!cdamath::isfinite(result))
-    aInput1->noError()->addCause("an overflow in the result of quotient");
 
-  aInput1->mValue = result;
-  delete aInput2;
-  return aInput1;
+  if (cdamath::isinf(result.value))
+    result.error = EDoubleCause(aFail, 0, "all arguments to min are +infinity");
+  return result;
 }
 
-EDouble TryRem(EDouble aInput1, EDouble aInput2)
+EDouble TryPower(EDouble aInput1, EDouble aInput2, struct fail_info* aFail)
 {
-  double quo = floor(aInput1->mValue / aInput2->mValue);
-  double result = aInput1->mValue - aInput2->mValue * quo;
-  if (!cdamath::isfinite(aInput1->mValue))
-    aInput1->addCause("the first operand to quotient is not finite");
-  else if (!cdamath::isfinite(aInput2->mValue))
-  {
-    aInput1->mWhyError = aInput2->mWhyError;
-    aInput1->addCause("the second operand to quotient is not finite");
-  }
-  else if (aInput2->mValue == 0.0)
-    aInput1->noError()->addCause("the second operand to quotient is zero");
-  else if (!cdamath::isfinite(result))
-    aInput1->noError()->addCause("an overflow in the result of quotient");
+  EDouble result = CreateEDouble(pow(aInput1.value, aInput2.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-  aInput1->mValue = result;
-  delete aInput2;
-  return aInput1;
+  if (!cdamath::isfinite(aInput1.value))
+    result.error = EDoubleCause(aFail, aInput1.error, "the first operand to power is not finite");
+  else if (!cdamath::isfinite(aInput2.value))
+    result.error = EDoubleCause(aFail, aInput2.error, "the second operand to power is not finite");
+  else if (aInput1.value < 0.0)
+    result.error = EDoubleCause(aFail, 0, "a negative number raised to a non-integer power");
+  else
+    result.error = EDoubleCause(aFail, 0, "an overflow in the result of power");
+  return result;
 }
 
-EDouble TryRoot(EDouble aInput1, EDouble aInput2)
+EDouble TryQuotient(EDouble aInput1, EDouble aInput2, struct fail_info* aFail)
 {
-  double result = pow(aInput1->mValue, 1.0 / aInput2->mValue);
-  if (!cdamath::isfinite(aInput1->mValue))
-    aInput1->addCause("the first operand to root is not finite");
-  else if (!cdamath::isfinite(aInput2->mValue))
-  {
-    aInput1->mWhyError = aInput2->mWhyError;
-    aInput1->addCause("the first operand to root is not finite");
-  }
-  else if (aInput1->mValue < 0.0)
-    aInput1->noError()->addCause("the first operand to root is negative");
-  else if (aInput2->mValue == 0.0)
-    aInput1->noError()->addCause("the second operand to root is zero");
-  else if (!cdamath::isfinite(result))
-    aInput1->noError()->addCause("the second operand to root is zero");
-  
-  delete aInput2;
-  aInput1->mValue = result;
-  return aInput1;
-}
+  EDouble result = CreateEDouble(floor(aInput1.value / aInput2.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-EDouble TrySec(EDouble aInput)
-{
-  double normInput = aInput->mValue - floor(aInput->mValue / PI) * PI;
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to sec is not finite");
-  else if (normInput == PI/2)
-    aInput->noError()->addCause("input to sec is equal to pi/2 + n*pi for some n");
+  if (!cdamath::isfinite(aInput1.value))
+    result.error = EDoubleCause(aFail, aInput1.error, "the first operand to quotient is not finite");
+  else if (!cdamath::isfinite(aInput2.value))
+    result.error = EDoubleCause(aFail, aInput2.error, "the second operand to quotient is not finite");
+  else if (aInput2.value == 0.0)
+    result.error = EDoubleCause(aFail, 0, "the second operand to quotient is zero");
   else
-    aInput->noError();
-
-  aInput->mValue = 1.0 / cos(aInput->mValue);
-  return aInput;
+    result.error = EDoubleCause(aFail, 0, "an overflow in the result of quotient");
+  return result;
 }
 
-EDouble TrySech(EDouble aInput)
+EDouble TryRem(EDouble aInput1, EDouble aInput2, struct fail_info* aFail)
 {
-  if (cdamath::isnan(aInput->mValue))
-    aInput->addCause("input to sech is not a number");
-  aInput->mValue = 1.0 / cosh(aInput->mValue);
-  return aInput;
-}
+  double quo = floor(aInput1.value / aInput2.value);
+  EDouble result = CreateEDouble(aInput1.value - aInput2.value * quo);
+  if (cdamath::isfinite(result.value))
+    return result;
 
-EDouble TrySin(EDouble aInput)
-{
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to sin is not finite");
+  if (!cdamath::isfinite(aInput1.value))
+    result.error = EDoubleCause(aFail, aInput1.error, "the first operand to rem is not finite");
+  else if (!cdamath::isfinite(aInput2.value))
+    result.error = EDoubleCause(aFail, aInput2.error, "the second operand to rem is not finite");
+  else if (aInput2.value == 0.0)
+    result.error = EDoubleCause(aFail, 0, "the second operand to rem is zero");
   else
-    aInput->noError();
-
-  aInput->mValue = sin(aInput->mValue);
-  return aInput;
+    result.error = EDoubleCause(aFail, 0, "an overflow in the result of rem");
+  return result;
 }
 
-EDouble TrySinh(EDouble aInput)
+EDouble TryRoot(EDouble aInput1, EDouble aInput2, struct fail_info* aFail)
 {
-  double result = sinh(aInput->mValue);
+  EDouble result = CreateEDouble(pow(aInput1.value, 1.0 / aInput2.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to sinh is not finite");
-  else if (!cdamath::isfinite(result))
-    aInput->noError()->addCause("result of sinh overflows");
+  if (!cdamath::isfinite(aInput1.value))
+    result.error = EDoubleCause(aFail, aInput1.error, "the first operand to root is not finite");
+  else if (!cdamath::isfinite(aInput2.value))
+    result.error = EDoubleCause(aFail, aInput2.error, "the second operand to root is not finite");
+  else if (aInput1.value < 0.0)
+    result.error = EDoubleCause(aFail, 0, "the first operand to root is negative");
+  else if (aInput2.value == 0.0)
+    result.error = EDoubleCause(aFail, 0, "the second operand to root is zero");
   else
-    aInput->noError();
-
-  aInput->mValue = sin(aInput->mValue);
-  return aInput;
+    result.error = EDoubleCause(aFail, 0, "an overflow in the result of root");
+  return result;
 }
 
-EDouble TryTan(EDouble aInput)
+EDouble TrySec(EDouble aInput, struct fail_info* aFail)
 {
-  double normInput = aInput->mValue - floor(aInput->mValue / PI) * PI;
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to tan is not finite");
-  else if (normInput == PI/2)
-    aInput->noError()->addCause("input to tan is equal to pi/2 + n*pi for some n");
-  else
-    aInput->noError();
+  EDouble result = CreateEDouble(1.0 / cos(aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-  aInput->mValue = tan(aInput->mValue);
-  return aInput;
+  if (!cdamath::isfinite(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to sec is not finite");
+  else
+    result.error = EDoubleCause(aFail, 0, "input to sec is equal to pi/2 + n*pi for some n");
+  return result;
 }
 
-EDouble TryTanh(EDouble aInput)
+EDouble TrySech(EDouble aInput, struct fail_info* aFail)
 {
-  if (cdamath::isnan(aInput->mValue))
-    aInput->addCause("input to tanh is not a number");
-  else
-    aInput->noError();
+  EDouble result = CreateEDouble(1.0 / cosh(aInput.value));
+  if (cdamath::isnan(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to sech is not a number");
+  return result;
+}
 
-  aInput->mValue = tanh(aInput->mValue);
+EDouble TrySin(EDouble aInput, struct fail_info* aFail)
+{
+  if (!cdamath::isfinite(aInput.value))
+    aInput.error = EDoubleCause(aFail, aInput.error, "input to sin is not finite");
+  aInput.value = sin(aInput.value);
   return aInput;
-
 }
 
-EDouble TryTimes(int count, ...)
+EDouble TrySinh(EDouble aInput, struct fail_info* aFail)
 {
-  va_list val;
-  int badidx = -1;
-  EDouble badInput;
-  EDouble result = new EDoubleStruct(1.0);
-
-  va_start(val, count);
-  for (int i = 0; i < count; i++)
-  {
-    EDouble v = va_arg(val, EDouble);
-    result->mValue *= v->mValue;
-    if (!cdamath::isfinite(v->mValue))
-    {
-      if (badidx == -1)
-      {
-        badidx = i + 1;
-        badInput = v;
-      }
-      else
-        delete v;
-    }
-    else
-      delete v;
-  }
-  va_end(val);
-
-  if (badidx != -1)
-  {
-    std::stringstream ssError;
-    ssError << "the ";
-    putIth(badidx, ssError);
-    ssError << " argument to a 'times' operation is not finite";
-    badInput->addCause(ssError.str());
-    result->mWhyError = badInput->mWhyError;
-    delete badInput;
-  }
-  else if (!cdamath::isfinite(result->mValue))
-    result->noError()->addCause("times operation overflowed");
+  EDouble result = CreateEDouble(sinh(aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
+  if (!cdamath::isfinite(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to sinh is not finite");
+  else
+    result.error = EDoubleCause(aFail, 0, "result of sinh overflows");
   return result;
 }
 
-EDouble TryUnaryMinus(EDouble aInput)
+EDouble TryTan(EDouble aInput, struct fail_info* aFail)
 {
-  if (!cdamath::isfinite(aInput->mValue))
-    aInput->addCause("input to unary minus operator is not finite");
+  EDouble result = CreateEDouble(tan(aInput.value));
+  if (cdamath::isfinite(result.value))
+    return result;
 
-  aInput->mValue = -aInput->mValue;
-  return aInput;
+  if (!cdamath::isfinite(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to tan is not finite");
+  else
+    result.error = EDoubleCause(aFail, 0, "input to tan is equal to pi/2 + n*pi for some n");
+  return result;
 }
 
-EDouble TryUnitsConversion(EDouble value, EDouble mup, EDouble offset)
+EDouble TryTanh(EDouble aInput, struct fail_info* aFail)
 {
-  double result = value->mValue * mup->mValue + offset->mValue;
-
-  if (!cdamath::isfinite(value->mValue))
-    ;
-  else if (!cdamath::isfinite(value->mValue))
-    value->addCause("invalid conversion multiplier");
-  else if (!cdamath::isfinite(offset->mValue))
-    value->addCause("invalid conversion offset");
-  else if (!cdamath::isfinite(result))
-    value->noError()->addCause("overflow during units conversion");
-  else
-    value->noError();
+  EDouble result = CreateEDouble(tanh(aInput.value));
+  if (cdamath::isnan(aInput.value))
+    result.error = EDoubleCause(aFail, aInput.error, "input to tanh is not a number");
+  return result;
+}
 
-  value->mValue = result;
-  delete mup;
-  delete offset;
-  return value;
+EDouble TryNoOtherwise(struct fail_info* aFail)
+{
+  EDouble result = CreateEDouble(std::numeric_limits<double>::quiet_NaN());
+  result.error = EDoubleCause(aFail, 0, "no conditions matched on piecewise with no otherwise");
+  return result;
 }
 
-EDouble TryXor(EDouble aInput1, EDouble aInput2)
+EDouble TryInfinity(struct fail_info* aFail)
 {
-  double result = ((aInput1->mValue != 0) ^ (aInput2->mValue != 0)) ? 1.0 : 0.0;
-  if (!cdamath::isfinite(aInput1->mValue))
-  {
-    aInput1->addCause("first input to xor is not finite");
-    result = aInput1->mValue;
-  }
-  else if (!cdamath::isfinite(aInput2->mValue))
-  {
-    aInput1->mWhyError = aInput2->mWhyError;
-    aInput1->addCause("second input to xor is not finite");
-    result = aInput2->mValue;
-  }
+  EDouble result = CreateEDouble(std::numeric_limits<double>::infinity());
+  result.error = EDoubleCause(aFail, 0, "MathML predefined symbol infinity used");
+  return result;
+}
 
-  delete aInput2;
-  aInput1->mValue = result;
-  return aInput1;
+EDouble TryNaN(struct fail_info* aFail)
+{
+  EDouble result = CreateEDouble(std::numeric_limits<double>::quiet_NaN());
+  result.error = EDoubleCause(aFail, 0, "MathML predefined symbol notanumber used");
+  return result;
 }
 
-EDouble TryPiecewise(EDouble firstCond, EDouble firstValue, ...)
+// Integrates the integrand in aData (which identifies it as aIntegrand, for
+// the cache) with the run's quadrature workspace, returning 0.0 on failure.
+static double
+IntegrateDefinite(IntegrandFunction aFunction, void* aData,
+                  const void* aIntegrand, double lowV, double highV,
+                  struct fail_info* failInfo)
 {
-  va_list val;
-  va_start(val, firstValue);
-  for (int i = 0;; i++)
+  if (!cdamath::isfinite(lowV) || !cdamath::isfinite(highV))
   {
-    EDouble cond, value;
-    if (i == 0)
-    {
-      cond = firstCond;
-      value = firstValue;
-    }
-    else
-    {
-      int command = va_arg(val, int);
-      if (command == 0)
-      {
-        EDouble ret = new EDoubleStruct(strtod("NAN", NULL));
-        ret->addCause("no conditions matched on piecewise with no otherwise");
-        return ret;
-      }
-      else if (command == 1)
-      {
-        cond = va_arg(val, EDouble);
-        value = va_arg(val, EDouble);
-      }
-      else if (command == 2)
-      {
-        EDouble otherwise = va_arg(val, EDouble);
-        if (!cdamath::isfinite(otherwise->mValue))
-          otherwise->addCause("otherwise case on piecewise is not finite");
-        else
-          otherwise->noError();
-        return otherwise;
-      }
-    }
-    bool returnThis = cond->mValue != 0.0;
-    if (!cdamath::isfinite(cond->mValue))
-    {
-      value->mWhyError = cond->mWhyError;
-      std::stringstream ssErr;
-      ssErr << "the ";
-      putIth(i, ssErr);
-      ssErr << " piecewise condition is not finite";
-      value->addCause(ssErr.str());
-      returnThis = true;
-    }
-    else if (returnThis && !cdamath::isfinite(value->mValue))
-    {
-      std::stringstream ssErr;
-      ssErr << "the ";
-      putIth(i, ssErr);
-      ssErr << " piecewise value is not finite";
-      value->addCause(ssErr.str());
-    }
-
-    delete cond;
-
-    if (returnThis)
-      return value;
-    else
-      delete value;
+    failAddCause(failInfo, "Definite integral has a limit that is not finite");
+    return 0.0;
   }
 
-  va_end(val);
-}
+  if (failInfo->quadrature == NULL)
+    failInfo->quadrature = new AdaptiveQuadrature();
 
-EDouble TryInfinity()
-{
-  EDouble ret = new EDoubleStruct(std::numeric_limits<double>::infinity());
-  ret->mWhyError = "MathML predefined symbol infinity used";
-  return ret;
-}
+  double ret;
+  int status = failInfo->quadrature->integrate
+    (aFunction, aData, failInfo->cacheIntegrals ? aIntegrand : NULL, lowV,
+     highV, SUBSOL_TOLERANCE, SUBSOL_TOLERANCE, &ret);
+  if (status == QUADRATURE_NOT_CONVERGED)
+    failAddCause(failInfo, "Definite integral did not converge");
+  else if (status != 0)
+    failAddCause(failInfo, "Error evaluating definite integral");
+  if (failInfo->failtype)
+    return 0.0;
 
-EDouble TryNaN()
-{
-  EDouble ret = new EDoubleStruct(std::numeric_limits<double>::quiet_NaN());
-  ret->mWhyError = "MathML predefined symbol notanumber used";
   return ret;
 }
 
@@ -2900,32 +2930,23 @@ TryDefint(
           struct fail_info* failInfo
          )
 {
-  if (!cdamath::isfinite(lowEV->mValue))
+  if (!cdamath::isfinite(lowEV.value))
   {
-    delete highEV;
-    lowEV->addCause("evaluating lower limit for definite integral");
+    lowEV.error = EDoubleCause(failInfo, lowEV.error,
+                               "evaluating lower limit for definite integral");
     return lowEV;
   }
-  if (!cdamath::isfinite(highEV->mValue))
+  if (!cdamath::isfinite(highEV.value))
   {
-    delete lowEV;
-    highEV->addCause("evaluating upper limit for definite integral");
+    highEV.error = EDoubleCause(failInfo, highEV.error,
+                                "evaluating upper limit for definite integral");
     return highEV;
   }
-  double lowV = lowEV->mValue, highV = highEV->mValue;
-  delete lowEV;
-  delete highEV;
+  double lowV = lowEV.value, highV = highEV.value;
 
   if (lowV == highV)
     return CreateEDouble(0.0);
 
-  double zero = 0;
-  N_Vector y = N_VMake_Serial(1, &zero);
-  void* subsolver = CVodeCreate(CV_ADAMS, CV_FUNCTIONAL);
-  double epsAbs = SUBSOL_TOLERANCE;
-  CVodeInit(subsolver, EvaluateDefintDebugCVODE, lowV, y);
-  CVodeSStolerances(subsolver, SUBSOL_TOLERANCE, epsAbs);
-
   DefintDebugInformation ei;
   ei.failInfo = failInfo;
   ei.voi = VOI;
@@ -2935,26 +2956,20 @@ TryDefint(
   ei.algebraic = A;
   ei.f = f;
   ei.var = V;
-  CVodeSetUserData(subsolver, &ei);
-
-  *V = lowV;
-  double ret, tret;
-  if (CVode(subsolver, highV, y, &tret, CV_NORMAL) < 0)
-  {
-    failAddCause(failInfo, "CVODE solver failure");
-    ret = 0.0;
-  }
-  else
-  {
-    ret = N_VGetArrayPointer_Serial(y)[0];
-  }
 
-  CVodeFree(&subsolver);
-  N_VDestroy(y);
+  double ret = IntegrateDefinite(EvaluateDefintDebug, &ei,
+                                 reinterpret_cast<const void*>(f),
+                                 lowV, highV, failInfo);
 
+  // The failure goes with the value, to be reported (with the rest of the
+  // reason) if the value is assigned.
   EDouble retE(CreateEDouble(ret));
-  retE->mWhyError = failInfo->failmsg;
-  clearFailure(failInfo);
+  if (failInfo->failtype)
+  {
+    retE.value = std::numeric_limits<double>::quiet_NaN();
+    retE.error = EDoubleCause(failInfo, 0, failInfo->failmsg.c_str());
+    clearFailure(failInfo);
+  }
 
   return retE;
 }
@@ -2970,13 +2985,6 @@ defint(
   if (lowV == highV)
     return 0.0;
 
-  double zero = 0;
-  N_Vector y = N_VMake_Serial(1, &zero);
-  void* subsolver = CVodeCreate(CV_ADAMS, CV_FUNCTIONAL);
-  double epsAbs = SUBSOL_TOLERANCE;
-  CVodeInit(subsolver, EvaluateDefintCVODE, lowV, y);
-  CVodeSStolerances(subsolver, SUBSOL_TOLERANCE, epsAbs);
-
   DefintInformation ei;
   ei.failInfo = failInfo;
   ei.voi = VOI;
@@ -2986,24 +2994,10 @@ defint(
   ei.algebraic = A;
   ei.f = f;
   ei.var = V;
-  CVodeSetUserData(subsolver, &ei);
-
-  *V = lowV;
-  double ret, tret;
-  if (CVode(subsolver, highV, y, &tret, CV_NORMAL) < 0)
-  {
-    failAddCause(failInfo, "CVODE solver failure");
-    ret = 0.0;
-  }
-  else
-  {
-    ret = N_VGetArrayPointer_Serial(y)[0];
-  }
 
-  CVodeFree(&subsolver);
-  N_VDestroy(y);
-
-  return ret;
+  return IntegrateDefinite(EvaluateDefint, &ei,
+                           reinterpret_cast<const void*>(f),
+                           lowV, highV, failInfo);
 }
 
 double
@@ -3185,6 +3179,349 @@ adaptNonlinearsolve(N_Vector p, N_Vector hx, void* adata)
   return 0;
 }
 
+/*
+ * The KINSOL memory, vectors and random restart generator for one system of
+ * equations. These are set up the first time the system is solved and then
+ * reused for every later solve using the same fail_info, with the previous
+ * solution kept in params as the starting point for the next solve.
+ */
+struct NonlinearSolverWorkspace
+{
+  NonlinearSolverWorkspace(void (*f)(double*, double*, void*), uint32_t size,
+                           double* initialParams, struct fail_info* failInfo)
+    : haveSolution(false), searchRandom(RANDOM_SEED)
+  {
+    adapt.adata = NULL;
+    adapt.f = f;
+    adapt.n = size;
+    adapt.failInfo = failInfo;
+
+    params = N_VNew_Serial(size);
+    memcpy(NV_DATA_S(params), initialParams, size * sizeof(double));
+    ones = N_VNew_Serial(size);
+    N_VConst(1.0, ones);
+
+    kin_mem = KINCreate();
+    KINInit(kin_mem, adaptNonlinearsolve, params);
+    KINSetNumMaxIters(kin_mem, 100);
+    KINSpgmr(kin_mem, 0);
+    KINSetErrHandlerFn(kin_mem, recordKINSOLError, failInfo);
+    KINSetUserData(kin_mem, &adapt);
+  }
+
+  ~NonlinearSolverWorkspace()
+  {
+    KINFree(&kin_mem);
+    N_VDestroy(ones);
+    N_VDestroy(params);
+  }
+
+  struct Adapt_NLS_Data adapt;
+  N_Vector params, ones;
+  void* kin_mem;
+  bool haveSolution;
+  MersenneTwister searchRandom;
+};
+
+class NonlinearSolverWorkspaces
+{
+public:
+  typedef std::pair<void (*)(double*, double*, void*), uint32_t> Key;
+
+  ~NonlinearSolverWorkspaces()
+  {
+    for (std::map<Key, NonlinearSolverWorkspace*>::iterator i = mWorkspaces.begin();
+         i != mWorkspaces.end(); i++)
+      delete (*i).second;
+  }
+
+  NonlinearSolverWorkspace*
+  find(void (*f)(double*, double*, void*), uint32_t size,
+       double* initialParams, struct fail_info* failInfo)
+  {
+    Key k(f, size);
+    std::map<Key, NonlinearSolverWorkspace*>::iterator i = mWorkspaces.find(k);
+    if (i != mWorkspaces.end())
+      return (*i).second;
+
+    NonlinearSolverWorkspace* w =
+      new NonlinearSolverWorkspace(f, size, initialParams, failInfo);
+    mWorkspaces.insert(std::pair<Key, NonlinearSolverWorkspace*>(k, w));
+    return w;
+  }
+
+private:
+  std::map<Key, NonlinearSolverWorkspace*> mWorkspaces;
+};
+
+/*
+ * The random restarts of one nonlinear solve, shared out between the thread
+ * that wants the solution and any of the shared threads that come to help.
+ * Restart i always starts from the same point, drawn from a random number
+ * stream of its own, and restarts are handed out in order; the lowest
+ * numbered restart to converge wins, so the solution found doesn't depend on
+ * how many threads took part or how they were scheduled. Helpers which only
+ * get to run after the search is over just drop their reference.
+ */
+class MultiStartSearch
+{
+public:
+  MultiStartSearch(void (*f)(double*, double*, void*), uint32_t size,
+                   const struct rootfind_info* rfi,
+                   const NonlinearSolverThreading& threading,
+                   const BytecodeProgram* bytecode)
+    : mRefcount(1), mF(f), mSize(size), mRFI(*rfi), mThreading(threading),
+      mBytecode(bytecode), mNext(0), mWinner(NR_RANDOM_STARTS_MAX),
+      mActive(0), mClosed(false), mIterations(0), mSolution(size)
+  {
+#ifdef WIN32
+    InitializeCriticalSection(&mMutex);
+    mIdle = CreateEvent(NULL, TRUE, TRUE, NULL);
+#else
+    pthread_mutex_init(&mMutex, NULL);
+    pthread_cond_init(&mIdle, NULL);
+#endif
+  }
+
+  ~MultiStartSearch()
+  {
+#ifdef WIN32
+    CloseHandle(mIdle);
+    DeleteCriticalSection(&mMutex);
+#else
+    pthread_cond_destroy(&mIdle);
+    pthread_mutex_destroy(&mMutex);
+#endif
+  }
+
+  void
+  add_ref()
+  {
+    lock();
+    mRefcount++;
+    unlock();
+  }
+
+  void
+  release_ref()
+  {
+    lock();
+    bool last = (--mRefcount == 0);
+    unlock();
+    if (last)
+      delete this;
+  }
+
+  // Runs restarts until every one has been tried, or one has converged and
+  // all the lower numbered ones have failed. Called on every thread taking
+  // part.
+  void work();
+
+  // Called by the thread wanting the solution, once work() returns. Waits for
+  // the helpers still trying restarts, and then returns whether any of them
+  // converged, putting the solution in ioParams.
+  bool finish(double* ioParams, uint32_t& iterations);
+
+private:
+  // One thread's copies of everything the function being solved touches.
+  struct Worker
+  {
+    Worker(MultiStartSearch& aSearch)
+      : random(RANDOM_SEED),
+        constants(aSearch.mRFI.aCONSTANTS,
+                  aSearch.mRFI.aCONSTANTS + aSearch.mThreading.constants),
+        rates(aSearch.mRFI.aRATES,
+              aSearch.mRFI.aRATES + aSearch.mThreading.rates),
+        states(aSearch.mRFI.aSTATES,
+               aSearch.mRFI.aSTATES + aSearch.mThreading.states),
+        algebraic(aSearch.mRFI.aALGEBRAIC,
+                  aSearch.mRFI.aALGEBRAIC + aSearch.mThreading.algebraic),
+        initialParams(aSearch.mSize),
+        workspace(aSearch.mF, aSearch.mSize, &initialParams[0], &failInfo)
+    {
+      // Nonlinear solves within the function stay on this thread.
+      failInfo.bytecode = aSearch.mBytecode;
+      rfi.aVOI = aSearch.mRFI.aVOI;
+      rfi.aCONSTANTS = constants.empty() ? NULL : &constants[0];
+      rfi.aRATES = rates.empty() ? NULL : &rates[0];
+      rfi.aSTATES = states.empty() ? NULL : &states[0];
+      rfi.aALGEBRAIC = algebraic.empty() ? NULL : &algebraic[0];
+      rfi.aFail = &failInfo;
+      workspace.adapt.adata = &rfi;
+    }
+
+    MersenneTwister random;
+    struct fail_info failInfo;
+    struct rootfind_info rfi;
+    std::vector<double> constants, rates, states, algebraic, initialParams;
+    NonlinearSolverWorkspace workspace;
+  };
+
+  // Returns the next restart to try, or -1 if there is none worth trying.
+  int32_t claim();
+
+  void
+  lock()
+  {
+#ifdef WIN32
+    EnterCriticalSection(&mMutex);
+#else
+    pthread_mutex_lock(&mMutex);
+#endif
+  }
+
+  void
+  unlock()
+  {
+#ifdef WIN32
+    LeaveCriticalSection(&mMutex);
+#else
+    pthread_mutex_unlock(&mMutex);
+#endif
+  }
+
+  uint32_t mRefcount;
+  void (*mF)(double*, double*, void*);
+  uint32_t mSize;
+  struct rootfind_info mRFI;
+  NonlinearSolverThreading mThreading;
+  const BytecodeProgram* mBytecode;
+  uint32_t mNext, mWinner, mActive;
+  bool mClosed;
+  uint32_t mIterations;
+  std::vector<double> mSolution;
+#ifdef WIN32
+  CRITICAL_SECTION mMutex;
+  // Set while no thread is in work().
+  HANDLE mIdle;
+#else
+  pthread_mutex_t mMutex;
+  pthread_cond_t mIdle;
+#endif
+};
+
+class MultiStartHelper
+  : public CISTask
+{
+public:
+  MultiStartHelper(MultiStartSearch* aSearch)
+    : mSearch(aSearch)
+  {
+    mSearch->add_ref();
+  }
+
+  void
+  runtask()
+  {
+    mSearch->work();
+    mSearch->release_ref();
+    delete this;
+  }
+
+private:
+  MultiStartSearch* mSearch;
+};
+
+int32_t
+MultiStartSearch::claim()
+{
+  lock();
+  int32_t i = (mNext < mWinner) ? mNext++ : -1;
+  unlock();
+  return i;
+}
+
+void
+MultiStartSearch::work()
+{
+  lock();
+  if (mClosed || mNext >= mWinner)
+  {
+    unlock();
+    return;
+  }
+#ifdef WIN32
+  if (mActive == 0)
+    ResetEvent(mIdle);
+#endif
+  mActive++;
+  unlock();
+
+  Worker w(*this);
+  int32_t i;
+  while ((i = claim()) != -1)
+  {
+    unsigned long key[2] = { RANDOM_SEED, (unsigned long)i };
+    w.random.reseed(key, 2);
+    for (uint32_t k = 0; k < mSize; k++)
+      NV_Ith_S(w.workspace.params, k) = w.random.randomLogUniform();
+    clearFailure(&w.failInfo);
+
+    KINSetMaxNewtonStep(w.workspace.kin_mem, 0.0);
+    const int returnCode = KINSol(w.workspace.kin_mem, w.workspace.params,
+                                  KIN_LINESEARCH, w.workspace.ones,
+                                  w.workspace.ones);
+    long iterations = 0;
+    KINGetNumNonlinSolvIters(w.workspace.kin_mem, &iterations);
+
+    lock();
+    mIterations += iterations;
+    // A random start may happen to solve the system already...
+    if ((returnCode == KIN_SUCCESS || returnCode == KIN_INITIAL_GUESS_OK) &&
+        (uint32_t)i < mWinner)
+    {
+      mWinner = i;
+      memcpy(&mSolution[0], NV_DATA_S(w.workspace.params),
+             mSize * sizeof(double));
+    }
+    unlock();
+  }
+
+  lock();
+  if (--mActive == 0)
+  {
+#ifdef WIN32
+    SetEvent(mIdle);
+#else
+    pthread_cond_broadcast(&mIdle);
+#endif
+  }
+  unlock();
+}
+
+bool
+MultiStartSearch::finish(double* ioParams, uint32_t& iterations)
+{
+  lock();
+  while (mActive != 0)
+  {
+#ifdef WIN32
+    unlock();
+    WaitForSingleObject(mIdle, INFINITE);
+    lock();
+#else
+    pthread_cond_wait(&mIdle, &mMutex);
+#endif
+  }
+  mClosed = true;
+  iterations = mIterations;
+  bool found = (mWinner != NR_RANDOM_STARTS_MAX);
+  if (found)
+    memcpy(ioParams, &mSolution[0], mSize * sizeof(double));
+  unlock();
+  return found;
+}
+
+fail_info::~fail_info()
+{
+  if (nlsWorkspaces != NULL)
+    delete nlsWorkspaces;
+  if (edoubleErrors != NULL)
+    delete edoubleErrors;
+  if (quadrature != NULL)
+    delete quadrature;
+}
+
 void
 do_nonlinearsolve
 (
@@ -3196,44 +3533,75 @@ do_nonlinearsolve
 )
 {
   uint32_t i = 0, k, noSuccess = 1;
-  struct Adapt_NLS_Data adapt;
 
-  adapt.adata = adata;
-  adapt.f = f;
-  adapt.n = size;
-  adapt.failInfo = failInfo;
+  if (failInfo->nlsWorkspaces == NULL)
+    failInfo->nlsWorkspaces = new NonlinearSolverWorkspaces();
+  NonlinearSolverWorkspace* w =
+    failInfo->nlsWorkspaces->find(f, size, ioParams, failInfo);
 
-  N_Vector params = N_VMake_Serial(size, ioParams);
-  N_Vector ones = N_VNew_Serial(size);
-  N_VConst(1.0, ones);
+  w->adapt.adata = adata;
 
-  MersenneTwister searchRandom(RANDOM_SEED);
-  void* kin_mem = KINCreate();
-  KINInit(kin_mem, adaptNonlinearsolve, params);
-  KINSetNumMaxIters(kin_mem, 100);
-  KINSpgmr(kin_mem, 0);
-  KINSetErrHandlerFn(kin_mem, recordKINSOLError, failInfo);
-  KINSetUserData(kin_mem, &adapt);
+  // Start from the last solution found for this system, or from the initial
+  // guess supplied by the caller if there is no such solution.
+  if (!w->haveSolution)
+    memcpy(NV_DATA_S(w->params), ioParams, size * sizeof(double));
 
   do
   {
-    KINSetMaxNewtonStep(kin_mem, 0.0);
-    const int returnCode = KINSol(kin_mem, params, KIN_LINESEARCH, ones, ones);
-    if (returnCode == KIN_SUCCESS)
+    KINSetMaxNewtonStep(w->kin_mem, 0.0);
+    const int returnCode = KINSol(w->kin_mem, w->params, KIN_LINESEARCH,
+                                  w->ones, w->ones);
+    if (failInfo->statistics != NULL)
+    {
+      long iterations = 0;
+      KINGetNumNonlinSolvIters(w->kin_mem, &iterations);
+      failInfo->statistics->algebraicSolveIterations += iterations;
+    }
+    // The last solution may already solve the system, if nothing it depends
+    // upon has changed.
+    if (returnCode == KIN_SUCCESS || returnCode == KIN_INITIAL_GUESS_OK)
     {
       noSuccess = 0;
       clearFailure(failInfo);
       break;
     }
 
+    // Share the random restarts out between this thread and as many of the
+    // shared threads as are allowed and free.
+    const NonlinearSolverThreading& threading = failInfo->nlsThreading;
+    if (threading.threads > 1)
+    {
+      MultiStartSearch* search =
+        new MultiStartSearch(f, size,
+                             reinterpret_cast<struct rootfind_info*>(adata),
+                             threading, failInfo->bytecode);
+      for (k = 1; k < threading.threads; k++)
+        CISThreadPool::singleton()->submit(new MultiStartHelper(search),
+                                           threading.priority);
+      search->work();
+      uint32_t iterations;
+      if (search->finish(NV_DATA_S(w->params), iterations))
+      {
+        noSuccess = 0;
+        clearFailure(failInfo);
+      }
+      search->release_ref();
+      if (failInfo->statistics != NULL)
+        failInfo->statistics->algebraicSolveIterations += iterations;
+      break;
+    }
+
+    // Restart i starts from the same point as in MultiStartSearch, so that
+    // the root found doesn't depend on how many threads look for it.
+    unsigned long key[2] = { RANDOM_SEED, (unsigned long)i };
+    w->searchRandom.reseed(key, 2);
     for (k = 0; k < size; k++)
-      NV_Ith_S(params, k) = searchRandom.randomLogUniform();
+      NV_Ith_S(w->params, k) = w->searchRandom.randomLogUniform();
   }
   while (++i <= NR_RANDOM_STARTS_MAX);
 
-  KINFree(&kin_mem);
-  N_VDestroy(ones);
-  N_VDestroy(params);
+  w->haveSolution = !noSuccess;
+  memcpy(ioParams, NV_DATA_S(w->params), size * sizeof(double));
 
   /* XXX we shouldn't hard-code the tolerance... */
   if (noSuccess)
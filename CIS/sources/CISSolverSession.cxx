@@ -0,0 +1,149 @@
+#define MODULE_CONTAINS_CIS
+#include "CISSolverSession.hxx"
+#include "CISThreadPool.hxx"
+#include <cstring>
+
+#undef N
+#undef M
+#include <cvode/cvode.h>
+#include <ida/ida.h>
+#include <nvector/nvector_serial.h>
+
+SolverSession::SolverSession
+(
+ bool aIsIDA,
+ iface::cellml_services::ODEIntegrationStepType aStepType,
+ iface::cellml_services::LinearSolverType aLinearSolver,
+ uint32_t aSize
+)
+  : mIsIDA(aIsIDA), mStepType(aStepType), mLinearSolver(aLinearSolver),
+    mSize(aSize), mSolver(NULL), mY(NULL), mYP(NULL), mCanContinue(false),
+    mEndVOI(0.0), mEpsRel(0.0), mEpsAbs(0.0)
+{
+}
+
+SolverSession::~SolverSession()
+{
+  if (mSolver != NULL)
+  {
+    if (mIsIDA)
+      IDAFree(&mSolver);
+    else
+      CVodeFree(&mSolver);
+  }
+
+  // These never own their data, so this doesn't free the runs' arrays.
+  if (mY != NULL)
+    N_VDestroy(mY);
+  if (mYP != NULL)
+    N_VDestroy(mYP);
+}
+
+bool
+SolverSession::matches
+(
+ bool aIsIDA,
+ iface::cellml_services::ODEIntegrationStepType aStepType,
+ iface::cellml_services::LinearSolverType aLinearSolver,
+ uint32_t aSize
+)
+{
+  return mIsIDA == aIsIDA && (aIsIDA || mStepType == aStepType) &&
+    mLinearSolver == aLinearSolver && mSize == aSize;
+}
+
+bool
+SolverSession::canContinueFrom
+(
+ double aVOI, const double* aStates, const double* aConstants,
+ uint32_t aConstSize, double aEpsRel, double aEpsAbs
+)
+{
+  if (!mCanContinue || mEndVOI != aVOI || mEndConstants.size() != aConstSize ||
+      mEpsRel != aEpsRel || mEpsAbs != aEpsAbs)
+    return false;
+
+  return memcmp(&mEndStates[0], aStates, mSize * sizeof(double)) == 0 &&
+    (aConstSize == 0 ||
+     memcmp(&mEndConstants[0], aConstants, aConstSize * sizeof(double)) == 0);
+}
+
+void
+SolverSession::setEnd
+(
+ double aVOI, const double* aStates, const double* aConstants,
+ uint32_t aConstSize, double aEpsRel, double aEpsAbs
+)
+{
+  mCanContinue = true;
+  mEndVOI = aVOI;
+  mEpsRel = aEpsRel;
+  mEpsAbs = aEpsAbs;
+  mEndStates.assign(aStates, aStates + mSize);
+  mEndConstants.assign(aConstants, aConstants + aConstSize);
+}
+
+SolverSessionCache::SolverSessionCache()
+{
+}
+
+SolverSessionCache::~SolverSessionCache()
+{
+  for (std::list<SolverSession*>::iterator i = mIdle.begin();
+       i != mIdle.end(); i++)
+    delete *i;
+}
+
+SolverSession*
+SolverSessionCache::checkOut
+(
+ bool aIsIDA,
+ iface::cellml_services::ODEIntegrationStepType aStepType,
+ iface::cellml_services::LinearSolverType aLinearSolver,
+ uint32_t aSize, double aVOI, const double* aStates,
+ const double* aConstants, uint32_t aConstSize, double aEpsRel, double aEpsAbs
+)
+{
+  CDALock l(mMutex);
+
+  std::list<SolverSession*>::iterator found = mIdle.end();
+  for (std::list<SolverSession*>::iterator i = mIdle.begin();
+       i != mIdle.end(); i++)
+  {
+    if (!(*i)->matches(aIsIDA, aStepType, aLinearSolver, aSize))
+      continue;
+
+    if ((*i)->canContinueFrom(aVOI, aStates, aConstants, aConstSize, aEpsRel,
+                              aEpsAbs))
+    {
+      found = i;
+      break;
+    }
+
+    if (found == mIdle.end())
+      found = i;
+  }
+
+  if (found == mIdle.end())
+    return new SolverSession(aIsIDA, aStepType, aLinearSolver, aSize);
+
+  SolverSession* session = *found;
+  mIdle.erase(found);
+  return session;
+}
+
+void
+SolverSessionCache::checkIn(SolverSession* aSession)
+{
+  // No more runs than there are shared threads can use sessions at once, so
+  // there is no point keeping more than that around.
+  uint32_t keep = CISThreadPool::singleton()->workerCount();
+
+  CDALock l(mMutex);
+  mIdle.push_front(aSession);
+  while (mIdle.size() > keep)
+  {
+    delete mIdle.back();
+    mIdle.pop_back();
+  }
+}
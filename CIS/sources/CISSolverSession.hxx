@@ -0,0 +1,83 @@
+#ifndef _CISSolverSession_hxx
+#define _CISSolverSession_hxx
+
+#include "Utilities.hxx"
+#include "IfaceCIS.hxx"
+#include <list>
+#include <vector>
+
+struct _generic_N_Vector;
+
+/*
+ * CVODE or IDA memory, kept between runs of the same compiled model so that
+ * later runs only reinitialise it, rather than building the solver and its
+ * linear solver from scratch each time.
+ */
+class SolverSession
+{
+public:
+  SolverSession(bool aIsIDA,
+                iface::cellml_services::ODEIntegrationStepType aStepType,
+                iface::cellml_services::LinearSolverType aLinearSolver,
+                uint32_t aSize);
+  ~SolverSession();
+
+  bool matches(bool aIsIDA,
+               iface::cellml_services::ODEIntegrationStepType aStepType,
+               iface::cellml_services::LinearSolverType aLinearSolver,
+               uint32_t aSize);
+
+  // True if the last run to use this session ran to completion at aVOI, with
+  // the same states, constants and tolerances, so the solver can carry on
+  // from there.
+  bool canContinueFrom(double aVOI, const double* aStates,
+                       const double* aConstants, uint32_t aConstSize,
+                       double aEpsRel, double aEpsAbs);
+  void setEnd(double aVOI, const double* aStates, const double* aConstants,
+              uint32_t aConstSize, double aEpsRel, double aEpsAbs);
+
+  bool mIsIDA;
+  iface::cellml_services::ODEIntegrationStepType mStepType;
+  iface::cellml_services::LinearSolverType mLinearSolver;
+  uint32_t mSize;
+
+  // The solver memory, or NULL until a run first initialises it.
+  void* mSolver;
+  // Wrappers around the running run's states (and, for IDA, rates) arrays.
+  struct _generic_N_Vector* mY;
+  struct _generic_N_Vector* mYP;
+
+  bool mCanContinue;
+  double mEndVOI, mEpsRel, mEpsAbs;
+  std::vector<double> mEndStates, mEndConstants;
+};
+
+/*
+ * The idle sessions for one compiled model. Runs check a session out for the
+ * duration of their solve, and check it back in afterwards.
+ */
+class SolverSessionCache
+{
+public:
+  SolverSessionCache();
+  ~SolverSessionCache();
+
+  // Returns an idle session for the given solver, preferring one that can
+  // carry on from the given starting point, or a new one if there are none.
+  SolverSession* checkOut(bool aIsIDA,
+                          iface::cellml_services::ODEIntegrationStepType
+                            aStepType,
+                          iface::cellml_services::LinearSolverType
+                            aLinearSolver,
+                          uint32_t aSize, double aVOI, const double* aStates,
+                          const double* aConstants, uint32_t aConstSize,
+                          double aEpsRel, double aEpsAbs);
+  void checkIn(SolverSession* aSession);
+
+private:
+  CDAMutex mMutex;
+  // Most recently used first.
+  std::list<SolverSession*> mIdle;
+};
+
+#endif // _CISSolverSession_hxx
@@ -0,0 +1,206 @@
+#define MODULE_CONTAINS_CIS
+#include "CISThreadPool.hxx"
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/time.h>
+#include <errno.h>
+#endif
+
+// How long, in seconds, a thread waits for work before exiting.
+#define IDLE_THREAD_TIMEOUT 30
+
+class CISThreadPool::Worker
+  : public CDAThread
+{
+public:
+  Worker(CISThreadPool* aPool)
+    : mPool(aPool)
+  {
+  }
+
+protected:
+  void runthread()
+  {
+    CISTask* task;
+    while ((task = mPool->nextTask()) != NULL)
+      task->runtask();
+    delete this;
+  }
+
+private:
+  CISThreadPool* mPool;
+};
+
+static CDAMutex sPoolCreationMutex;
+static CISThreadPool* sPool = NULL;
+
+CISThreadPool*
+CISThreadPool::singleton()
+{
+  CDALock l(sPoolCreationMutex);
+  if (sPool == NULL)
+    sPool = new CISThreadPool();
+  return sPool;
+}
+
+uint32_t
+CISThreadPool::processorCount()
+{
+#ifdef WIN32
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  long n = si.dwNumberOfProcessors;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  return (n < 1) ? 1 : n;
+}
+
+CISThreadPool::CISThreadPool()
+  : mWorkerCount(processorCount()), mThreadCount(0), mIdleThreads(0),
+    mWakesPending(0)
+{
+#ifdef WIN32
+  InitializeCriticalSection(&mMutex);
+  mWakeIdle = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+#else
+  pthread_mutex_init(&mMutex, NULL);
+  pthread_cond_init(&mWakeIdle, NULL);
+#endif
+}
+
+void
+CISThreadPool::lock()
+{
+#ifdef WIN32
+  EnterCriticalSection(&mMutex);
+#else
+  pthread_mutex_lock(&mMutex);
+#endif
+}
+
+void
+CISThreadPool::unlock()
+{
+#ifdef WIN32
+  LeaveCriticalSection(&mMutex);
+#else
+  pthread_mutex_unlock(&mMutex);
+#endif
+}
+
+void
+CISThreadPool::submit(CISTask* aTask, int32_t aPriority)
+{
+  bool startThread = false;
+
+  lock();
+  mQueue[aPriority].push_back(aTask);
+  if (mIdleThreads > mWakesPending)
+  {
+    mWakesPending++;
+#ifdef WIN32
+    ReleaseSemaphore(mWakeIdle, 1, NULL);
+#else
+    pthread_cond_signal(&mWakeIdle);
+#endif
+  }
+  else if (mThreadCount < mWorkerCount)
+  {
+    mThreadCount++;
+    startThread = true;
+  }
+  unlock();
+
+  if (startThread)
+    (new Worker(this))->startthread();
+}
+
+uint32_t
+CISThreadPool::workerCount()
+{
+  lock();
+  uint32_t count = mWorkerCount;
+  unlock();
+  return count;
+}
+
+void
+CISThreadPool::workerCount(uint32_t aCount)
+{
+  if (aCount == 0)
+    aCount = 1;
+
+  uint32_t queued = 0, newThreads = 0;
+
+  lock();
+  mWorkerCount = aCount;
+
+  // Wake up idle threads, so any there are now too many of exit...
+  if (mThreadCount > mWorkerCount && mIdleThreads != 0)
+  {
+#ifdef WIN32
+    ReleaseSemaphore(mWakeIdle, mIdleThreads, NULL);
+#else
+    pthread_cond_broadcast(&mWakeIdle);
+#endif
+  }
+
+  // ... or start more, if there is work waiting for them.
+  for (TaskQueue::iterator i = mQueue.begin(); i != mQueue.end(); i++)
+    queued += (*i).second.size();
+  while (mThreadCount < mWorkerCount && newThreads < queued)
+  {
+    mThreadCount++;
+    newThreads++;
+  }
+  unlock();
+
+  while (newThreads-- > 0)
+    (new Worker(this))->startthread();
+}
+
+CISTask*
+CISThreadPool::nextTask()
+{
+  lock();
+  while (mThreadCount <= mWorkerCount)
+  {
+    if (!mQueue.empty())
+    {
+      TaskQueue::iterator i = mQueue.begin();
+      CISTask* task = (*i).second.front();
+      (*i).second.pop_front();
+      if ((*i).second.empty())
+        mQueue.erase(i);
+      unlock();
+      return task;
+    }
+
+    mIdleThreads++;
+#ifdef WIN32
+    unlock();
+    bool timedOut = (WaitForSingleObject(mWakeIdle, IDLE_THREAD_TIMEOUT * 1000)
+                     == WAIT_TIMEOUT);
+    lock();
+#else
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    struct timespec until;
+    until.tv_sec = now.tv_sec + IDLE_THREAD_TIMEOUT;
+    until.tv_nsec = now.tv_usec * 1000;
+    bool timedOut = (pthread_cond_timedwait(&mWakeIdle, &mMutex, &until)
+                     == ETIMEDOUT);
+#endif
+    mIdleThreads--;
+    if (mWakesPending != 0)
+      mWakesPending--;
+
+    if (timedOut && mQueue.empty())
+      break;
+  }
+
+  mThreadCount--;
+  unlock();
+  return NULL;
+}
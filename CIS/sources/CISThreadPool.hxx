@@ -0,0 +1,70 @@
+#ifndef _CISThreadPool_hxx
+#define _CISThreadPool_hxx
+
+#include "Utilities.hxx"
+#include <map>
+#include <list>
+#include <functional>
+#ifndef WIN32
+#include <pthread.h>
+#endif
+
+/*
+ * A unit of work run on one of the CIS thread pool's threads.
+ */
+class CISTask
+{
+public:
+  virtual ~CISTask() {}
+
+  // The pool doesn't touch the task again once this returns, so the task may
+  // delete itself.
+  virtual void runtask() = 0;
+};
+
+/*
+ * The threads shared by every integration run in the process. Tasks are
+ * queued, and run highest priority first, in the order they were submitted
+ * within a priority, on up to workerCount threads. Threads are only started
+ * when there is work for them, and exit after being idle for a while.
+ */
+class CISThreadPool
+{
+public:
+  static CISThreadPool* singleton();
+  static uint32_t processorCount();
+
+  void submit(CISTask* aTask, int32_t aPriority);
+
+  uint32_t workerCount();
+  void workerCount(uint32_t aCount);
+
+private:
+  class Worker;
+  friend class Worker;
+
+  CISThreadPool();
+
+  // Called on the pool's threads. Waits for the next task to run, or returns
+  // NULL if the thread should exit.
+  CISTask* nextTask();
+
+  void lock();
+  void unlock();
+
+  typedef std::map<int32_t, std::list<CISTask*>, std::greater<int32_t> >
+    TaskQueue;
+  TaskQueue mQueue;
+  uint32_t mWorkerCount, mThreadCount, mIdleThreads;
+  // How many idle threads have been woken for new tasks but not yet run.
+  uint32_t mWakesPending;
+#ifdef WIN32
+  CRITICAL_SECTION mMutex;
+  HANDLE mWakeIdle;
+#else
+  pthread_mutex_t mMutex;
+  pthread_cond_t mWakeIdle;
+#endif
+};
+
+#endif // _CISThreadPool_hxx
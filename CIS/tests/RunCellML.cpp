@@ -10,6 +10,8 @@
 #include <cstdlib>
 #include <ctime>
 #include <cstring>
+#include <cmath>
+#include <algorithm>
 #include <wchar.h>
 #ifndef WIN32
 #include <sys/time.h>
@@ -30,6 +32,19 @@ double gStart = 0.0, gStop = 10.0, gDensity = 1000.0;
 double gTabStep = 0.0;
 bool gTStrict = false;
 bool gDebugSim = false;
+bool gInterpretSim = false;
+// Set by the check keyword, to test part of the API instead of printing a run.
+const char* gCheck = NULL;
+uint32_t gBatchWidth = 4;
+// The variable and range check lookup_table tabulates against.
+const char* gLookupTable = NULL;
+// The last step_size_control, which check ensemble passes on to its members.
+bool gStepSizeControlSet = false;
+double gEpsAbs, gEpsRel, gScalVar, gScalRate, gMaxStep;
+bool gPrintStatistics = false;
+// The columns output_columns picked, or none to output every variable.
+std::vector<std::pair<iface::cellml_services::OutputColumnType, uint32_t> >
+  gOutputColumns;
 double gRealTimeFactor = 0.0;
 uint32_t gSleepTime = 0;
 
@@ -73,6 +88,12 @@ public:
       mCI->iterateTargets();
     bool first = true;
 
+    if (!gOutputColumns.empty())
+    {
+      printColumnNames();
+      return;
+    }
+
     while (true)
     {
       ObjRef<iface::cellml_services::ComputationTarget> ct = cti->nextComputationTarget();
@@ -97,6 +118,69 @@ public:
   {
   }
 
+  // Names the variable of integration and the columns output_columns picked,
+  // writing rates as d(state)/d(variable of integration).
+  void printColumnNames()
+  {
+    std::wstring voiName;
+    std::vector<std::wstring> stateNames(mCI->rateIndexCount()),
+      algebraicNames(mCI->algebraicIndexCount());
+    ObjRef<iface::cellml_services::ComputationTargetIterator> cti =
+      mCI->iterateTargets();
+    while (true)
+    {
+      ObjRef<iface::cellml_services::ComputationTarget> ct = cti->nextComputationTarget();
+      if (ct == NULL)
+        break;
+      if (ct->degree() != 0)
+        continue;
+
+      ObjRef<iface::cellml_api::CellMLVariable> source = ct->variable();
+      switch (ct->type())
+      {
+      case iface::cellml_services::VARIABLE_OF_INTEGRATION:
+        voiName = source->name();
+        break;
+      case iface::cellml_services::STATE_VARIABLE:
+      case iface::cellml_services::PSEUDOSTATE_VARIABLE:
+        if (ct->assignedIndex() < stateNames.size())
+          stateNames[ct->assignedIndex()] = source->name();
+        break;
+      case iface::cellml_services::ALGEBRAIC:
+        if (ct->assignedIndex() < algebraicNames.size())
+          algebraicNames[ct->assignedIndex()] = source->name();
+        break;
+      default:
+        break;
+      }
+    }
+
+    printf("\"%S\"", voiName.c_str());
+    for (std::vector<std::pair<iface::cellml_services::OutputColumnType,
+           uint32_t> >::iterator i = gOutputColumns.begin();
+         i != gOutputColumns.end(); i++)
+    {
+      std::wstring n;
+      switch ((*i).first)
+      {
+      case iface::cellml_services::OUTPUT_STATE:
+        if ((*i).second < stateNames.size())
+          n = stateNames[(*i).second];
+        break;
+      case iface::cellml_services::OUTPUT_RATE:
+        if ((*i).second < stateNames.size())
+          n = L"d(" + stateNames[(*i).second] + L")/d(" + voiName + L")";
+        break;
+      case iface::cellml_services::OUTPUT_ALGEBRAIC:
+        if ((*i).second < algebraicNames.size())
+          n = algebraicNames[(*i).second];
+        break;
+      }
+      printf(",\"%S\"", n.c_str());
+    }
+    printf("\n");
+  }
+
   void add_ref()
     throw(std::exception&)
   {
@@ -183,6 +267,11 @@ public:
     uint32_t ric = mCI->rateIndexCount();
     uint32_t recsize = 2 * ric + aic + 1;
 
+    // The records then hold just the variable of integration and the columns
+    // picked, in order...
+    if (!gOutputColumns.empty())
+      recsize = gOutputColumns.size() + 1;
+
     if (recsize == 1)
       return;
 
@@ -216,6 +305,14 @@ public:
         }
       }
 
+      if (!gOutputColumns.empty())
+      {
+        for (uint32_t j = 0; j < recsize; j++)
+          printf(j == 0 ? "\"%g\"" : ",\"%g\"", values[i + j]);
+        puts("");
+        continue;
+      }
+
       bool first = true;
       ObjRef<iface::cellml_services::ComputationTargetIterator> cti =
         mCI->iterateTargets();
@@ -259,6 +356,7 @@ public:
   void done()
     throw (std::exception&)
   {
+    printStatistics();
     printf("# Run completed.\n");
     CDALock l(gFinishedMutex);
     gFinished = true;
@@ -267,11 +365,37 @@ public:
   void failed(const std::string& errmsg)
     throw (std::exception&)
   {
+    printStatistics();
     printf("# Integration failed (%s)\n", errmsg.c_str());
     CDALock l(gFinishedMutex);
     gFinished = true;
   }
 private:
+  void printStatistics()
+  {
+    if (!gPrintStatistics)
+      return;
+
+    ObjRef<iface::cellml_services::IntegrationStatistics> s =
+      mRun->statistics();
+    printf("# Statistics: %llu rate evaluations, %llu Jacobian evaluations, "
+           "%llu steps, %llu rejected steps\n",
+           (unsigned long long)s->rhsEvaluations(),
+           (unsigned long long)s->jacobianEvaluations(),
+           (unsigned long long)s->steps(),
+           (unsigned long long)s->rejectedSteps());
+    printf("# Statistics: %llu nonlinear iterations, %llu convergence failures, "
+           "%llu roots, %llu algebraic solve iterations\n",
+           (unsigned long long)s->nonlinearIterations(),
+           (unsigned long long)s->nonlinearConvergenceFailures(),
+           (unsigned long long)s->rootsFound(),
+           (unsigned long long)s->algebraicSolveIterations());
+    printf("# Statistics: %gs setting up, %gs solving (%gs computing "
+           "variables), %gs in the observer\n",
+           s->setupTime(), s->solveTime(), s->computeVariablesTime(),
+           s->observerTime());
+  }
+
   ObjRef<iface::cellml_services::CellMLCompiledModel> mCCM;
   ObjRef<iface::cellml_services::CodeInformation> mCI;
   uint32_t mRefcount;
@@ -280,6 +404,261 @@ private:
   iface::cellml_services::CellMLIntegrationRun* mRun;
 };
 
+/*
+ * Keeps the computed constants and results of a run, for the checks below to
+ * compare against, rather than printing them.
+ */
+class CollectingProgressObserver
+  : public iface::cellml_services::IntegrationProgressObserver
+{
+public:
+  CollectingProgressObserver()
+    : mRefcount(1), mFailed(false)
+  {
+  }
+
+  void add_ref()
+    throw(std::exception&)
+  {
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_4)
+    __sync_fetch_and_add(&mRefcount, 1);
+#elif defined(WIN32)
+    InterlockedIncrement((volatile long int*)&mRefcount);
+#else
+    mRefcount++;
+#endif
+  }
+
+  void release_ref()
+    throw(std::exception&)
+  {
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_4)
+    if (__sync_sub_and_fetch(&mRefcount, 1) == 0)
+      delete this;
+#elif defined(WIN32)
+    if (InterlockedDecrement((volatile long int*)&mRefcount) == 0)
+      delete this;
+#else
+    mRefcount--;
+    if (mRefcount == 0)
+      delete this;
+#endif
+  }
+
+  std::string objid()
+    throw (std::exception&)
+  {
+    return "singletonCollectingProgressObserver";
+  }
+
+  void* query_interface(const std::string& iface)
+    throw (std::exception&)
+  {
+    add_ref();
+    if (iface == "XPCOM::IObject")
+      return static_cast< ::iface::XPCOM::IObject* >(this);
+    else if (iface == "cellml_services::IntegrationProgressObserver")
+      return
+        static_cast< ::iface::cellml_services::IntegrationProgressObserver*>
+        (this);
+    release_ref();
+    return NULL;
+  }
+
+  std::vector<std::string> supported_interfaces() throw()
+  {
+    std::vector<std::string> ret;
+    ret.push_back("XPCOM::IObject");
+    ret.push_back("cellml_services::IntegrationProgressObserver");
+    return ret;
+  }
+
+  void computedConstants(const std::vector<double>& values)
+    throw (std::exception&)
+  {
+    mConstants = values;
+  }
+
+  void results(const std::vector<double>& values)
+    throw (std::exception&)
+  {
+    mResults.insert(mResults.end(), values.begin(), values.end());
+  }
+
+  void done()
+    throw (std::exception&)
+  {
+    CDALock l(gFinishedMutex);
+    gFinished = true;
+  }
+
+  void failed(const std::string& errmsg)
+    throw (std::exception&)
+  {
+    printf("# Integration failed (%s)\n", errmsg.c_str());
+    mFailed = true;
+    CDALock l(gFinishedMutex);
+    gFinished = true;
+  }
+
+  std::vector<double> mConstants, mResults;
+  bool mFailed;
+
+private:
+  uint32_t mRefcount;
+};
+
+/*
+ * Keeps what each member of an ensemble run reported, and notes any
+ * callback that breaks the ordering EnsembleProgressObserver promises.
+ */
+class CollectingEnsembleObserver
+  : public iface::cellml_services::EnsembleProgressObserver
+{
+public:
+  CollectingEnsembleObserver(uint32_t aMemberCount)
+    : mRefcount(1), mMembers(aMemberCount), mDoneCount(0),
+      mFinishedAtDone(0), mOutOfOrder(0)
+  {
+  }
+
+  void add_ref()
+    throw(std::exception&)
+  {
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_4)
+    __sync_fetch_and_add(&mRefcount, 1);
+#elif defined(WIN32)
+    InterlockedIncrement((volatile long int*)&mRefcount);
+#else
+    mRefcount++;
+#endif
+  }
+
+  void release_ref()
+    throw(std::exception&)
+  {
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_4)
+    if (__sync_sub_and_fetch(&mRefcount, 1) == 0)
+      delete this;
+#elif defined(WIN32)
+    if (InterlockedDecrement((volatile long int*)&mRefcount) == 0)
+      delete this;
+#else
+    mRefcount--;
+    if (mRefcount == 0)
+      delete this;
+#endif
+  }
+
+  std::string objid()
+    throw (std::exception&)
+  {
+    return "singletonCollectingEnsembleObserver";
+  }
+
+  void* query_interface(const std::string& iface)
+    throw (std::exception&)
+  {
+    add_ref();
+    if (iface == "XPCOM::IObject")
+      return static_cast< ::iface::XPCOM::IObject* >(this);
+    else if (iface == "cellml_services::EnsembleProgressObserver")
+      return
+        static_cast< ::iface::cellml_services::EnsembleProgressObserver*>
+        (this);
+    release_ref();
+    return NULL;
+  }
+
+  std::vector<std::string> supported_interfaces() throw()
+  {
+    std::vector<std::string> ret;
+    ret.push_back("XPCOM::IObject");
+    ret.push_back("cellml_services::EnsembleProgressObserver");
+    return ret;
+  }
+
+  void computedConstants(uint32_t member, const std::vector<double>& values)
+    throw (std::exception&)
+  {
+    CDALock l(mMutex);
+    if (!checkMember(member))
+      return;
+    mMembers[member].mConstants = values;
+  }
+
+  void results(uint32_t member, const std::vector<double>& state)
+    throw (std::exception&)
+  {
+    CDALock l(mMutex);
+    if (!checkMember(member))
+      return;
+    std::vector<double>& r = mMembers[member].mResults;
+    r.insert(r.end(), state.begin(), state.end());
+  }
+
+  void memberDone(uint32_t member)
+    throw (std::exception&)
+  {
+    CDALock l(mMutex);
+    if (!checkMember(member))
+      return;
+    mMembers[member].mFinished = true;
+  }
+
+  void memberFailed(uint32_t member, const std::string& errorMessage)
+    throw (std::exception&)
+  {
+    CDALock l(mMutex);
+    if (!checkMember(member))
+      return;
+    mMembers[member].mFinished = true;
+    mMembers[member].mFailed = true;
+  }
+
+  void done()
+    throw (std::exception&)
+  {
+    {
+      CDALock l(mMutex);
+      mDoneCount++;
+      mFinishedAtDone = 0;
+      for (uint32_t i = 0; i < mMembers.size(); i++)
+        if (mMembers[i].mFinished)
+          mFinishedAtDone++;
+    }
+    CDALock l(gFinishedMutex);
+    gFinished = true;
+  }
+
+  struct Member
+  {
+    Member() : mFinished(false), mFailed(false) {}
+    std::vector<double> mConstants, mResults;
+    bool mFinished, mFailed;
+  };
+
+  CDAMutex mMutex;
+  std::vector<Member> mMembers;
+  uint32_t mDoneCount, mFinishedAtDone;
+  // Callbacks for unknown or already finished members, or after done().
+  uint32_t mOutOfOrder;
+
+private:
+  bool checkMember(uint32_t aMember)
+  {
+    if (mDoneCount != 0 || aMember >= mMembers.size() ||
+        mMembers[aMember].mFinished)
+    {
+      mOutOfOrder++;
+      return false;
+    }
+    return true;
+  }
+
+  uint32_t mRefcount;
+};
+
 void ProcessInitialKeywords(int argc, char** argv)
 {
   // Scoped locale change.
@@ -303,6 +682,40 @@ void ProcessInitialKeywords(int argc, char** argv)
       else
         printf("# Warning: debug command given unrecognised value - true and false accepted.\n");
     }
+    else if (!strcasecmp(command, "interpret"))
+      gInterpretSim = !strcasecmp(value, "true");
+    else if (!strcasecmp(command, "check"))
+      gCheck = value;
+    else if (!strcasecmp(command, "batch_width"))
+      gBatchWidth = strtoul(value, NULL, 10);
+    else if (!strcasecmp(command, "lookup_table"))
+      gLookupTable = value;
+    else if (!strcasecmp(command, "output_columns"))
+    {
+      gOutputColumns.clear();
+      while (*value)
+      {
+        iface::cellml_services::OutputColumnType type;
+        if (*value == 's')
+          type = iface::cellml_services::OUTPUT_STATE;
+        else if (*value == 'r')
+          type = iface::cellml_services::OUTPUT_RATE;
+        else if (*value == 'a')
+          type = iface::cellml_services::OUTPUT_ALGEBRAIC;
+        else
+        {
+          printf("# Warning: Expected s, r or a in output_columns. "
+                 "Rest of output_columns ignored.\n");
+          break;
+        }
+        value++;
+        gOutputColumns.push_back
+          (std::pair<iface::cellml_services::OutputColumnType, uint32_t>
+           (type, strtoul(value, &value, 10)));
+        if (*value == ',')
+          value++;
+      }
+    }
   }
 }
 
@@ -351,6 +764,8 @@ ProcessKeywords(int argc, char** argv,
         ist = iface::cellml_services::ADAMS_MOULTON_1_12;
       else if (!strcasecmp(value, "BDF15SIMP"))
         ist = iface::cellml_services::BDF_IMPLICIT_1_5_SOLVE;
+      else if (!strcasecmp(value, "RL"))
+        ist = iface::cellml_services::RUSH_LARSEN;
       else if (!strcasecmp(value, "IDA"))
         continue;
       else
@@ -419,6 +834,31 @@ ProcessKeywords(int argc, char** argv,
         continue;
       }
       run->setStepSizeControl(epsAbs, epsRel, scalVar, scalRate, maxStep);
+      gStepSizeControlSet = true;
+      gEpsAbs = epsAbs;
+      gEpsRel = epsRel;
+      gScalVar = scalVar;
+      gScalRate = scalRate;
+      gMaxStep = maxStep;
+    }
+    else if (!strcasecmp(command, "linear_solver"))
+    {
+      iface::cellml_services::LinearSolverType lst;
+      if (!strcasecmp(value, "AUTO"))
+        lst = iface::cellml_services::LINEAR_SOLVER_AUTOMATIC;
+      else if (!strcasecmp(value, "DENSE"))
+        lst = iface::cellml_services::LINEAR_SOLVER_DENSE;
+      else if (!strcasecmp(value, "BAND"))
+        lst = iface::cellml_services::LINEAR_SOLVER_BAND;
+      else if (!strcasecmp(value, "SPGMR"))
+        lst = iface::cellml_services::LINEAR_SOLVER_SPGMR;
+      else
+      {
+        printf("# Warning: Unsupported linear_solver value %s (ignored)\n",
+               value);
+        continue;
+      }
+      run->linearSolverType(lst);
     }
     else if (!strcasecmp(command, "range"))
     {
@@ -462,6 +902,18 @@ ProcessKeywords(int argc, char** argv,
       gTabStep = tabstepsize;
       gTStrict = tstrict;
     }
+    else if (!strcasecmp(command, "interpolate_tabulation"))
+    {
+      run->interpolateTabulation(!strcasecmp(value, "true"));
+    }
+    else if (!strcasecmp(command, "nonlinear_solver_threads"))
+    {
+      run->nonlinearSolverThreads(strtoul(value, NULL, 10));
+    }
+    else if (!strcasecmp(command, "cache_definite_integrals"))
+    {
+      run->cacheDefiniteIntegrals(!strcasecmp(value, "true"));
+    }
     // A special undocumented debugging command...
     else if (!strcasecmp(command, "sleep_time"))
     {
@@ -471,7 +923,22 @@ ProcessKeywords(int argc, char** argv,
     {
       gRealTimeFactor = strtod(value, NULL);
     }
-    else if (!strcasecmp(command, "debug"))
+    else if (!strcasecmp(command, "statistics"))
+    {
+      gPrintStatistics = !strcasecmp(value, "true");
+    }
+    else if (!strcasecmp(command, "output_columns"))
+    {
+      for (std::vector<std::pair<iface::cellml_services::OutputColumnType,
+             uint32_t> >::iterator i = gOutputColumns.begin();
+           i != gOutputColumns.end(); i++)
+        run->addOutputColumn((*i).first, (*i).second);
+    }
+    else if (!strcasecmp(command, "debug") ||
+             !strcasecmp(command, "interpret") ||
+             !strcasecmp(command, "check") ||
+             !strcasecmp(command, "batch_width") ||
+             !strcasecmp(command, "lookup_table"))
       ; // ProcessInitialKeywords
     else
       printf("# Warning: Unrecognised command %s. Ignored.\n",
@@ -552,7 +1019,10 @@ ODEMain(iface::cellml_services::CellMLIntegrationService* cis,
   try
   {
     printf("# Compiling model...\n");
-    ccm = gDebugSim ? cis->compileDebugModelODE(mod) : cis->compileModelODE(mod);
+    if (gInterpretSim)
+      ccm = cis->compileModelODEInterpreted(mod);
+    else
+      ccm = gDebugSim ? cis->compileDebugModelODE(mod) : cis->compileModelODE(mod);
   }
   catch (iface::cellml_api::CellMLException& ce)
   {
@@ -596,6 +1066,600 @@ ODEMain(iface::cellml_services::CellMLIntegrationService* cis,
   return 0;
 }
 
+static void
+WaitForRun()
+{
+  while (1)
+  {
+    {
+      CDALock l(gFinishedMutex);
+      if (gFinished) break;
+    }
+    usleep(10000);
+  }
+  gFinished = false;
+}
+
+// Are a and b the same, allowing for the compiler rearranging arithmetic?
+static bool
+CloseEnough(double a, double b)
+{
+  return fabs(a - b) <= 1E-10 * std::max(1.0, std::max(fabs(a), fabs(b)));
+}
+
+/*
+ * Checks that every lane of computeRatesBatch gives the same rates as the
+ * model compiled by compileModelODE, at each point the latter's run
+ * records. Each record is put in every lane in turn, with the other lanes
+ * holding other records.
+ */
+int
+CheckBatch(iface::cellml_services::CellMLIntegrationService* cis,
+           iface::cellml_api::Model* mod, int argc, char** argv)
+{
+  ObjRef<iface::cellml_services::ODESolverCompiledModel> ccm, bccm;
+  try
+  {
+    printf("# Compiling model...\n");
+    ccm = cis->compileModelODE(mod);
+    printf("# Compiling model for batch evaluation...\n");
+    bccm = cis->compileBatchModelODE(mod, gBatchWidth);
+  }
+  catch (iface::cellml_api::CellMLException& ce)
+  {
+    std::wstring err = cis->lastError();
+    printf("Caught a CellMLException while compiling model: %S\n", err.c_str());
+    return -1;
+  }
+
+  printf("# Creating run...\n");
+  ObjRef<iface::cellml_services::ODESolverRun> cir =
+    cis->createODEIntegrationRun(ccm);
+  ObjRef<CollectingProgressObserver> cpo =
+    already_AddRefd<CollectingProgressObserver>(new CollectingProgressObserver());
+  cir->setProgressObserver(cpo);
+  ProcessKeywords(argc, argv, cir);
+  cir->start();
+  WaitForRun();
+  if (cpo->mFailed)
+    return -1;
+
+  ObjRef<iface::cellml_services::CodeInformation> ci = ccm->codeInformation();
+  uint32_t ric = ci->rateIndexCount(), cic = ci->constantIndexCount();
+  uint32_t recsize = 2 * ric + ci->algebraicIndexCount() + 1;
+  uint32_t nrecs = cpo->mResults.size() / recsize, width = bccm->batchWidth();
+  const double* recs = cpo->mResults.empty() ? NULL : &cpo->mResults[0];
+  printf("# Comparing %u records in each of %u lanes...\n", nrecs, width);
+
+  std::vector<double> constants(cic * width), states(ric * width);
+  for (uint32_t i = 0; i < cic; i++)
+    for (uint32_t l = 0; l < width; l++)
+      constants[i * width + l] = cpo->mConstants[i];
+
+  for (uint32_t r = 0; r < nrecs; r++)
+    for (uint32_t lane = 0; lane < width; lane++)
+    {
+      for (uint32_t l = 0; l < width; l++)
+      {
+        const double* rec = recs + ((r + nrecs + l - lane) % nrecs) * recsize;
+        for (uint32_t i = 0; i < ric; i++)
+          states[i * width + l] = rec[1 + i];
+      }
+
+      const double* rec = recs + r * recsize;
+      std::vector<double> rates = bccm->computeRatesBatch(rec[0], constants, states);
+      for (uint32_t i = 0; i < ric; i++)
+        if (!CloseEnough(rates[i * width + lane], rec[1 + ric + i]))
+        {
+          printf("Lane %u at %g: rate %u is %g, not %g\n", lane, rec[0], i,
+                 rates[i * width + lane], rec[1 + ric + i]);
+          return -1;
+        }
+    }
+
+  printf("Batch rates match compileModelODE.\n");
+  return 0;
+}
+
+#define ENSEMBLE_CHECK_MEMBERS 4
+#define ENSEMBLE_CHECK_FAILING_MEMBER 2
+#define ENSEMBLE_CHECK_STOPPED_MEMBERS 256
+
+// Runs ccm on its own, overriding the first constant and state variable.
+static already_AddRefd<CollectingProgressObserver>
+RunSingleMember(iface::cellml_services::CellMLIntegrationService* cis,
+                iface::cellml_services::ODESolverCompiledModel* ccm,
+                int argc, char** argv, const double* aOverrides)
+{
+  ObjRef<iface::cellml_services::ODESolverRun> cir =
+    cis->createODEIntegrationRun(ccm);
+  ObjRef<CollectingProgressObserver> cpo =
+    already_AddRefd<CollectingProgressObserver>(new CollectingProgressObserver());
+  cir->setProgressObserver(cpo);
+  ProcessKeywords(argc, argv, cir);
+  if (aOverrides != NULL)
+  {
+    cir->setOverride(iface::cellml_services::CONSTANT, 0, aOverrides[0]);
+    cir->setOverride(iface::cellml_services::STATE_VARIABLE, 0, aOverrides[1]);
+  }
+  cir->start();
+  WaitForRun();
+  cpo->add_ref();
+  return cpo.getPointer();
+}
+
+// Gives an ensemble run the settings the other options gave aTemplate.
+static void
+CopyRunSettings(iface::cellml_services::ODESolverRun* aTemplate,
+                iface::cellml_services::ODESolverEnsembleRun* aEnsemble)
+{
+  aEnsemble->stepType(aTemplate->stepType());
+  aEnsemble->interpolateTabulation(aTemplate->interpolateTabulation());
+  if (gStepSizeControlSet)
+    aEnsemble->setStepSizeControl(gEpsAbs, gEpsRel, gScalVar, gScalRate,
+                                  gMaxStep);
+  if (gTabStep != 0.0)
+    aEnsemble->setTabulationStepControl(gTabStep, gTStrict);
+  aEnsemble->setResultRange(gStart, gStop, gDensity);
+}
+
+/*
+ * Checks an ensemble run, overriding the first constant and state variable,
+ * against single runs with the same overrides. One member's initial value is
+ * not a number, so it must fail on its own. Then checks that stop() leaves
+ * done() as the last callback.
+ */
+int
+CheckEnsemble(iface::cellml_services::CellMLIntegrationService* cis,
+              iface::cellml_api::Model* mod, int argc, char** argv)
+{
+  ObjRef<iface::cellml_services::ODESolverCompiledModel> ccm;
+  try
+  {
+    printf("# Compiling model...\n");
+    ccm = cis->compileModelODE(mod);
+  }
+  catch (iface::cellml_api::CellMLException& ce)
+  {
+    std::wstring err = cis->lastError();
+    printf("Caught a CellMLException while compiling model: %S\n", err.c_str());
+    return -1;
+  }
+
+  ObjRef<iface::cellml_services::CodeInformation> ci = ccm->codeInformation();
+  if (ci->constantIndexCount() == 0 || ci->rateIndexCount() == 0)
+  {
+    printf("The model needs a constant and a state variable to override.\n");
+    return -1;
+  }
+
+  printf("# Running the model without overrides...\n");
+  ObjRef<CollectingProgressObserver> base =
+    RunSingleMember(cis, ccm, argc, argv, NULL);
+  if (base->mFailed || base->mResults.empty())
+    return -1;
+
+  std::vector<double> overrides;
+  for (uint32_t m = 0; m < ENSEMBLE_CHECK_MEMBERS; m++)
+  {
+    overrides.push_back(base->mConstants[0] * (1.0 + 0.05 * m));
+    if (m == ENSEMBLE_CHECK_FAILING_MEMBER)
+      overrides.push_back(strtod("NAN", NULL));
+    else
+      overrides.push_back(base->mResults[1] * (1.0 + 0.02 * m));
+  }
+
+  ObjRef<iface::cellml_services::ODESolverRun> settings =
+    cis->createODEIntegrationRun(ccm);
+  ProcessKeywords(argc, argv, settings);
+
+  printf("# Running %u members...\n", ENSEMBLE_CHECK_MEMBERS);
+  ObjRef<iface::cellml_services::ODESolverEnsembleRun> er =
+    cis->createODEEnsembleRun(ccm);
+  CopyRunSettings(settings, er);
+  er->workerCount(2);
+  er->addOverrideColumn(iface::cellml_services::CONSTANT, 0);
+  er->addOverrideColumn(iface::cellml_services::STATE_VARIABLE, 0);
+  er->setOverrideValues(ENSEMBLE_CHECK_MEMBERS, overrides);
+  ObjRef<CollectingEnsembleObserver> ceo =
+    already_AddRefd<CollectingEnsembleObserver>
+    (new CollectingEnsembleObserver(ENSEMBLE_CHECK_MEMBERS));
+  er->setProgressObserver(ceo);
+  er->start();
+  WaitForRun();
+  // Give any callback that wrongly comes after done() the chance to arrive.
+  usleep(100000);
+
+  CDALock l(ceo->mMutex);
+  if (ceo->mDoneCount != 1 || ceo->mOutOfOrder != 0 ||
+      ceo->mFinishedAtDone != ENSEMBLE_CHECK_MEMBERS)
+  {
+    printf("done() came %u times, with %u of %u members finished, and %u "
+           "callbacks out of order.\n", ceo->mDoneCount, ceo->mFinishedAtDone,
+           ENSEMBLE_CHECK_MEMBERS, ceo->mOutOfOrder);
+    return -1;
+  }
+  printf("done() came once, after every member finished.\n");
+
+  for (uint32_t m = 0; m < ENSEMBLE_CHECK_MEMBERS; m++)
+  {
+    CollectingEnsembleObserver::Member& em = ceo->mMembers[m];
+    ObjRef<CollectingProgressObserver> single =
+      RunSingleMember(cis, ccm, argc, argv, &overrides[m * 2]);
+    if (em.mFailed != (m == ENSEMBLE_CHECK_FAILING_MEMBER) ||
+        em.mFailed != single->mFailed)
+    {
+      printf("Member %u %s, but its single run %s.\n", m,
+             em.mFailed ? "failed" : "succeeded",
+             single->mFailed ? "failed" : "succeeded");
+      return -1;
+    }
+    if (em.mFailed)
+      continue;
+
+    if (em.mConstants.size() != single->mConstants.size() ||
+        em.mResults.size() != single->mResults.size())
+    {
+      printf("Member %u gave %u constants and %u results, not %u and %u.\n",
+             m, (uint32_t)em.mConstants.size(), (uint32_t)em.mResults.size(),
+             (uint32_t)single->mConstants.size(),
+             (uint32_t)single->mResults.size());
+      return -1;
+    }
+    for (uint32_t i = 0; i < em.mConstants.size(); i++)
+      if (!CloseEnough(em.mConstants[i], single->mConstants[i]))
+      {
+        printf("Member %u: constant %u is %g, not %g.\n", m, i,
+               em.mConstants[i], single->mConstants[i]);
+        return -1;
+      }
+    for (uint32_t i = 0; i < em.mResults.size(); i++)
+      if (!CloseEnough(em.mResults[i], single->mResults[i]))
+      {
+        printf("Member %u: result %u is %g, not %g.\n", m, i,
+               em.mResults[i], single->mResults[i]);
+        return -1;
+      }
+  }
+  printf("Members match single runs with the same overrides.\n");
+  printf("Member %u failed, as its single run did.\n",
+         ENSEMBLE_CHECK_FAILING_MEMBER);
+
+  printf("# Running %u members and stopping them...\n",
+         ENSEMBLE_CHECK_STOPPED_MEMBERS);
+  std::vector<double> stoppedOverrides;
+  for (uint32_t m = 0; m < ENSEMBLE_CHECK_STOPPED_MEMBERS; m++)
+  {
+    stoppedOverrides.push_back(base->mConstants[0]);
+    stoppedOverrides.push_back(base->mResults[1]);
+  }
+  er = cis->createODEEnsembleRun(ccm);
+  CopyRunSettings(settings, er);
+  er->workerCount(2);
+  er->addOverrideColumn(iface::cellml_services::CONSTANT, 0);
+  er->addOverrideColumn(iface::cellml_services::STATE_VARIABLE, 0);
+  er->setOverrideValues(ENSEMBLE_CHECK_STOPPED_MEMBERS, stoppedOverrides);
+  ObjRef<CollectingEnsembleObserver> sceo =
+    already_AddRefd<CollectingEnsembleObserver>
+    (new CollectingEnsembleObserver(ENSEMBLE_CHECK_STOPPED_MEMBERS));
+  er->setProgressObserver(sceo);
+  er->start();
+  er->stop();
+  WaitForRun();
+  usleep(100000);
+
+  CDALock sl(sceo->mMutex);
+  uint32_t started = 0;
+  for (uint32_t m = 0; m < ENSEMBLE_CHECK_STOPPED_MEMBERS; m++)
+  {
+    CollectingEnsembleObserver::Member& em = sceo->mMembers[m];
+    if (!em.mFinished && !em.mResults.empty())
+    {
+      printf("Member %u gave results but never finished.\n", m);
+      return -1;
+    }
+    if (em.mFinished)
+      started++;
+  }
+  if (sceo->mDoneCount != 1 || sceo->mOutOfOrder != 0 ||
+      sceo->mFinishedAtDone != started)
+  {
+    printf("After stop(), done() came %u times, with %u of %u started members "
+           "finished, and %u callbacks out of order.\n", sceo->mDoneCount,
+           sceo->mFinishedAtDone, started, sceo->mOutOfOrder);
+    return -1;
+  }
+  if (started == ENSEMBLE_CHECK_STOPPED_MEMBERS)
+  {
+    printf("stop() didn't abandon any members.\n");
+    return -1;
+  }
+  printf("stop() abandoned members, and done() still came once, last.\n");
+
+  return 0;
+}
+
+// The largest interpolation error check lookup_table accepts, and the largest
+// difference it accepts between the states with and without the tables,
+// relative to the largest magnitude each state reaches.
+#define LOOKUP_CHECK_MAX_ERROR 1E-2
+#define LOOKUP_CHECK_MAX_STATE_DIFFERENCE 1E-2
+
+/*
+ * Checks a model compiled by compileModelODEWithLookupTable: the constants
+ * at lookupTableErrorIndices must hold small, finite errors, and a run must
+ * match one of the model compiled by compileModelODE.
+ */
+int
+CheckLookupTable(iface::cellml_services::CellMLIntegrationService* cis,
+                 iface::cellml_api::Model* mod, int argc, char** argv)
+{
+  char compName[256], varName[256];
+  double minimum, maximum, step;
+  if (gLookupTable == NULL ||
+      sscanf(gLookupTable, "%255[^/]/%255[^,],%lf,%lf,%lf", compName, varName,
+             &minimum, &maximum, &step) != 5)
+  {
+    printf("check lookup_table needs lookup_table "
+           "component/variable,minimum,maximum,step.\n");
+    return -1;
+  }
+
+  std::wstring wcompName, wvarName;
+  for (const char* p = compName; *p; p++)
+    wcompName += static_cast<wchar_t>(*p);
+  for (const char* p = varName; *p; p++)
+    wvarName += static_cast<wchar_t>(*p);
+
+  ObjRef<iface::cellml_api::CellMLComponentSet> ccs = mod->modelComponents();
+  ObjRef<iface::cellml_api::CellMLComponent> comp =
+    ccs->getComponent(wcompName.c_str());
+  ObjRef<iface::cellml_api::CellMLVariable> v;
+  if (comp != NULL)
+  {
+    ObjRef<iface::cellml_api::CellMLVariableSet> vs = comp->variables();
+    v = vs->getVariable(wvarName.c_str());
+  }
+  if (v == NULL)
+  {
+    printf("Can't find %s/%s to tabulate against.\n", compName, varName);
+    return -1;
+  }
+
+  ObjRef<iface::cellml_services::ODESolverCompiledModel> ccm, lccm;
+  try
+  {
+    printf("# Compiling model...\n");
+    ccm = cis->compileModelODE(mod);
+    printf("# Compiling model with lookup tables...\n");
+    lccm = cis->compileModelODEWithLookupTable(mod, v, minimum, maximum, step);
+  }
+  catch (iface::cellml_api::CellMLException& ce)
+  {
+    std::wstring err = cis->lastError();
+    printf("Caught a CellMLException while compiling model: %S\n", err.c_str());
+    return -1;
+  }
+
+  printf("# Running model...\n");
+  ObjRef<CollectingProgressObserver> cpo =
+    RunSingleMember(cis, ccm, argc, argv, NULL);
+  printf("# Running model with lookup tables...\n");
+  ObjRef<CollectingProgressObserver> lcpo =
+    RunSingleMember(cis, lccm, argc, argv, NULL);
+  if (cpo->mFailed || lcpo->mFailed)
+  {
+    printf("A run failed.\n");
+    return -1;
+  }
+
+  ObjRef<iface::cellml_services::CodeInformation> ci = lccm->codeInformation();
+  std::vector<uint32_t> errorIndices = ci->lookupTableErrorIndices();
+  if (errorIndices.empty())
+  {
+    printf("No lookup tables were made.\n");
+    return -1;
+  }
+  for (std::vector<uint32_t>::iterator eii = errorIndices.begin();
+       eii != errorIndices.end(); eii++)
+  {
+    if (*eii >= lcpo->mConstants.size())
+    {
+      printf("Lookup table error index %u is out of range.\n", *eii);
+      return -1;
+    }
+    double error = lcpo->mConstants[*eii];
+    // Written to be false for NaN, too.
+    if (!(error >= 0.0 && error <= LOOKUP_CHECK_MAX_ERROR))
+    {
+      printf("Lookup table error in constant %u is %g.\n", *eii, error);
+      return -1;
+    }
+  }
+  printf("Lookup tables made: %u, with errors below %g.\n",
+         static_cast<uint32_t>(errorIndices.size()), LOOKUP_CHECK_MAX_ERROR);
+
+  uint32_t ric = ci->rateIndexCount();
+  uint32_t recsize = 2 * ric + ci->algebraicIndexCount() + 1;
+  if (cpo->mResults.size() != lcpo->mResults.size())
+  {
+    printf("The runs recorded %u and %u points.\n",
+           static_cast<uint32_t>(cpo->mResults.size() / recsize),
+           static_cast<uint32_t>(lcpo->mResults.size() / recsize));
+    return -1;
+  }
+  for (uint32_t i = 0; i < ric; i++)
+  {
+    double largest = 0.0, difference = 0.0;
+    for (uint32_t r = 0; r < cpo->mResults.size(); r += recsize)
+    {
+      largest = std::max(largest, fabs(cpo->mResults[r + 1 + i]));
+      difference = std::max(difference, fabs(cpo->mResults[r + 1 + i] -
+                                             lcpo->mResults[r + 1 + i]));
+    }
+    if (!(difference <= LOOKUP_CHECK_MAX_STATE_DIFFERENCE * largest))
+    {
+      printf("State %u differs by %g with lookup tables.\n", i, difference);
+      return -1;
+    }
+  }
+  printf("States match the run without lookup tables.\n");
+  return 0;
+}
+
+// Runs ccm from aStart to aStop, starting from aStates if it isn't NULL.
+static already_AddRefd<CollectingProgressObserver>
+RunPart(iface::cellml_services::CellMLIntegrationService* cis,
+        iface::cellml_services::ODESolverCompiledModel* ccm,
+        int argc, char** argv, double aStart, double aStop,
+        const double* aStates, bool aContinue)
+{
+  ObjRef<iface::cellml_services::ODESolverRun> cir =
+    cis->createODEIntegrationRun(ccm);
+  ObjRef<CollectingProgressObserver> cpo =
+    already_AddRefd<CollectingProgressObserver>(new CollectingProgressObserver());
+  cir->setProgressObserver(cpo);
+  ProcessKeywords(argc, argv, cir);
+  cir->setResultRange(aStart, aStop, gDensity);
+  cir->continueSolver(aContinue);
+  if (aStates != NULL)
+  {
+    ObjRef<iface::cellml_services::CodeInformation> ci = ccm->codeInformation();
+    for (uint32_t i = 0; i < ci->rateIndexCount(); i++)
+      cir->setOverride(iface::cellml_services::STATE_VARIABLE, i, aStates[i]);
+  }
+  cir->start();
+  WaitForRun();
+  cpo->add_ref();
+  return cpo.getPointer();
+}
+
+// Do aFirst, then aSecond without its first record, give the same results
+// as aWhole?
+static bool
+SameAsWhole(const std::vector<double>& aWhole,
+            const std::vector<double>& aFirst,
+            const std::vector<double>& aSecond, uint32_t aRecordSize)
+{
+  if (aSecond.empty() ||
+      aFirst.size() + aSecond.size() - aRecordSize != aWhole.size())
+    return false;
+  for (uint32_t i = 0; i < aWhole.size(); i++)
+  {
+    double v = (i < aFirst.size()) ? aFirst[i] :
+      aSecond[i - aFirst.size() + aRecordSize];
+    if (!CloseEnough(v, aWhole[i]))
+      return false;
+  }
+  return true;
+}
+
+/*
+ * Checks runs which reuse the solver of an earlier run of the same compiled
+ * model. Running the model again must give the results of a run of a freshly
+ * compiled one. Splitting the range in two, with the second half carrying on
+ * from the first with continueSolver, must give the results of one run over
+ * the whole range, as the solver keeps the history it had at the middle,
+ * which starting the second half afresh must not.
+ */
+int
+CheckContinue(iface::cellml_services::CellMLIntegrationService* cis,
+              iface::cellml_api::Model* mod, int argc, char** argv)
+{
+  ObjRef<iface::cellml_services::ODESolverCompiledModel> ccm, fccm;
+  try
+  {
+    printf("# Compiling model twice...\n");
+    ccm = cis->compileModelODE(mod);
+    fccm = cis->compileModelODE(mod);
+  }
+  catch (iface::cellml_api::CellMLException& ce)
+  {
+    std::wstring err = cis->lastError();
+    printf("Caught a CellMLException while compiling model: %S\n", err.c_str());
+    return -1;
+  }
+
+  // Read the range from the options...
+  ObjRef<iface::cellml_services::ODESolverRun> settings =
+    cis->createODEIntegrationRun(ccm);
+  ProcessKeywords(argc, argv, settings);
+
+  ObjRef<iface::cellml_services::CodeInformation> ci = ccm->codeInformation();
+  uint32_t ric = ci->rateIndexCount();
+  uint32_t recsize = 2 * ric + ci->algebraicIndexCount() + 1;
+  double middle = (gStart + gStop) / 2;
+
+  printf("# Running the model twice, then each half in turn...\n");
+  ObjRef<CollectingProgressObserver> fresh =
+    RunPart(cis, fccm, argc, argv, gStart, gStop, NULL, false);
+  ObjRef<CollectingProgressObserver> first =
+    RunPart(cis, ccm, argc, argv, gStart, gStop, NULL, false);
+  ObjRef<CollectingProgressObserver> again =
+    RunPart(cis, ccm, argc, argv, gStart, gStop, NULL, false);
+  ObjRef<CollectingProgressObserver> firstHalf =
+    RunPart(cis, ccm, argc, argv, gStart, middle, NULL, false);
+  if (fresh->mFailed || first->mFailed || again->mFailed ||
+      firstHalf->mFailed || firstHalf->mResults.empty())
+  {
+    printf("A run failed.\n");
+    return -1;
+  }
+
+  const double* middleRec =
+    &firstHalf->mResults[firstHalf->mResults.size() - recsize];
+  if (middleRec[0] != middle)
+  {
+    printf("The first half ended at %g, not %g.\n", middleRec[0], middle);
+    return -1;
+  }
+  ObjRef<CollectingProgressObserver> continued =
+    RunPart(cis, ccm, argc, argv, middle, gStop, middleRec + 1, true);
+  ObjRef<CollectingProgressObserver> restarted =
+    RunPart(cis, ccm, argc, argv, middle, gStop, middleRec + 1, false);
+  if (continued->mFailed || restarted->mFailed)
+  {
+    printf("A run failed.\n");
+    return -1;
+  }
+
+  if (first->mResults.size() != fresh->mResults.size() ||
+      again->mResults.size() != fresh->mResults.size())
+  {
+    printf("The runs recorded %u, %u and %u points.\n",
+           static_cast<uint32_t>(fresh->mResults.size() / recsize),
+           static_cast<uint32_t>(first->mResults.size() / recsize),
+           static_cast<uint32_t>(again->mResults.size() / recsize));
+    return -1;
+  }
+  for (uint32_t i = 0; i < fresh->mResults.size(); i++)
+    if (!CloseEnough(first->mResults[i], fresh->mResults[i]) ||
+        !CloseEnough(again->mResults[i], fresh->mResults[i]))
+    {
+      printf("Result %u is %g and then %g, not %g.\n", i,
+             first->mResults[i], again->mResults[i], fresh->mResults[i]);
+      return -1;
+    }
+  printf("Running the model again matches a freshly compiled model.\n");
+
+  if (!SameAsWhole(fresh->mResults, firstHalf->mResults, continued->mResults,
+                   recsize))
+  {
+    printf("The continued half doesn't match the run over the whole range.\n");
+    return -1;
+  }
+  if (SameAsWhole(fresh->mResults, firstHalf->mResults, restarted->mResults,
+                  recsize))
+  {
+    printf("The restarted half matches the run over the whole range too, so "
+           "the check can't tell whether the solver carried on.\n");
+    return -1;
+  }
+  printf("The second half carries on from the first, giving the run over the "
+         "whole range.\n");
+  return 0;
+}
+
 int
 main(int argc, char** argv)
 {
@@ -605,7 +1669,7 @@ main(int argc, char** argv)
     printf("Usage: RunCellML modelURL (options)*\n"
            "Available options:\n"
            "  step_type RK2|RK4|RKF45|RKCK|RKPD|"
-           "RK2IMP|RK2SIMP|RK4IMP|BSIMP|GEAR1|GEAR2|AM_1_12|BDF15SIMP|IDA\n"
+           "RK2IMP|RK2SIMP|RK4IMP|BSIMP|GEAR1|GEAR2|AM_1_12|BDF15SIMP|RL|IDA\n"
            "    => Sets the stepping algorithm to use:\n"
            "      RK2     = 2nd order Runge-Kutta.\n"
            "      RK4     = 4th order Runge-Kutta.\n"
@@ -620,6 +1684,13 @@ main(int argc, char** argv)
            "      GEAR2   = Implict Gear method (M=2).\n"
            "    AM_1_12   = Adams-Moulton (1-12)\n"
            "  BDF15SIMP   = BDF(1-5) with non-linear solve.\n"
+           "         RL   = Fixed step Rush-Larsen, stepping by max_step.\n"
+           "  linear_solver AUTO|DENSE|BAND|SPGMR\n"
+           "    => Sets the linear solver used by BDF15SIMP and IDA:\n"
+           "      AUTO  = Chosen from the structure of the model (default).\n"
+           "      DENSE = Dense LU factorisation.\n"
+           "      BAND  = Banded LU factorisation.\n"
+           "      SPGMR = Preconditioned GMRES.\n"
            "  step_size_control absolute_epsilon,relative_epsilon[,variable_weight[,max_step]]\n"
            "    => Sets the step-size control parameters.\n"
            "      absolute_epsilon: A floating point absolute error tolerance value.\n"
@@ -636,11 +1707,45 @@ main(int argc, char** argv)
            "    => Sets the interval in the bound variable for guaranteed values in other variables,\n"
            "       and whether to only tabulate values at points that are thus guaranteed.\n"
            "       step_size: A floating point tabulation step size.\n"
+           "  interpolate_tabulation true|false\n"
+           "    => Specifies whether AM_1_12, BDF15SIMP and IDA interpolate values at\n"
+           "       tabulation points instead of stepping to each of them.\n"
+           "  nonlinear_solver_threads number\n"
+           "    => Sets how many threads may try random starting points at once when\n"
+           "       solving a system of nonlinear equations fails (0 = one per\n"
+           "       processor; default 1).\n"
+           "  cache_definite_integrals true|false\n"
+           "    => Specifies whether definite integrals whose integrand takes the same\n"
+           "       values are looked up instead of being evaluated again.\n"
            "  real_time_factor number\n"
            "    => Slows the simulation so that number real seconds elapse for \n"
            "       each unit of time in the simulation.\n" 
+           "  output_columns column,column,...\n"
+           "    => Outputs just the variable of integration and these columns, each\n"
+           "       s, r or a (for a state variable, rate or algebraic variable)\n"
+           "       followed by its index.\n"
+           "  statistics true|false\n"
+           "    => Specifies whether to print how much work the run did, and how\n"
+           "       long it took, once it finishes.\n"
            "  debug true|false\n"
            "    => Specifies whether or not to use debug mode.\n"
+           "  interpret true|false\n"
+           "    => Specifies whether to interpret the model rather than compiling it\n"
+           "       (ODE solvers only; debug mode is then ignored).\n"
+           "  check batch|ensemble|lookup_table|continue\n"
+           "    => Instead of printing the results, checks part of the integration\n"
+           "       service against an ordinary run with the other options:\n"
+           "      batch    = computeRatesBatch against the rates recorded by the run.\n"
+           "      ensemble = An ensemble run against single runs with the same\n"
+           "                 overrides, and the order of its callbacks.\n"
+           "      lookup_table = compileModelODEWithLookupTable's interpolation\n"
+           "                 errors, and a run against one without the tables.\n"
+           "      continue = Runs reusing the solver of an earlier run, and a run\n"
+           "                 split in two with continueSolver, against fresh runs.\n"
+           "  batch_width number\n"
+           "    => Sets the batch width for check batch (default 4).\n"
+           "  lookup_table component/variable,minimum,maximum,step\n"
+           "    => Sets the variable and range check lookup_table tabulates against.\n"
           );
     return -1;
   }
@@ -683,7 +1788,20 @@ main(int argc, char** argv)
 
   int ret;
 
-  if (PeekForIDA(argc, argv))
+  if (gCheck != NULL && !strcasecmp(gCheck, "batch"))
+    ret = CheckBatch(cis, mod, argc, argv);
+  else if (gCheck != NULL && !strcasecmp(gCheck, "ensemble"))
+    ret = CheckEnsemble(cis, mod, argc, argv);
+  else if (gCheck != NULL && !strcasecmp(gCheck, "lookup_table"))
+    ret = CheckLookupTable(cis, mod, argc, argv);
+  else if (gCheck != NULL && !strcasecmp(gCheck, "continue"))
+    ret = CheckContinue(cis, mod, argc, argv);
+  else if (gCheck != NULL)
+  {
+    printf("Unknown check %s.\n", gCheck);
+    ret = -1;
+  }
+  else if (PeekForIDA(argc, argv))
     ret = IDAMain(cis, mod, argc, argv);
   else
     ret = ODEMain(cis, mod, argc, argv);
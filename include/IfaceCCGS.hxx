@@ -24,6 +24,7 @@ namespace iface
   namespace cellml_services
   {
     class CustomGenerator;
+    typedef std::vector<uint32_t>& IndexSeq;
     typedef enum _enum_VariableEvaluationType
     {
       VARIABLE_OF_INTEGRATION = 0,
@@ -79,6 +80,15 @@ namespace iface
       virtual std::wstring ratesString() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
       virtual std::wstring variablesString() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
       virtual std::wstring functionsString() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
+      virtual std::wstring jacobianString() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
+      virtual std::vector<uint32_t> rateDependencies(uint32_t rateIndex) throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
+      virtual std::wstring linearCoefficientsString() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
+      virtual std::vector<uint32_t> lookupTableErrorIndices() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
+      virtual std::vector<uint32_t> hoistedConstantIndices() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
+      virtual bool hasResetRules() throw(std::exception&)  = 0;
+      virtual uint32_t variablesFragmentCount() throw(std::exception&)  = 0;
+      virtual std::wstring variablesFragmentString(uint32_t fragment) throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
+      virtual std::vector<uint32_t> variablesFragmentsFor(const std::vector<uint32_t>& algebraicIndices) throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
       virtual already_AddRefd<iface::cellml_services::ComputationTargetIterator>  iterateTargets() throw(std::exception&) WARN_IF_RETURN_UNUSED = 0;
       virtual already_AddRefd<iface::mathml_dom::MathMLNodeList>  flaggedEquations() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
       virtual already_AddRefd<iface::cellml_services::ComputationTarget>  missingInitial() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
@@ -122,6 +132,17 @@ namespace iface
       virtual void declareTemporaryPattern(const std::wstring& attr) throw(std::exception&) = 0;
       virtual std::wstring conditionalAssignmentPattern() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
       virtual void conditionalAssignmentPattern(const std::wstring& attr) throw(std::exception&) = 0;
+      virtual std::wstring jacobianEntryPattern() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
+      virtual void jacobianEntryPattern(const std::wstring& attr) throw(std::exception&) = 0;
+      virtual std::wstring linearCoefficientPattern() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
+      virtual void linearCoefficientPattern(const std::wstring& attr) throw(std::exception&) = 0;
+      virtual void setLookupTable(iface::cellml_api::CellMLVariable* variable, double minimum, double maximum, double step) throw(std::exception&) = 0;
+      virtual std::wstring lookupTablePattern() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
+      virtual void lookupTablePattern(const std::wstring& attr) throw(std::exception&) = 0;
+      virtual std::wstring lookupTableBuildPattern() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
+      virtual void lookupTableBuildPattern(const std::wstring& attr) throw(std::exception&) = 0;
+      virtual bool hoistConstantSubexpressions() throw(std::exception&)  = 0;
+      virtual void hoistConstantSubexpressions(bool attr) throw(std::exception&) = 0;
       virtual already_AddRefd<iface::cellml_services::MaLaESTransform>  transform() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
       virtual void transform(iface::cellml_services::MaLaESTransform* attr) throw(std::exception&) = 0;
       virtual already_AddRefd<iface::cellml_services::CeVAS>  useCeVAS() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
@@ -195,6 +216,8 @@ namespace iface
       virtual void trackPiecewiseConditions(bool attr) throw(std::exception&) = 0;
       virtual std::wstring conditionVariablePattern() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
       virtual void conditionVariablePattern(const std::wstring& attr) throw(std::exception&) = 0;
+      virtual std::wstring jacobianRateCoefficientName() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
+      virtual void jacobianRateCoefficientName(const std::wstring& attr) throw(std::exception&) = 0;
     };
     PUBLIC_CCGS_PRE 
     class  PUBLIC_CCGS_POST CodeGeneratorBootstrap
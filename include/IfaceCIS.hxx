@@ -39,8 +39,22 @@ namespace iface
       GEAR_1 = 9,
       GEAR_2 = 10,
       ADAMS_MOULTON_1_12 = 11,
-      BDF_IMPLICIT_1_5_SOLVE = 12
+      BDF_IMPLICIT_1_5_SOLVE = 12,
+      RUSH_LARSEN = 13
     } ODEIntegrationStepType;
+    typedef enum _enum_LinearSolverType
+    {
+      LINEAR_SOLVER_AUTOMATIC = 0,
+      LINEAR_SOLVER_DENSE = 1,
+      LINEAR_SOLVER_BAND = 2,
+      LINEAR_SOLVER_SPGMR = 3
+    } LinearSolverType;
+    typedef enum _enum_OutputColumnType
+    {
+      OUTPUT_STATE = 0,
+      OUTPUT_RATE = 1,
+      OUTPUT_ALGEBRAIC = 2
+    } OutputColumnType;
     PUBLIC_CIS_PRE 
     class  PUBLIC_CIS_POST IntegrationProgressObserver
      : public virtual iface::XPCOM::IObject
@@ -54,6 +68,26 @@ namespace iface
       virtual void failed(const std::string& errorMessage) throw(std::exception&) = 0;
     };
     PUBLIC_CIS_PRE 
+    class  PUBLIC_CIS_POST IntegrationStatistics
+     : public virtual iface::XPCOM::IObject
+    {
+    public:
+      static const char* INTERFACE_NAME() { return "cellml_services::IntegrationStatistics"; }
+      virtual ~IntegrationStatistics() {}
+      virtual uint64_t rhsEvaluations() throw(std::exception&)  = 0;
+      virtual uint64_t jacobianEvaluations() throw(std::exception&)  = 0;
+      virtual uint64_t steps() throw(std::exception&)  = 0;
+      virtual uint64_t rejectedSteps() throw(std::exception&)  = 0;
+      virtual uint64_t nonlinearIterations() throw(std::exception&)  = 0;
+      virtual uint64_t nonlinearConvergenceFailures() throw(std::exception&)  = 0;
+      virtual uint64_t rootsFound() throw(std::exception&)  = 0;
+      virtual uint64_t algebraicSolveIterations() throw(std::exception&)  = 0;
+      virtual double setupTime() throw(std::exception&)  = 0;
+      virtual double solveTime() throw(std::exception&)  = 0;
+      virtual double computeVariablesTime() throw(std::exception&)  = 0;
+      virtual double observerTime() throw(std::exception&)  = 0;
+    };
+    PUBLIC_CIS_PRE 
     class  PUBLIC_CIS_POST CellMLIntegrationRun
      : public virtual iface::XPCOM::IObject
     {
@@ -62,9 +96,24 @@ namespace iface
       virtual ~CellMLIntegrationRun() {}
       virtual void setStepSizeControl(double epsAbs, double epsRel, double scalVar, double scalRate, double maxStep) throw(std::exception&) = 0;
       virtual void setTabulationStepControl(double tabulationStepSize, bool strictTabulation) throw(std::exception&) = 0;
+      virtual bool interpolateTabulation() throw(std::exception&)  = 0;
+      virtual void interpolateTabulation(bool attr) throw(std::exception&) = 0;
+      virtual void setResultBatching(uint32_t maxPoints, uint32_t maxBytes, double maxLatency) throw(std::exception&) = 0;
       virtual void setResultRange(double startBvar, double stopBvar, double maxPointDensity) throw(std::exception&) = 0;
+      virtual iface::cellml_services::LinearSolverType linearSolverType() throw(std::exception&)  = 0;
+      virtual void linearSolverType(iface::cellml_services::LinearSolverType attr) throw(std::exception&) = 0;
+      virtual int32_t priority() throw(std::exception&)  = 0;
+      virtual void priority(int32_t attr) throw(std::exception&) = 0;
+      virtual bool continueSolver() throw(std::exception&)  = 0;
+      virtual void continueSolver(bool attr) throw(std::exception&) = 0;
+      virtual uint32_t nonlinearSolverThreads() throw(std::exception&)  = 0;
+      virtual void nonlinearSolverThreads(uint32_t attr) throw(std::exception&) = 0;
+      virtual bool cacheDefiniteIntegrals() throw(std::exception&)  = 0;
+      virtual void cacheDefiniteIntegrals(bool attr) throw(std::exception&) = 0;
       virtual void setProgressObserver(iface::cellml_services::IntegrationProgressObserver* ipo) throw(std::exception&) = 0;
+      virtual already_AddRefd<iface::cellml_services::IntegrationStatistics>  statistics() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
       virtual void setOverride(iface::cellml_services::VariableEvaluationType type, uint32_t variableIndex, double newValue) throw(std::exception&) = 0;
+      virtual void addOutputColumn(iface::cellml_services::OutputColumnType type, uint32_t index) throw(std::exception&) = 0;
       virtual void start() throw(std::exception&) = 0;
       virtual void stop() throw(std::exception&) = 0;
       virtual void pause() throw(std::exception&) = 0;
@@ -89,6 +138,47 @@ namespace iface
       virtual ~DAESolverRun() {}
     };
     PUBLIC_CIS_PRE 
+    class  PUBLIC_CIS_POST EnsembleProgressObserver
+     : public virtual iface::XPCOM::IObject
+    {
+    public:
+      static const char* INTERFACE_NAME() { return "cellml_services::EnsembleProgressObserver"; }
+      virtual ~EnsembleProgressObserver() {}
+      virtual void computedConstants(uint32_t member, const std::vector<double>& values) throw(std::exception&) = 0;
+      virtual void results(uint32_t member, const std::vector<double>& state) throw(std::exception&) = 0;
+      virtual void memberDone(uint32_t member) throw(std::exception&) = 0;
+      virtual void memberFailed(uint32_t member, const std::string& errorMessage) throw(std::exception&) = 0;
+      virtual void done() throw(std::exception&) = 0;
+    };
+    PUBLIC_CIS_PRE 
+    class  PUBLIC_CIS_POST ODESolverEnsembleRun
+     : public virtual iface::XPCOM::IObject
+    {
+    public:
+      static const char* INTERFACE_NAME() { return "cellml_services::ODESolverEnsembleRun"; }
+      virtual ~ODESolverEnsembleRun() {}
+      virtual iface::cellml_services::ODEIntegrationStepType stepType() throw(std::exception&)  = 0;
+      virtual void stepType(iface::cellml_services::ODEIntegrationStepType attr) throw(std::exception&) = 0;
+      virtual iface::cellml_services::LinearSolverType linearSolverType() throw(std::exception&)  = 0;
+      virtual void linearSolverType(iface::cellml_services::LinearSolverType attr) throw(std::exception&) = 0;
+      virtual uint32_t workerCount() throw(std::exception&)  = 0;
+      virtual void workerCount(uint32_t attr) throw(std::exception&) = 0;
+      virtual int32_t priority() throw(std::exception&)  = 0;
+      virtual void priority(int32_t attr) throw(std::exception&) = 0;
+      virtual void setStepSizeControl(double epsAbs, double epsRel, double scalVar, double scalRate, double maxStep) throw(std::exception&) = 0;
+      virtual void setTabulationStepControl(double tabulationStepSize, bool strictTabulation) throw(std::exception&) = 0;
+      virtual bool interpolateTabulation() throw(std::exception&)  = 0;
+      virtual void interpolateTabulation(bool attr) throw(std::exception&) = 0;
+      virtual void setResultBatching(uint32_t maxPoints, uint32_t maxBytes, double maxLatency) throw(std::exception&) = 0;
+      virtual void setResultRange(double startBvar, double stopBvar, double maxPointDensity) throw(std::exception&) = 0;
+      virtual void setProgressObserver(iface::cellml_services::EnsembleProgressObserver* epo) throw(std::exception&) = 0;
+      virtual void addOverrideColumn(iface::cellml_services::VariableEvaluationType type, uint32_t variableIndex) throw(std::exception&) = 0;
+      virtual void addOutputColumn(iface::cellml_services::OutputColumnType type, uint32_t index) throw(std::exception&) = 0;
+      virtual void setOverrideValues(uint32_t memberCount, const std::vector<double>& values) throw(std::exception&) = 0;
+      virtual void start() throw(std::exception&) = 0;
+      virtual void stop() throw(std::exception&) = 0;
+    };
+    PUBLIC_CIS_PRE 
     class  PUBLIC_CIS_POST CellMLCompiledModel
      : public virtual iface::XPCOM::IObject
     {
@@ -97,6 +187,8 @@ namespace iface
       virtual ~CellMLCompiledModel() {}
       virtual already_AddRefd<iface::cellml_api::Model>  model() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
       virtual already_AddRefd<iface::cellml_services::CodeInformation>  codeInformation() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
+      virtual double distributionTolerance() throw(std::exception&)  = 0;
+      virtual void distributionTolerance(double attr) throw(std::exception&) = 0;
     };
     PUBLIC_CIS_PRE 
     class  PUBLIC_CIS_POST ODESolverCompiledModel
@@ -105,6 +197,8 @@ namespace iface
     public:
       static const char* INTERFACE_NAME() { return "cellml_services::ODESolverCompiledModel"; }
       virtual ~ODESolverCompiledModel() {}
+      virtual uint32_t batchWidth() throw(std::exception&)  = 0;
+      virtual std::vector<double> computeRatesBatch(double voi, const std::vector<double>& constants, const std::vector<double>& states) throw(std::exception&) WARN_IF_RETURN_UNUSED = 0;
     };
     PUBLIC_CIS_PRE 
     class  PUBLIC_CIS_POST DAESolverCompiledModel
@@ -123,10 +217,16 @@ namespace iface
       virtual ~CellMLIntegrationService() {}
       virtual already_AddRefd<iface::cellml_services::ODESolverCompiledModel>  compileModelODE(iface::cellml_api::Model* aModel) throw(std::exception&) WARN_IF_RETURN_UNUSED = 0;
       virtual already_AddRefd<iface::cellml_services::ODESolverCompiledModel>  compileDebugModelODE(iface::cellml_api::Model* aModel) throw(std::exception&) WARN_IF_RETURN_UNUSED = 0;
+      virtual already_AddRefd<iface::cellml_services::ODESolverCompiledModel>  compileBatchModelODE(iface::cellml_api::Model* aModel, uint32_t batchWidth) throw(std::exception&) WARN_IF_RETURN_UNUSED = 0;
+      virtual already_AddRefd<iface::cellml_services::ODESolverCompiledModel>  compileModelODEWithLookupTable(iface::cellml_api::Model* aModel, iface::cellml_api::CellMLVariable* variable, double minimum, double maximum, double step) throw(std::exception&) WARN_IF_RETURN_UNUSED = 0;
+      virtual already_AddRefd<iface::cellml_services::ODESolverCompiledModel>  compileModelODEInterpreted(iface::cellml_api::Model* aModel) throw(std::exception&) WARN_IF_RETURN_UNUSED = 0;
       virtual already_AddRefd<iface::cellml_services::DAESolverCompiledModel>  compileModelDAE(iface::cellml_api::Model* aModel) throw(std::exception&) WARN_IF_RETURN_UNUSED = 0;
       virtual already_AddRefd<iface::cellml_services::DAESolverCompiledModel>  compileDebugModelDAE(iface::cellml_api::Model* aModel) throw(std::exception&) WARN_IF_RETURN_UNUSED = 0;
       virtual already_AddRefd<iface::cellml_services::ODESolverRun>  createODEIntegrationRun(iface::cellml_services::ODESolverCompiledModel* aModel) throw(std::exception&) WARN_IF_RETURN_UNUSED = 0;
       virtual already_AddRefd<iface::cellml_services::DAESolverRun>  createDAEIntegrationRun(iface::cellml_services::DAESolverCompiledModel* aModel) throw(std::exception&) WARN_IF_RETURN_UNUSED = 0;
+      virtual already_AddRefd<iface::cellml_services::ODESolverEnsembleRun>  createODEEnsembleRun(iface::cellml_services::ODESolverCompiledModel* aModel) throw(std::exception&) WARN_IF_RETURN_UNUSED = 0;
+      virtual uint32_t workerCount() throw(std::exception&)  = 0;
+      virtual void workerCount(uint32_t attr) throw(std::exception&) = 0;
       virtual std::wstring lastError() throw(std::exception&)  WARN_IF_RETURN_UNUSED = 0;
     };
   };
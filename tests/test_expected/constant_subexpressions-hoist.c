@@ -0,0 +1,73 @@
+/* Model is correctly constrained.
+ * No equations needed Newton-Raphson evaluation.
+ * The rate and state arrays need 1 entries.
+ * The algebraic variables array needs 0 entries.
+ * The constant array needs 8 entries.
+ * The hoisted subexpressions are in constants 6 7.
+ * Variable storage is as follows:
+ * * Target F in component main
+ * * * Variable type: constant
+ * * * Variable index: 2
+ * * * Variable storage: CONSTANTS[2]
+ * * Target Ki in component main
+ * * * Variable type: constant
+ * * * Variable index: 4
+ * * * Variable storage: CONSTANTS[4]
+ * * Target Ko in component main
+ * * * Variable type: constant
+ * * * Variable index: 3
+ * * * Variable storage: CONSTANTS[3]
+ * * Target R in component main
+ * * * Variable type: constant
+ * * * Variable index: 0
+ * * * Variable storage: CONSTANTS[0]
+ * * Target T in component main
+ * * * Variable type: constant
+ * * * Variable index: 1
+ * * * Variable storage: CONSTANTS[1]
+ * * Target V in component main
+ * * * Variable type: state variable
+ * * * Variable index: 0
+ * * * Variable storage: STATES[0]
+ * * Target d^1/dt^1 V in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 0
+ * * * Variable storage: RATES[0]
+ * * Target tau in component main
+ * * * Variable type: constant
+ * * * Variable index: 5
+ * * * Variable storage: CONSTANTS[5]
+ * * Target time in component main
+ * * * Variable type: variable of integration
+ * * * Variable index: 0
+ * * * Variable storage: VOI
+ */
+void SetupFixedConstants(double* CONSTANTS, double* RATES, double* STATES)
+{
+/* Constant V */
+STATES[0] = -80;
+/* Constant R */
+CONSTANTS[0] = 8314.472;
+/* Constant T */
+CONSTANTS[1] = 310;
+/* Constant F */
+CONSTANTS[2] = 96485.3415;
+/* Constant Ko */
+CONSTANTS[3] = 5.4;
+/* Constant Ki */
+CONSTANTS[4] = 140;
+/* Constant tau */
+CONSTANTS[5] = 2;
+/* hoisted constant subexpression */
+CONSTANTS[6] =  (( CONSTANTS[0]*CONSTANTS[1])/CONSTANTS[2])*log(CONSTANTS[3]/CONSTANTS[4]);
+/* hoisted constant subexpression */
+CONSTANTS[7] =  CONSTANTS[5]*(1.00000+2.00000);
+}
+void EvaluateVariables(double VOI, double* CONSTANTS, double* RATES, double* STATES, double* ALGEBRAIC)
+{
+}
+void ComputeRates(double VOI, double* STATES, double* RATES, double* CONSTANTS, double* ALGEBRAIC)
+{
+/* Element with no id */
+RATES[0] = (CONSTANTS[6] - STATES[0])/CONSTANTS[7];
+}
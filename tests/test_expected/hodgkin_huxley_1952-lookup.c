@@ -0,0 +1,321 @@
+/* Model is correctly constrained.
+ * No equations needed Newton-Raphson evaluation.
+ * The rate and state arrays need 4 entries.
+ * The algebraic variables array needs 10 entries.
+ * The constant array needs 1940 entries.
+ * The lookup table errors are in constants 329 651 973 1295 1617 1939.
+ * Variable storage is as follows:
+ * * Target Cm in component main
+ * * * Variable type: constant
+ * * * Variable index: 0
+ * * * Variable storage: CONSTANTS[0]
+ * * Target E_K in component main
+ * * * Variable type: constant
+ * * * Variable index: 6
+ * * * Variable storage: CONSTANTS[6]
+ * * Target E_L in component main
+ * * * Variable type: constant
+ * * * Variable index: 7
+ * * * Variable storage: CONSTANTS[7]
+ * * Target E_Na in component main
+ * * * Variable type: constant
+ * * * Variable index: 5
+ * * * Variable storage: CONSTANTS[5]
+ * * Target E_R in component main
+ * * * Variable type: constant
+ * * * Variable index: 1
+ * * * Variable storage: CONSTANTS[1]
+ * * Target V in component main
+ * * * Variable type: state variable
+ * * * Variable index: 0
+ * * * Variable storage: STATES[0]
+ * * Target alpha_h in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 6
+ * * * Variable storage: ALGEBRAIC[6]
+ * * Target alpha_m in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 4
+ * * * Variable storage: ALGEBRAIC[4]
+ * * Target alpha_n in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 8
+ * * * Variable storage: ALGEBRAIC[8]
+ * * Target beta_h in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 7
+ * * * Variable storage: ALGEBRAIC[7]
+ * * Target beta_m in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 5
+ * * * Variable storage: ALGEBRAIC[5]
+ * * Target beta_n in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 9
+ * * * Variable storage: ALGEBRAIC[9]
+ * * Target d^1/dt^1 V in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 0
+ * * * Variable storage: RATES[0]
+ * * Target d^1/dt^1 h in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 2
+ * * * Variable storage: RATES[2]
+ * * Target d^1/dt^1 m in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 1
+ * * * Variable storage: RATES[1]
+ * * Target d^1/dt^1 n in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 3
+ * * * Variable storage: RATES[3]
+ * * Target g_K in component main
+ * * * Variable type: constant
+ * * * Variable index: 3
+ * * * Variable storage: CONSTANTS[3]
+ * * Target g_L in component main
+ * * * Variable type: constant
+ * * * Variable index: 4
+ * * * Variable storage: CONSTANTS[4]
+ * * Target g_Na in component main
+ * * * Variable type: constant
+ * * * Variable index: 2
+ * * * Variable storage: CONSTANTS[2]
+ * * Target h in component main
+ * * * Variable type: state variable
+ * * * Variable index: 2
+ * * * Variable storage: STATES[2]
+ * * Target i_K in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 2
+ * * * Variable storage: ALGEBRAIC[2]
+ * * Target i_L in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 3
+ * * * Variable storage: ALGEBRAIC[3]
+ * * Target i_Na in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 1
+ * * * Variable storage: ALGEBRAIC[1]
+ * * Target i_Stim in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 0
+ * * * Variable storage: ALGEBRAIC[0]
+ * * Target m in component main
+ * * * Variable type: state variable
+ * * * Variable index: 1
+ * * * Variable storage: STATES[1]
+ * * Target n in component main
+ * * * Variable type: state variable
+ * * * Variable index: 3
+ * * * Variable storage: STATES[3]
+ * * Target time in component main
+ * * * Variable type: variable of integration
+ * * * Variable index: 0
+ * * * Variable storage: VOI
+ */
+void SetupFixedConstants(double* CONSTANTS, double* RATES, double* STATES)
+{
+/* Constant V */
+STATES[0] = -75;
+/* Constant Cm */
+CONSTANTS[0] = 1;
+/* Constant E_R */
+CONSTANTS[1] = -75;
+/* Constant g_Na */
+CONSTANTS[2] = 120;
+/* Constant g_K */
+CONSTANTS[3] = 36;
+/* Constant g_L */
+CONSTANTS[4] = 0.3;
+/* Constant m */
+STATES[1] = 0.05;
+/* Constant h */
+STATES[2] = 0.6;
+/* Constant n */
+STATES[3] = 0.325;
+/* Constant Element with no id */
+CONSTANTS[5] = CONSTANTS[1]+115.000;
+/* Constant Element with no id */
+CONSTANTS[6] = CONSTANTS[1] - 12.0000;
+/* Constant Element with no id */
+CONSTANTS[7] = CONSTANTS[1]+10.6130;
+{
+  double LOOKUP_SAVED = STATES[0], LOOKUP_ERROR = 0.0, LOOKUP_DIFF;
+  int LOOKUP_I;
+  for (LOOKUP_I = 0; LOOKUP_I < 321; LOOKUP_I++)
+  {
+    STATES[0] = (-100) + LOOKUP_I * 0.5;
+    CONSTANTS[8 + LOOKUP_I] = ( -0.100000*(STATES[0]+50.0000))/(exp(- (STATES[0]+50.0000)/10.0000) - 1.00000);
+    /* Step off removable singularities. */
+    if (CONSTANTS[8 + LOOKUP_I] != CONSTANTS[8 + LOOKUP_I])
+    {
+      STATES[0] += 1E-6 * 0.5;
+      CONSTANTS[8 + LOOKUP_I] = ( -0.100000*(STATES[0]+50.0000))/(exp(- (STATES[0]+50.0000)/10.0000) - 1.00000);
+    }
+  }
+  for (LOOKUP_I = 0; LOOKUP_I + 1 < 321; LOOKUP_I++)
+  {
+    STATES[0] = (-100) + (LOOKUP_I + 0.5) * 0.5;
+    LOOKUP_DIFF = fabs((( -0.100000*(STATES[0]+50.0000))/(exp(- (STATES[0]+50.0000)/10.0000) - 1.00000)) - 0.5 * (CONSTANTS[8 + LOOKUP_I] + CONSTANTS[8 + LOOKUP_I + 1]));
+    if (LOOKUP_DIFF > LOOKUP_ERROR)
+      LOOKUP_ERROR = LOOKUP_DIFF;
+  }
+  STATES[0] = LOOKUP_SAVED;
+  CONSTANTS[329] = LOOKUP_ERROR;
+}
+{
+  double LOOKUP_SAVED = STATES[0], LOOKUP_ERROR = 0.0, LOOKUP_DIFF;
+  int LOOKUP_I;
+  for (LOOKUP_I = 0; LOOKUP_I < 321; LOOKUP_I++)
+  {
+    STATES[0] = (-100) + LOOKUP_I * 0.5;
+    CONSTANTS[330 + LOOKUP_I] =  4.00000*exp(- (STATES[0]+75.0000)/18.0000);
+    /* Step off removable singularities. */
+    if (CONSTANTS[330 + LOOKUP_I] != CONSTANTS[330 + LOOKUP_I])
+    {
+      STATES[0] += 1E-6 * 0.5;
+      CONSTANTS[330 + LOOKUP_I] =  4.00000*exp(- (STATES[0]+75.0000)/18.0000);
+    }
+  }
+  for (LOOKUP_I = 0; LOOKUP_I + 1 < 321; LOOKUP_I++)
+  {
+    STATES[0] = (-100) + (LOOKUP_I + 0.5) * 0.5;
+    LOOKUP_DIFF = fabs(( 4.00000*exp(- (STATES[0]+75.0000)/18.0000)) - 0.5 * (CONSTANTS[330 + LOOKUP_I] + CONSTANTS[330 + LOOKUP_I + 1]));
+    if (LOOKUP_DIFF > LOOKUP_ERROR)
+      LOOKUP_ERROR = LOOKUP_DIFF;
+  }
+  STATES[0] = LOOKUP_SAVED;
+  CONSTANTS[651] = LOOKUP_ERROR;
+}
+{
+  double LOOKUP_SAVED = STATES[0], LOOKUP_ERROR = 0.0, LOOKUP_DIFF;
+  int LOOKUP_I;
+  for (LOOKUP_I = 0; LOOKUP_I < 321; LOOKUP_I++)
+  {
+    STATES[0] = (-100) + LOOKUP_I * 0.5;
+    CONSTANTS[652 + LOOKUP_I] =  0.0700000*exp(- (STATES[0]+75.0000)/20.0000);
+    /* Step off removable singularities. */
+    if (CONSTANTS[652 + LOOKUP_I] != CONSTANTS[652 + LOOKUP_I])
+    {
+      STATES[0] += 1E-6 * 0.5;
+      CONSTANTS[652 + LOOKUP_I] =  0.0700000*exp(- (STATES[0]+75.0000)/20.0000);
+    }
+  }
+  for (LOOKUP_I = 0; LOOKUP_I + 1 < 321; LOOKUP_I++)
+  {
+    STATES[0] = (-100) + (LOOKUP_I + 0.5) * 0.5;
+    LOOKUP_DIFF = fabs(( 0.0700000*exp(- (STATES[0]+75.0000)/20.0000)) - 0.5 * (CONSTANTS[652 + LOOKUP_I] + CONSTANTS[652 + LOOKUP_I + 1]));
+    if (LOOKUP_DIFF > LOOKUP_ERROR)
+      LOOKUP_ERROR = LOOKUP_DIFF;
+  }
+  STATES[0] = LOOKUP_SAVED;
+  CONSTANTS[973] = LOOKUP_ERROR;
+}
+{
+  double LOOKUP_SAVED = STATES[0], LOOKUP_ERROR = 0.0, LOOKUP_DIFF;
+  int LOOKUP_I;
+  for (LOOKUP_I = 0; LOOKUP_I < 321; LOOKUP_I++)
+  {
+    STATES[0] = (-100) + LOOKUP_I * 0.5;
+    CONSTANTS[974 + LOOKUP_I] = 1.00000/(exp(- (STATES[0]+45.0000)/10.0000)+1.00000);
+    /* Step off removable singularities. */
+    if (CONSTANTS[974 + LOOKUP_I] != CONSTANTS[974 + LOOKUP_I])
+    {
+      STATES[0] += 1E-6 * 0.5;
+      CONSTANTS[974 + LOOKUP_I] = 1.00000/(exp(- (STATES[0]+45.0000)/10.0000)+1.00000);
+    }
+  }
+  for (LOOKUP_I = 0; LOOKUP_I + 1 < 321; LOOKUP_I++)
+  {
+    STATES[0] = (-100) + (LOOKUP_I + 0.5) * 0.5;
+    LOOKUP_DIFF = fabs((1.00000/(exp(- (STATES[0]+45.0000)/10.0000)+1.00000)) - 0.5 * (CONSTANTS[974 + LOOKUP_I] + CONSTANTS[974 + LOOKUP_I + 1]));
+    if (LOOKUP_DIFF > LOOKUP_ERROR)
+      LOOKUP_ERROR = LOOKUP_DIFF;
+  }
+  STATES[0] = LOOKUP_SAVED;
+  CONSTANTS[1295] = LOOKUP_ERROR;
+}
+{
+  double LOOKUP_SAVED = STATES[0], LOOKUP_ERROR = 0.0, LOOKUP_DIFF;
+  int LOOKUP_I;
+  for (LOOKUP_I = 0; LOOKUP_I < 321; LOOKUP_I++)
+  {
+    STATES[0] = (-100) + LOOKUP_I * 0.5;
+    CONSTANTS[1296 + LOOKUP_I] = ( -0.0100000*(STATES[0]+65.0000))/(exp(- (STATES[0]+65.0000)/10.0000) - 1.00000);
+    /* Step off removable singularities. */
+    if (CONSTANTS[1296 + LOOKUP_I] != CONSTANTS[1296 + LOOKUP_I])
+    {
+      STATES[0] += 1E-6 * 0.5;
+      CONSTANTS[1296 + LOOKUP_I] = ( -0.0100000*(STATES[0]+65.0000))/(exp(- (STATES[0]+65.0000)/10.0000) - 1.00000);
+    }
+  }
+  for (LOOKUP_I = 0; LOOKUP_I + 1 < 321; LOOKUP_I++)
+  {
+    STATES[0] = (-100) + (LOOKUP_I + 0.5) * 0.5;
+    LOOKUP_DIFF = fabs((( -0.0100000*(STATES[0]+65.0000))/(exp(- (STATES[0]+65.0000)/10.0000) - 1.00000)) - 0.5 * (CONSTANTS[1296 + LOOKUP_I] + CONSTANTS[1296 + LOOKUP_I + 1]));
+    if (LOOKUP_DIFF > LOOKUP_ERROR)
+      LOOKUP_ERROR = LOOKUP_DIFF;
+  }
+  STATES[0] = LOOKUP_SAVED;
+  CONSTANTS[1617] = LOOKUP_ERROR;
+}
+{
+  double LOOKUP_SAVED = STATES[0], LOOKUP_ERROR = 0.0, LOOKUP_DIFF;
+  int LOOKUP_I;
+  for (LOOKUP_I = 0; LOOKUP_I < 321; LOOKUP_I++)
+  {
+    STATES[0] = (-100) + LOOKUP_I * 0.5;
+    CONSTANTS[1618 + LOOKUP_I] =  0.125000*exp((STATES[0]+75.0000)/80.0000);
+    /* Step off removable singularities. */
+    if (CONSTANTS[1618 + LOOKUP_I] != CONSTANTS[1618 + LOOKUP_I])
+    {
+      STATES[0] += 1E-6 * 0.5;
+      CONSTANTS[1618 + LOOKUP_I] =  0.125000*exp((STATES[0]+75.0000)/80.0000);
+    }
+  }
+  for (LOOKUP_I = 0; LOOKUP_I + 1 < 321; LOOKUP_I++)
+  {
+    STATES[0] = (-100) + (LOOKUP_I + 0.5) * 0.5;
+    LOOKUP_DIFF = fabs(( 0.125000*exp((STATES[0]+75.0000)/80.0000)) - 0.5 * (CONSTANTS[1618 + LOOKUP_I] + CONSTANTS[1618 + LOOKUP_I + 1]));
+    if (LOOKUP_DIFF > LOOKUP_ERROR)
+      LOOKUP_ERROR = LOOKUP_DIFF;
+  }
+  STATES[0] = LOOKUP_SAVED;
+  CONSTANTS[1939] = LOOKUP_ERROR;
+}
+}
+void EvaluateVariables(double VOI, double* CONSTANTS, double* RATES, double* STATES, double* ALGEBRAIC)
+{
+}
+void ComputeRates(double VOI, double* STATES, double* RATES, double* CONSTANTS, double* ALGEBRAIC)
+{
+/* Element with no id */
+ALGEBRAIC[0] = (VOI>=10.0000&&VOI<=10.5000 ? 20.0000 : 0.00000);
+/* Element with no id */
+ALGEBRAIC[1] =  CONSTANTS[2]*pow(STATES[1], 3.00000)*STATES[2]*(STATES[0] - CONSTANTS[5]);
+/* Element with no id */
+ALGEBRAIC[2] =  CONSTANTS[3]*pow(STATES[3], 4.00000)*(STATES[0] - CONSTANTS[6]);
+/* Element with no id */
+ALGEBRAIC[3] =  CONSTANTS[4]*(STATES[0] - CONSTANTS[7]);
+/* Element with no id */
+RATES[0] = - (- ALGEBRAIC[0]+ALGEBRAIC[1]+ALGEBRAIC[2]+ALGEBRAIC[3])/CONSTANTS[0];
+/* Element with no id */
+ALGEBRAIC[4] = (STATES[0] >= (-100) && STATES[0] <= 60 ? lookup_table(CONSTANTS + 8, 321, (-100), 1.0 / 0.5, STATES[0]) : ( -0.100000*(STATES[0]+50.0000))/(exp(- (STATES[0]+50.0000)/10.0000) - 1.00000));
+/* Element with no id */
+ALGEBRAIC[5] = (STATES[0] >= (-100) && STATES[0] <= 60 ? lookup_table(CONSTANTS + 330, 321, (-100), 1.0 / 0.5, STATES[0]) :  4.00000*exp(- (STATES[0]+75.0000)/18.0000));
+/* Element with no id */
+RATES[1] =  ALGEBRAIC[4]*(1.00000 - STATES[1]) -  ALGEBRAIC[5]*STATES[1];
+/* Element with no id */
+ALGEBRAIC[6] = (STATES[0] >= (-100) && STATES[0] <= 60 ? lookup_table(CONSTANTS + 652, 321, (-100), 1.0 / 0.5, STATES[0]) :  0.0700000*exp(- (STATES[0]+75.0000)/20.0000));
+/* Element with no id */
+ALGEBRAIC[7] = (STATES[0] >= (-100) && STATES[0] <= 60 ? lookup_table(CONSTANTS + 974, 321, (-100), 1.0 / 0.5, STATES[0]) : 1.00000/(exp(- (STATES[0]+45.0000)/10.0000)+1.00000));
+/* Element with no id */
+RATES[2] =  ALGEBRAIC[6]*(1.00000 - STATES[2]) -  ALGEBRAIC[7]*STATES[2];
+/* Element with no id */
+ALGEBRAIC[8] = (STATES[0] >= (-100) && STATES[0] <= 60 ? lookup_table(CONSTANTS + 1296, 321, (-100), 1.0 / 0.5, STATES[0]) : ( -0.0100000*(STATES[0]+65.0000))/(exp(- (STATES[0]+65.0000)/10.0000) - 1.00000));
+/* Element with no id */
+ALGEBRAIC[9] = (STATES[0] >= (-100) && STATES[0] <= 60 ? lookup_table(CONSTANTS + 1618, 321, (-100), 1.0 / 0.5, STATES[0]) :  0.125000*exp((STATES[0]+75.0000)/80.0000));
+/* Element with no id */
+RATES[3] =  ALGEBRAIC[8]*(1.00000 - STATES[3]) -  ALGEBRAIC[9]*STATES[3];
+}
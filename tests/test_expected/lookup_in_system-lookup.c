@@ -0,0 +1,96 @@
+/* Model is correctly constrained.
+ * The following equations needed Newton-Raphson evaluation:
+ *   <equation with no cmeta ID>
+ *   in math with cmeta:id eq1
+ * The rate and state arrays need 1 entries.
+ * The algebraic variables array needs 1 entries.
+ * The constant array needs 202 entries.
+ * The lookup table errors are in constants 201.
+ * Variable storage is as follows:
+ * * Target d^1/dt^1 y in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 0
+ * * * Variable storage: RATES[0]
+ * * Target time in component main
+ * * * Variable type: variable of integration
+ * * * Variable index: 0
+ * * * Variable storage: VOI
+ * * Target x in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 0
+ * * * Variable storage: ALGEBRAIC[0]
+ * * Target y in component main
+ * * * Variable type: state variable
+ * * * Variable index: 0
+ * * * Variable storage: STATES[0]
+ */
+void objfunc_0(double* p, double* hx, void *adata)
+{
+  /* Solver for equation: Element with no id */
+  struct rootfind_info* rfi = (struct rootfind_info*)adata;
+#define VOI rfi->aVOI
+#define CONSTANTS rfi->aCONSTANTS
+#define RATES rfi->aRATES
+#define STATES rfi->aSTATES
+#define ALGEBRAIC rfi->aALGEBRAIC
+#define pret rfi->aPRET
+  ALGEBRAIC[0] = *p;
+  *hx = (pow(ALGEBRAIC[0], 3.00000)+ALGEBRAIC[0]) - ((STATES[0] >= (-10) && STATES[0] <= 10 ? lookup_table(CONSTANTS + 0, 201, (-10), 1.0 / 0.10.0000000000001, STATES[0]) : 1.00000+exp(STATES[0]/10.0000)));
+#undef VOI
+#undef CONSTANTS
+#undef RATES
+#undef STATES
+#undef ALGEBRAIC
+#undef pret
+}
+void rootfind_0(double VOI, double* CONSTANTS, double* RATES, double* STATES, double* ALGEBRAIC, int* pret)
+{
+  static double val = 0.1;
+  struct rootfind_info rfi;
+  rfi.aVOI = VOI;
+  rfi.aCONSTANTS = CONSTANTS;
+  rfi.aRATES = RATES;
+  rfi.aSTATES = STATES;
+  rfi.aALGEBRAIC = ALGEBRAIC;
+  rfi.aPRET = pret;
+  do_nonlinearsolve(objfunc_0, &val, pret, 1, &rfi);
+  ALGEBRAIC[0] = val;
+}
+void SetupFixedConstants(double* CONSTANTS, double* RATES, double* STATES)
+{
+/* Constant y */
+STATES[0] = 0;
+{
+  double LOOKUP_SAVED = STATES[0], LOOKUP_ERROR = 0.0, LOOKUP_DIFF;
+  int LOOKUP_I;
+  for (LOOKUP_I = 0; LOOKUP_I < 201; LOOKUP_I++)
+  {
+    STATES[0] = (-10) + LOOKUP_I * 0.10.0000000000001;
+    CONSTANTS[0 + LOOKUP_I] = 1.00000+exp(STATES[0]/10.0000);
+    /* Step off removable singularities. */
+    if (CONSTANTS[0 + LOOKUP_I] != CONSTANTS[0 + LOOKUP_I])
+    {
+      STATES[0] += 1E-6 * 0.10.0000000000001;
+      CONSTANTS[0 + LOOKUP_I] = 1.00000+exp(STATES[0]/10.0000);
+    }
+  }
+  for (LOOKUP_I = 0; LOOKUP_I + 1 < 201; LOOKUP_I++)
+  {
+    STATES[0] = (-10) + (LOOKUP_I + 0.5) * 0.10.0000000000001;
+    LOOKUP_DIFF = fabs((1.00000+exp(STATES[0]/10.0000)) - 0.5 * (CONSTANTS[0 + LOOKUP_I] + CONSTANTS[0 + LOOKUP_I + 1]));
+    if (LOOKUP_DIFF > LOOKUP_ERROR)
+      LOOKUP_ERROR = LOOKUP_DIFF;
+  }
+  STATES[0] = LOOKUP_SAVED;
+  CONSTANTS[201] = LOOKUP_ERROR;
+}
+}
+void EvaluateVariables(double VOI, double* CONSTANTS, double* RATES, double* STATES, double* ALGEBRAIC)
+{
+}
+void ComputeRates(double VOI, double* STATES, double* RATES, double* CONSTANTS, double* ALGEBRAIC)
+{
+rootfind_0(VOI, CONSTANTS, RATES, STATES, ALGEBRAIC, pret);
+/* Element with no id */
+RATES[0] = ALGEBRAIC[0];
+}
@@ -0,0 +1,86 @@
+/* Model is correctly constrained.
+ * The following equations needed Newton-Raphson evaluation:
+ *   <equation with no cmeta ID>
+ *   in math with cmeta:id eq2
+ *   <equation with no cmeta ID>
+ *   in math with cmeta:id eq3
+ * The rate and state arrays need 1 entries.
+ * The algebraic variables array needs 3 entries.
+ * The constant array needs 0 entries.
+ * Variable storage is as follows:
+ * * Target a in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 0
+ * * * Variable storage: ALGEBRAIC[0]
+ * * Target b in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 1
+ * * * Variable storage: ALGEBRAIC[1]
+ * * Target c in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 2
+ * * * Variable storage: ALGEBRAIC[2]
+ * * Target d^1/dt^1 y in component main
+ * * * Variable type: algebraic variable
+ * * * Variable index: 0
+ * * * Variable storage: RATES[0]
+ * * Target time in component main
+ * * * Variable type: variable of integration
+ * * * Variable index: 0
+ * * * Variable storage: VOI
+ * * Target y in component main
+ * * * Variable type: state variable
+ * * * Variable index: 0
+ * * * Variable storage: STATES[0]
+ */
+void objfunc_0(double* p, double* hx, void *adata)
+{
+  struct rootfind_info* rfi = (struct rootfind_info*)adata;
+#define VOI rfi->aVOI
+#define CONSTANTS rfi->aCONSTANTS
+#define RATES rfi->aRATES
+#define STATES rfi->aSTATES
+#define ALGEBRAIC rfi->aALGEBRAIC
+#define pret rfi->aPRET
+  ALGEBRAIC[0] = p[0];
+  ALGEBRAIC[1] = p[1];
+  hx[0] = (ALGEBRAIC[0]+ALGEBRAIC[1]) - ( 2.00000*VOI+3.00000);
+  hx[1] = (ALGEBRAIC[0] - ALGEBRAIC[1]) - 1.00000;
+#undef VOI
+#undef CONSTANTS
+#undef RATES
+#undef STATES
+#undef ALGEBRAIC
+#undef pret
+}
+void rootfind_0(double VOI, double* CONSTANTS, double* RATES, double* STATES, double* ALGEBRAIC, int* pret)
+{
+  /* Solver for equations: Element with no id, Element with no id */
+  static double p[2] = {0.1,0.1};
+  struct rootfind_info rfi;
+  rfi.aVOI = VOI;
+  rfi.aCONSTANTS = CONSTANTS;
+  rfi.aRATES = RATES;
+  rfi.aSTATES = STATES;
+  rfi.aALGEBRAIC = ALGEBRAIC;
+  rfi.aPRET = pret;
+  do_nonlinearsolve(objfunc_0, p, pret, 2, &rfi);
+  ALGEBRAIC[0] = p[0];
+  ALGEBRAIC[1] = p[1];
+}
+void SetupFixedConstants(double* CONSTANTS, double* RATES, double* STATES)
+{
+/* Constant y */
+STATES[0] = 0;
+}
+void EvaluateVariables(double VOI, double* CONSTANTS, double* RATES, double* STATES, double* ALGEBRAIC)
+{
+/* Element with no id */
+ALGEBRAIC[2] =  ALGEBRAIC[0]*ALGEBRAIC[1];
+}
+void ComputeRates(double VOI, double* STATES, double* RATES, double* CONSTANTS, double* ALGEBRAIC)
+{
+rootfind_0(VOI, CONSTANTS, RATES, STATES, ALGEBRAIC, pret);
+/* Element with no id */
+RATES[0] = ALGEBRAIC[0];
+}